@@ -75,6 +75,7 @@ Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
 #define __LWPR_H
 
 #include <lwpr_config.h>
+#include <stddef.h>
 
 #ifndef NUM_THREADS 
 #define NUM_THREADS   1
@@ -92,6 +93,14 @@ Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
 #define LWPR_REGINCR    2
 #endif
 
+/** Index of element (i,j), i<=j, within a packed upper triangular (or symmetric) 
+    nIn x nIn matrix. The upper triangle is stored column by column, that is, 
+    column j occupies the j+1 elements starting at LWPR_TRI(0,j). */
+#define LWPR_TRI(i,j)      ((i) + ((j)*((j)+1))/2)
+
+/** Number of elements of a packed triangular N x N matrix */
+#define LWPR_TRI_SIZE(N)   (((N)*((N)+1))/2)
+
 
 #ifdef __cplusplus
 extern "C" {
@@ -123,11 +132,71 @@ typedef enum {
    \ingroup LWPR_C      
 */
 
+/** \brief Maximum number of kernels (built-in and registered) that can be used at the same time
+   \ingroup LWPR_C
+*/
+#define LWPR_MAX_KERNELS   16
+
+/** \brief Maximum number of receptive fields that lwpr_predict_topk() evaluates per output dimension
+   \ingroup LWPR_C
+*/
+#define LWPR_MAX_TOPK      64
+
+/** \brief Signature of a user-defined locality kernel, see lwpr_register_kernel()
+   \param[in] q        Squared distance (x-c)'D(x-c) of an input vector to a receptive field
+   \param[out] dwdq    Derivative of the activation with respect to q
+   \param[out] ddwdqdq 2nd derivative of the activation with respect to q
+   \return The activation w
+   \ingroup LWPR_C
+*/
+typedef double (*LWPR_KernelFunction)(double q, double *dwdq, double *ddwdqdq);
+
+/** \brief Describes a locality kernel, see lwpr_kernel_info()
+   \ingroup LWPR_C
+*/
+typedef struct {
+   const char *name;          /**< \brief Name of the kernel, as used in XML files */
+   LWPR_KernelFunction func;  /**< \brief Function that computes activation and derivatives */
+   double support;            /**< \brief Squared distance at and beyond which the kernel is zero, or 0 if the support is unbounded */
+} LWPR_KernelInfo;
+
+/** Enumeration of policies that determine what happens if a new receptive field
+    should be created, but the corresponding submodel has already reached its
+    budget (see LWPR_Model.max_rfs and LWPR_Model.max_bytes).
+   \ingroup LWPR_C
+*/
+typedef enum {
+   LWPR_EVICT_REFUSE, LWPR_EVICT_LEAST_RECENT, LWPR_EVICT_LEAST_DATA
+} LWPR_EvictionPolicy;
+
+/** \var LWPR_EVICT_REFUSE
+      No receptive field is removed, and the new receptive field is simply not created.
+      This is the default setting after a call to lwpr_init_model().
+   \ingroup LWPR_C
+*/
+
+/** \var LWPR_EVICT_LEAST_RECENT
+      The receptive field that has not been activated (w > 0.001) for the
+      longest time is removed to make room for the new one
+      (see LWPR_ReceptiveField.last_active).
+   \ingroup LWPR_C
+*/
+
+/** \var LWPR_EVICT_LEAST_DATA
+      The receptive field that has seen the smallest (forgetting-weighted) number of
+      training data is removed to make room for the new one. Since freshly created 
+      receptive fields have seen very little data, this policy favours well-established 
+      receptive fields, and is therefore more suitable for stationary input distributions.
+   \ingroup LWPR_C
+*/
+
 /** \brief This structure completely describes a "receptive field" (a local linear model). 
 
    In the descriptions of matrix- and vector-valued members of this structure,
    <em>N</em> denotes the input dimensionality, and <em>R</em> denotes the number
-   of partial least squares (PLS) dimensions.
+   of partial least squares (PLS) dimensions. The NxN matrices D, M, alpha, h and b
+   are either symmetric or upper triangular, and only their upper triangle is
+   stored in packed form (see LWPR_TRI).
    \ingroup LWPR_C
 */
 typedef struct {
@@ -136,17 +205,19 @@ typedef struct {
    
    double *fixStorage; /**< \brief A pointer to memory that is independent of nReg */
    double *varStorage; /**< \brief A pointer to memory that might have to be re-allocated (nReg) */
+   int pooled;         /**< \brief Flag that indicates whether the memory independent of nReg was moved into LWPR_SubModel.pool (see lwpr_reorder_rfs). fixStorage is NULL then. */
    
    int trustworthy;    /**< \brief This flag indicates whether a receptive field has "seen" enough data so that its predictions can be trusted */ 
    int slopeReady;     /**< \brief Indicates whether the vector "slope" can be used instead of doing PLS calculatations */    
+   int last_active;    /**< \brief Value of LWPR_Model.n_data when this RF was last updated (activation above 0.001) */
    double w;           /**< \brief The current activation (weight) */
    double sum_e2;      /**< \brief The accumulated prediction error on the training data */
    double beta0;       /**< \brief Constant part of the PLS output */
    double SSp;         /**< \brief Sufficient statistics used for the confidence bounds */
            
-   double *D;          /**< \brief Distance metric (NxN) */
-   double *M;          /**< \brief Cholesky factorization of the distance metric (NxN) */
-   double *alpha;      /**< \brief Learning rates for updates to M (NxN) */
+   double *D;          /**< \brief Distance metric (NxN, symmetric, packed) */
+   double *M;          /**< \brief Cholesky factorization of the distance metric (NxN, upper triangular, packed) */
+   double *alpha;      /**< \brief Learning rates for updates to M (NxN, upper triangular, packed) */
    double *beta;       /**< \brief PLS regression coefficients (Rx1) */
    double *c;          /**< \brief The centre of the receptive field (Nx1) */
    double *SXresYres;  /**< \brief Sufficient statistics for the PLS regression axes LWPR_ReceptiveField.U (NxR) */
@@ -157,8 +228,8 @@ typedef struct {
    double *P;          /**< \brief PLS input reduction parameters (NxR) */
    double *H;          /**< \brief Sufficient statistics for distance metric updates (Rx1) */
    double *r;          /**< \brief Sufficient statistics for distance metric updates (Rx1) */
-   double *h;          /**< \brief Sufficient statistics for 2nd order distance metric updates (NxN) */
-   double *b;          /**< \brief Memory terms for 2nd order updates to M (NxN) */
+   double *h;          /**< \brief Sufficient statistics for 2nd order distance metric updates (NxN, upper triangular, packed) */
+   double *b;          /**< \brief Memory terms for 2nd order updates to M (NxN, upper triangular, packed) */
    double *sum_w;      /**< \brief Accumulated activation w per PLS direction (Rx1) */
    double *sum_e_cv2;  /**< \brief Accumulated CV-error on training data (Rx1) */
    double *n_data;     /**< \brief Number of training data each PLS direction has seen (Rx1) */
@@ -178,7 +249,13 @@ typedef struct {
    int numRFS;                /**< \brief The number of receptive fields (see LWPR_ReceptiveField) */
    int numPointers;           /**< \brief The number of RFs that can be stored before a re-allocation is necessary */
    int n_pruned;              /**< \brief Number of RFs that were pruned during training */
+   int n_evicted;             /**< \brief Number of RFs that were removed in order to stay within the budget */
    LWPR_ReceptiveField **rf;  /**< \brief Array of pointers to LWPR_ReceptiveField */
+   double *pool;              /**< \brief Contiguous storage of the fixed-size RF variables after lwpr_reorder_rfs(), or NULL. Do not touch. */
+   int poolSize;              /**< \brief Number of receptive fields the pool was allocated for */
+   int numPooled;             /**< \brief Number of receptive fields whose fixed-size variables are still stored in the pool */
+   double *dw;                /**< \brief Derivatives of the activations (2*numPointers) for two-phase updates with several threads, or NULL. Do not touch. */
+   int *order;                /**< \brief Working memory for distributing the active RFs among the threads (3*numPointers + nIn + 1), or NULL. Do not touch. */
    const struct LWPR_Model *model;/**< \brief Pointer to the "mother" LWPR_Model. */
 } LWPR_SubModel;
 
@@ -218,6 +295,14 @@ typedef struct LWPR_Model {
    double add_threshold;/**< \brief Threshold that determines when a new PLS regression axis is added */
    LWPR_Kernel kernel;  /**< \brief Describes which kernel function is used (Gaussian or BiSquare) */
    int update_D;        /**< \brief Flag that determines whether distance metric updates are performed (default: 1) */
+   int max_rfs;         /**< \brief Maximum number of receptive fields per submodel (default: 0 = unlimited) */
+   size_t max_bytes;    /**< \brief Maximum memory in bytes occupied by the receptive fields of one submodel, as counted by lwpr_mem_sub_bytes() (default: 0 = unlimited). It is checked before creating a receptive field and after one has grown to store more PLS projections. With LWPR_EVICT_REFUSE, grown receptive fields are not evicted, so the budget may be exceeded. */
+   LWPR_EvictionPolicy evict; /**< \brief Determines what happens if a new RF is needed, but max_rfs or max_bytes would be exceeded. max_rfs, max_bytes and evict are stored in binary and XML files. */
+   int inference_only;  /**< \brief Flag that indicates the model was stripped of its training statistics (see lwpr_strip_for_inference) */
+   int eager_slopes;    /**< \brief Flag that determines whether the slopes of receptive fields are recomputed during each update, so predictions never need PLS calculations (default: 0, see lwpr_finalize_slopes) */
+   int early_exit;      /**< \brief Flag that determines whether distance computations stop as soon as a receptive field is known to be inactive (default: 0). This is not done for diag_only models with a non-diagonal init_D. Activations below the cutoff that are reported as max_w are then only upper bounds. */
+   int shared_geometry; /**< \brief Flag that determines whether all output dimensions share the centres and distance metrics of their receptive fields (default: 0). Receptive fields are then created, pruned and evicted together, each centre and distance metric (with its learning rates) is stored once and updated once per training datum from the errors of all outputs, and lwpr_update() and lwpr_predict() evaluate each kernel only once for all outputs. Only change it with lwpr_set_shared_geometry(), which checks that the receptive fields are aligned and links or unlinks their geometry. It is not stored in model files, but the geometry of loaded models stays shared, so the flag may be set again. */
+   int reorder_every;   /**< \brief If positive, lwpr_update() calls lwpr_reorder_rfs() after every reorder_every training data (default: 0) */
    LWPR_SubModel *sub;  /**< \brief Array of SubModels, one for each output dimension. */
    struct LWPR_Workspace *ws;  /**< \brief Array of Workspaces, one for each thread (cf. LWPR_NUM_THREADS) */
    
@@ -316,6 +401,151 @@ LIBRARY_API void lwpr_predict_JcJ(const LWPR_Model *model, const double *x,
 LIBRARY_API void lwpr_predict_JH(const LWPR_Model *model, const double *x,
       double cutoff, double *y, double *J, double *H);      
 
+/** \brief Computes the prediction and its first and second derivatives 
+           of an LWPR model given an input vector x, with the Hessians in packed storage.
+  
+   \param[in] model  Must point to a valid LWPR_Model structure
+   \param[in] x      Input vector, must point to an array of <em>nIn</em> doubles
+   \param[in] cutoff A threshold parameter. Receptive fields with activation below the cutoff are ignored
+   \param[out] y     Output vector, must point to an array of <em>nOut</em> doubles
+   \param[out] J     Jacobian matrix, as in lwpr_predict_JH(). 
+                     Must point to an array of <em>nOut*nIn</em> doubles. 
+   \param[out] Hp    Upper triangles of the (symmetric) Hessian matrices, packed column by column
+                     (see LWPR_TRI). Must point to an array of <em>LWPR_TRI_SIZE(nIn)*nOut</em> doubles. 
+                     The Hessians for each output dimension are stored one after another.
+
+   The Hessians are accumulated in packed form anyway, so this skips mirroring them
+   into dense matrices.
+   \ingroup LWPR_C
+*/      
+LIBRARY_API void lwpr_predict_JHp(const LWPR_Model *model, const double *x,
+      double cutoff, double *y, double *J, double *Hp);      
+
+/** \brief Computes the prediction of an LWPR model and the product of its Jacobian
+      with a vector v, without forming the Jacobian.
+  
+   \param[in] model  Must point to a valid LWPR_Model structure
+   \param[in] x      Input vector, must point to an array of <em>nIn</em> doubles
+   \param[in] v      Direction vector, must point to an array of <em>nIn</em> doubles
+   \param[in] cutoff A threshold parameter. Receptive fields with activation below the cutoff are ignored
+   \param[out] y     Output vector, must point to an array of <em>nOut</em> doubles
+   \param[out] Jv    Directional derivative J*v, must point to an array of <em>nOut</em> doubles
+   
+   Each active receptive field only contributes scalars, so no vectors or matrices are
+   accumulated. Like lwpr_predict_J(), this caches the slopes of the receptive fields.
+   This function is not multi-threaded.
+   \ingroup LWPR_C
+*/      
+LIBRARY_API void lwpr_predict_Jv(const LWPR_Model *model, const double *x, const double *v,
+      double cutoff, double *y, double *Jv);
+
+/** \brief Computes the prediction of an LWPR model and the product of a vector u 
+      with its Jacobian, without forming the Jacobian.
+  
+   \param[in] model  Must point to a valid LWPR_Model structure
+   \param[in] x      Input vector, must point to an array of <em>nIn</em> doubles
+   \param[in] u      Weights of the output dimensions, must point to an array of <em>nOut</em> doubles
+   \param[in] cutoff A threshold parameter. Receptive fields with activation below the cutoff are ignored
+   \param[out] y     Output vector, must point to an array of <em>nOut</em> doubles
+   \param[out] uJ    Gradient of u'*y with respect to x, must point to an array of <em>nIn</em> doubles
+   
+   The gradients of the output dimensions are accumulated one after another.
+   This function is not multi-threaded.
+   \ingroup LWPR_C
+*/      
+LIBRARY_API void lwpr_predict_vJ(const LWPR_Model *model, const double *x, const double *u,
+      double cutoff, double *y, double *uJ);
+
+/** \brief Computes the prediction of an LWPR model and the products of its Hessians
+      with a vector v, without forming the Hessians.
+  
+   \param[in] model  Must point to a valid LWPR_Model structure
+   \param[in] x      Input vector, must point to an array of <em>nIn</em> doubles
+   \param[in] v      Direction vector, must point to an array of <em>nIn</em> doubles
+   \param[in] cutoff A threshold parameter. Receptive fields with activation below the cutoff are ignored
+   \param[out] y     Output vector, must point to an array of <em>nOut</em> doubles
+   \param[out] Jv    Directional derivative J*v. Must be NULL or point to an array of <em>nOut</em> doubles
+   \param[out] Hv    Hessian-vector products, must point to an array of <em>nIn*nOut</em> doubles.
+                     The product for output dimension <em>k</em> starts at Hv + k*nIn.
+   
+   Instead of the <em>nIn x nIn</em> matrices of lwpr_predict_JH(), only vectors of length
+   <em>nIn</em> are accumulated. This function is not multi-threaded.
+   \ingroup LWPR_C
+*/      
+LIBRARY_API void lwpr_predict_Hv(const LWPR_Model *model, const double *x, const double *v,
+      double cutoff, double *y, double *Jv, double *Hv);
+
+/** \brief Computes the prediction of an LWPR model given an input vector x, evaluating
+      only the local models of the K receptive fields with the largest activations.
+  
+   \param[in] model  Must point to a valid LWPR_Model structure
+   \param[in] x      Input vector, must point to an array of <em>nIn</em> doubles
+   \param[in] K      Maximum number of receptive fields that contribute to each output 
+                     dimension, between 0 and LWPR_MAX_TOPK (values outside are clamped)
+   \param[in] cutoff A threshold parameter. Receptive fields with activation below the cutoff are ignored
+   \param[out] y     Output vector, must point to an array of <em>nOut</em> doubles
+   \param[out] dropped  Fraction of the activation mass that was left out per output dimension,
+                     that is, the summed activations of trustworthy receptive fields above the cutoff
+                     that were not among the K strongest, divided by the summed activations of all 
+                     of them. Must be NULL or point to an array of <em>nOut</em> doubles
+   \param[out] max_w Maximum activation per output dimension. Must be NULL or point to an array of <em>nOut</em> doubles
+   
+   The activations of all receptive fields are still computed, but the (PLS or slope) 
+   evaluations are limited to K per output dimension. If the strongest K receptive 
+   fields have activations \f$w_k\f$ and the others \f$w_l\f$, the difference to 
+   the result of lwpr_predict() is
+   \f[ \frac{\sum_l w_l}{\sum_k w_k + \sum_l w_l} (\bar{y}_l - \bar{y}_k), \f]
+   where \f$\bar{y}_k\f$ and \f$\bar{y}_l\f$ are the weighted averages of the local 
+   predictions of both groups. Thus <em>dropped</em> times the spread of the local predictions 
+   bounds the approximation error. This function is not multi-threaded.
+   \ingroup LWPR_C
+*/      
+LIBRARY_API void lwpr_predict_topk(const LWPR_Model *model, const double *x, int K,
+      double cutoff, double *y, double *dropped, double *max_w);
+
+/** \brief Computes the predictions of an LWPR model for a batch of input vectors. Can also
+      return confidence bounds and the maximal activation of all receptive fields.
+  
+   \param[in] model  Must point to a valid LWPR_Model structure
+   \param[in] N      Number of input vectors
+   \param[in] X      Input vectors, stored column by column (<em>nIn</em> x <em>N</em>, column-major)
+   \param[in] ldx    Offset between adjacent input vectors (>= nIn)
+   \param[in] cutoff A threshold parameter. Receptive fields with activation below the cutoff are ignored
+   \param[out] Y     Output vectors, stored column by column (<em>nOut</em> x <em>N</em>, column-major)
+   \param[in] ldy    Offset between adjacent output vectors (>= nOut), also used for conf and max_w
+   \param[out] conf  Confidence bounds, NULL or laid out like Y
+   \param[out] max_w Maximum activations, NULL or laid out like Y
+   
+   The result is the same as calling lwpr_predict() for every column of X, but
+   the input and output matrices can be mapped directly from (e.g.) Eigen or numpy arrays.
+   If the library is compiled with NUM_THREADS > 1, the batch is split into NUM_THREADS
+   contiguous chunks that are processed in parallel. Every chunk uses its own workspace,
+   so unlike lwpr_predict(), this function does not write to the model at all.
+   \ingroup LWPR_C   
+*/      
+LIBRARY_API void lwpr_predict_batch(const LWPR_Model *model, int N, const double *X, int ldx,
+      double cutoff, double *Y, int ldy, double *conf, double *max_w);
+
+/** \brief Computes the predictions and Jacobians of an LWPR model for a batch of input vectors.
+  
+   \param[in] model  Must point to a valid LWPR_Model structure
+   \param[in] N      Number of input vectors
+   \param[in] X      Input vectors, stored column by column (<em>nIn</em> x <em>N</em>, column-major)
+   \param[in] ldx    Offset between adjacent input vectors (>= nIn)
+   \param[in] cutoff A threshold parameter. Receptive fields with activation below the cutoff are ignored
+   \param[out] Y     Output vectors, stored column by column (<em>nOut</em> x <em>N</em>, column-major)
+   \param[in] ldy    Offset between adjacent output vectors (>= nOut)
+   \param[out] J     Jacobians, must point to an array of <em>nOut*nIn*N</em> doubles. The Jacobian
+                     of the k-th input vector starts at J + k*nOut*nIn and is stored as in lwpr_predict_J(),
+                     so J as a whole is an <em>nOut</em> x <em>nIn*N</em> column-major matrix.
+   
+   Parallelisation works as in lwpr_predict_batch(). The slopes of all receptive fields
+   that are not yet cached are computed before the batch is split up.
+   \ingroup LWPR_C   
+*/      
+LIBRARY_API void lwpr_predict_J_batch(const LWPR_Model *model, int N, const double *X, int ldx,
+      double cutoff, double *Y, int ldy, double *J);
+
 /** \brief Updates an LWPR model with a given input/output pair (x,y). Optionally
       returns the model's prediction for y and the maximal activation of all receptive fields.
   
@@ -326,7 +556,13 @@ LIBRARY_API void lwpr_predict_JH(const LWPR_Model *model, const double *x,
    \param[out] max_w     Maximum activation per output dimension. Must be NULL or point to an array of <em>nOut</em> doubles
    \return               
       - 1 if the update was succesful
-      - 0 if a receptive field would have to be added, but the necessary memory could not be allocated.
+      - 0 if a receptive field would have to be added, but the necessary memory could not be allocated,
+        or if the model has been stripped by lwpr_strip_for_inference().
+      
+   If a submodel has reached its budget (LWPR_Model.max_rfs or LWPR_Model.max_bytes), 
+   new receptive fields are only created after evicting an old one according to
+   LWPR_Model.evict. With the policy LWPR_EVICT_REFUSE, the new receptive field
+   is not created, but the update still counts as successful.
    \ingroup LWPR_C                           
 */  
 LIBRARY_API int lwpr_update(LWPR_Model *model, const double *x, const double *y,
@@ -424,6 +660,23 @@ LIBRARY_API int lwpr_set_init_D_diagonal(LWPR_Model *model, const double *d);
 */
 LIBRARY_API int lwpr_set_init_D(LWPR_Model *model, const double *D, int stride);
 
+/** \brief Switches the shared receptive field geometry of all output dimensions on or off
+      (see LWPR_Model.shared_geometry)
+   \param[in,out] model  Pointer to a valid LWPR_Model
+   \param[in] flag       1 for sharing the geometry, 0 for independent submodels
+   \return  
+      - 0 in case of failure (the submodels already hold receptive fields that differ 
+        in their number, centres or distance metrics)
+      - 1 in case of success
+   
+   Switching sharing on is only possible before training, or for models whose receptive
+   fields were created with shared geometry, e.g., after reading them from a file. The
+   receptive fields of all output dimensions then use the learning rates of the first one.
+   Switching sharing off gives each receptive field its own copy of the shared geometry.
+   \ingroup LWPR_C   
+*/
+LIBRARY_API int lwpr_set_shared_geometry(LWPR_Model *model, int flag);
+
 /** \brief Creates a duplicate (deep copy) of an LWPR model structure
    \param[out] dest  Pointer to an (uninitialised) LWPR_Model
    \param[in] src    Pointer to the LWPR_Model that should be duplicated
@@ -436,6 +689,104 @@ LIBRARY_API int lwpr_set_init_D(LWPR_Model *model, const double *D, int stride);
 */   
 LIBRARY_API int lwpr_duplicate_model(LWPR_Model *dest, const LWPR_Model *src);
 
+/** \brief Transfers the contents of an LWPR model structure to another one, without copying
+   any receptive fields
+   \param[out] dest     Pointer to an (uninitialised or freed) LWPR_Model
+   \param[in,out] src   Pointer to the LWPR_Model whose storage should be taken over
+   
+   All storage of src is handed over to dest, and the back-pointers of the
+   submodels and receptive fields are updated accordingly, so this takes time 
+   proportional to the number of receptive fields, but allocates and copies nothing.
+   Afterwards, src is left empty: it must not be used for anything other than 
+   lwpr_free_model() (which is then a no-op), or as the destination of another 
+   lwpr_init_model(), lwpr_duplicate_model() or lwpr_move_model() call.
+   Code that needs to exchange models in constant time should hold them by pointer,
+   as LWPR_Object does.
+   \ingroup LWPR_C   
+*/   
+LIBRARY_API void lwpr_move_model(LWPR_Model *dest, LWPR_Model *src);
+
+/** \brief Turns a trained LWPR model into a compact, prediction-only model
+   \param[in,out] model  Pointer to a valid LWPR_Model
+   \return 
+      - 0 in case of failure (insufficient memory), the model is left unchanged 
+      - 1 in case of success
+      
+   This function releases all receptive field statistics that are only needed
+   for training (alpha, h, b, var_x, SXresYres, SSXres, SSYres, H, r, lambda, s),
+   and keeps only what lwpr_predict(), lwpr_predict_J() and the confidence bounds 
+   depend on. Full distance metrics are kept as their Cholesky factor M only (D is
+   released), whereas for LWPR_Model.diag_only only D is kept. The slopes of all receptive fields are computed in advance.
+   Afterwards, LWPR_Model.inference_only is set, lwpr_update() will refuse to
+   change the model, and lwpr_write_binary() stores it in a slim format
+   (see lwpr_binio.h). Models stripped in this way cannot be written to XML files.
+   \ingroup LWPR_C   
+*/   
+LIBRARY_API int lwpr_strip_for_inference(LWPR_Model *model);
+
+/** \brief Computes and caches the slopes of all receptive fields (see LWPR_ReceptiveField.slope)
+   \param[in,out] model  Must point to a valid LWPR_Model structure
+   
+   Predictions with lwpr_predict() use the cached slope of a receptive field if available,
+   which reduces the local model to a single dot product instead of a PLS projection.
+   Slopes are invalidated by updates to the receptive field, so call this function after
+   training, or set LWPR_Model.eager_slopes to keep them valid during training. If the
+   library is compiled with NUM_THREADS > 1, the receptive fields are distributed among 
+   the threads.
+   \ingroup LWPR_C   
+*/   
+LIBRARY_API void lwpr_finalize_slopes(LWPR_Model *model);
+
+/** \brief Sorts the receptive fields of each submodel along a space-filling curve, and 
+      moves their centres, distance metrics and slopes into one contiguous block
+   \param[in,out] model  Must point to a valid LWPR_Model structure
+   \return 
+      - 0 in case of failure (insufficient memory), the model is still valid 
+      - 1 in case of success
+   
+   The receptive fields are sorted by the Morton (Z-order) code of their centres, quantised
+   to 16 bits per input dimension within the bounding box of all centres. Receptive fields
+   that are close in input space are then also close in memory, so scans for similar inputs
+   touch fewer cache lines. Training creates and prunes receptive fields in arbitrary places,
+   so call this function once after training (e.g. after lwpr_strip_for_inference()), or set
+   LWPR_Model.reorder_every. With LWPR_Model.shared_geometry, all submodels keep the same
+   order. Predictions only change by rounding, but indices of receptive fields do change
+   (see lwpr_cursor_reset()).
+   \ingroup LWPR_C   
+*/   
+LIBRARY_API int lwpr_reorder_rfs(LWPR_Model *model);
+
+/** \brief Registers an additional locality kernel that can be selected through LWPR_Model.kernel
+   \param[in] name     Name of the kernel. The string is not copied and must stay valid.
+   \param[in] func     Function that computes the activation and its derivatives with
+                       respect to the squared distance q. Both derivative pointers are always valid.
+   \param[in] support  Squared distance at and beyond which the kernel is zero. The function is
+                       not called for such distances. Pass 0 for kernels with unbounded support.
+   \return
+      - the new kernel identifier, which can be cast to LWPR_Kernel
+      - -1 if the arguments are invalid, the name is taken, or LWPR_MAX_KERNELS is reached
+
+   The update and prediction loops are specialised for the built-in kernels, whereas registered
+   kernels are called through their function pointer. Model files store registered kernels by
+   name, so a program that reads them must have registered the same names (in any order).
+   
+   The registry is a global table without synchronisation: this function is not thread-safe,
+   and all registrations must be finished before any model is used from other threads.
+   Register kernels once at startup.
+   \ingroup LWPR_C
+*/
+LIBRARY_API int lwpr_register_kernel(const char *name, LWPR_KernelFunction func, double support);
+
+/** \brief Returns a description of a kernel, or NULL if the identifier is unknown
+   \ingroup LWPR_C
+*/
+LIBRARY_API const LWPR_KernelInfo *lwpr_kernel_info(LWPR_Kernel kernel);
+
+/** \brief Returns the identifier of the kernel with the given name, or -1 if there is no such kernel
+   \ingroup LWPR_C
+*/
+LIBRARY_API int lwpr_kernel_by_name(const char *name);
+
 #ifdef __cplusplus
 }
 #endif
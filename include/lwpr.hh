@@ -33,6 +33,7 @@ Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
 #include <lwpr_binio.h>
 #include <lwpr_xml.h>
 #include <string.h>
+#include <new>
 #include <vector>
 
 #ifdef EIGEN3_FOUND
@@ -46,23 +47,23 @@ Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
 typedef std::vector<double> doubleVec;
 
 #ifdef EIGEN3_FOUND
-Eigen::VectorXd doubleVecToEigen(const doubleVec& ret) {
-      return Eigen::Map<Eigen::VectorXd>(const_cast<double*>(ret.data()),ret.size());
+inline Eigen::VectorXd doubleVecToEigen(const doubleVec& ret) {
+      return Eigen::Map<const Eigen::VectorXd>(ret.data(),ret.size());
    }
 
-Eigen::MatrixXd doubleVecToEigen(const std::vector<doubleVec>& tmp) {
+inline Eigen::MatrixXd doubleVecToEigen(const std::vector<doubleVec>& tmp) {
       Eigen::MatrixXd ret(tmp.size(), tmp[0].size());
-      for(int i=0;i<tmp.size();i++) ret.row(i) = Eigen::Map<Eigen::VectorXd>(const_cast<double*>(tmp[i].data()),tmp[i].size());
+      for(size_t i=0;i<tmp.size();i++) ret.row(i) = Eigen::Map<const Eigen::VectorXd>(tmp[i].data(),tmp[i].size());
       return ret;
    }
 
-std::vector<Eigen::VectorXd> doubleVecToEigenVec(const std::vector<doubleVec>& tmp) {
+inline std::vector<Eigen::VectorXd> doubleVecToEigenVec(const std::vector<doubleVec>& tmp) {
 	std::vector<Eigen::VectorXd> ret(tmp.size());
-	for (int i = 0; i<tmp.size(); i++) ret[i] = Eigen::Map<Eigen::VectorXd>(const_cast<double*>(tmp[i].data()), tmp[i].size());
+	for (size_t i = 0; i<tmp.size(); i++) ret[i] = Eigen::Map<const Eigen::VectorXd>(tmp[i].data(), tmp[i].size());
 	return ret;
 }
 
-doubleVec EigenTodoubleVec(const Eigen::Ref<const Eigen::VectorXd> ret) {
+inline doubleVec EigenTodoubleVec(const Eigen::Ref<const Eigen::VectorXd> ret) {
       return doubleVec(ret.data(),ret.data()+ret.rows());
    }
 #endif
@@ -84,6 +85,8 @@ class LWPR_Exception {
       UNKNOWN_KERNEL,   /**< \brief Thrown when the name of an unknown kernel function has been passed */
       IO_ERROR,         /**< \brief Thrown when errors occured during reading from or writing to files */
       OUT_OF_RANGE,     /**< \brief Thrown when an out-of-range index was passed */
+      INFERENCE_ONLY,   /**< \brief Thrown when a model that was stripped for inference should be updated */
+      BAD_GEOMETRY,     /**< \brief Thrown when the receptive fields of the output dimensions cannot share their geometry */
       UNSPECIFIED_ERROR /**< \brief Thrown in any other error case (should not happen) */
    } Code;
    
@@ -117,6 +120,10 @@ class LWPR_Exception {
             return "An error occurred during I/O operations.";
          case OUT_OF_RANGE:
             return "Index parameter out of range.";
+         case INFERENCE_ONLY:
+            return "Model was stripped for inference and cannot be updated.";
+         case BAD_GEOMETRY:
+            return "Receptive fields of the output dimensions do not share their geometry.";
          default:
             return "Oops: Unspecified error.";
       }
@@ -131,6 +138,110 @@ class LWPR_Exception {
 class LWPR_Object;
 
 
+/** \brief Read-only, non-owning view of a column-major (possibly strided) array
+   inside an LWPR model. Vectors are views with a single column.
+   
+   Views returned by LWPR_ReceptiveFieldObject point directly into the receptive field,
+   so no memory is allocated or copied. They are only valid as long as the 
+   underlying LWPR model is not changed (see LWPR_Object::getRF).
+   \ingroup LWPR_CPP
+*/
+class LWPR_ConstView {
+   public:
+   
+   /** \brief Creates an empty view */
+   LWPR_ConstView() : ptr(NULL), nRows(0), nCols(0), ld(0) {}
+   
+   /** \brief Creates a view of a rows x cols matrix whose columns are stride doubles 
+      apart (default: rows) */
+   LWPR_ConstView(const double *data, int rows, int cols = 1, int stride = 0) 
+      : ptr(data), nRows(rows), nCols(cols), ld(stride > 0 ? stride : rows) {}
+   
+   /** \brief Returns a pointer to the first element */
+   const double *data() const { return ptr; }
+   
+   /** \brief Returns the number of rows */
+   int rows() const { return nRows; }
+   
+   /** \brief Returns the number of columns */
+   int cols() const { return nCols; }
+   
+   /** \brief Returns the offset between the first elements of adjacent columns */
+   int stride() const { return ld; }
+   
+   /** \brief Returns the number of elements (rows x cols) */
+   int size() const { return nRows*nCols; }
+   
+   /** \brief Returns whether the view does not point to any data */
+   bool empty() const { return ptr == NULL || nRows*nCols == 0; }
+   
+   /** \brief Returns element i of a vector (single column) view */
+   double operator[](int i) const { return ptr[i]; }
+   
+   /** \brief Returns element (i,j) */
+   double operator()(int i, int j) const { return ptr[i + j*ld]; }
+   
+   /** \brief Returns a pointer to the first element of column j */
+   const double *col(int j) const { return ptr + j*ld; }
+   
+   private:
+   
+   const double *ptr;   /**< \brief Pointer to the first element */
+   int nRows;           /**< \brief Number of rows */
+   int nCols;           /**< \brief Number of columns */
+   int ld;              /**< \brief Stride parameter (offset between columns) */
+};
+
+/** \brief Read-only, non-owning view of a symmetric or upper triangular matrix 
+   that is stored in packed form (see LWPR_TRI), such as LWPR_ReceptiveField.D and .M
+   
+   The same validity rules as for LWPR_ConstView apply.
+   \ingroup LWPR_CPP
+*/
+class LWPR_ConstPackedView {
+   public:
+   
+   /** \brief Creates an empty view */
+   LWPR_ConstPackedView() : ptr(NULL), n(0), sym(false) {}
+   
+   /** \brief Creates a view of a packed N x N matrix, which is either symmetric or upper triangular */
+   LWPR_ConstPackedView(const double *data, int N, bool symmetric) 
+      : ptr(data), n(N), sym(symmetric) {}
+   
+   /** \brief Returns a pointer to the packed elements */
+   const double *data() const { return ptr; }
+   
+   /** \brief Returns the number of rows (and columns) */
+   int rows() const { return n; }
+   
+   /** \brief Returns the number of columns (and rows) */
+   int cols() const { return n; }
+   
+   /** \brief Returns whether the matrix is symmetric (otherwise upper triangular) */
+   bool symmetric() const { return sym; }
+   
+   /** \brief Returns whether the view does not point to any data */
+   bool empty() const { return ptr == NULL || n == 0; }
+   
+   /** \brief Returns element (i,j) */
+   double operator()(int i, int j) const { 
+      if (i<=j) return ptr[LWPR_TRI(i,j)];
+      return sym ? ptr[LWPR_TRI(j,i)] : 0.0;
+   }
+   
+   /** \brief Copies the matrix into dense column-major storage, whose columns are
+      stride doubles apart (default: N) */
+   void copyTo(double *dense, int stride = 0) const {
+      lwpr_math_tri_unpack(n, stride > 0 ? stride : n, dense, ptr, sym ? 1:0);
+   }
+   
+   private:
+   
+   const double *ptr;   /**< \brief Pointer to the packed elements */
+   int n;               /**< \brief Number of rows and columns */
+   bool sym;            /**< \brief Symmetric (true) or upper triangular (false) */
+};
+
 /** \brief Thin wrapper class for inspecting a receptive field.
    You can only create an object of this class by a call to LWPR_Object::getRF()
    All methods of this class leave the underlying receptive field unchanged.
@@ -153,8 +264,10 @@ class LWPR_ReceptiveFieldObject {
       return mx;
    }   
    
-   /** \brief Returns the weighted variance of the input data, as seen by the receptive field (nIn)*/   
+   /** \brief Returns the weighted variance of the input data, as seen by the receptive field (nIn).
+       The result is empty if the model was stripped for inference. */   
    doubleVec varX() const {
+      if (RF->var_x == NULL) return doubleVec();
       doubleVec vx(nIn);   
       memcpy(&vx[0], RF->var_x, sizeof(double)*nIn);
       return vx;
@@ -175,20 +288,30 @@ class LWPR_ReceptiveFieldObject {
    /** \brief Returns the distance metric of the receptive field, as a vector of vectors (nIn x nIn) */
    std::vector<doubleVec> D() const {
       std::vector<doubleVec> ds(nIn);
+      doubleVec Dp;
+      const double *D = RF->D;
+      if (D == NULL) {
+         // stripped models only keep the Cholesky factor of full metrics
+         Dp.resize(LWPR_TRI_SIZE(nIn));
+         lwpr_math_trip_gram(nIn, &Dp[0], RF->M);
+         D = &Dp[0];
+      }
       for (int i=0;i<nIn;i++) {
          ds[i].resize(nIn);
-         memcpy(&ds[i][0], RF->D + i*nInS, sizeof(double)*nIn);    
+         for (int j=0;j<nIn;j++) ds[i][j] = (j<=i) ? D[LWPR_TRI(j,i)] : D[LWPR_TRI(i,j)];
       }
       return ds;
    }
 
    /** \brief Returns the Cholesky decomposition of the RF's distance metric. The result is a
-       vector of vectors with varying length (simulating a triagonal matrix) */   
+       vector of vectors with varying length (simulating a triagonal matrix). 
+       The result is empty if the model was stripped for inference and uses diagonal metrics. */   
    std::vector<doubleVec> M() const {
+      if (RF->M == NULL) return std::vector<doubleVec>();
       std::vector<doubleVec> ms(nIn);
       for (int i=0;i<nIn;i++) {
          ms[i].resize(i+1);
-         memcpy(&ms[i][0], RF->M + i*nInS, sizeof(double)*(i+1));    
+         memcpy(&ms[i][0], RF->M + LWPR_TRI(0,i), sizeof(double)*(i+1));    
       }
       return ms;
    }
@@ -236,64 +359,127 @@ class LWPR_ReceptiveFieldObject {
    /** \brief Returns the slope of the local model (simulating ordinary linear regression) (nIn) */
    doubleVec slope() const {
       doubleVec s(nIn);
-      doubleVec t(nIn);
-      
+      slope(&s[0]);
+      return s;
+   }
+   
+   /** \brief Computes the slope of the local model into caller-provided storage
+      \param[out] s  Array of nIn doubles
+   */
+   void slope(double *s) const {
       if (RF->slopeReady) {
-         memcpy(&s[0], RF->slope, sizeof(double)*RF->nReg);
+         memcpy(s, RF->slope, sizeof(double)*nIn);
+         return;
+      }
+      // calculate the slope by hand, without using any model-internal storage
+      // we do this because we do not want this code to interfere with the "real"
+      // LWPR_Model. Same recursion as in lwpr_aux_compute_slope:
+      // going backwards, s <- beta_j * u_j + (I - u_j * p_j^T) * s
+      int nR = RF->nReg;
+      if (RF->n_data[nR-1] <= 2*nIn) nR--;
+      
+      memset(s, 0, sizeof(double)*nIn);
+      for (int j=nR-1;j>=0;j--) {
+         double dp = lwpr_math_dot_product(RF->P + j*nInS, s, nIn);
+         lwpr_math_add_scalar_vector(s, RF->beta[j] - dp, RF->U + j*nInS, nIn);
+      }
+   }
+   
+   /** \brief Copies the distance metric into caller-provided dense storage
+      \param[out] dense  Array of nIn*nIn doubles (column-major, symmetric)
+   */
+   void D(double *dense) const {
+      if (RF->D != NULL) {
+         lwpr_math_tri_unpack(nIn, nIn, dense, RF->D, 1);
       } else {
-         // calculate the slope by hand, without using any model-internal storage
-         // we do this because we do not want this code to interfere with the "real"
-         // LWPR_Model
-         lwpr_math_scalar_vector(&s[0], RF->beta[0], RF->U, nIn);
-         for (int i=1;i<RF->nReg;i++) {
-            lwpr_math_scalar_vector(&t[0], RF->beta[i], RF->U + i*nInS, nIn);
-            for (int j=i-1;j>=0;j--) {
-               // left-multiply  (I - u_j * p_j^T)
-               double dp = lwpr_math_dot_product(&t[0],RF->P + j*nInS, nIn);
-               lwpr_math_add_scalar_vector(&t[0], dp, RF->U + j*nInS, nIn);
+         // stripped models only keep the Cholesky factor of full metrics: D = M'M
+         for (int j=0;j<nIn;j++) {
+            for (int i=0;i<=j;i++) {
+               dense[i + j*nIn] = dense[j + i*nIn] = 
+                  lwpr_math_dot_product(RF->M + LWPR_TRI(0,i), RF->M + LWPR_TRI(0,j), i+1);
             }
-            for (int m=0;m<nIn;m++) s[m]+=t[m];
          }
       }
-      return s;
+   }
+   
+   /** \brief Returns a view of the weighted mean of the input data (nIn) */
+   LWPR_ConstView meanXView() const { return LWPR_ConstView(RF->mean_x, nIn); }
+   
+   /** \brief Returns a view of the weighted variance of the input data (nIn).
+       The view is empty if the model was stripped for inference. */
+   LWPR_ConstView varXView() const { return LWPR_ConstView(RF->var_x, RF->var_x ? nIn : 0); }
+   
+   /** \brief Returns a view of the center vector of the receptive field (nIn) */
+   LWPR_ConstView centerView() const { return LWPR_ConstView(RF->c, nIn); }
+   
+   /** \brief Returns a view of the PLS regression coefficients (nReg) */
+   LWPR_ConstView betaView() const { return LWPR_ConstView(RF->beta, RF->nReg); }
+   
+   /** \brief Returns a view of the weighted number of training data (nReg) */
+   LWPR_ConstView numDataView() const { return LWPR_ConstView(RF->n_data, RF->nReg); }
+   
+   /** \brief Returns a view of the PLS regression directions, one per column (nIn x nReg) */
+   LWPR_ConstView UView() const { return LWPR_ConstView(RF->U, nIn, RF->nReg, nInS); }
+   
+   /** \brief Returns a view of the PLS projections, one per column (nIn x nReg) */
+   LWPR_ConstView PView() const { return LWPR_ConstView(RF->P, nIn, RF->nReg, nInS); }
+   
+   /** \brief Returns a view of the distance metric (nIn x nIn, symmetric). 
+       The view is empty if the model was stripped for inference and uses full metrics,
+       in which case you can use MView() or D(double *). */
+   LWPR_ConstPackedView DView() const { 
+      return RF->D ? LWPR_ConstPackedView(RF->D, nIn, true) : LWPR_ConstPackedView();
+   }
+   
+   /** \brief Returns a view of the Cholesky factor of the distance metric (nIn x nIn, upper triangular).
+       The view is empty if the model was stripped for inference and uses diagonal metrics. */
+   LWPR_ConstPackedView MView() const { 
+      return RF->M ? LWPR_ConstPackedView(RF->M, nIn, false) : LWPR_ConstPackedView();
    }
 
 #ifdef EIGEN3_FOUND
    Eigen::VectorXd meanX_eig() const {
-      return doubleVecToEigen(meanX());
+      return Eigen::Map<const Eigen::VectorXd>(RF->mean_x, nIn);
    }
 
    Eigen::VectorXd varX_eig() const {
-	   return doubleVecToEigen(varX());
+	   if (RF->var_x == NULL) return Eigen::VectorXd();
+	   return Eigen::Map<const Eigen::VectorXd>(RF->var_x, nIn);
    }
 
    Eigen::VectorXd center_eig() const {
-	   return doubleVecToEigen(center());
+	   return Eigen::Map<const Eigen::VectorXd>(RF->c, nIn);
    }
 
    Eigen::VectorXd beta_eig() const {
-	   return doubleVecToEigen(beta());
+	   return Eigen::Map<const Eigen::VectorXd>(RF->beta, RF->nReg);
    }
 
    Eigen::VectorXd numData_eig() const {
-	   return doubleVecToEigen(numData());
+	   return Eigen::Map<const Eigen::VectorXd>(RF->n_data, RF->nReg);
    }
 
    Eigen::VectorXd slope_eig() const {
-	   return doubleVecToEigen(slope());
+	   Eigen::VectorXd s(nIn);
+	   slope(s.data());
+	   return s;
    }
 
    Eigen::MatrixXd D_eig() const {
-	   return doubleVecToEigen(D());
+	   Eigen::MatrixXd d(nIn, nIn);
+	   D(d.data());
+	   return d;
    }
    std::vector<Eigen::VectorXd> M_eig() const {
 	   return doubleVecToEigenVec(M());
    }
+   /** \brief Returns the PLS regression directions, one per row (nReg x nIn) */
    Eigen::MatrixXd U_eig() const {
-	   return doubleVecToEigen(U());
+	   return Eigen::Map<const Eigen::MatrixXd, 0, Eigen::OuterStride<> >(RF->U, nIn, RF->nReg, Eigen::OuterStride<>(nInS)).transpose();
    }
+   /** \brief Returns the PLS projections, one per row (nReg x nIn) */
    Eigen::MatrixXd P_eig() const {
-	   return doubleVecToEigen(P());
+	   return Eigen::Map<const Eigen::MatrixXd, 0, Eigen::OuterStride<> >(RF->P, nIn, RF->nReg, Eigen::OuterStride<>(nInS)).transpose();
    }
 #endif
    
@@ -328,7 +514,9 @@ class LWPR_Object {
       LWPR_Model (C library), an OUT_OF_MEMORY exception is thrown.
    */
    LWPR_Object(int nIn, int nOut) {
-      if (!lwpr_init_model(&model, nIn, nOut, NULL)) {
+      model = allocModel();
+      if (!lwpr_init_model(model, nIn, nOut, NULL)) {
+         delete model;
          throw LWPR_Exception(LWPR_Exception::OUT_OF_MEMORY);
       }
    }
@@ -341,11 +529,66 @@ class LWPR_Object {
       LWPR_Model (C library), an OUT_OF_MEMORY exception is thrown.
    */
    LWPR_Object(const LWPR_Object& otherObj) {
-      if (!lwpr_duplicate_model(&(this->model), &(otherObj.model))) {
+      model = allocModel();
+      if (!lwpr_duplicate_model(model, otherObj.model)) {
+         delete model;
          throw LWPR_Exception(LWPR_Exception::OUT_OF_MEMORY);
       }
    }
    
+#if __cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1600)
+   /** \brief Creates an LWPR_Object by taking over the model of another object.
+      \param otherObj   LWPR_Object whose model is transferred (not copied). It is left
+                        empty and may only be destroyed or assigned to afterwards.
+      \return     A new object
+   */
+   LWPR_Object(LWPR_Object&& otherObj) noexcept {
+      model = otherObj.model;
+      otherObj.model = NULL;
+   }
+   
+   /** \brief Replaces the model of this object by the model of another object.
+      \param otherObj   LWPR_Object whose model is transferred (not copied). It is left
+                        empty and may only be destroyed or assigned to afterwards.
+      \return     Reference to this object
+   */
+   LWPR_Object& operator=(LWPR_Object&& otherObj) noexcept {
+      if (this != &otherObj) {
+         freeModel();
+         model = otherObj.model;
+         otherObj.model = NULL;
+      }
+      return *this;
+   }
+#endif
+
+   /** \brief Replaces the model of this object by a copy of another object's model.
+      \param otherObj   LWPR_Object to be duplicated.
+      \return     Reference to this object
+      
+      In case there is insufficient memory for allocating the copy, an OUT_OF_MEMORY 
+      exception is thrown, and this object is left unchanged.
+   */
+   LWPR_Object& operator=(const LWPR_Object& otherObj) {
+      if (this != &otherObj) {
+         LWPR_Object tmp(otherObj);
+         swap(tmp);
+      }
+      return *this;
+   }
+   
+   /** \brief Exchanges the models of two objects by exchanging their pointers.
+      \param otherObj   LWPR_Object to swap models with
+      
+      This is useful for swapping a retrained model into place while 
+      keeping the LWPR_Object itself.
+   */
+   void swap(LWPR_Object& otherObj) {
+      LWPR_Model *tmp = model;
+      model = otherObj.model;
+      otherObj.model = tmp;
+   }
+   
    /** \brief Creates an LWPR_Object from a binary file, or if compiled
               with support for EXPAT, an XML file.
       \param filename  Name of file to read the model from
@@ -356,31 +599,62 @@ class LWPR_Object {
    */
    LWPR_Object(const char *filename) {
       int ok;
+      model = allocModel();
       // First try treating the file as binary
-      ok = lwpr_read_binary(&model, filename);
+      ok = lwpr_read_binary(model, filename);
       #if HAVE_LIBEXPAT
       if (!ok) {
          int numErr, numWar;
-         numErr = lwpr_read_xml(&model, filename, &numWar);
+         numErr = lwpr_read_xml(model, filename, &numWar);
          ok = (numErr == 0);
       }
       #endif
-      if (!ok) throw LWPR_Exception(LWPR_Exception::IO_ERROR);
+      if (!ok) {
+         delete model;
+         throw LWPR_Exception(LWPR_Exception::IO_ERROR);
+      }
    }
 
    /** \brief Destroys an LWPR_Object and disposes allocated memory */
    ~LWPR_Object() {
-      lwpr_free_model(&model);
+      freeModel();
    }
    
    /** \brief Write the model to an XML file
       \param filename   Name of the file, which will we overwritten if it already exists
       \return
          - 1 in case of success
-         - 0 if the file could not be written to
+         - 0 if the file could not be written to, or the model was stripped for inference
    */
    int writeXML(const char *filename) {
-      return lwpr_write_xml(&model, filename);
+      return lwpr_write_xml(model, filename);
+   }
+   
+   /** \brief Drops all training statistics and keeps only what is needed for predictions
+      (see lwpr_strip_for_inference). The model cannot be updated afterwards.
+      \exception LWPR_Exception::OUT_OF_MEMORY  
+         if the compact receptive fields could not be allocated (the model is left unchanged)
+   */
+   void stripForInference() {
+      if (!lwpr_strip_for_inference(model)) {
+         throw LWPR_Exception(LWPR_Exception::OUT_OF_MEMORY);
+      }
+   }
+   
+   /** \brief Computes and caches the slopes of all receptive fields, so that predictions 
+      need no PLS calculations until the next update (see lwpr_finalize_slopes)
+   */
+   void finalizeSlopes() { lwpr_finalize_slopes(model); }
+   
+   /** \brief Sorts the receptive fields along a space-filling curve and stores them 
+      contiguously (see lwpr_reorder_rfs)
+      \exception LWPR_Exception::OUT_OF_MEMORY  
+         if temporary memory or the contiguous block could not be allocated (the model is still valid)
+   */
+   void reorderRFs() {
+      if (!lwpr_reorder_rfs(model)) {
+         throw LWPR_Exception(LWPR_Exception::OUT_OF_MEMORY);
+      }
    }
    
    /** \brief Write the model to a binary file
@@ -390,7 +664,7 @@ class LWPR_Object {
          - 0 if the file could not be written to
    */
    int writeBinary(const char *filename) {
-      return lwpr_write_binary(&model, filename);
+      return lwpr_write_binary(model, filename);
    }
       
    /** \brief Updates an LWPR model with a given input/output pair (x,y). 
@@ -406,24 +680,79 @@ class LWPR_Object {
          if the parameter x does not match the model dimensions
       \exception LWPR_Exception::BAD_OUTPUT_DIM
          if the parameter y does not match the model dimensions
+      \exception LWPR_Exception::INFERENCE_ONLY
+         if the model has been stripped by stripForInference()
    */  
    doubleVec update(const doubleVec& x, const doubleVec& y) {
-      doubleVec yp(model.nOut);
+      doubleVec yp(model->nOut);
       
-      if (x.size()!=(unsigned) model.nIn) {
+      if (model->inference_only) {
+         throw LWPR_Exception(LWPR_Exception::INFERENCE_ONLY);
+      }
+      
+      if (x.size()!=(unsigned) model->nIn) {
          throw LWPR_Exception(LWPR_Exception::BAD_INPUT_DIM);
       }
       
-      if (y.size()!=(unsigned) model.nOut) {
+      if (y.size()!=(unsigned) model->nOut) {
          throw LWPR_Exception(LWPR_Exception::BAD_OUTPUT_DIM);
       }
 
-      if (!lwpr_update(&model, &x[0], &y[0], &yp[0], NULL)) {
+      if (!lwpr_update(model, &x[0], &y[0], &yp[0], NULL)) {
          throw LWPR_Exception(LWPR_Exception::OUT_OF_MEMORY);
       }
       return yp;
    }
    
+   /** \brief Updates an LWPR model with a given input/output pair (x,y),
+      without allocating any memory for the result.
+  
+      \param[in] x    Input vector (nIn doubles)
+      \param[in] y    Output vector (nOut doubles)
+      \param[out] yp  Current prediction of y given x (nOut doubles), may be NULL
+      
+      The dimensions of x, y and yp are not (and cannot be) checked.
+      \exception LWPR_Exception::OUT_OF_MEMORY  
+         if a receptive field would have to be added, but memory could not be allocated
+      \exception LWPR_Exception::INFERENCE_ONLY
+         if the model has been stripped by stripForInference()
+   */  
+   void update(const double *x, const double *y, double *yp = NULL) {
+      if (model->inference_only) {
+         throw LWPR_Exception(LWPR_Exception::INFERENCE_ONLY);
+      }
+      if (!lwpr_update(model, x, y, yp, NULL)) {
+         throw LWPR_Exception(LWPR_Exception::OUT_OF_MEMORY);
+      }
+   }
+   
+   /** \brief Computes the prediction of an LWPR model given an input vector x,
+      without allocating any memory for the result.
+  
+      \param[in] x      Input vector (nIn doubles)
+      \param[out] yp    Predicted output vector (nOut doubles)
+      \param[in] cutoff A threshold parameter (default = 0.001). 
+         Receptive fields with activation below the cutoff are ignored
+   */
+   void predict(const double *x, double *yp, double cutoff = 0.001) {
+      lwpr_predict(model, x, cutoff, yp, NULL, NULL);
+   }
+   
+   /** \brief Computes the prediction of an LWPR model given an input vector x,
+      together with confidence bounds and maximal activations, without allocating
+      any memory for the result.
+  
+      \param[in] x      Input vector (nIn doubles)
+      \param[out] yp    Predicted output vector (nOut doubles)
+      \param[out] conf  Confidence bounds (nOut doubles), may be NULL
+      \param[out] maxW  Maximal activations (nOut doubles), may be NULL
+      \param[in] cutoff A threshold parameter (default = 0.001). 
+         Receptive fields with activation below the cutoff are ignored
+   */
+   void predict(const double *x, double *yp, double *conf, double *maxW, double cutoff = 0.001) {
+      lwpr_predict(model, x, cutoff, yp, conf, maxW);
+   }
+   
    /** \brief Computes the prediction of an LWPR model given an 
       input vector x.
   
@@ -435,13 +764,13 @@ class LWPR_Object {
          if the parameter x does not match the model dimensions
    */      
    doubleVec predict(const doubleVec& x, double cutoff = 0.001) {
-      doubleVec yp(model.nOut);   
+      doubleVec yp(model->nOut);   
 
-      if (x.size()!=(unsigned) model.nIn) {
+      if (x.size()!=(unsigned) model->nIn) {
          throw LWPR_Exception(LWPR_Exception::BAD_INPUT_DIM);
       }      
 
-      lwpr_predict(&model, &x[0], cutoff, &yp[0], NULL, NULL);
+      lwpr_predict(model, &x[0], cutoff, &yp[0], NULL, NULL);
       return yp;
    }
    
@@ -459,14 +788,14 @@ class LWPR_Object {
          if the parameter x does not match the model dimensions
    */      
    doubleVec predict(const doubleVec& x, doubleVec& confidence, double cutoff = 0.001) {
-      doubleVec yp(model.nOut);   
+      doubleVec yp(model->nOut);   
       
-      if (x.size()!=(unsigned) model.nIn) {
+      if (x.size()!=(unsigned) model->nIn) {
          throw LWPR_Exception(LWPR_Exception::BAD_INPUT_DIM);
       }      
-      if (confidence.size()!=(unsigned) model.nOut) confidence.resize(model.nOut);
+      if (confidence.size()!=(unsigned) model->nOut) confidence.resize(model->nOut);
 
-      lwpr_predict(&model, &x[0], cutoff, &yp[0], &confidence[0], NULL);
+      lwpr_predict(model, &x[0], cutoff, &yp[0], &confidence[0], NULL);
       return yp;
    }  
    
@@ -486,25 +815,51 @@ class LWPR_Object {
          if the parameter x does not match the model dimensions
    */      
    doubleVec predict(const doubleVec& x, doubleVec& confidence, doubleVec& maxW, double cutoff = 0.001) {
-      doubleVec yp(model.nOut);   
+      doubleVec yp(model->nOut);   
       
-      if (x.size()!=(unsigned) model.nIn) {
+      if (x.size()!=(unsigned) model->nIn) {
          throw LWPR_Exception(LWPR_Exception::BAD_INPUT_DIM);
       }      
-      if (confidence.size()!=(unsigned) model.nOut) confidence.resize(model.nOut);
-      if (maxW.size()!=(unsigned) model.nOut) maxW.resize(model.nOut);
+      if (confidence.size()!=(unsigned) model->nOut) confidence.resize(model->nOut);
+      if (maxW.size()!=(unsigned) model->nOut) maxW.resize(model->nOut);
 
-      lwpr_predict(&model, &x[0], cutoff, &yp[0], &confidence[0], &maxW[0]);
+      lwpr_predict(model, &x[0], cutoff, &yp[0], &confidence[0], &maxW[0]);
       return yp;
    } 
    
+   /** \brief Computes the prediction of an LWPR model given an input vector x,
+      using only the K receptive fields with the largest activations per
+      output dimension (see lwpr_predict_topk).
+
+      \param[in] x      Input vector
+      \param[in] K      Maximum number of receptive fields per output dimension (at most LWPR_MAX_TOPK)
+      \param[out] dropped  Vector to store the fraction of the activation mass that 
+         was left out per output dimension, will be resized if necessary
+      \param[in] cutoff A threshold parameter (default = 0.001). 
+         Receptive fields with activation below the cutoff are ignored
+      \return    Predicted output vector
+      \exception LWPR_Exception::BAD_INPUT_DIM  
+         if the parameter x does not match the model dimensions
+   */      
+   doubleVec predictTopK(const doubleVec& x, int K, doubleVec& dropped, double cutoff = 0.001) {
+      doubleVec yp(model->nOut);   
+      
+      if (x.size()!=(unsigned) model->nIn) {
+         throw LWPR_Exception(LWPR_Exception::BAD_INPUT_DIM);
+      }      
+      if (dropped.size()!=(unsigned) model->nOut) dropped.resize(model->nOut);
+
+      lwpr_predict_topk(model, &x[0], K, cutoff, &yp[0], &dropped[0], NULL);
+      return yp;
+   }
+   
    /** \brief Sets a spherical initial distance metric
       \param delta   Width parameter, distance matrix will be delta * eye(nIn)
       \exception LWPR_Exception::BAD_INIT_D
          if the parameter delta is <= 0, giving rise to a non-positive matrix
    */
    void setInitD(double delta) {
-      if (!lwpr_set_init_D_spherical(&model,delta)) {
+      if (!lwpr_set_init_D_spherical(model,delta)) {
          throw LWPR_Exception(LWPR_Exception::BAD_INIT_D);
       }
    }
@@ -517,12 +872,12 @@ class LWPR_Object {
          if the parameter initD gives rise to a non-positive matrix
    */
    void setInitD(const doubleVec& initD) {
-      if (initD.size()==(unsigned) model.nIn) {
-         if (!lwpr_set_init_D_diagonal(&model,&initD[0])) {
+      if (initD.size()==(unsigned) model->nIn) {
+         if (!lwpr_set_init_D_diagonal(model,&initD[0])) {
             throw LWPR_Exception(LWPR_Exception::BAD_INIT_D);
          }
-      } else if (initD.size()==(unsigned) (model.nIn*model.nIn)) {
-         if (!lwpr_set_init_D(&model,&initD[0],model.nIn)) {
+      } else if (initD.size()==(unsigned) (model->nIn*model->nIn)) {
+         if (!lwpr_set_init_D(model,&initD[0],model->nIn)) {
             throw LWPR_Exception(LWPR_Exception::BAD_INIT_D);
          }
       } else {
@@ -532,159 +887,205 @@ class LWPR_Object {
    
    /** \brief Sets init_alpha (learning rate for 2nd order distance metric updates) */
    void setInitAlpha(double alpha) {
-      lwpr_set_init_alpha(&model,alpha);
+      lwpr_set_init_alpha(model,alpha);
    }
    
    /** \brief Sets w_gen (threshold for adding new receptive fields) */
-   void wGen(double w_gen) { model.w_gen = w_gen; }
+   void wGen(double w_gen) { model->w_gen = w_gen; }
    
    /** \brief Sets w_prune (threshold for removing a receptive field) */   
-   void wPrune(double w_prune) { model.w_prune = w_prune; }
+   void wPrune(double w_prune) { model->w_prune = w_prune; }
 
    /** \brief Sets penalty (pre-factor for smoothing term in distance metric updates) */
-   void penalty(double pen) { model.penalty = pen; }
+   void penalty(double pen) { model->penalty = pen; }
    
    /** \brief Sets initial forgetting factor */
-   void initLambda(double iLam) { model.init_lambda = iLam; }
+   void initLambda(double iLam) { model->init_lambda = iLam; }
    
    /** \brief Sets annealing rate for forgetting factor */
-   void tauLambda(double tLam) { model.tau_lambda = tLam; }
+   void tauLambda(double tLam) { model->tau_lambda = tLam; }
       
    /** \brief Sets final forgetting factor */   
-   void finalLambda(double fLam) { model.final_lambda = fLam; }
+   void finalLambda(double fLam) { model->final_lambda = fLam; }
    
    /** \brief Sets initial value for covariance computation SSs2 */
-   void initS2(double init_s2) { model.init_S2 = init_s2; }
+   void initS2(double init_s2) { model->init_S2 = init_s2; }
    
    /** \brief Determines whether distance matrix updates are to be performed */
-   void updateD(bool update) { model.update_D = update ? 1:0; }
+   void updateD(bool update) { model->update_D = update ? 1:0; }
    
    /** \brief Determines whether distance matrices should be treaded as diagonal-only */
-   void diagOnly(bool dOnly) { model.diag_only = dOnly ? 1:0; }
+   void diagOnly(bool dOnly) { model->diag_only = dOnly ? 1:0; }
    
    /** \brief Determines whether 2nd order distance matrix updates are to be performed */   
-   void useMeta(bool meta) { model.meta = meta ? 1:0; }
+   void useMeta(bool meta) { model->meta = meta ? 1:0; }
    
    /** \brief Sets the learning rate for 2nd order distance matrix updates */
-   void metaRate(double rate) { model.meta_rate = rate; }
+   void metaRate(double rate) { model->meta_rate = rate; }
    
    /** \brief Sets the kernel to be used in the LWPR model */
-   void kernel(LWPR_Kernel kern) { model.kernel = kern; }
+   void kernel(LWPR_Kernel kern) { model->kernel = kern; }
    
-   /** \brief Sets the kernel (either "Gaussian" or "BiSquare") to be used in the LWPR model */
+   /** \brief Sets the kernel ("Gaussian", "BiSquare", or the name of a kernel 
+      registered by lwpr_register_kernel) to be used in the LWPR model */
    void kernel(const char *str) {
-      if (!strcmp(str,"Gaussian")) {
-         model.kernel = LWPR_GAUSSIAN_KERNEL;
-         return;
-      }
-      if (!strcmp(str,"BiSquare")) {
-         model.kernel = LWPR_BISQUARE_KERNEL;
-         return;
+      int k = lwpr_kernel_by_name(str);
+      if (k < 0) throw LWPR_Exception(LWPR_Exception::UNKNOWN_KERNEL);
+      model->kernel = (LWPR_Kernel) k;
+   }
+   
+   /** \brief Sets the maximum number of receptive fields per output dimension (0 = unlimited) */
+   void maxRFS(int num) { model->max_rfs = num; }
+   
+   /** \brief Sets the maximum memory (bytes) of receptive fields per output dimension (0 = unlimited) */
+   void maxBytes(size_t bytes) { model->max_bytes = bytes; }
+   
+   /** \brief Sets the policy for handling new receptive fields if the budget is exhausted */
+   void evictionPolicy(LWPR_EvictionPolicy policy) { model->evict = policy; }
+   
+   /** \brief Sets whether slopes of receptive fields are recomputed during each update (see LWPR_Model.eager_slopes) */
+   void eagerSlopes(bool flag) { model->eager_slopes = flag ? 1:0; }
+   
+   /** \brief Sets whether distance computations stop early for inactive receptive fields (see LWPR_Model.early_exit) */
+   void earlyExit(bool flag) { model->early_exit = flag ? 1:0; }
+   
+   /** \brief Sets whether all output dimensions share their receptive field geometry (see lwpr_set_shared_geometry).
+      \exception LWPR_Exception::BAD_GEOMETRY  if the model was trained without sharing
+   */
+   void sharedGeometry(bool flag) { 
+      if (!lwpr_set_shared_geometry(model, flag ? 1:0)) {
+         throw LWPR_Exception(LWPR_Exception::BAD_GEOMETRY);
       }
-      throw LWPR_Exception(LWPR_Exception::UNKNOWN_KERNEL);
    }
    
+   /** \brief Sets after how many updates the receptive fields are reordered (see LWPR_Model.reorder_every, 0 = never) */
+   void reorderEvery(int num) { model->reorder_every = num; }
+   
    /** \brief Returns the number of training data the model has seen */
-   int nData() const { return model.n_data; }
+   int nData() const { return model->n_data; }
    
    /** \brief Returns the input dimensionality */
-   int nIn() const { return model.nIn; }
+   int nIn() const { return model->nIn; }
    
    /** \brief Returns the output dimensionality */   
-   int nOut() const { return model.nOut; }
+   int nOut() const { return model->nOut; }
    
    /** \brief Returns w_gen (threshold for adding new receptive fields) */
-   double wGen() const { return model.w_gen; }
+   double wGen() const { return model->w_gen; }
    
    /** \brief Returns w_prune (threshold for removing a receptive field) */ 
-   double wPrune() const { return model.w_prune; }   
+   double wPrune() const { return model->w_prune; }   
    
    /** \brief Returns penalty (pre-factor for smoothing term in distance metric updates) */
-   double penalty() const { return model.penalty; }
+   double penalty() const { return model->penalty; }
    
    /** \brief Returns initial forgetting factor */
-   double initLambda() const { return model.init_lambda; }
+   double initLambda() const { return model->init_lambda; }
 
    /** \brief Returns annealing rate for forgetting factor */
-   double tauLambda() const { return model.tau_lambda; }
+   double tauLambda() const { return model->tau_lambda; }
 
    /** \brief Returns final forgetting factor */   
-   double finalLambda() const { return model.final_lambda; }
+   double finalLambda() const { return model->final_lambda; }
    
    /** \brief Returns initial value for the covariance computation SSs2 */
-   double initS2() const { return model.init_S2; }
+   double initS2() const { return model->init_S2; }
    
    /** \brief Returns whether distance matrix updates are performed */
-   bool updateD() { return (bool) model.update_D; }
+   bool updateD() { return (bool) model->update_D; }
 
    /** \brief Returns whether distance matrices are treaded as diagonal-only */
-   bool diagOnly() { return (bool) model.diag_only; }
+   bool diagOnly() { return (bool) model->diag_only; }
    
    /** \brief Returns whether 2nd order distance matrix updates are performed */   
-   bool useMeta() { return (bool) model.meta; }
+   bool useMeta() { return (bool) model->meta; }
    
    /** \brief Returns learning rate for 2nd order distance matrix updates */      
-   double metaRate() { return model.meta_rate; }
+   double metaRate() { return model->meta_rate; }
 
    /** \brief Returns the kernel */   
-   LWPR_Kernel kernel() { return model.kernel; }
+   LWPR_Kernel kernel() { return model->kernel; }
+   
+   /** \brief Returns the maximum number of receptive fields per output dimension (0 = unlimited) */
+   int maxRFS() const { return model->max_rfs; }
+   
+   /** \brief Returns the maximum memory (bytes) of receptive fields per output dimension (0 = unlimited) */
+   size_t maxBytes() const { return model->max_bytes; }
+   
+   /** \brief Returns the policy for handling new receptive fields if the budget is exhausted */
+   LWPR_EvictionPolicy evictionPolicy() const { return model->evict; }
+   
+   /** \brief Returns whether slopes of receptive fields are recomputed during each update */
+   bool eagerSlopes() const { return (bool) model->eager_slopes; }
+   
+   /** \brief Returns whether distance computations stop early for inactive receptive fields */
+   bool earlyExit() const { return (bool) model->early_exit; }
+   
+   /** \brief Returns whether all output dimensions share their receptive field geometry */
+   bool sharedGeometry() const { return (bool) model->shared_geometry; }
+   
+   /** \brief Returns after how many updates the receptive fields are reordered (0 = never) */
+   int reorderEvery() const { return model->reorder_every; }
+   
+   /** \brief Returns whether the model was stripped for inference (see stripForInference) */
+   bool inferenceOnly() const { return (bool) model->inference_only; }
    
    /** \brief Returns the mean of all input samples the model has seen */
    doubleVec meanX() {
-      doubleVec mx(model.nIn);
-      memcpy(model.mean_x,&mx[0],sizeof(double)*model.nIn);
+      doubleVec mx(model->nIn);
+      memcpy(&mx[0],model->mean_x,sizeof(double)*model->nIn);
       return mx;
    }
 
    /** \brief Returns the variance of all input samples the model has seen */   
    doubleVec varX() {
-      doubleVec vx(model.nIn);
-      memcpy(model.var_x, &vx[0],sizeof(double)*model.nIn);
+      doubleVec vx(model->nIn);
+      memcpy(&vx[0],model->var_x,sizeof(double)*model->nIn);
       return vx;
    }
    
    /** \brief Sets the input normalisation (expected scale or standard deviation
       of input data */
    void normIn(const doubleVec& norm) {
-      if (norm.size()!=(unsigned) model.nIn) {
+      if (norm.size()!=(unsigned) model->nIn) {
          throw LWPR_Exception(LWPR_Exception::BAD_INPUT_DIM);      
       }
-      memcpy(model.norm_in,&norm[0],sizeof(double)*model.nIn);
+      memcpy(model->norm_in,&norm[0],sizeof(double)*model->nIn);
    }
 
    /** \brief Returns the input normalisation factors */
    doubleVec normIn() const {
-      doubleVec norm(model.nIn);
-      memcpy(&norm[0],model.norm_in,sizeof(double)*model.nIn);
+      doubleVec norm(model->nIn);
+      memcpy(&norm[0],model->norm_in,sizeof(double)*model->nIn);
       return norm;
    }
    
    /** \brief Sets the output normalisation (expected scale or standard deviation
       of output data */
    void normOut(const doubleVec& norm) {
-      if (norm.size()!=(unsigned) model.nOut) {
+      if (norm.size()!=(unsigned) model->nOut) {
          throw LWPR_Exception(LWPR_Exception::BAD_OUTPUT_DIM);
       }
-      memcpy(model.norm_out,&norm[0],sizeof(double)*model.nOut);
+      memcpy(model->norm_out,&norm[0],sizeof(double)*model->nOut);
    }
 
    /** \brief Returns the output normalisation factors */
    doubleVec normOut() const {
-      doubleVec norm(model.nOut);
-      memcpy(&norm[0],model.norm_out,sizeof(double)*model.nOut);
+      doubleVec norm(model->nOut);
+      memcpy(&norm[0],model->norm_out,sizeof(double)*model->nOut);
       return norm;
    }
    
    /** \brief Returns the number of receptive fields for output dimension "outDim" */
    int numRFS(int outDim) {
-      if (outDim < 0 || outDim >= model.nOut) return 0;
-      return model.sub[outDim].numRFS;
+      if (outDim < 0 || outDim >= model->nOut) return 0;
+      return model->sub[outDim].numRFS;
    }
    
    /** \brief Returns the number of receptive fields for all output dimensions */
    std::vector<int> numRFS() {
-      std::vector<int> num(model.nOut);
-      for (int i=0;i<model.nOut;i++) num[i] = model.sub[i].numRFS;
+      std::vector<int> num(model->nOut);
+      for (int i=0;i<model->nOut;i++) num[i] = model->sub[i].numRFS;
       return num;
    }
    
@@ -701,18 +1102,18 @@ class LWPR_Object {
       this wrapper points to!!!   
    */
    LWPR_ReceptiveFieldObject getRF(int outDim, int index) const {
-      if (outDim < 0 || outDim >= model.nOut) {
+      if (outDim < 0 || outDim >= model->nOut) {
          throw LWPR_Exception(LWPR_Exception::OUT_OF_RANGE);
       }
-      if (index < 0 || index >= model.sub[outDim].numRFS) { 
+      if (index < 0 || index >= model->sub[outDim].numRFS) { 
          throw LWPR_Exception(LWPR_Exception::OUT_OF_RANGE);
       }
-      return LWPR_ReceptiveFieldObject(model.sub[outDim].rf[index]);
+      return LWPR_ReceptiveFieldObject(model->sub[outDim].rf[index]);
    }
 
 #ifdef EIGEN3_FOUND
    Eigen::VectorXd normOut_eig() const {
-      return doubleVecToEigen(normOut());
+      return Eigen::Map<const Eigen::VectorXd>(model->norm_out, model->nOut);
    }
 
    void normOut(const Eigen::Ref<const Eigen::VectorXd> norm) {
@@ -720,7 +1121,7 @@ class LWPR_Object {
    }
 
    Eigen::VectorXd normIn_eig() const {
-      return doubleVecToEigen(normIn());
+      return Eigen::Map<const Eigen::VectorXd>(model->norm_in, model->nIn);
    }
 
    void normIn(const Eigen::Ref<const Eigen::VectorXd> norm) {
@@ -728,11 +1129,11 @@ class LWPR_Object {
    }
 
    Eigen::VectorXd varX_eig() {
-      return doubleVecToEigen(varX());
+      return Eigen::Map<const Eigen::VectorXd>(model->var_x, model->nIn);
    }
 
    Eigen::VectorXd meanX_eig() {
-      return doubleVecToEigen(meanX());
+      return Eigen::Map<const Eigen::VectorXd>(model->mean_x, model->nIn);
    }
 
    void setInitD(const Eigen::Ref<const Eigen::VectorXd> initD) {
@@ -740,31 +1141,139 @@ class LWPR_Object {
    }
 
    Eigen::VectorXd predict(const Eigen::Ref<const Eigen::VectorXd> x, Eigen::Ref<Eigen::VectorXd> confidence, Eigen::Ref<Eigen::VectorXd> maxW, double cutoff = 0.001) {
-      doubleVec conf_, maxW_, ret;
-	  ret = predict(EigenTodoubleVec(x), conf_, maxW_, cutoff);
-	  confidence = doubleVecToEigen(conf_);
-	  maxW = doubleVecToEigen(maxW_);
-	  return doubleVecToEigen(ret);
+      Eigen::VectorXd yp(model->nOut);
+      if (x.size() != model->nIn) throw LWPR_Exception(LWPR_Exception::BAD_INPUT_DIM);
+      if (confidence.size() != model->nOut || maxW.size() != model->nOut) {
+         throw LWPR_Exception(LWPR_Exception::BAD_OUTPUT_DIM);
+      }
+      lwpr_predict(model, x.data(), cutoff, yp.data(), confidence.data(), maxW.data());
+      return yp;
    }
 
    Eigen::VectorXd predict(const Eigen::Ref<const Eigen::VectorXd> x, Eigen::Ref<Eigen::VectorXd> confidence, double cutoff = 0.001) {
-	   doubleVec conf_, ret;
-	   ret = predict(EigenTodoubleVec(x), conf_, cutoff);
-	   confidence = doubleVecToEigen(conf_);
-	   return doubleVecToEigen(ret);
+      Eigen::VectorXd yp(model->nOut);
+      if (x.size() != model->nIn) throw LWPR_Exception(LWPR_Exception::BAD_INPUT_DIM);
+      if (confidence.size() != model->nOut) throw LWPR_Exception(LWPR_Exception::BAD_OUTPUT_DIM);
+      lwpr_predict(model, x.data(), cutoff, yp.data(), confidence.data(), NULL);
+      return yp;
    }
 
    Eigen::VectorXd predict(const Eigen::Ref<const Eigen::VectorXd> x, double cutoff = 0.001) {
-	   return doubleVecToEigen(predict(EigenTodoubleVec(x), cutoff));
+      Eigen::VectorXd yp(model->nOut);
+      if (x.size() != model->nIn) throw LWPR_Exception(LWPR_Exception::BAD_INPUT_DIM);
+      lwpr_predict(model, x.data(), cutoff, yp.data(), NULL, NULL);
+      return yp;
    }
 
    Eigen::VectorXd update(const Eigen::Ref<const Eigen::VectorXd> x, const Eigen::Ref<const Eigen::VectorXd> y) {
-	   return doubleVecToEigen(update(EigenTodoubleVec(x), EigenTodoubleVec(y)));
+      Eigen::VectorXd yp(model->nOut);
+      if (x.size() != model->nIn) throw LWPR_Exception(LWPR_Exception::BAD_INPUT_DIM);
+      if (y.size() != model->nOut) throw LWPR_Exception(LWPR_Exception::BAD_OUTPUT_DIM);
+      update(x.data(), y.data(), yp.data());
+      return yp;
+   }
+   
+   /** \brief Computes predictions for a batch of input vectors (see lwpr_predict_batch)
+      \param[in] X      Input vectors, one per column (nIn x N)
+      \param[in] cutoff A threshold parameter (default = 0.001)
+      \return    Predicted output vectors, one per column (nOut x N)
+      \exception LWPR_Exception::BAD_INPUT_DIM  
+         if the number of rows of X does not match the input dimensionality
+      
+      The columns of X are read in place, without copying.
+   */
+   Eigen::MatrixXd predictBatch(const Eigen::Ref<const Eigen::MatrixXd>& X, double cutoff = 0.001) {
+      Eigen::MatrixXd Y(model->nOut, X.cols());
+      predictBatch(X, Y, cutoff);
+      return Y;
+   }
+   
+   /** \brief Computes predictions for a batch of input vectors into caller-provided storage
+      \param[in] X      Input vectors, one per column (nIn x N)
+      \param[out] Y     Predicted output vectors, one per column (nOut x N)
+      \param[in] cutoff A threshold parameter (default = 0.001)
+      \exception LWPR_Exception::BAD_INPUT_DIM  
+         if the number of rows of X does not match the input dimensionality
+      \exception LWPR_Exception::BAD_OUTPUT_DIM  
+         if Y does not have nOut x N elements
+   */
+   void predictBatch(const Eigen::Ref<const Eigen::MatrixXd>& X, Eigen::Ref<Eigen::MatrixXd> Y, double cutoff = 0.001) {
+      if (X.rows() != model->nIn) throw LWPR_Exception(LWPR_Exception::BAD_INPUT_DIM);
+      if (Y.rows() != model->nOut || Y.cols() != X.cols()) throw LWPR_Exception(LWPR_Exception::BAD_OUTPUT_DIM);
+      lwpr_predict_batch(model, (int) X.cols(), X.data(), (int) X.outerStride(), cutoff, 
+            Y.data(), (int) Y.outerStride(), NULL, NULL);
+   }
+   
+   /** \brief Computes predictions and confidence bounds for a batch of input vectors 
+      \param[in] X      Input vectors, one per column (nIn x N)
+      \param[out] Y     Predicted output vectors, one per column (nOut x N)
+      \param[out] confidence  Confidence bounds, one column per input vector (nOut x N)
+      \param[in] cutoff A threshold parameter (default = 0.001)
+      \exception LWPR_Exception::BAD_INPUT_DIM  
+         if the number of rows of X does not match the input dimensionality
+      \exception LWPR_Exception::BAD_OUTPUT_DIM  
+         if Y or confidence do not have nOut x N elements
+   */
+   void predictBatch(const Eigen::Ref<const Eigen::MatrixXd>& X, Eigen::Ref<Eigen::MatrixXd> Y, 
+         Eigen::Ref<Eigen::MatrixXd> confidence, double cutoff = 0.001) {
+      if (X.rows() != model->nIn) throw LWPR_Exception(LWPR_Exception::BAD_INPUT_DIM);
+      if (Y.rows() != model->nOut || Y.cols() != X.cols()) throw LWPR_Exception(LWPR_Exception::BAD_OUTPUT_DIM);
+      if (confidence.rows() != model->nOut || confidence.cols() != X.cols() 
+            || confidence.outerStride() != Y.outerStride()) {
+         throw LWPR_Exception(LWPR_Exception::BAD_OUTPUT_DIM);
+      }
+      lwpr_predict_batch(model, (int) X.cols(), X.data(), (int) X.outerStride(), cutoff, 
+            Y.data(), (int) Y.outerStride(), confidence.data(), NULL);
+   }
+   
+   /** \brief Computes predictions and Jacobians for a batch of input vectors (see lwpr_predict_J_batch)
+      \param[in] X      Input vectors, one per column (nIn x N)
+      \param[out] J     Jacobians, resized to nOut x (nIn*N) if necessary. The Jacobian of the
+                        k-th input vector is J.middleCols(k*nIn, nIn).
+      \param[in] cutoff A threshold parameter (default = 0.001)
+      \return    Predicted output vectors, one per column (nOut x N)
+      \exception LWPR_Exception::BAD_INPUT_DIM  
+         if the number of rows of X does not match the input dimensionality
+   */
+   Eigen::MatrixXd predictJBatch(const Eigen::Ref<const Eigen::MatrixXd>& X, Eigen::MatrixXd& J, double cutoff = 0.001) {
+      if (X.rows() != model->nIn) throw LWPR_Exception(LWPR_Exception::BAD_INPUT_DIM);
+      Eigen::MatrixXd Y(model->nOut, X.cols());
+      J.resize(model->nOut, model->nIn * X.cols());
+      lwpr_predict_J_batch(model, (int) X.cols(), X.data(), (int) X.outerStride(), cutoff, 
+            Y.data(), model->nOut, J.data());
+      return Y;
    }
 #endif
    
-   /** \brief Underlying C structure */
-   LWPR_Model model;
+   /** \brief Underlying C structure. It is held by pointer, so that swap() and the move
+       operations do not have to update the back-pointers of all receptive fields.
+       The pointer is NULL in objects whose model was moved away. */
+   LWPR_Model *model;
+   
+   private:
+   
+   /** \brief Allocates an (uninitialised) LWPR_Model structure, throws OUT_OF_MEMORY on failure */
+   static LWPR_Model *allocModel() {
+      LWPR_Model *m = new (std::nothrow) LWPR_Model;
+      if (m == NULL) throw LWPR_Exception(LWPR_Exception::OUT_OF_MEMORY);
+      return m;
+   }
+   
+   /** \brief Frees the model including the LWPR_Model structure itself */
+   void freeModel() {
+      if (model != NULL) {
+         lwpr_free_model(model);
+         delete model;
+         model = NULL;
+      }
+   }
 };
 
+/** \brief Exchanges the models of two LWPR_Object instances (see LWPR_Object::swap)
+   \ingroup LWPR_CPP
+*/
+inline void swap(LWPR_Object& a, LWPR_Object& b) {
+   a.swap(b);
+}
+
 #endif
@@ -40,7 +40,7 @@ extern "C" {
 typedef struct LWPR_Workspace {
    int *derivOk;           /**< \brief Used within lwpr_aux_update_distance_metric for storing which PLS directions can be trusted */
    double *storage;        /**< \brief Pointer to the allocated memory */
-   double *dx;             /**< \brief Used to hold the difference between a normalised input vector and a RF's centre */
+   double *dx;             /**< \brief Used to hold the difference between a normalised input vector and a RF's centre, or M times that difference during predictions */
    double *dwdM;           /**< \brief Derivatives of the weight w with respect to LWPR_ReceptiveField.M */
    double *dJ2dM;          /**< \brief Derivatives of the cost J2 with respect to M */
    double *ddwdMdM;        /**< \brief 2nd derivatives of w wrt. M */
@@ -61,6 +61,10 @@ typedef struct LWPR_Workspace {
    double *sum_ydwdx_wdydx;/**< \brief Intermediate results used within lwpr_aux_predict_one_J */
    double *sum_ddwdxdx;    /**< \brief Intermediate results used within lwpr_aux_predict_one_gH */
    double *sum_ddRdxdx;    /**< \brief Intermediate results used within lwpr_aux_predict_one_gH */   
+   double *sum_out;        /**< \brief Per-output sums of predictions and activations (2*nOut), see lwpr_aux_update_shared */
+   double *metric_derivs;  /**< \brief Per-output derivatives for the shared distance metric update (4*nOut), see lwpr_aux_update_shared */
+   double *vn;             /**< \brief Direction of lwpr_predict_Jv and lwpr_predict_Hv in normalised coordinates */
+   double *inv_norm;       /**< \brief Reciprocals of LWPR_Model.norm_in, used within lwpr_predict_JH and lwpr_predict_JHp */
 } LWPR_Workspace;
 
 
@@ -81,27 +85,35 @@ typedef struct {
    int end;                /**< \brief Upper bound for RF index this thread should handle */
    int ind_max;            /**< \brief Index of RF with largest activation */
    int ind_sec;            /**< \brief Index of RF with second largest activation */
+   int topk;               /**< \brief Number of RFs whose local models are evaluated (see lwpr_aux_predict_topk_one_T) */
+   double dropped;         /**< \brief Fraction of the activation of trustworthy RFs that was left out (see lwpr_aux_predict_topk_one_T) */
+   const double *v;        /**< \brief Normalised direction vector for directional derivatives (Nx1, see lwpr_aux_predict_one_Jv_T) */
+   double dydv;            /**< \brief Derivative of yn along v */
+   const double *yv;       /**< \brief Normalised output vector (Mx1), for shared-geometry updates */
+   double *dw;             /**< \brief If not NULL, updates only compute activations, and store dw/dq and d2w/dq2 of the active RFs here (2 per RF, see lwpr_aux_update_one) */
+   int grown;              /**< \brief Set if the PLS storage of an updated RF was enlarged, so LWPR_Model.max_bytes must be checked again */
+   const int *active;      /**< \brief Indices of the active RFs this thread should update in the second phase of a two-phase update */
+   int numActive;          /**< \brief Number of elements of active */
 } LWPR_ThreadData;  
 
 /** \brief Computes the derivates of the activation w and a penalty term with
             respect to M, Cholesky factors of the distance metric 
    \param[in] nIn       Number of input dimensions
-   \param[in] nInS      Offset between columns in matrices (stride)
-   \param[out] dwdM     Derivative of w with respect to M (nIn x nIn)
-   \param[out] dJ2dM    Derivative of penalty term J2 to M (nIn x nIn)
-   \param[out] ddwdMdM  2nd derivative of w with respect to M (nIn x nIn)
-   \param[out] ddJ2dMdM 2nd derivative of J2 with respect to M (nIn x nIn)
+   \param[out] dwdM     Derivative of w with respect to M (nIn x nIn, upper triangle packed)
+   \param[out] dJ2dM    Derivative of penalty term J2 to M (nIn x nIn, upper triangle packed)
+   \param[out] ddwdMdM  2nd derivative of w with respect to M (nIn x nIn, upper triangle packed)
+   \param[out] ddJ2dMdM 2nd derivative of J2 with respect to M (nIn x nIn, upper triangle packed)
    \param[in] w         Activation of receptive field
    \param[in] dwdq      Derivative of w with respect to squared distance (~ outer derivate of the kernel)
    \param[in] ddwdqdq   2nd derivative of w with respect to squared distance 
-   \param[in] RF_D      The receptive field's distance metric (nIn x nIn)
-   \param[in] RF_M      The Cholesky factorisation of RF_M (nIn x nIn)
+   \param[in] RF_D      The receptive field's distance metric (nIn x nIn, upper triangle packed)
+   \param[in] RF_M      The Cholesky factorisation of RF_M (nIn x nIn, upper triangle packed)
    \param[in] dx        The difference between the normalised input x and the receptive fields centre c (nIn x 1)
    \param[in] diag_only Flag that determines whether the distance metric is to be treated as diagonal
    \param[in] penalty   Pre-factor involved in computation of J2
    \param[in] meta      Flag that determines whether 2nd derivatives should be computed
 */              
-void lwpr_aux_dist_derivatives(int nIn,int nInS, 
+void lwpr_aux_dist_derivatives(int nIn,
          double *dwdM, double *dJ2dM, double *ddwdMdM, double *ddJ2dMdM, 
          double w, double dwdq, double ddwdqdq, 
          const double *RF_D, const double *RF_M, const double *dx,
@@ -122,6 +134,42 @@ double lwpr_aux_update_distance_metric(LWPR_ReceptiveField *RF,
       double w, double dwdq, double ddwdqdq, 
       double e_cv, double e, const double *xn, LWPR_Workspace *ws);
 
+/** \brief Computes the squared distance of an input from a receptive field's centre
+   \param[in] RF    Pointer to the receptive field
+   \param[in] xc    Difference between the normalised input vector and the RF's centre (nIn)
+   \return          The squared distance xc'*D*xc
+   
+   For full distance metrics, this is evaluated as ||M*xc||^2 using the Cholesky factor M,
+   so RF.D is only read if LWPR_Model.diag_only is set.
+*/   
+double lwpr_aux_rf_dist(const LWPR_ReceptiveField *RF, const double *xc);
+
+/** \brief Computes the squared distance of an input from a receptive field's centre, and D*xc
+   \param[in] RF    Pointer to the receptive field
+   \param[in] xc    Difference between the normalised input vector and the RF's centre (nIn)
+   \param[out] Dx   Receives D*xc (nIn)
+   \param[out] Mx   Receives M*xc for full distance metrics, untouched otherwise (nIn)
+   \return          The squared distance xc'*D*xc
+*/   
+double lwpr_aux_rf_dist_Dx(const LWPR_ReceptiveField *RF, const double *xc, double *Dx, double *Mx);
+
+/** \brief Computes the squared distance beyond which the activation of a receptive field
+      is known to be below a threshold
+   \param[in] kernel  Kernel identifier (see LWPR_Model.kernel)
+   \param[in] custom  Registry entry of the kernel (see lwpr_kernel_info), may be NULL
+   \param[in] wmin    Activation threshold
+   \return            Squared distance, or HUGE_VAL if no such bound is known
+*/
+double lwpr_aux_qmax(int kernel, const LWPR_KernelInfo *custom, double wmin);
+
+/** \brief Computes the (normalised) output of the local model of a receptive field
+   \param[in] RF    Pointer to the receptive field
+   \param[in] xn    Normalised input vector (nIn)
+   \param[in] WS    Workspace for intermediate results
+   \return          beta0 + slope'*(xn-mean_x) if the slope is cached, the PLS prediction otherwise
+*/
+double lwpr_aux_predict_rf(const LWPR_ReceptiveField *RF, const double *xn, LWPR_Workspace *WS);
+
 /** \brief Performs an update of the receptive field's statistics (weighted mean input and output)
    \param[in,out] RF    Pointer to the receptive field
    \param[in] x         Normalised input vector (nIn)
@@ -177,6 +225,16 @@ void lwpr_aux_compute_projection_d(int nIn, int nInS, int nReg,
       double *s, double *dsdx, const double *x, 
       const double *U, const double *P, LWPR_Workspace *ws);      
 
+/** \brief Computes the slope of the local linear model of a receptive field
+   \param[in,out] RF    Pointer to the receptive field. On return, RF->slope is filled
+                        and RF->slopeReady is set.
+   
+   As in the prediction routines, the last PLS direction is ignored if it has
+   not seen enough data yet. The slope is accumulated backwards over the PLS 
+   directions, so no workspace is needed.
+*/
+void lwpr_aux_compute_slope(LWPR_ReceptiveField *RF);
+
 /** \brief Performs an update on the regression parameters of one receptive field
    \param[in,out] RF    Pointer to the receptive field
    \param[out] yp       Predicted output of the receptive field AFTER the update
@@ -198,6 +256,29 @@ void lwpr_aux_update_regression(LWPR_ReceptiveField *RF, double *yp,
 */
 LWPR_ReceptiveField *lwpr_aux_add_rf(LWPR_SubModel *sub, int nReg);
 
+/** \brief Removes a receptive field from the specified LWPR_SubModel and disposes its memory.
+   The gap in the array of receptive fields is filled with the last one.
+   \param[in,out] sub   LWPR_SubModel specific to one output dimension
+   \param[in]     ind   Index of the receptive field to be removed
+*/
+void lwpr_aux_remove_rf(LWPR_SubModel *sub, int ind);
+
+/** \brief Checks whether another receptive field can be added to a submodel without
+   exceeding LWPR_Model.max_rfs or LWPR_Model.max_bytes, and evicts receptive fields
+   according to LWPR_Model.evict if necessary.
+   \param[in]     model      Pointer to the LWPR model
+   \param[in,out] sub        LWPR_SubModel specific to one output dimension
+   \param[in]     keep       Receptive field that must not be evicted (e.g. a template), may be NULL
+   \param[in]     nRegStore  Storage size of the PLS variables of the new receptive field,
+                             or 0 to only bring the submodel back within its budget after
+                             receptive fields have grown (see lwpr_aux_check_add_projection)
+   \return
+      - 1 if there is room for another receptive field
+      - 0 if the budget is exhausted and no receptive field could be evicted
+*/
+int lwpr_aux_make_room(LWPR_Model *model, LWPR_SubModel *sub, 
+      const LWPR_ReceptiveField *keep, int nRegStore);
+
 /** \brief Check if a receptive field needs another PLS regression axis,
    and modify the relevant variables.
    \param[in,out] RF    Pointer to the receptive field
@@ -232,6 +313,9 @@ int lwpr_aux_init_rf(LWPR_ReceptiveField *RF, const LWPR_Model *model,
    \return
       - 1 in case of success
       - 0 if a receptive field would have to be added, but memory allocation failed
+      
+   With NUM_THREADS > 1, the threads first compute all activations, and then the active 
+   receptive fields are distributed among the threads according to their estimated cost.
 */      
 int lwpr_aux_update_one(LWPR_Model *model, int dim, const double *xn, 
       double yn, double *y_pred, double *max_w);
@@ -255,7 +339,95 @@ void *lwpr_aux_update_one_T(void *ptr);
 */      
 int lwpr_aux_update_one_add_prune(LWPR_Model *model, LWPR_ThreadData *TD, 
       int dim, const double *xn, double yn);   
+
+/** \brief Computes the Morton (Z-order) of the receptive field centres of a submodel
+   \param[in] sub     Pointer to a valid LWPR submodel structure
+   \param[out] order  Indices of the receptive fields in Morton order (numRFS)
+   \return
+      - 1 in case of success
+      - 0 if temporary memory could not be allocated
+   
+   Each coordinate is quantised to 16 bits within the bounding box of all centres. The codes
+   are not interleaved explicitly, but compared along the dimension with the most significant
+   differing bit, so any number of input dimensions can be handled.
+   \sa lwpr_reorder_rfs
+*/
+int lwpr_aux_morton_order(const LWPR_SubModel *sub, int *order);
+
+/** \brief Checks whether updates and predictions can use the shared receptive field geometry
+   of all output dimensions (see LWPR_Model.shared_geometry)
+   \param[in] model  Pointer to the LWPR model
+   \return 1 if the flag is set and all submodels hold the same number of receptive fields,
+           and 0 otherwise
+*/
+int lwpr_aux_shared_geometry(const LWPR_Model *model);
+
+/** \brief Makes the receptive fields of all submodels use the centres and distance metrics
+   (including learning rates and meta-learning state) of the first submodel
+   \param[in,out] model Pointer to the LWPR model, whose submodels must hold the same number of receptive fields
+   
+   The other receptive fields keep their own storage for these variables, which is not used
+   until lwpr_aux_unlink_geometry copies the shared values back. Stripped models are left alone.
+   \sa LWPR_Model.shared_geometry
+*/
+void lwpr_aux_link_geometry(LWPR_Model *model);
+
+/** \brief Gives the receptive fields of all submodels their own copies of the centres and
+   distance metrics that lwpr_aux_link_geometry made them share
+   \param[in,out] model Pointer to the LWPR model
+*/
+void lwpr_aux_unlink_geometry(LWPR_Model *model);
+
+/** \brief Updates the receptive fields of all output dimensions, which share their centres
+   and distance metrics (see LWPR_Model.shared_geometry)
+   \param[in,out] model Pointer to the LWPR model
+   \param[in]  xn       Normalised input vector (nIn)
+   \param[in]  yn       Normalised output vector (nOut)
+   \param[out] y_pred   Predictions for yn after update (nOut, normalised). May be NULL.
+   \param[out] max_w    Maximum activation over all receptive fields (nOut, all equal). May be NULL.
+   \return
+      - 1 in case of success
+      - 0 if receptive fields would have to be added, but memory allocation failed
+   
+   Each activation is computed once for all outputs. The receptive fields with index n in all
+   submodels form one unit that is created, pruned and evicted as a whole, so that the
+   submodels stay aligned. They share one centre and distance metric (see lwpr_aux_link_geometry),
+   which is updated once per call from the derivatives of all outputs, averaged with weights
+   proportional to their transient multipliers.
+*/      
+int lwpr_aux_update_shared(LWPR_Model *model, const double *xn, const double *yn, 
+      double *y_pred, double *max_w);
+
+/** \brief Thread function for updating a subset of receptive fields of all output dimensions
+   \param[in] ptr    Pointer to an LWPR_ThreadData structure, with \e yv pointing to the normalised output vector
+   \return NULL
+   
+   Per-output sums of predictions and activations are returned in \e sum_out of the workspace.
+*/
+void *lwpr_aux_update_shared_T(void *ptr);      
       
+/** \brief Computes the predictions of an LWPR model with shared receptive field geometry
+      for all output dimensions (see LWPR_Model.shared_geometry)
+   \param[in] model  Must point to a valid LWPR_Model structure
+   \param[in] ws     Workspace to use, or NULL for using the model's workspaces with 
+                     LWPR_NUM_THREADS threads, which then split up the receptive fields
+   \param[in] xn     Normalised input vector (nIn)
+   \param[in] cutoff A threshold parameter. Receptive fields with activation below the cutoff are ignored
+   \param[out] yn    Normalised predictions (nOut)
+   \param[out] max_w Maximum activation per output dimension (nOut, all equal). May be NULL.
+*/
+void lwpr_aux_predict_shared(const LWPR_Model *model, LWPR_Workspace *ws, const double *xn,
+      double cutoff, double *yn, double *max_w);
+
+/** \brief Thread function for predicting all output dimensions from a subset of receptive fields
+   \param[in] ptr    Pointer to an LWPR_ThreadData structure
+   \return NULL
+   
+   Per-output sums of predictions and activations are returned in \e sum_out of the workspace,
+   and the largest activation in \e w_max.
+*/
+void *lwpr_aux_predict_shared_T(void *ptr);
+
 /** \brief Computes the prediction of an LWPR model for a specific output dimension.
       Can also return confidence bounds and the maximal activation of all receptive fields.
    \param[in] model  Must point to a valid LWPR_Model structure
@@ -308,6 +480,27 @@ void *lwpr_aux_predict_one_T(void *ptr);
 */      
 void *lwpr_aux_predict_conf_one_T(void *ptr);
 
+/** \brief Computes the prediction of an LWPR model for a specific output dimension,
+            using only the receptive fields with the largest activations.
+   \param[in,out] ptr    Pointer to an LWPR_ThreadData structure      
+   \return NULL   
+   
+   You must set the following fields of the LWPR_ThreadData structure that \e ptr points to:
+   - \e model  Must point to a valid LWPR_Model structure
+   - \e dim    Specific output dimension to handle   
+   - \e xn     Input vector, must point to an array of model->nIn doubles
+   - \e cutoff A threshold parameter. Receptive fields with activation below the cutoff are ignored
+   - \e topk   Number of trustworthy receptive fields (0 to LWPR_MAX_TOPK) whose 
+               local models are evaluated
+   
+   On return, you may read the following fields:
+   - \e yn     Prediction of the LWPR model along dimension dim (not yet normalised)
+   - \e w_max  Maximum activation per output dimension.
+   - \e dropped Fraction of the activation of all trustworthy receptive fields above the 
+               cutoff that belongs to receptive fields which were left out
+*/      
+void *lwpr_aux_predict_topk_one_T(void *ptr);
+
 
 /** \brief Computes the prediction of an LWPR model for a specific output dimension,
       and also the gradient of that prediction with respect to the input vector.
@@ -414,10 +607,50 @@ void *lwpr_aux_predict_one_JcJ_T(void *ptr);
    On return, you may read the following fields:
    - \e yn       Prediction of the LWPR model along dimension dim (not yet normalised)
    - \e sum_dwdx (within LWPR_Workspace pointed to by LWPR_ThreadData) Gradient of \e yn w.r.t. \e xn
-   - \e sum_ddwdxdx (within LWPR_Workspace pointed to by LWPR_ThreadData) Hessian of \e yn w.r.t. \e xn   
+   - \e sum_ddwdxdx (within LWPR_Workspace pointed to by LWPR_ThreadData) Hessian of \e yn w.r.t. \e xn,
+     as its upper triangle in packed storage (see LWPR_TRI)
+   
+   Since the Hessian is symmetric, only one triangle is accumulated, using
+   lwpr_math_symp_rank1() and lwpr_math_symp_rank2().
 */      
 void *lwpr_aux_predict_one_gH_T(void *ptr);
 
+/** \brief Thread function for predicting output and its derivative along a direction for one SubModel
+   \param[in,out] ptr    Pointer to an LWPR_ThreadData structure
+   \return NULL
+      
+   You must set the following fields of the LWPR_ThreadData structure that \e ptr points to:
+   - \e model  Must point to a valid LWPR_Model structure
+   - \e dim    Specific output dimension to handle   
+   - \e xn     Input vector, must point to an array of model->nIn doubles
+   - \e v      Direction vector, must point to an array of model->nIn doubles
+   - \e cutoff A threshold parameter. Receptive fields with activation below the cutoff are ignored
+   
+   On return, you may read the following fields:
+   - \e yn     Prediction of the LWPR model along dimension dim (not yet normalised)
+   - \e dydv   Derivative of \e yn along \e v, i.e. the gradient times \e v
+   
+   Only scalars are accumulated, so no gradient vector is formed.
+*/      
+void *lwpr_aux_predict_one_Jv_T(void *ptr);
+
+/** \brief Thread function for predicting output, gradient, and the Hessian times a vector for one SubModel
+   \param[in,out] ptr    Pointer to an LWPR_ThreadData structure
+   \return NULL
+      
+   You must set the same fields as for lwpr_aux_predict_one_Jv_T().
+   
+   On return, you may read the following fields:
+   - \e yn     Prediction of the LWPR model along dimension dim (not yet normalised)
+   - \e dydv   Derivative of \e yn along \e v
+   - \e sum_dwdx (within LWPR_Workspace pointed to by LWPR_ThreadData) Gradient of \e yn w.r.t. \e xn
+   - \e sum_ddwdxdx (within LWPR_Workspace pointed to by LWPR_ThreadData) Hessian of \e yn w.r.t. \e xn
+     times \e v, in its first model->nIn elements
+     
+   The Hessian is never formed, every receptive field only contributes a few vectors.
+*/      
+void *lwpr_aux_predict_one_Hv_T(void *ptr);
+
 
 /** \brief Updates the global model statistics, i.e. the mean and variance of the
       input training data, and also the number of data points.
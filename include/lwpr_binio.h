@@ -38,7 +38,9 @@ Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
    <TR><TD>nIn                </TD><TD>1 integer </TD></TR>
    <TR><TD>nIn                </TD><TD>1 integer </TD></TR>
    <TR><TD>nOut               </TD><TD>1 integer </TD></TR>
-   <TR><TD>kernel             </TD><TD>1 integer </TD></TR>
+   <TR><TD>kernel             </TD><TD>1 integer (0 = Gaussian, 1 = BiSquare, -1 = registered kernel)</TD></TR>
+   <TR><TD>length of the kernel name (only for registered kernels)</TD><TD>1 integer </TD></TR>
+   <TR><TD>name of the kernel (only for registered kernels)</TD><TD>nr. of bytes as determined by previous integer </TD></TR>
    <TR><TD>length of 'name' string (may be 0)</TD><TD>integer </TD></TR>
    <TR><TD>name of the model  </TD><TD>nr. of bytes as determined by previous integer </TD></TR>
    <TR><TD>n_data             </TD><TD>1 integer </TD></TR>
@@ -103,6 +105,30 @@ Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
    <TR><TD>w            </TD><TD>1 double</TD></TR>
    <TR><TD>s            </TD><TD>nReg doubles</TD></TR>
    </TABLE>   
+   Models that have been stripped by lwpr_strip_for_inference() are written with 
+   BINIO version -2. The header and submodel entries are the same, but each
+   LWPR_ReceptiveField only contains what is needed for predictions:
+   <TABLE>
+   <TR><TH>Element description</TH><TH>Size of element</TH></TR>
+   <TR><TD>"[RF]"       </TD><TD>4 bytes</TD></TR>
+   <TR><TD>nReg         </TD><TD>1 integer</TD></TR>
+   <TR><TD>D (if diag_only), M otherwise</TD><TD>1 nIn*nIn doubles</TD></TR>
+   <TR><TD>beta0        </TD><TD>1 double</TD></TR>
+   <TR><TD>beta         </TD><TD>nReg doubles</TD></TR>
+   <TR><TD>c            </TD><TD>nIn doubles</TD></TR>
+   <TR><TD>SSs2         </TD><TD>nReg doubles</TD></TR>
+   <TR><TD>U            </TD><TD>nIn*nReg doubles</TD></TR>
+   <TR><TD>P            </TD><TD>nIn*nReg doubles</TD></TR>
+   <TR><TD>sum_w        </TD><TD>nReg doubles</TD></TR>
+   <TR><TD>sum_e_cv2    </TD><TD>nReg doubles</TD></TR>
+   <TR><TD>SSp          </TD><TD>1 double</TD></TR>
+   <TR><TD>n_data       </TD><TD>nReg doubles</TD></TR>
+   <TR><TD>trustworthy  </TD><TD>1 integer</TD></TR>
+   <TR><TD>mean_x       </TD><TD>nIn doubles</TD></TR>
+   <TR><TD>slope        </TD><TD>nIn doubles</TD></TR>
+   </TABLE>   
+   Reading such a file yields a model with LWPR_Model.inference_only set.
+   
    As a last sanity check, the file ends with the 4 characters "RPWL". The overall
    structure of a binary LWPR file looks like this:
    
@@ -125,6 +151,19 @@ Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
 extern "C" {
 #endif
 
+/** \brief Destination or source of binary IO: either an opened file, or a memory buffer.
+
+   If LWPR_Stream.fp is not NULL, the file is used. Otherwise, bytes are copied to or from
+   LWPR_Stream.buf. When writing with neither a file nor a buffer, only LWPR_Stream.pos
+   is advanced, which is used to determine the size of a model in binary format.
+*/
+typedef struct {
+   FILE *fp;      /**< \brief File descriptor, or NULL for memory streams */
+   char *buf;     /**< \brief Memory buffer (only read from when reading) */
+   size_t size;   /**< \brief Size of the memory buffer in bytes */
+   size_t pos;    /**< \brief Current read/write position within the memory buffer */
+} LWPR_Stream;
+
 /** \brief Writes an LWPR model to a file 
    \param[in] model    Pointer to a valid LWPR model structure
    \param[in] filename The name of the file
@@ -168,8 +207,59 @@ int lwpr_write_binary_fp(const LWPR_Model *model, FILE *fp);
 int lwpr_read_binary_fp(LWPR_Model *model, FILE *fp);
 
 
-/** \brief Writes a matrix of doubles into a binary file
-   \param[in] fp       File descriptor
+/** \brief Returns the number of bytes needed to store an LWPR model in binary format
+   \param[in] model    Pointer to a valid LWPR model structure
+   \return
+      - the size of the binary representation in bytes, as written by lwpr_write_binary()
+        or lwpr_write_binary_mem()
+      - 0 if errors have occured
+   \ingroup LWPR_C    
+*/
+size_t lwpr_binary_size(const LWPR_Model *model);
+
+/** \brief Writes an LWPR model into a memory buffer in binary format
+   \param[in] model    Pointer to a valid LWPR model structure
+   \param[out] buf     Buffer of at least <em>size</em> bytes
+   \param[in] size     Size of the buffer, use lwpr_binary_size() to determine the required number of bytes
+   \return
+      - 0 if errors have occured or the buffer is too small
+      - 1 on success
+   \ingroup LWPR_C    
+*/
+int lwpr_write_binary_mem(const LWPR_Model *model, char *buf, size_t size);
+
+/** \brief Reads an LWPR model from a memory buffer in binary format
+   \param[in,out] model Pointer to a valid LWPR model structure
+   \param[in] buf       Buffer as filled by lwpr_write_binary_mem(), or the contents of a binary file
+   \param[in] size      Number of valid bytes in the buffer
+   \return
+      - 0 if errors have occured
+      - 1 on success
+   \ingroup LWPR_C    
+*/
+int lwpr_read_binary_mem(LWPR_Model *model, const char *buf, size_t size);
+
+/** \brief Writes raw bytes into a binary stream
+   \param[in] s        Binary stream
+   \param[in] data     Pointer to the bytes
+   \param[in] n        Number of bytes
+   \return
+      - 0 if errors have occured
+      - 1 on success
+*/
+int lwpr_io_write_bytes(LWPR_Stream *s, const void *data, size_t n);
+
+/** \brief Reads raw bytes from a binary stream, see lwpr_io_write_bytes() */
+int lwpr_io_read_bytes(LWPR_Stream *s, void *data, size_t n);
+
+/** \brief Writes a complete LWPR model into a binary stream (used by lwpr_write_binary_fp() and lwpr_write_binary_mem()) */
+int lwpr_io_write_model(LWPR_Stream *s, const LWPR_Model *model);
+
+/** \brief Reads a complete LWPR model from a binary stream (used by lwpr_read_binary_fp() and lwpr_read_binary_mem()) */
+int lwpr_io_read_model(LWPR_Stream *s, LWPR_Model *model);
+
+/** \brief Writes a matrix of doubles into a binary stream
+   \param[in] s        Binary stream
    \param[in] M        Number of rows
    \param[in] Ms       Stride parameter (offset between columns)
    \param[in] N        Number of columns
@@ -178,10 +268,10 @@ int lwpr_read_binary_fp(LWPR_Model *model, FILE *fp);
       - 0 if errors have occured
       - 1 on success
 */
-int lwpr_io_write_matrix(FILE *fp,int M, int Ms, int N, const double *data);
+int lwpr_io_write_matrix(LWPR_Stream *s, int M, int Ms, int N, const double *data);
 
-/** \brief Reads a matrix of doubles from a binary file
-   \param[in] fp       File descriptor
+/** \brief Reads a matrix of doubles from a binary stream
+   \param[in] s        Binary stream
    \param[in] M        Number of rows
    \param[in] Ms       Stride parameter (offset between columns)
    \param[in] N        Number of columns
@@ -190,82 +280,113 @@ int lwpr_io_write_matrix(FILE *fp,int M, int Ms, int N, const double *data);
       - 0 if errors have occured
       - 1 on success
 */
-int lwpr_io_read_matrix(FILE *fp, int M, int Ms, int N, double *data);
+int lwpr_io_read_matrix(LWPR_Stream *s, int M, int Ms, int N, double *data);
 
-/** \brief Writes a vector of doubles into a binary file
-   \param[in] fp       File descriptor
+/** \brief Writes a packed triangular matrix into a binary stream as a full (dense) matrix
+   \param[in] s        Binary stream
+   \param[in] N         Number of rows and columns
+   \param[in] data      Pointer to the packed upper triangle (see LWPR_TRI)
+   \param[in] symmetric If non-zero, the lower triangle is written as the mirror image of the
+                        upper triangle, otherwise as zeros
+   \return
+      - 0 if errors have occured
+      - 1 on success
+*/
+int lwpr_io_write_tri(LWPR_Stream *s, int N, const double *data, int symmetric);
+
+/** \brief Reads a full (dense) matrix from a binary stream, keeping only its packed upper triangle
+   \param[in] s        Binary stream
+   \param[in] N        Number of rows and columns
+   \param[out] data    Pointer to the packed upper triangle (see LWPR_TRI)
+   \return
+      - 0 if errors have occured
+      - 1 on success
+*/
+int lwpr_io_read_tri(LWPR_Stream *s, int N, double *data);
+
+/** \brief Writes a vector of doubles into a binary stream
+   \param[in] s        Binary stream
    \param[in] N        Number of elements
    \param[in] data     Pointer to vector elements
    \return
       - 0 if errors have occured
       - 1 on success
 */
-int lwpr_io_write_vector(FILE *fp, int N, const double *data);
+int lwpr_io_write_vector(LWPR_Stream *s, int N, const double *data);
 
-/** \brief Reads a vector of doubles from a binary file
-   \param[in] fp       File descriptor
+/** \brief Reads a vector of doubles from a binary stream
+   \param[in] s        Binary stream
    \param[in] N        Number of elements
    \param[out] data     Pointer to vector elements
    \return
       - 0 if errors have occured
       - 1 on success
 */
-int lwpr_io_read_vector(FILE *fp, int N, double *data);
+int lwpr_io_read_vector(LWPR_Stream *s, int N, double *data);
 
-/** \brief Writes a scalar (double) into a binary file
-   \param[in] fp       File descriptor
+/** \brief Writes a scalar (double) into a binary stream
+   \param[in] s        Binary stream
    \param[in] data     Scalar value
    \return
       - 0 if errors have occured
       - 1 on success
 */
-int lwpr_io_write_scalar(FILE *fp, double data);
+int lwpr_io_write_scalar(LWPR_Stream *s, double data);
 
-/** \brief Reads a scalar (double) from a binary file
-   \param[in] fp       File descriptor
+/** \brief Reads a scalar (double) from a binary stream
+   \param[in] s        Binary stream
    \param[out] data    Pointer to scalar value
    \return
       - 0 if errors have occured
       - 1 on success
 */
-int lwpr_io_read_scalar(FILE *fp, double *data);
+int lwpr_io_read_scalar(LWPR_Stream *s, double *data);
 
-/** \brief Writes an integer into a binary file
-   \param[in] fp       File descriptor
+/** \brief Writes an integer into a binary stream
+   \param[in] s        Binary stream
    \param[in] data     Integer value
    \return
       - 0 if errors have occured
       - 1 on success
 */
-int lwpr_io_write_int(FILE *fp, int data);
+int lwpr_io_write_int(LWPR_Stream *s, int data);
 
-/** \brief Reads an integer from a binary file
-   \param[in] fp      File descriptor
+/** \brief Reads an integer from a binary stream
+   \param[in] s        Binary stream
    \param[out] data    Pointer to integer
    \return
       - 0 if errors have occured
       - 1 on success
 */
-int lwpr_io_read_int(FILE *fp, int *data);
+int lwpr_io_read_int(LWPR_Stream *s, int *data);
 
-/** \brief Writes a receptive field structure into a binary file
-   \param[in] fp     File descriptor
+/** \brief Writes a receptive field structure into a binary stream
+   \param[in] s        Binary stream
    \param[in] RF     Pointer to a receptive field structure
    \return
       - 0 if errors have occured
       - 1 on success
 */
-int lwpr_io_write_rf(FILE *fp, const LWPR_ReceptiveField *RF);
+int lwpr_io_write_rf(LWPR_Stream *s, const LWPR_ReceptiveField *RF);
+
+/** \brief Writes the prediction-relevant part of a receptive field structure into a binary stream
+   \param[in] s        Binary stream
+   \param[in] RF     Pointer to a receptive field structure of a stripped model (see lwpr_strip_for_inference)
+   \return
+      - 0 if errors have occured
+      - 1 on success
+*/
+int lwpr_io_write_rf_slim(LWPR_Stream *s, const LWPR_ReceptiveField *RF);
 
-/** \brief Reads a receptive field structure from a binary file
-   \param[in] fp      File descriptor
+/** \brief Reads a receptive field structure from a binary stream
+   \param[in] s        Binary stream
    \param[in,out] sub Pointer to the current LWPR_SubModel, to which a new LWPR_ReceptiveField structure
-                      will be added.
+                      will be added. If LWPR_Model.inference_only is set, the slim format is expected.
    \return
       - 0 if errors have occured
       - 1 on success
 */
-int lwpr_io_read_rf(FILE *fp, LWPR_SubModel *sub);
+int lwpr_io_read_rf(LWPR_Stream *s, LWPR_SubModel *sub);
 
 
 #ifdef __cplusplus
@@ -0,0 +1,126 @@
+/*********************************************************************
+LWPR: A library for incremental online learning
+Copyright (C) 2007  Stefan Klanke, Sethu Vijayakumar
+Contact: sethu.vijayakumar@ed.ac.uk
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Library General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free
+Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*********************************************************************/
+
+/** \file lwpr_cursor.h
+   \brief Stateful predictions for sequences of nearby input vectors
+
+   An LWPR_QueryCursor speeds up predictions along smooth trajectories. At an
+   anchor point x0, it scans all receptive fields and stores for each one a radius
+   around x0 within which the receptive field cannot become active. This follows
+   from the triangle inequality of the distance \f$\|\mathbf{M}(\mathbf{x-c})\|\f$
+   and an upper bound on the norm of \f$\mathbf{M}\f$. The receptive fields are
+   sorted by their radii, so a later query at x only has to look at the receptive
+   fields whose radius is below |x - x0|. These include all active ones, which
+   makes the predictions equal to those of lwpr_predict() up to rounding.
+
+   A new anchor is set (with a full scan) if the model was updated in the meantime,
+   after LWPR_QueryCursor.max_steps queries, or if more than half of the receptive
+   fields would have to be checked. Since the cursor refers to receptive fields by
+   their index, lwpr_cursor_reset() must be called after lwpr_reorder_rfs().
+   \ingroup LWPR_C
+*/
+
+#ifndef __LWPR_CURSOR_H
+#define __LWPR_CURSOR_H
+
+#include <lwpr.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \brief Radius around the anchor point within which a receptive field is inactive
+   \ingroup LWPR_C
+*/
+typedef struct {
+   double radius;    /**< \brief Radius in normalised input space. Receptive fields that are active at the anchor point have negative radii. */
+   int index;        /**< \brief Index of the receptive field within its submodel */
+} LWPR_CursorEntry;
+
+/** \brief Receptive fields of one output dimension, sorted by their radii
+   \ingroup LWPR_C
+*/
+typedef struct {
+   int numRFS;       /**< \brief Number of receptive fields at the time of the last full scan */
+   int capacity;     /**< \brief Number of entries that can be stored */
+   LWPR_CursorEntry *entry;   /**< \brief Entries in ascending order of their radii */
+} LWPR_CursorSubModel;
+
+/** \brief State for predictions along a trajectory, see lwpr_cursor_init()
+   \ingroup LWPR_C
+*/
+typedef struct {
+   const LWPR_Model *model;   /**< \brief Model the cursor queries */
+   double cutoff;    /**< \brief Threshold parameter, receptive fields with activation below the cutoff are ignored */
+   int max_steps;    /**< \brief Number of queries after which a new anchor is set (default: 100) */
+   int steps;        /**< \brief Number of queries since the last full scan, -1 if there was none */
+   int n_data;       /**< \brief LWPR_Model.n_data at the time of the last full scan */
+   int full_scans;   /**< \brief Number of full scans so far (statistics only) */
+   int queries;      /**< \brief Number of queries so far (statistics only) */
+   double *x0;       /**< \brief Normalised anchor point (nIn) */
+   double *xn;       /**< \brief Used to hold a normalised input vector (nIn) */
+   LWPR_CursorSubModel *sub;  /**< \brief Array of sorted receptive fields, one for each output dimension */
+   struct LWPR_Workspace *ws; /**< \brief Working memory for predictions */
+} LWPR_QueryCursor;
+
+/** \brief Initialises a query cursor for a model
+   \param[out] qc     Pointer to an (uninitialised) LWPR_QueryCursor
+   \param[in] model   Pointer to a valid LWPR_Model, which must stay valid while the cursor is used
+   \param[in] cutoff  Threshold parameter, as in lwpr_predict()
+   \return
+      - 1 in case of success
+      - 0 if memory could not be allocated
+
+   The cursor does not write to the model, so several cursors can be used on the same model
+   from different threads. Each cursor must only be used by one thread at a time.
+   \ingroup LWPR_C
+*/
+LIBRARY_API int lwpr_cursor_init(LWPR_QueryCursor *qc, const LWPR_Model *model, double cutoff);
+
+/** \brief Frees all memory held by an LWPR_QueryCursor
+   \ingroup LWPR_C
+*/
+LIBRARY_API void lwpr_cursor_free(LWPR_QueryCursor *qc);
+
+/** \brief Makes the next query perform a full scan, e.g. after a jump of the trajectory
+   \ingroup LWPR_C
+*/
+LIBRARY_API void lwpr_cursor_reset(LWPR_QueryCursor *qc);
+
+/** \brief Computes the prediction of the model for an input vector close to the previous ones
+   \param[in,out] qc  Pointer to an LWPR_QueryCursor
+   \param[in] x       Input vector, must point to an array of <em>nIn</em> doubles
+   \param[out] y      Output vector, must point to an array of <em>nOut</em> doubles
+   \param[out] max_w  Maximum activation per output dimension. Must be NULL or point to an
+                      array of <em>nOut</em> doubles. Only receptive fields that are checked
+                      contribute, so values below the cutoff may be too small.
+   \return
+      - 1 in case of success
+      - 0 if memory for a full scan could not be allocated (y is still computed, by a
+        full scan without storing the radii)
+   \ingroup LWPR_C
+*/
+LIBRARY_API int lwpr_cursor_predict(LWPR_QueryCursor *qc, const double *x, double *y, double *max_w);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,376 @@
+/*********************************************************************
+LWPR: A library for incremental online learning
+Copyright (C) 2007  Stefan Klanke, Sethu Vijayakumar
+Contact: sethu.vijayakumar@ed.ac.uk
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Library General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free
+Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*********************************************************************/
+
+/** \file lwpr_fixed.hh
+   \brief Header-only C++ predictor for LWPR models with dimensions known at compile time
+   \ingroup LWPR_CPP
+*/
+
+#ifndef __LWPR_FIXED_HH
+#define __LWPR_FIXED_HH
+
+#include <lwpr.hh>
+#include <math.h>
+
+/** \brief Prediction-only snapshot of an LWPR model whose input and output
+   dimensionality are fixed at compile time.
+
+   All receptive field data that predictions depend on (centres, distance metrics,
+   means, slopes and offsets) is copied into fixed-size arrays, so that the loops
+   over the input dimensions have constant trip counts and can be fully unrolled
+   by the compiler. There is no nInStore padding and no PLS projection: predictions
+   always use the slopes of the receptive fields, which are computed while constructing
+   the predictor (see lwpr_finalize_slopes).
+
+   The predictor is an independent copy, so later updates of the model are not
+   reflected. Since prediction does not write to any workspace, the const methods
+   may be called from several threads at the same time.
+
+   \code
+   LWPR_Object model(6, 2);
+   // ... training ...
+   LWPR_FixedPredictor<6,2> fixed(model);
+   double x[6], y[2];
+   fixed.predict(x, y);
+   \endcode
+   \ingroup LWPR_CPP
+*/
+template<int NIN, int NOUT>
+class LWPR_FixedPredictor {
+   public:
+
+   /** \brief Creates a predictor from an LWPR_Model
+      \param model  Model to copy from. Missing slopes of its receptive fields are
+                    computed, otherwise the model is not changed.
+      \exception LWPR_Exception::BAD_INPUT_DIM   if model.nIn does not match NIN
+      \exception LWPR_Exception::BAD_OUTPUT_DIM  if model.nOut does not match NOUT
+      \exception LWPR_Exception::OUT_OF_MEMORY   if the receptive fields cannot be allocated
+   */
+   LWPR_FixedPredictor(LWPR_Model& model) : storage(NULL) {
+      init(model);
+   }
+
+   /** \brief Creates a predictor from the model of an LWPR_Object, see above */
+   LWPR_FixedPredictor(LWPR_Object& obj) : storage(NULL) {
+      init(*obj.model);
+   }
+
+   /** \brief Creates a copy of another predictor */
+   LWPR_FixedPredictor(const LWPR_FixedPredictor& other) : storage(NULL) {
+      storage = allocate(other.numBytes);
+      copyFrom(other);
+   }
+
+   /** \brief Replaces this predictor by a copy of another one. If there is insufficient
+      memory, an OUT_OF_MEMORY exception is thrown and this predictor is left unchanged. */
+   LWPR_FixedPredictor& operator=(const LWPR_FixedPredictor& other) {
+      if (this != &other) {
+         char *s = allocate(other.numBytes);
+         delete[] storage;
+         storage = s;
+         copyFrom(other);
+      }
+      return *this;
+   }
+
+   /** \brief Destroys the predictor */
+   ~LWPR_FixedPredictor() {
+      delete[] storage;
+   }
+
+   /** \brief Computes the prediction of the model
+      \param x       Input vector, must point to NIN doubles
+      \param y       Output vector, must point to NOUT doubles
+      \param cutoff  Threshold parameter (default: 0.001). Receptive fields with
+                     activation below the cutoff are ignored
+      \param max_w   Maximum activation per output dimension. Must be NULL or
+                     point to NOUT doubles
+   */
+   void predict(const double *x, double *y, double cutoff = 0.001, double *max_w = NULL) const {
+      double xn[NIN];
+
+      for (int i=0;i<NIN;i++) xn[i] = x[i]/normIn[i];
+
+      for (int k=0;k<NOUT;k++) {
+         double wm;
+         y[k] = normOut[k] * predictDim(k, xn, cutoff, wm);
+         if (max_w != NULL) max_w[k] = wm;
+      }
+   }
+
+   /** \brief Computes the prediction of the model
+      \param x       Input vector of length NIN
+      \param cutoff  Threshold parameter (default: 0.001)
+      \return        Output vector of length NOUT
+      \exception LWPR_Exception::BAD_INPUT_DIM  if x does not have NIN elements
+   */
+   doubleVec predict(const doubleVec& x, double cutoff = 0.001) const {
+      doubleVec y(NOUT);
+
+      if (x.size() != (unsigned int) NIN) throw LWPR_Exception(LWPR_Exception::BAD_INPUT_DIM);
+      predict(&x[0], &y[0], cutoff);
+      return y;
+   }
+
+   /** \brief Returns the number of receptive fields of output dimension outDim (0-based) */
+   int numRFS(int outDim) const {
+      if (outDim < 0 || outDim >= NOUT) throw LWPR_Exception(LWPR_Exception::OUT_OF_RANGE);
+      return numRF[outDim];
+   }
+
+   private:
+
+   /** \brief How the distance of an input to a receptive field centre is computed */
+   typedef enum {
+      DIAGONAL,      /**< \brief Diagonal of D, stored in the first NIN elements of metric */
+      CHOLESKY,      /**< \brief Upper triangular M with D=M'M, packed (full metrics) */
+      SYMMETRIC      /**< \brief D itself, packed (diag_only models with off-diagonal initial metric) */
+   } MetricType;
+
+   /** \brief How activations are computed from the distance, see predictDimT */
+   typedef enum {
+      GAUSSIAN,      /**< \brief LWPR_GAUSSIAN_KERNEL */
+      BISQUARE,      /**< \brief LWPR_BISQUARE_KERNEL */
+      REGISTERED     /**< \brief Kernel function from lwpr_register_kernel */
+   } KernelType;
+
+   /** \brief Receptive field data in fixed-size arrays */
+   struct RF {
+      double c[NIN];                      /**< \brief Centre */
+      double metric[LWPR_TRI_SIZE(NIN)];  /**< \brief Distance metric, see MetricType */
+      double meanX[NIN];                  /**< \brief Mean of the input data */
+      double slope[NIN];                  /**< \brief Slope of the local linear model */
+      double beta0;                       /**< \brief Offset of the local linear model */
+      bool trustworthy;                   /**< \brief Whether the RF contributes to predictions */
+   };
+
+   /** \brief Alignment of every RF in bytes, suitable for AVX loads */
+   enum { ALIGN = 32 };
+
+   /** \brief Offset between adjacent RFs in bytes, sizeof(RF) rounded up to ALIGN */
+   static size_t rfStride() {
+      return (sizeof(RF) + ALIGN - 1) & ~((size_t) ALIGN - 1);
+   }
+
+   /** \brief Start of the (aligned) receptive field data inside storage */
+   char *rfBlock() const {
+      return (char *) (((size_t) storage + ALIGN - 1) & ~((size_t) ALIGN - 1));
+   }
+
+   /** \brief Receptive field n of output dimension k */
+   RF& getRF(int k, int n) {
+      return *(RF *) (rfBlock() + offset[k] + n*rfStride());
+   }
+
+   /** \brief Copies everything from another predictor, whose storage must fit into ours */
+   void copyFrom(const LWPR_FixedPredictor& other) {
+      kernel = other.kernel;
+      custom = other.custom;
+      metricType = other.metricType;
+      kernelType = other.kernelType;
+      numBytes = other.numBytes;
+      for (int i=0;i<NIN;i++) normIn[i] = other.normIn[i];
+      for (int k=0;k<NOUT;k++) {
+         normOut[k] = other.normOut[k];
+         numRF[k] = other.numRF[k];
+         offset[k] = other.offset[k];
+      }
+      memcpy(rfBlock(), other.rfBlock(), numBytes);
+   }
+
+   /** \brief Allocates storage for n bytes of receptive field data (plus room for the alignment) */
+   static char *allocate(size_t n) {
+      char *s = new (std::nothrow) char[n + ALIGN];
+      if (s == NULL) throw LWPR_Exception(LWPR_Exception::OUT_OF_MEMORY);
+      return s;
+   }
+
+   void init(LWPR_Model& model) {
+      if (model.nIn != NIN) throw LWPR_Exception(LWPR_Exception::BAD_INPUT_DIM);
+      if (model.nOut != NOUT) throw LWPR_Exception(LWPR_Exception::BAD_OUTPUT_DIM);
+
+      lwpr_finalize_slopes(&model);
+
+      kernel = model.kernel;
+      custom = lwpr_kernel_info(kernel);
+      if (kernel == LWPR_GAUSSIAN_KERNEL) {
+         kernelType = GAUSSIAN;
+      } else if (kernel == LWPR_BISQUARE_KERNEL) {
+         kernelType = BISQUARE;
+      } else {
+         kernelType = REGISTERED;
+      }
+      if (!model.diag_only) {
+         metricType = CHOLESKY;
+      } else {
+         metricType = DIAGONAL;
+         for (int k=0;k<NOUT;k++) {
+            for (int n=0;n<model.sub[k].numRFS;n++) {
+               const double *D = model.sub[k].rf[n]->D;
+               for (int j=1;j<NIN;j++) for (int i=0;i<j;i++) {
+                  if (D[LWPR_TRI(i,j)] != 0.0) metricType = SYMMETRIC;
+               }
+            }
+         }
+      }
+
+      numBytes = 0;
+      for (int k=0;k<NOUT;k++) {
+         numRF[k] = model.sub[k].numRFS;
+         offset[k] = numBytes;
+         numBytes += numRF[k]*rfStride();
+      }
+      storage = allocate(numBytes);
+
+      for (int i=0;i<NIN;i++) normIn[i] = model.norm_in[i];
+      for (int k=0;k<NOUT;k++) {
+         const LWPR_SubModel& sub = model.sub[k];
+
+         normOut[k] = model.norm_out[k];
+         for (int n=0;n<sub.numRFS;n++) {
+            const LWPR_ReceptiveField *src = sub.rf[n];
+            RF& dst = getRF(k,n);
+
+            for (int i=0;i<NIN;i++) {
+               dst.c[i] = src->c[i];
+               dst.meanX[i] = src->mean_x[i];
+               dst.slope[i] = src->slope[i];
+            }
+            switch(metricType) {
+               case DIAGONAL:
+                  for (int i=0;i<NIN;i++) dst.metric[i] = src->D[LWPR_TRI(i,i)];
+                  break;
+               case CHOLESKY:
+                  for (int i=0;i<LWPR_TRI_SIZE(NIN);i++) dst.metric[i] = src->M[i];
+                  break;
+               case SYMMETRIC:
+                  for (int i=0;i<LWPR_TRI_SIZE(NIN);i++) dst.metric[i] = src->D[i];
+                  break;
+            }
+            dst.beta0 = src->beta0;
+            dst.trustworthy = (src->trustworthy != 0);
+         }
+      }
+   }
+
+   template<MetricType MT>
+   static double distance(const RF& R, const double *xc) {
+      double dist = 0.0;
+
+      switch(MT) {
+         case DIAGONAL:
+            for (int i=0;i<NIN;i++) dist += R.metric[i]*xc[i]*xc[i];
+            break;
+         case CHOLESKY:
+            /* dist = ||M*xc||^2 */
+            for (int i=0;i<NIN;i++) {
+               double r = 0.0;
+               for (int j=i;j<NIN;j++) r += R.metric[LWPR_TRI(i,j)]*xc[j];
+               dist += r*r;
+            }
+            break;
+         case SYMMETRIC:
+            for (int j=0;j<NIN;j++) {
+               double r = 0.0;
+               for (int i=0;i<j;i++) r += R.metric[LWPR_TRI(i,j)]*xc[i];
+               dist += xc[j]*(2.0*r + R.metric[LWPR_TRI(j,j)]*xc[j]);
+            }
+            break;
+      }
+      return dist;
+   }
+
+   /** \brief Loop over the RFs of output dimension k. Metric and kernel are template
+      parameters, so the switches inside the loop are resolved at compile time */
+   template<MetricType MT, KernelType KT>
+   double predictDimT(int k, const double *xn, double cutoff, double& w_max) const {
+      const char *block = rfBlock() + offset[k];
+      const size_t stride = rfStride();
+      double yp = 0.0, sum_w = 0.0;
+
+      w_max = 0.0;
+      for (int n=0;n<numRF[k];n++) {
+         const RF& R = *(const RF *) (block + n*stride);
+         double xc[NIN];
+         double w;
+
+         for (int i=0;i<NIN;i++) xc[i] = xn[i] - R.c[i];
+         double dist = distance<MT>(R, xc);
+
+         switch(KT) {
+            case GAUSSIAN:
+               w = exp(-0.5*dist);
+               break;
+            case BISQUARE:
+               w = 1-0.25*dist;
+               w = (w<0) ? 0 : w*w;
+               break;
+            default:
+               if (custom == NULL || (custom->support > 0.0 && dist >= custom->support)) {
+                  w = 0.0;
+               } else {
+                  double dwdq, ddwdqdq;
+                  w = custom->func(dist, &dwdq, &ddwdqdq);
+               }
+         }
+         if (w > w_max) w_max = w;
+
+         if (w > cutoff && R.trustworthy) {
+            double yp_n = R.beta0;
+            for (int i=0;i<NIN;i++) yp_n += R.slope[i]*(xn[i] - R.meanX[i]);
+            yp += w*yp_n;
+            sum_w += w;
+         }
+      }
+      if (sum_w > 0.0) yp/=sum_w;
+      return yp;
+   }
+
+   template<MetricType MT>
+   double predictDimM(int k, const double *xn, double cutoff, double& w_max) const {
+      switch(kernelType) {
+         case GAUSSIAN: return predictDimT<MT,GAUSSIAN>(k, xn, cutoff, w_max);
+         case BISQUARE: return predictDimT<MT,BISQUARE>(k, xn, cutoff, w_max);
+         default:       return predictDimT<MT,REGISTERED>(k, xn, cutoff, w_max);
+      }
+   }
+
+   /** \brief Dispatches once per call to the predictDimT instance for the metric and kernel */
+   double predictDim(int k, const double *xn, double cutoff, double& w_max) const {
+      switch(metricType) {
+         case DIAGONAL: return predictDimM<DIAGONAL>(k, xn, cutoff, w_max);
+         case CHOLESKY: return predictDimM<CHOLESKY>(k, xn, cutoff, w_max);
+         default:       return predictDimM<SYMMETRIC>(k, xn, cutoff, w_max);
+      }
+   }
+
+   LWPR_Kernel kernel;        /**< \brief Copy of LWPR_Model.kernel */
+   const LWPR_KernelInfo *custom;   /**< \brief Registered kernel description (see lwpr_register_kernel) */
+   MetricType metricType;     /**< \brief Representation of the distance metrics */
+   KernelType kernelType;     /**< \brief Kind of kernel, derived from kernel */
+   double normIn[NIN];        /**< \brief Copy of LWPR_Model.norm_in */
+   double normOut[NOUT];      /**< \brief Copy of LWPR_Model.norm_out */
+   int numRF[NOUT];           /**< \brief Number of receptive fields of each output dimension */
+   size_t offset[NOUT];       /**< \brief Byte offset of the receptive fields of each output dimension */
+   size_t numBytes;           /**< \brief Size of the receptive field data */
+   char *storage;             /**< \brief Receptive field data, starting at the ALIGN boundary (see rfBlock) */
+};
+
+#endif
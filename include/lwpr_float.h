@@ -0,0 +1,155 @@
+/*********************************************************************
+LWPR: A library for incremental online learning
+Copyright (C) 2007  Stefan Klanke, Sethu Vijayakumar
+Contact: sethu.vijayakumar@ed.ac.uk
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Library General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free
+Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*********************************************************************/
+
+/** \file lwpr_float.h
+   \brief Single precision inference representation of LWPR models
+
+   An LWPR_FloatModel is a read-only snapshot of a trained LWPR_Model that only
+   contains what is needed for predictions, stored in single precision. The receptive
+   fields of each submodel are grouped into blocks of LWPR_FLOAT_LANES, and within
+   a block every quantity is stored lane by lane ("structure of arrays"), so that
+   the inner loops of lwpr_float_predict() run over LWPR_FLOAT_LANES adjacent
+   floats and can be vectorised by the compiler.
+
+   Predictions always use the slopes of the local models (see lwpr_finalize_slopes),
+   so there are no PLS calculations at all. Use lwpr_float_compare() to check the
+   accuracy against the double precision model on representative inputs.
+   \ingroup LWPR_C
+*/
+
+#ifndef __LWPR_FLOAT_H
+#define __LWPR_FLOAT_H
+
+#include <lwpr.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \brief Number of receptive fields that are processed together (SIMD lanes) */
+#ifndef LWPR_FLOAT_LANES
+#define LWPR_FLOAT_LANES   8
+#endif
+
+/** \brief Receptive fields of one output dimension in single precision, stored in
+   blocks of LWPR_FLOAT_LANES. Element <em>i</em> of RF <em>n</em> in, e.g., <em>c</em>
+   is located at c[(n/LWPR_FLOAT_LANES)*nIn*LWPR_FLOAT_LANES + i*LWPR_FLOAT_LANES + n%LWPR_FLOAT_LANES].
+   \ingroup LWPR_C
+*/
+typedef struct {
+   int numRFS;       /**< \brief Number of receptive fields */
+   int numBlocks;    /**< \brief Number of blocks, numRFS rounded up to a multiple of LWPR_FLOAT_LANES */
+   float *c;         /**< \brief Centres (nIn per RF) */
+   float *mean_x;    /**< \brief Means of the input data of each RF (nIn per RF) */
+   float *slope;     /**< \brief Slopes of the local linear models (nIn per RF) */
+   float *metric;    /**< \brief Diagonal of D (nIn per RF) for diag_only models, packed M (LWPR_TRI_SIZE(nIn) per RF) otherwise */
+   float *beta0;     /**< \brief Constant part of the local models (1 per RF) */
+   float *trust;     /**< \brief 1 for trustworthy RFs, 0 for others and for padding lanes (1 per RF) */
+   float *valid;     /**< \brief 1 for actual RFs, 0 for padding lanes (1 per RF) */
+   void *storage;    /**< \brief Pointer to allocated memory. Do not touch. */
+} LWPR_FloatSubModel;
+
+/** \brief Single precision inference representation of an LWPR model, see lwpr_float_init()
+   \ingroup LWPR_C
+*/
+typedef struct {
+   int nIn;          /**< \brief Number of input dimensions */
+   int nOut;         /**< \brief Number of output dimensions */
+   int nMetric;      /**< \brief Number of metric elements per RF (see LWPR_FloatSubModel.metric) */
+   int diag_only;    /**< \brief Copy of LWPR_Model.diag_only */
+   LWPR_Kernel kernel;  /**< \brief Copy of LWPR_Model.kernel */
+   double *norm_in;  /**< \brief Copy of LWPR_Model.norm_in */
+   double *norm_out; /**< \brief Copy of LWPR_Model.norm_out */
+   LWPR_FloatSubModel *sub;   /**< \brief Array of submodels, one for each output dimension */
+   void *storage;    /**< \brief Pointer to allocated memory. Do not touch. */
+} LWPR_FloatModel;
+
+/** \brief Accuracy of an LWPR_FloatModel compared to the LWPR_Model it was built from,
+   see lwpr_float_compare()
+   \ingroup LWPR_C
+*/
+typedef struct {
+   int N;               /**< \brief Number of input vectors that were compared */
+   double max_abs_err;  /**< \brief Largest absolute difference of any output */
+   double rms_err;      /**< \brief Root mean squared difference over all outputs */
+   double max_norm_err; /**< \brief Largest absolute difference divided by LWPR_Model.norm_out */
+   double max_w_err;    /**< \brief Largest absolute difference of the maximal activations */
+} LWPR_FloatAccuracy;
+
+/** \brief Builds a single precision inference representation of an LWPR model
+   \param[out] fm      Pointer to an (uninitialised) LWPR_FloatModel
+   \param[in,out] model Pointer to a valid LWPR_Model. Missing slopes of its
+                       receptive fields are computed (see lwpr_finalize_slopes),
+                       otherwise the model is not changed.
+   \return
+      - 1 in case of success
+      - 0 if memory could not be allocated, or a distance metric is not positive definite
+
+   For models with diag_only, the diagonal of D is stored. If a user-supplied initial
+   distance metric has off-diagonal elements, the Cholesky factors of all D are stored
+   instead, just like for full models. The float model is an independent snapshot: later updates to the model are not reflected.
+   \ingroup LWPR_C
+*/
+LIBRARY_API int lwpr_float_init(LWPR_FloatModel *fm, LWPR_Model *model);
+
+/** \brief Frees all memory held by an LWPR_FloatModel
+   \ingroup LWPR_C
+*/
+LIBRARY_API void lwpr_float_free(LWPR_FloatModel *fm);
+
+/** \brief Computes the prediction of a single precision model
+   \param[in] fm      Pointer to an LWPR_FloatModel
+   \param[in] x       Input vector, must point to an array of <em>nIn</em> doubles
+   \param[in] cutoff  A threshold parameter. Receptive fields with activation below the cutoff are ignored
+   \param[out] y      Output vector, must point to an array of <em>nOut</em> doubles
+   \param[out] max_w  Maximum activation per output dimension. Must be NULL or point to an array of <em>nOut</em> doubles
+
+   \return
+      - 1 in case of success
+      - 0 if working memory could not be allocated (only for models with many inputs)
+
+   Inputs and outputs are double precision, only the receptive field computations are done in floats.
+   The float model is not written to, so it can be used by several threads at the same time.
+   \ingroup LWPR_C
+*/
+LIBRARY_API int lwpr_float_predict(const LWPR_FloatModel *fm, const double *x, double cutoff, double *y, double *max_w);
+
+/** \brief Compares the predictions of a single precision model to the double precision
+   model it was built from, on a given set of input vectors
+   \param[in] model   Pointer to the LWPR_Model the float model was built from
+   \param[in] fm      Pointer to the LWPR_FloatModel
+   \param[in] N       Number of input vectors
+   \param[in] X       Input vectors, stored column by column (<em>nIn</em> x <em>N</em>)
+   \param[in] ldx     Offset between adjacent input vectors (>= nIn)
+   \param[in] cutoff  Threshold parameter passed to both prediction routines
+   \param[out] acc    Accuracy figures
+   \return
+      - 1 in case of success
+      - 0 if the models do not match in their dimensions, or memory could not be allocated
+   \ingroup LWPR_C
+*/
+LIBRARY_API int lwpr_float_compare(const LWPR_Model *model, const LWPR_FloatModel *fm, int N,
+      const double *X, int ldx, double cutoff, LWPR_FloatAccuracy *acc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
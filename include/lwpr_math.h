@@ -29,6 +29,17 @@ Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
 
 #include <lwpr_config.h>
 
+#ifndef LWPR_TRI
+/** Index of element (i,j), i<=j, within a packed upper triangular matrix (also defined in lwpr.h) */
+#define LWPR_TRI(i,j)      ((i) + ((j)*((j)+1))/2)
+#endif
+
+/** \brief Number of input dimensions that are accumulated between two checks of the 
+   bounded distance computations (lwpr_math_trip_norm2_bounded, lwpr_math_diagp_quad_bounded) */
+#ifndef LWPR_MATH_DIST_BLOCK
+#define LWPR_MATH_DIST_BLOCK  4
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -87,6 +98,19 @@ LIBRARY_API void lwpr_math_add_scalar_vector(double *y, double a,const double *x
 */    
 LIBRARY_API void lwpr_math_scale_add_scalar_vector(double b, double *y, double a,const double *x,int n);
 
+/** \brief Computes the exponential function of all elements of a vector.
+
+   \param[in] n   Length of the vectors
+   \param[out] y  Output vector, must point to an array of <em>n</em> doubles. May be equal to <em>x</em>.
+   \param[in] x   Input vector, must point to an array of <em>n</em> doubles, with \f$x_i \leq 0\f$
+   
+   This is meant for computing many Gaussian activations at once. The loop contains no 
+   function calls or branches, so that compilers can vectorise it. The relative error 
+   is below 1e-15 for \f$-708.375 \leq x_i \leq 0\f$. Smaller inputs yield 0 (instead of
+   subnormal numbers, that is, with an absolute error below 2.3e-308).
+*/   
+LIBRARY_API void lwpr_math_exp_array(int n, double *y, const double *x);
+
 /** \brief Computes the Cholesky decomposition of a matrix.
 
    \param[in] N   Number of columns and rows of the matrix
@@ -108,6 +132,161 @@ LIBRARY_API void lwpr_math_scale_add_scalar_vector(double b, double *y, double a
 */   
 LIBRARY_API int lwpr_math_cholesky(int N,int Ns,double *R,const double *A);
 
+/** \brief Computes the quadratic form of a symmetric matrix in packed storage.
+
+   \param[in] N   Number of columns and rows of the matrix
+   \param[in] Ap  Upper triangle of the symmetric matrix <em>A</em>, packed column by column (see LWPR_TRI)
+   \param[in] x   Input vector, must point to an array of <em>N</em> doubles
+   \return  \f[\mathbf{x}^T\mathbf{A}\mathbf{x}\f]
+   
+   Only the upper triangle is visited, so this takes roughly half the 
+   operations of a dense quadratic form.
+*/
+LIBRARY_API double lwpr_math_symp_quad(int N, const double *Ap, const double *x);
+
+/** \brief Multiplies a symmetric matrix in packed storage by a vector.
+
+   \param[in] N   Number of columns and rows of the matrix
+   \param[out] y  Output vector, must point to an array of <em>N</em> doubles
+   \param[in] Ap  Upper triangle of the symmetric matrix <em>A</em>, packed column by column (see LWPR_TRI)
+   \param[in] x   Input vector, must point to an array of <em>N</em> doubles
+   
+   Computes \f[\mathbf{y} \leftarrow \mathbf{A}\mathbf{x}\f]
+*/
+LIBRARY_API void lwpr_math_symp_mv(int N, double *y, const double *Ap, const double *x);
+
+/** \brief Adds a multiple of a symmetric matrix in packed storage to a dense matrix.
+
+   \param[in] N   Number of columns and rows of the matrices
+   \param[in] Ns  Stride parameter of <em>A</em>, i.e. offset between the first element of adjacent columns
+   \param[in,out] A  Dense matrix
+   \param[in] a   Scalar multiplier
+   \param[in] Bp  Upper triangle of the symmetric matrix <em>B</em>, packed column by column (see LWPR_TRI)
+   
+   Computes \f[\mathbf{A} \leftarrow \mathbf{A} + a\mathbf{B}\f]
+*/
+LIBRARY_API void lwpr_math_symp_add_scalar(int N, int Ns, double *A, double a, const double *Bp);
+
+/** \brief Symmetric rank-1 update of a matrix in packed storage.
+
+   \param[in] N   Number of columns and rows of the matrix
+   \param[in,out] Ap  Upper triangle of the symmetric matrix <em>A</em>, packed column by column (see LWPR_TRI)
+   \param[in] a   Scalar multiplier
+   \param[in] x   Vector, must point to an array of <em>N</em> doubles
+   
+   Computes \f[\mathbf{A} \leftarrow \mathbf{A} + a\mathbf{x}\mathbf{x}^T\f]
+   Each column of the triangle is updated by one contiguous lwpr_math_add_scalar_vector().
+*/
+LIBRARY_API void lwpr_math_symp_rank1(int N, double *Ap, double a, const double *x);
+
+/** \brief Symmetric rank-2 update of a matrix in packed storage.
+
+   \param[in] N   Number of columns and rows of the matrix
+   \param[in,out] Ap  Upper triangle of the symmetric matrix <em>A</em>, packed column by column (see LWPR_TRI)
+   \param[in] a   Scalar multiplier
+   \param[in] x   Vector, must point to an array of <em>N</em> doubles
+   \param[in] y   Vector, must point to an array of <em>N</em> doubles
+   
+   Computes \f[\mathbf{A} \leftarrow \mathbf{A} + a(\mathbf{x}\mathbf{y}^T + \mathbf{y}\mathbf{x}^T)\f]
+*/
+LIBRARY_API void lwpr_math_symp_rank2(int N, double *Ap, double a, const double *x, const double *y);
+
+/** \brief Computes the squared norm of an upper triangular matrix in packed storage times a vector.
+
+   \param[in] N   Number of columns and rows of the matrix
+   \param[in] Mp  Upper triangular matrix <em>M</em>, packed column by column (see LWPR_TRI)
+   \param[in] x   Input vector, must point to an array of <em>N</em> doubles
+   \return  \f[\|\mathbf{M}\mathbf{x}\|^2 = \mathbf{x}^T\mathbf{M}^T\mathbf{M}\mathbf{x}\f]
+   
+   If <em>M</em> is the Cholesky factor of <em>D</em>, this equals the quadratic form
+   of <em>D</em>, but needs only one multiplication per stored element and no temporary storage.
+*/
+LIBRARY_API double lwpr_math_trip_norm2(int N, const double *Mp, const double *x);
+
+/** \brief Like lwpr_math_trip_norm2, but stops as soon as the result is known to exceed a bound.
+
+   \param[in] N     Number of columns and rows of the matrix
+   \param[in] Mp    Upper triangular matrix <em>M</em>, packed column by column (see LWPR_TRI)
+   \param[in] x     Input vector, must point to an array of <em>N</em> doubles
+   \param[in] qmax  Bound on the result
+   \return  \f[\|\mathbf{M}\mathbf{x}\|^2\f] if that is not larger than <em>qmax</em>,
+      otherwise any partial sum that exceeds <em>qmax</em>
+   
+   The squared elements of <em>Mx</em> are summed up row by row, so every partial sum is a
+   lower bound of the result. It is checked against <em>qmax</em> after every 
+   LWPR_MATH_DIST_BLOCK rows. Results below the bound are identical to lwpr_math_trip_norm2().
+*/
+LIBRARY_API double lwpr_math_trip_norm2_bounded(int N, const double *Mp, const double *x, double qmax);
+
+/** \brief Computes the quadratic form of a diagonal matrix stored as a packed symmetric matrix,
+   stopping as soon as the result is known to exceed a bound.
+
+   \param[in] N     Number of columns and rows of the matrix
+   \param[in] Ap    Symmetric matrix <em>A</em>, packed column by column (see LWPR_TRI). 
+                    Only its diagonal is used.
+   \param[in] x     Input vector, must point to an array of <em>N</em> doubles
+   \param[in] qmax  Bound on the result
+   \return  \f[\sum_i A_{ii} x_i^2\f] if that is not larger than <em>qmax</em>,
+      otherwise any partial sum that exceeds <em>qmax</em>
+   
+   The partial sums are checked after every LWPR_MATH_DIST_BLOCK elements. For a diagonal 
+   matrix with non-negative elements, results below the bound are identical to lwpr_math_symp_quad().
+*/
+LIBRARY_API double lwpr_math_diagp_quad_bounded(int N, const double *Ap, const double *x, double qmax);
+
+/** \brief Multiplies an upper triangular matrix in packed storage by a vector.
+
+   \param[in] N   Number of columns and rows of the matrix
+   \param[out] y  Output vector, must point to an array of <em>N</em> doubles (not aliased with x)
+   \param[in] Mp  Upper triangular matrix <em>M</em>, packed column by column (see LWPR_TRI)
+   \param[in] x   Input vector, must point to an array of <em>N</em> doubles
+   
+   Computes \f[\mathbf{y} \leftarrow \mathbf{M}\mathbf{x}\f]
+*/
+LIBRARY_API void lwpr_math_trip_mv(int N, double *y, const double *Mp, const double *x);
+
+/** \brief Multiplies the transpose of an upper triangular matrix in packed storage by a vector.
+
+   \param[in] N   Number of columns and rows of the matrix
+   \param[out] y  Output vector, must point to an array of <em>N</em> doubles (not aliased with x)
+   \param[in] Mp  Upper triangular matrix <em>M</em>, packed column by column (see LWPR_TRI)
+   \param[in] x   Input vector, must point to an array of <em>N</em> doubles
+   
+   Computes \f[\mathbf{y} \leftarrow \mathbf{M}^T\mathbf{x}\f]
+*/
+LIBRARY_API void lwpr_math_trip_tmv(int N, double *y, const double *Mp, const double *x);
+
+/** \brief Computes the product of a packed upper triangular matrix with its own transpose from the left.
+
+   \param[in] N   Number of columns and rows of the matrices
+   \param[out] Dp Packed upper triangle of the symmetric result <em>D</em>
+   \param[in] Mp  Upper triangular matrix <em>M</em>, packed column by column (see LWPR_TRI)
+   
+   Computes \f[\mathbf{D} \leftarrow \mathbf{M}^T\mathbf{M}\f], i.e. recovers a 
+   distance metric from its Cholesky factor.
+*/
+LIBRARY_API void lwpr_math_trip_gram(int N, double *Dp, const double *Mp);
+
+/** \brief Packs the upper triangle of a dense matrix.
+
+   \param[in] N   Number of columns and rows of the matrix
+   \param[in] Ns  Stride parameter of <em>A</em>, i.e. offset between the first element of adjacent columns
+   \param[out] Ap Packed upper triangle, must point to an array of LWPR_TRI_SIZE(N) doubles
+   \param[in] A   Dense matrix. The strictly lower triangle is ignored.
+*/
+LIBRARY_API void lwpr_math_tri_pack(int N, int Ns, double *Ap, const double *A);
+
+/** \brief Unpacks an upper triangular or symmetric matrix into dense storage.
+
+   \param[in] N   Number of columns and rows of the matrix
+   \param[in] Ns  Stride parameter of <em>A</em>, i.e. offset between the first element of adjacent columns
+   \param[out] A  Dense matrix
+   \param[in] Ap  Packed upper triangle
+   \param[in] symmetric  If non-zero, the strictly lower triangle of <em>A</em> is mirrored from 
+                  the upper triangle, otherwise it is set to zero.
+*/
+LIBRARY_API void lwpr_math_tri_unpack(int N, int Ns, double *A, const double *Ap, int symmetric);
+
 #ifdef __cplusplus
 }
 #endif
@@ -30,6 +30,7 @@ Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
 #include <lwpr.h>
 #include <lwpr_aux.h>
 #include <lwpr_mem.h>
+#include <lwpr_math.h>
 
 #define RF_FIELDS     27
 #define SUB_FIELDS     2
@@ -44,6 +45,8 @@ void set_scalar_field(mxArray *S,int num, int numField, double value);
 
 void get_field(const mxArray *S,int num, const char *name,int m,int n, double *dest);
 void set_field(mxArray *S,int num, int numField, int m, int n, const double *src);
+void get_tri_field(const mxArray *S,int num, const char *name,int n, double *dest);
+void set_tri_field(mxArray *S,int num, int numField, int n, const double *src, int symmetric);
 void create_RF_from_matlab(LWPR_ReceptiveField *RF, const LWPR_Model *model, const mxArray *S, int num);
 void fill_matlab_from_RF(LWPR_ReceptiveField *RF, mxArray *S, int num);
 void model_consts_from_matlab(LWPR_Model *model, const mxArray *S);
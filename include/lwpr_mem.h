@@ -56,17 +56,34 @@ extern "C" {
    \param[in] nReg       Initial number of PLS regression axes
    \param[in] nRegStore  Number of PLS axes that can initially be stored (>= <em>nReg</em>)
    \return
-      - 1 in case of succes
+      - 1 in case of success
       - 0 in case of failure (e.g. memory could not be allocated).
 */             
 int lwpr_mem_alloc_rf(LWPR_ReceptiveField *RF, const LWPR_Model *model, int nReg, int nRegStore);
 
+/** \brief Allocates memory for only those variables of a receptive field that are needed for predictions.
+
+   \param[in,out] RF     Pointer to a receptive field structure (must already be allocated).
+   \param[in] model      Pointer to a valid LWPR model structure. 
+   \param[in] nReg       Number of PLS regression axes
+   \return
+      - 1 in case of success
+      - 0 in case of failure (e.g. memory could not be allocated).
+      
+   All pointers to training statistics (e.g. alpha, SXresYres) are set to NULL. Of the
+   distance metric, only the Cholesky factor M is kept, or only D if LWPR_Model.diag_only is set,
+   and the other pointer is set to NULL.
+   lwpr_mem_alloc_rf() calls this function if LWPR_Model.inference_only is set.
+   \sa lwpr_strip_for_inference
+*/             
+int lwpr_mem_alloc_rf_slim(LWPR_ReceptiveField *RF, const LWPR_Model *model, int nReg);
+
 /** \brief Re-allocates memory for the PLS-related variables of a receptive field.
 
    \param[in,out] RF     Pointer to a valid receptive field structure.
    \param[in] nRegStore  Number of PLS axes that can be stored. 
    \return
-      - 1 in case of succes
+      - 1 in case of success
       - 0 in case of failure (e.g. memory could not be allocated).
       
    This function does NOT add a new PLS axis, but only creates the space for it.
@@ -75,6 +92,26 @@ int lwpr_mem_alloc_rf(LWPR_ReceptiveField *RF, const LWPR_Model *model, int nReg
 */         
 int lwpr_mem_realloc_rf(LWPR_ReceptiveField *RF, int nRegStore);
 
+/** \brief Computes the number of bytes occupied by a receptive field.
+
+   \param[in] model      Pointer to a valid LWPR model structure. 
+   \param[in] nRegStore  Number of PLS axes the receptive field can store
+   \return The size of the LWPR_ReceptiveField structure, its pointer within the 
+      submodel, and the storage allocated by lwpr_mem_alloc_rf (or lwpr_mem_alloc_rf_slim
+      if LWPR_Model.inference_only is set).
+*/
+size_t lwpr_mem_rf_bytes(const LWPR_Model *model, int nRegStore);
+
+/** \brief Computes the number of bytes occupied by the receptive fields of a submodel.
+
+   \param[in] sub   Pointer to a valid LWPR submodel structure.
+   \return The sum of lwpr_mem_rf_bytes() over all receptive fields of the submodel.
+      For receptive fields whose fixed-size variables were moved into LWPR_SubModel.pool
+      (see lwpr_mem_pool_rfs), the whole pool is counted instead, including the slots of 
+      receptive fields that were removed in the meantime.
+*/
+size_t lwpr_mem_sub_bytes(const LWPR_SubModel *sub);
+
 /** \brief Disposes the memory for the internal variables of a receptive field.
 
    \param[in,out] RF     Pointer to a receptive field structure.
@@ -84,15 +121,34 @@ int lwpr_mem_realloc_rf(LWPR_ReceptiveField *RF, int nRegStore);
 */
 void lwpr_mem_free_rf(LWPR_ReceptiveField *RF);
 
+/** \brief Moves the variables of all receptive fields of a submodel that do not depend
+      on nReg (e.g. c, D, M, slope) into one contiguous block, in the order of LWPR_SubModel.rf.
+
+   \param[in,out] sub   Pointer to a valid LWPR submodel structure.
+   \return
+      - 1 in case of success
+      - 0 in case of failure (the submodel is left unchanged)
+      
+   The block is stored in LWPR_SubModel.pool. The relocated receptive fields are marked by
+   LWPR_ReceptiveField.pooled, and their fixStorage is set to NULL, so lwpr_mem_free_rf() 
+   does not free it.
+   A previous block is freed. Receptive fields that are removed later just leave a gap 
+   in the block until the next call, or until the last pooled receptive field is removed
+   (see lwpr_aux_remove_rf).
+   \sa lwpr_reorder_rfs
+*/
+int lwpr_mem_pool_rfs(LWPR_SubModel *sub);
+
 /** \brief Allocates memory for internal variables of a LWPR workspace structure.
 
    \param[in,out] ws     Pointer to a LWPR_Workspace structure (must already be allocated).
    \param[in] nIn        Input dimensionality of the LWPR model
+   \param[in] nOut       Output dimensionality of the LWPR model
    \return
-      - 1 in case of succes
+      - 1 in case of success
       - 0 in case of failure 
 */             
-int lwpr_mem_alloc_ws(LWPR_Workspace *ws, int nIn);
+int lwpr_mem_alloc_ws(LWPR_Workspace *ws, int nIn, int nOut);
 
 /** \brief Disposes the internal memory for an internally used "workspace"
 
@@ -110,7 +166,7 @@ void lwpr_mem_free_ws(LWPR_Workspace *ws);
    \param[in] nOut       Output dimensionality of the LWPR model   
    \param[in] storeRFS   Expected number of receptive fields per output dimension
    \return
-      - 1 in case of succes
+      - 1 in case of success
       - 0 in case of failure 
       
    This function also allocates space for workspaces (one per thread) and
@@ -126,7 +182,7 @@ int lwpr_mem_alloc_model(LWPR_Model *model, int nIn, int nOut, int storeRFS);
    \param[in,out] sub  Pointer to an existing LWPR_SubModel structure
    \param[in] storeRFS   Expected number of receptive fields 
    \return
-      - 1 in case of succes
+      - 1 in case of success
       - 0 in case of failure 
 
    Note that storeRFS determines only the number of <b>pointers</b>, that is,
@@ -54,17 +54,21 @@ typedef struct {
    int N;            /**< \brief Number of columns of current data element */
    int readM;        /**< \brief Number of already read rows of current data element */
    int readN;        /**< \brief Number of already read columns of current data element */
+   int packed;       /**< \brief If non-zero, the current matrix is stored as a packed upper triangle (see LWPR_TRI) */
    int numErrors;    /**< \brief Number of errors encountered during parsing */
    int numWarnings;  /**< \brief Number of warnings encountered during parsing */
    FILE *errFile;    /**< \brief stdio-file to write errors and warnings to, must be open. If this is NULL, errors and warnings are not reported. */
    LWPR_Model *model;/**< \brief Pointer to the LWPR_Model structure that is to be filled */
+   double maxBytes;  /**< \brief Holds LWPR_Model.max_bytes, which is stored as a scalar */
+   int evict;        /**< \brief Holds LWPR_Model.evict, which is stored as an integer */
 } LWPR_ParserData;
 
 /** \brief Writes an LWPR model to an XML file 
    \param[in] model    Pointer to a valid LWPR model structure
    \param[in] filename Name of the XML file to write the model to
    \return
-      - 0 in case of failure (e.g. file could not be opened for writing)
+      - 0 in case of failure (e.g. file could not be opened for writing, or the
+          model has been stripped by lwpr_strip_for_inference)
       - 1 in case of success
    \ingroup LWPR_C          
 */
@@ -73,6 +77,8 @@ LIBRARY_API int lwpr_write_xml(const LWPR_Model *model, const char *filename);
 /** \brief Writes an LWPR model to an XML file 
    \param[in] model    Pointer to a valid LWPR model structure
    \param[in] fp       Descriptor of an already opened file (see stdio.h)
+   
+   Nothing is written if the model has been stripped by lwpr_strip_for_inference().
    \ingroup LWPR_C    
 */
 LIBRARY_API void lwpr_write_xml_fp(const LWPR_Model *model,FILE *fp);
@@ -108,6 +114,18 @@ LIBRARY_API int lwpr_read_xml(LWPR_Model *model, const char *filename, int *numW
 LIBRARY_API void lwpr_xml_write_matrix(FILE *fp, int level, const char *name,
       int M, int Ms, int N, const double *val);
 
+/** \brief Writes a packed triangular matrix as a full (dense) XML matrix tag into a file
+   \param[in] fp        File descriptor
+   \param[in] level     Indicates global (0), model (1), submodel (2) or receptive field (3)
+   \param[in] name      Name of the matrix
+   \param[in] N         Number of rows and columns
+   \param[in] val       Pointer to the packed upper triangle (see LWPR_TRI)
+   \param[in] symmetric If non-zero, the lower triangle is written as the mirror image of the
+                        upper triangle, otherwise as zeros
+*/
+LIBRARY_API void lwpr_xml_write_tri(FILE *fp, int level, const char *name,
+      int N, const double *val, int symmetric);
+
 /** \brief Writes a vector as an XML tag into a file
    \param[in] fp       File descriptor
    \param[in] level    Indicates global (0), model (1), submodel (2) or receptive field (3)
@@ -109,11 +109,11 @@ funcs = {'lwpr_num_data', ...
          'lwpr_predict_J', ...         
          'lwpr_predict_JcJ', ...                  
          'lwpr_predict_JH', ...                  
-         'lwpr_update', ...
-         'lwpr_storage'};
+         'lwpr_update'};
 
 bfuncs = {'lwpr_write_binary', ...
-          'lwpr_read_binary'};
+          'lwpr_read_binary', ...
+          'lwpr_storage'};
          
 funcs = [xfuncs funcs];
                   
@@ -7,7 +7,7 @@ function [yp, conf, max_w] = lwpr_predict(model,x,cutoff)
 %
 % Input parameters
 %
-%     model    Valid LWPR model structure
+%     model    Valid LWPR model structure or storage-ID (see lwpr_storage)
 %     x        N input vectors (as nIn x N matrix), i.e. a
 %              single input sample is passed as a column vector
 %     cutoff   Optional threshold parameter for ignoring RFs with
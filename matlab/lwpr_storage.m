@@ -27,6 +27,27 @@ function model = lwpr_storage(command,model)
 % Note that you cannot access the internal variables of the model 
 % in this mode.
 %
+% Besides lwpr_predict, lwpr_predict_J, lwpr_predict_JcJ, lwpr_predict_JH 
+% and lwpr_update, the functions lwpr_num_data, lwpr_num_rfs, 
+% lwpr_write_binary and lwpr_write_xml also accept IDs, so a typical
+% experiment only converts the model when it is stored and when it
+% is explicitly retrieved for inspection:
+%
+%    ID = lwpr_storage('Store', lwpr_init(2,1,'init_D',50*eye(2)));
+%    for i=1:10000
+%       [ID, yp] = lwpr_update(ID, x(:,i), y(:,i));
+%    end
+%    lwpr_write_binary(ID, 'trained.bin');
+%    model = lwpr_storage('GetFree', ID);
+%
+% > model_ID = lwpr_storage('ReadBinary', filename)
+% Reads a binary LWPR file (see lwpr_write_binary) directly into
+% MEX-internal storage, without creating a MATLAB struct.
+%
+% > model_ID2 = lwpr_storage('Duplicate', model_ID)
+% Stores a copy of the model pointed to by model_ID and returns
+% its ID, e.g. to keep a snapshot while training continues.
+%
 % > model = lwpr_storage('Get', model_ID)
 % Retrieves a MATLAB struct from MEX-internal storage, pointed to
 % by the input parameter 'model'. Useful for inspecting internal
@@ -79,6 +100,10 @@ switch(command)
       return
    case 'Get'
       return
+   case 'ReadBinary'
+      error('Reading into MEX-internal storage is only available through MEX-files (see lwpr_buildmex)');
+   case 'Duplicate'
+      return
    case 'Free'
       model = [];
    case 'FreeAll'
@@ -7,7 +7,7 @@ function [model, yp, max_w] = lwpr_update(model,x,y)
 %
 % Input parameters
 %
-%     model    Valid LWPR model structure
+%     model    Valid LWPR model structure or storage-ID (see lwpr_storage)
 %     x        Input vector (nIn x 1 matrix)
 %     y        Output vector (nOut x 1 matrix)
 %
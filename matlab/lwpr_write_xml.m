@@ -6,7 +6,7 @@ function ok = lwpr_write_xml(model, filename)
 %
 % Input parameters
 %     
-%     model       Valid LWPR model structure
+%     model       Valid LWPR model structure or storage-ID (see lwpr_storage)
 %     filename    Name of the destination file 
 %
 % Return value
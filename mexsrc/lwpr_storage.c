@@ -18,9 +18,14 @@ License along with this library; if not, write to the Free
 Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
 *********************************************************************/
 #include <lwpr_matlab.h>
+#include <lwpr_binio.h>
 #include <string.h>
 #include <stdio.h>
 
+#ifndef MAX_PATH
+#define MAX_PATH  512
+#endif
+
 #define MAX_NUM_MODELS  128
 
 static LWPR_Model *models[MAX_NUM_MODELS];
@@ -86,6 +91,7 @@ void free_all_models(void) {
 
 void mexFunction(int nlhs, mxArray *plhs[], int nrhs,const mxArray *prhs[]) {
    char command[20];
+   char filename[MAX_PATH];
    LWPR_Model *model;
    int num;
          
@@ -101,6 +107,21 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs,const mxArray *prhs[]) {
       make_model_persistent(model);
       models[num]=model;
       
+      plhs[0]=create_array_from_pointer(model);
+   } else if (!strcmp(command,"ReadBinary")) {
+      if (nrhs<2 || !mxIsChar(prhs[1])) mexErrMsgTxt("2nd argument must be a filename (string).");
+      num = find_empty_slot();
+      if (num==-1) mexErrMsgTxt("No more free model slots.\n");
+      
+      mxGetString(prhs[1],filename,MAX_PATH);
+      model = (LWPR_Model *) mxCalloc(1,sizeof(LWPR_Model));
+      if (!lwpr_read_binary(model, filename)) {
+         mxFree(model);
+         mexErrMsgTxt("LWPR file could not be opened or seems to be invalid.\n");
+      }
+      make_model_persistent(model);
+      models[num]=model;
+      
       plhs[0]=create_array_from_pointer(model);
    } else if (!strcmp(command,"FreeAll")) {
       free_all_models();
@@ -117,6 +138,19 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs,const mxArray *prhs[]) {
          lwpr_free_model(models[num]);
          mxFree(models[num]);
          models[num]=NULL;
+      } else if (!strcmp(command,"Duplicate")) {
+         int dup = find_empty_slot();
+         if (dup==-1) mexErrMsgTxt("No more free model slots.\n");
+         
+         model = (LWPR_Model *) mxCalloc(1,sizeof(LWPR_Model));
+         if (!lwpr_duplicate_model(model, models[num])) {
+            mxFree(model);
+            mexErrMsgTxt("Could not allocate memory for the copy.\n");
+         }
+         make_model_persistent(model);
+         models[dup]=model;
+         
+         plhs[0]=create_array_from_pointer(model);
       } else if (!strcmp(command,"Free")) {
          lwpr_free_model(models[num]);
          mxFree(models[num]);
@@ -26,24 +26,30 @@ Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
 
 void mexFunction(int nlhs, mxArray *plhs[], int nrhs,const mxArray *prhs[]) {
    LWPR_Model model;
+   LWPR_Model *pmodel;
    char filename[MAX_PATH];
    FILE *fp;   
    int ok;
    
    if (nrhs<2 || !mxIsChar(prhs[1])) mexErrMsgTxt("Second argument must be a filename (string).\n");
    
-   create_model_from_matlab(&model, prhs[0]);
+   pmodel = get_pointer_from_array(prhs[0]);
+   if (pmodel == NULL) {
+      create_model_from_matlab(&model,prhs[0]);
+      pmodel = &model;
+   }
    mxGetString(prhs[1],filename,MAX_PATH);
    
    fp = fopen(filename, "wb");
    if (fp==NULL) {
+      if (pmodel == &model) lwpr_free_model(&model);
       mexErrMsgTxt("Could not open the file. Please check filename and access permissions.\n");
    }
   
-   ok = lwpr_write_binary_fp(&model, fp);
+   ok = lwpr_write_binary_fp(pmodel, fp);
    fclose(fp);
    
    plhs[0] = mxCreateDoubleScalar(ok);
    
-   lwpr_free_model(&model);
+   if (pmodel == &model) lwpr_free_model(&model);
 }
@@ -26,17 +26,22 @@ Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
 
 void mexFunction(int nlhs, mxArray *plhs[], int nrhs,const mxArray *prhs[]) {
    LWPR_Model model;
+   LWPR_Model *pmodel;
    char filename[MAX_PATH];
    int code;
    
    if (nrhs<2 || !mxIsChar(prhs[1])) mexErrMsgTxt("Second argument must be a filename (string).\n");
    
-   create_model_from_matlab(&model, prhs[0]);
+   pmodel = get_pointer_from_array(prhs[0]);
+   if (pmodel == NULL) {
+      create_model_from_matlab(&model,prhs[0]);
+      pmodel = &model;
+   }
    mxGetString(prhs[1],filename,MAX_PATH);
   
-   code = lwpr_write_xml(&model, filename);
+   code = lwpr_write_xml(pmodel, filename);
    
    plhs[0] = mxCreateDoubleScalar(code);
    
-   lwpr_free_model(&model);
+   if (pmodel == &model) lwpr_free_model(&model);
 }
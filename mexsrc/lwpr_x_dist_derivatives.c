@@ -23,12 +23,13 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs,const mxArray *prhs[]) {
    const mxArray *ar;
    
    double *dwdM, *dJ2dM, *ddwdMdM, *ddJ2dMdM;
+   double *packed, *RF_Mp, *RF_Dp;
    const double *RF_M,*RF_D,*dx;
    
    double w, dwdq, ddwdqdq;
 
    int diag_only,meta;
-   int m,n;
+   int m,n,nTri;
    double penalty;
 
    if (nrhs<8) mexErrMsgTxt("Too few arguments.");
@@ -62,11 +63,26 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs,const mxArray *prhs[]) {
    plhs[2] = mxCreateDoubleMatrix(n,n,mxREAL);
    plhs[3] = mxCreateDoubleMatrix(n,n,mxREAL);
   
-   dwdM = mxGetPr(plhs[0]);
-   dJ2dM = mxGetPr(plhs[1]);
-   ddwdMdM = mxGetPr(plhs[2]);
-   ddJ2dMdM = mxGetPr(plhs[3]);
+   /* The C routine works on packed upper triangles, MATLAB uses dense matrices */
+   nTri = LWPR_TRI_SIZE(n);
+   packed = (double *) mxMalloc(6*nTri*sizeof(double));
+   RF_Mp = packed;
+   RF_Dp = packed + nTri;
+   dwdM = packed + 2*nTri;
+   dJ2dM = packed + 3*nTri;
+   ddwdMdM = packed + 4*nTri;
+   ddJ2dMdM = packed + 5*nTri;
    
-   lwpr_aux_dist_derivatives(n, n, dwdM, dJ2dM, ddwdMdM, ddJ2dMdM, w, dwdq, ddwdqdq, RF_D, RF_M, dx, diag_only, penalty, meta);
+   lwpr_math_tri_pack(n, n, RF_Mp, RF_M);
+   lwpr_math_tri_pack(n, n, RF_Dp, RF_D);
+   
+   lwpr_aux_dist_derivatives(n, dwdM, dJ2dM, ddwdMdM, ddJ2dMdM, w, dwdq, ddwdqdq, RF_Dp, RF_Mp, dx, diag_only, penalty, meta);
+   
+   lwpr_math_tri_unpack(n, n, mxGetPr(plhs[0]), dwdM, 0);
+   lwpr_math_tri_unpack(n, n, mxGetPr(plhs[1]), dJ2dM, 0);
+   lwpr_math_tri_unpack(n, n, mxGetPr(plhs[2]), ddwdMdM, 0);
+   lwpr_math_tri_unpack(n, n, mxGetPr(plhs[3]), ddJ2dMdM, 0);
+   
+   mxFree(packed);
 }
 
@@ -19,6 +19,7 @@ Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
 *********************************************************************/
 
 #include <Python.h>
+#include <pythread.h>
 #include <lwpr.h>
 #include <lwpr_math.h>
 #include <lwpr_xml.h>
@@ -33,14 +34,66 @@ typedef struct {
     double *extra_out2;    
     double *extra_out3;
     double *extra_J;
+    PyThread_type_lock lock;
+    int num_views;
 } PyLWPR;
 
+/** Base object of the arrays returned by rf_view(). It keeps the LWPR object alive
+    and counts the live views in PyLWPR.num_views, so that methods which could free
+    or move receptive fields can refuse to run while views exist. */
+typedef struct {
+    PyObject_HEAD
+    PyLWPR *owner;
+} PyLWPR_ViewBase;
+
 static const char *TrueFalse[]={"False","True"};
-static const char *GaussBiSq[]={"Gaussian","BiSquare"};
+
+static void PyLWPR_ViewBase_dealloc(PyLWPR_ViewBase* self) {
+   self->owner->num_views--;
+   Py_DECREF(self->owner);
+   self->ob_type->tp_free((PyObject*)self);
+}
+
+static PyTypeObject PyLWPR_ViewBase_Type = {
+    PyObject_HEAD_INIT(NULL)
+    0,                           /* ob_size */
+    "lwpr.RFViewBase",           /* tp_name */
+    sizeof(PyLWPR_ViewBase),     /* tp_basicsize */
+    0,                           /* tp_itemsize */
+    (destructor) PyLWPR_ViewBase_dealloc, /* tp_dealloc */
+    0,                           /* tp_print */
+    0,                           /* tp_getattr */
+    0,                           /* tp_setattr */
+    0,                           /* tp_compare */
+    0,                           /* tp_repr */
+    0,                           /* tp_as_number */
+    0,                           /* tp_as_sequence */
+    0,                           /* tp_as_mapping */
+    0,                           /* tp_hash */
+    0,                           /* tp_call */
+    0,                           /* tp_str */
+    0,                           /* tp_getattro */
+    0,                           /* tp_setattro */
+    0,                           /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,          /* tp_flags */
+    "Keeps an LWPR object alive while views of its receptive fields exist." /* tp_doc */
+};
+
+/** Raises an exception and returns -1 if views of receptive fields exist. Methods
+    that may free or move receptive fields (update, strip, setstate, and thereby
+    also pruning, eviction and reordering) must check this first. */
+static int check_no_views(PyLWPR *self) {
+   if (self->num_views > 0) {
+      PyErr_Format(PyExc_RuntimeError, "Model cannot be changed while %d array(s) returned by rf_view() exist.", self->num_views);
+      return -1;
+   }
+   return 0;
+}
 
 static void PyLWPR_dealloc(PyLWPR* self) {
    lwpr_free_model(&self->model);
    free(self->extra_in);
+   if (self->lock != NULL) PyThread_free_lock(self->lock);
    self->ob_type->tp_free((PyObject*)self);
 }
 
@@ -67,6 +120,18 @@ static PyObject *get_array_from_matrix(int m, int ms, int n, const double *data)
    return PyArray_Return(matout);
 }
 
+static PyObject *get_array_from_tri(int n, const double *data, int symmetric) {
+   npy_intp dims[2];
+   PyArrayObject *matout;
+   
+   dims[0] = dims[1] = n;
+   matout = (PyArrayObject *) PyArray_NewFromDescr(&PyArray_Type,
+      PyArray_DescrFromType(NPY_DOUBLE), 2, dims, NULL, NULL, 1, NULL);
+   
+   lwpr_math_tri_unpack(n, (int) (PyArray_STRIDE(matout,1)/sizeof(double)), (double *) matout->data, data, symmetric);
+   return PyArray_Return(matout);
+}
+
 static int set_vector_from_array(int n, double *dest, PyArrayObject *obj) {
    int i;
    if (PyArray_DESCR(obj) != PyArray_DescrFromType(NPY_DOUBLE)) {
@@ -132,101 +197,165 @@ static int set_matrix_from_array(int m,int ms,int n, double *dest, PyArrayObject
    return 0;
 }
 
-/** Getters for scalar parameters *************************************************/
-static PyObject *PyLWPR_G_nIn(PyLWPR *self, void *closure) { return Py_BuildValue("i",self->model.nIn); }
-static PyObject *PyLWPR_G_nOut(PyLWPR *self, void *closure) { return Py_BuildValue("i",self->model.nOut); }
-static PyObject *PyLWPR_G_n_data(PyLWPR *self, void *closure) { return Py_BuildValue("i",self->model.n_data); }
-static PyObject *PyLWPR_G_meta(PyLWPR *self, void *closure) { return PyBool_FromLong(self->model.meta); }
-static PyObject *PyLWPR_G_diag_only(PyLWPR *self, void *closure) { return PyBool_FromLong(self->model.diag_only); }
-static PyObject *PyLWPR_G_update_D(PyLWPR *self, void *closure) { return PyBool_FromLong(self->model.update_D); }
-static PyObject *PyLWPR_G_w_prune(PyLWPR *self, void *closure) { return PyFloat_FromDouble(self->model.w_prune); }
-static PyObject *PyLWPR_G_w_gen(PyLWPR *self, void *closure) { return PyFloat_FromDouble(self->model.w_gen); }
-static PyObject *PyLWPR_G_meta_rate(PyLWPR *self, void *closure) { return PyFloat_FromDouble(self->model.meta_rate); }
-static PyObject *PyLWPR_G_penalty(PyLWPR *self, void *closure) { return PyFloat_FromDouble(self->model.penalty); }
-static PyObject *PyLWPR_G_init_S2(PyLWPR *self, void *closure) { return PyFloat_FromDouble(self->model.init_S2); }
-static PyObject *PyLWPR_G_init_lambda(PyLWPR *self, void *closure) { return PyFloat_FromDouble(self->model.init_lambda); }
-static PyObject *PyLWPR_G_tau_lambda(PyLWPR *self, void *closure) { return PyFloat_FromDouble(self->model.tau_lambda); }
-static PyObject *PyLWPR_G_final_lambda(PyLWPR *self, void *closure) { return PyFloat_FromDouble(self->model.final_lambda); }
-static PyObject *PyLWPR_G_add_threshold(PyLWPR *self, void *closure) { return PyFloat_FromDouble(self->model.add_threshold); }
-
-
-/** Getter for vector & matrix parameters *****************************************/
-static PyObject *PyLWPR_G_norm_in(PyLWPR *self, void *closure) { 
-   return get_array_from_vector(self->model.nIn, self->model.norm_in);
+/** Batch methods release the GIL while running, so every method, getter and setter
+    that touches the model (which lwpr_predict and lwpr_update use as scratch space)
+    holds a per-object lock. If the lock is busy, we wait for it without holding the GIL.
+    The lock is not recursive, so functions called with the lock held must not take it again. */
+static void lock_model(PyLWPR *self) {
+   if (!PyThread_acquire_lock(self->lock, NOWAIT_LOCK)) {
+      Py_BEGIN_ALLOW_THREADS
+      PyThread_acquire_lock(self->lock, WAIT_LOCK);
+      Py_END_ALLOW_THREADS
+   }
 }
 
-static PyObject *PyLWPR_G_norm_out(PyLWPR *self, void *closure) { 
-   return get_array_from_vector(self->model.nOut, self->model.norm_out);
+static void unlock_model(PyLWPR *self) {
+   PyThread_release_lock(self->lock);
 }
 
-static PyObject *PyLWPR_G_mean_x(PyLWPR *self, void *closure) { 
-   return get_array_from_vector(self->model.nIn, self->model.mean_x);
+/** Converts obj into a C-contiguous (N x n) double array, which is exactly the
+    column-major (n x N) layout expected by the batch functions of the C library. */
+static PyArrayObject *get_batch_from_object(PyObject *obj, int n) {
+   PyArrayObject *arr = (PyArrayObject *) PyArray_FROMANY(obj, NPY_DOUBLE, 2, 2, NPY_IN_ARRAY);
+   if (arr == NULL) return NULL;
+   if (PyArray_DIM(arr,1) != n) {
+      PyErr_SetString(PyExc_TypeError, "Number of columns does not match the model dimensions.");
+      Py_DECREF(arr);
+      return NULL;
+   }
+   if (PyArray_DIM(arr,0) > INT_MAX) {
+      PyErr_SetString(PyExc_ValueError, "Too many rows in batch.");
+      Py_DECREF(arr);
+      return NULL;
+   }
+   return arr;
 }
 
-static PyObject *PyLWPR_G_var_x(PyLWPR *self, void *closure) { 
-   return get_array_from_vector(self->model.nIn, self->model.var_x);
+static PyArrayObject *new_batch_array(npy_intp N, int n) {
+   npy_intp dims[2];
+   dims[0] = N;
+   dims[1] = n;
+   return (PyArrayObject *) PyArray_SimpleNew(2, dims, NPY_DOUBLE);
 }
 
-static PyObject *PyLWPR_G_init_D(PyLWPR *self, void *closure) { 
-   return get_array_from_matrix(self->model.nIn, self->model.nInStore, self->model.nIn, self->model.init_D);
+static int alloc_extra(PyLWPR *self, int nIn, int nOut) {
+   double *extra = (double *) malloc(sizeof(double) * (nIn*(nOut +1) + 3*nOut));
+   if (extra == NULL) return -1;
+   free(self->extra_in);
+   self->extra_in = extra;
+   self->extra_out = self->extra_in + nIn;
+   self->extra_out2 = self->extra_out + nOut;
+   self->extra_out3 = self->extra_out2 + nOut;
+   self->extra_J = self->extra_out3 + nOut;
+   return 0;
 }
 
-static PyObject *PyLWPR_G_init_M(PyLWPR *self, void *closure) { 
-   return get_array_from_matrix(self->model.nIn, self->model.nInStore, self->model.nIn, self->model.init_M);
+/** Getters for scalar, vector & matrix parameters. Like all other accessors, they hold 
+    the model lock (see lock_model), since a batch method may be changing the model in 
+    another thread. */
+#define LOCKED_GETTER(name, expr) \
+static PyObject *PyLWPR_G_##name(PyLWPR *self, void *closure) {\
+   PyObject *result;\
+   lock_model(self);\
+   result = expr;\
+   unlock_model(self);\
+   return result;\
 }
 
-static PyObject *PyLWPR_G_init_alpha(PyLWPR *self, void *closure) { 
-   return get_array_from_matrix(self->model.nIn, self->model.nInStore, self->model.nIn, self->model.init_alpha);
-}
+LOCKED_GETTER(nIn, Py_BuildValue("i",self->model.nIn))
+LOCKED_GETTER(nOut, Py_BuildValue("i",self->model.nOut))
+LOCKED_GETTER(n_data, Py_BuildValue("i",self->model.n_data))
+LOCKED_GETTER(meta, PyBool_FromLong(self->model.meta))
+LOCKED_GETTER(diag_only, PyBool_FromLong(self->model.diag_only))
+LOCKED_GETTER(update_D, PyBool_FromLong(self->model.update_D))
+LOCKED_GETTER(w_prune, PyFloat_FromDouble(self->model.w_prune))
+LOCKED_GETTER(w_gen, PyFloat_FromDouble(self->model.w_gen))
+LOCKED_GETTER(meta_rate, PyFloat_FromDouble(self->model.meta_rate))
+LOCKED_GETTER(penalty, PyFloat_FromDouble(self->model.penalty))
+LOCKED_GETTER(init_S2, PyFloat_FromDouble(self->model.init_S2))
+LOCKED_GETTER(init_lambda, PyFloat_FromDouble(self->model.init_lambda))
+LOCKED_GETTER(tau_lambda, PyFloat_FromDouble(self->model.tau_lambda))
+LOCKED_GETTER(final_lambda, PyFloat_FromDouble(self->model.final_lambda))
+LOCKED_GETTER(add_threshold, PyFloat_FromDouble(self->model.add_threshold))
+
+LOCKED_GETTER(norm_in, get_array_from_vector(self->model.nIn, self->model.norm_in))
+LOCKED_GETTER(norm_out, get_array_from_vector(self->model.nOut, self->model.norm_out))
+LOCKED_GETTER(mean_x, get_array_from_vector(self->model.nIn, self->model.mean_x))
+LOCKED_GETTER(var_x, get_array_from_vector(self->model.nIn, self->model.var_x))
+LOCKED_GETTER(init_D, get_array_from_matrix(self->model.nIn, self->model.nInStore, self->model.nIn, self->model.init_D))
+LOCKED_GETTER(init_M, get_array_from_matrix(self->model.nIn, self->model.nInStore, self->model.nIn, self->model.init_M))
+LOCKED_GETTER(init_alpha, get_array_from_matrix(self->model.nIn, self->model.nInStore, self->model.nIn, self->model.init_alpha))
 
 /**  "Getter" for num_rfs and n_pruned ****************************************/
 static PyObject *PyLWPR_G_num_rfs(PyLWPR *self, void *closure) {
    int i;
    PyArrayObject *matout;
-   npy_intp len = self->model.nOut;
+   npy_intp len;
    
+   lock_model(self);
+   len = self->model.nOut;
    matout = (PyArrayObject *) PyArray_SimpleNew(1, &len, NPY_INT);
-      
+   if (matout == NULL) {
+      unlock_model(self);
+      return NULL;
+   }
    for (i=0;i<len;i++) {
       *((int *) PyArray_GETPTR1(matout, i)) = self->model.sub[i].numRFS; 
    }
+   unlock_model(self);
    return PyArray_Return(matout);
 }
 
 static PyObject *PyLWPR_G_n_pruned(PyLWPR *self, void *closure) {
    int i;
    PyArrayObject *matout;
-   npy_intp len = self->model.nOut;
+   npy_intp len;
    
+   lock_model(self);
+   len = self->model.nOut;
    matout = (PyArrayObject *) PyArray_SimpleNew(1, &len, NPY_INT);
-
+   if (matout == NULL) {
+      unlock_model(self);
+      return NULL;
+   }
    for (i=0;i<len;i++) {
       *((int *) PyArray_GETPTR1(matout, i)) = self->model.sub[i].n_pruned;
    }
+   unlock_model(self);
    return PyArray_Return(matout);
 }
 
 /**  "Getter and Setter" for kernel ***********************************************/
 static PyObject *PyLWPR_G_kernel(PyLWPR *self, void *closure) {
-   int num = self->model.kernel == LWPR_BISQUARE_KERNEL ? 1:0;
-   return PyString_FromString(GaussBiSq[num]);
+   const LWPR_KernelInfo *kern;
+   lock_model(self);
+   kern = lwpr_kernel_info(self->model.kernel);
+   unlock_model(self);
+   return PyString_FromString(kern != NULL ? kern->name : "Unknown");
 }
 
 static int PyLWPR_S_kernel(PyLWPR *self, PyObject *value, void *closure) {
    const char *str;
+   LWPR_Kernel kernel;
    if (!PyString_Check(value)) {
       PyErr_SetString(PyExc_TypeError, "Attribute 'kernel' must be a string (either 'Gaussian' or 'BiSquare').");
       return -1;
    }
    str = PyString_AsString(value);
    if (!strcasecmp(str,"Gaussian")) {
-      self->model.kernel = LWPR_GAUSSIAN_KERNEL;
+      kernel = LWPR_GAUSSIAN_KERNEL;
    } else if (!strcasecmp(str,"BiSquare")) {
-      self->model.kernel = LWPR_BISQUARE_KERNEL;
+      kernel = LWPR_BISQUARE_KERNEL;
+   } else if (lwpr_kernel_by_name(str) >= 0) {
+      /* Kernel registered through the C library (lwpr_register_kernel) */
+      kernel = (LWPR_Kernel) lwpr_kernel_by_name(str);
    } else {
-      PyErr_SetString(PyExc_TypeError, "Attribute 'kernel' must be either 'Gaussian' or 'BiSquare'.");
+      PyErr_SetString(PyExc_TypeError, "Attribute 'kernel' must be either 'Gaussian', 'BiSquare', or the name of a registered kernel.");
       return -1;
    }
+   lock_model(self);
+   self->model.kernel = kernel;
+   unlock_model(self);
    return 0;
 }
 
@@ -257,89 +386,55 @@ static int PyLWPR_S_kernel(PyLWPR *self, PyObject *value, void *closure) {
 static int PyLWPR_S_meta(PyLWPR *self, PyObject *value, void *closure) {
    CHECK_DELETE(value,"meta");
    CHECK_BOOL(value,"meta");
+   lock_model(self);
    self->model.meta = (value == Py_True) ? 1 : 0;
+   unlock_model(self);
    return 0;
 }
 
 static int PyLWPR_S_diag_only(PyLWPR *self, PyObject *value, void *closure) {
    CHECK_DELETE(value,"diag_only");
    CHECK_BOOL(value,"diag_only");
+   lock_model(self);
    self->model.diag_only = (value == Py_True) ? 1 : 0;
+   unlock_model(self);
    return 0;
 }
 
 static int PyLWPR_S_update_D(PyLWPR *self, PyObject *value, void *closure) {
    CHECK_DELETE(value,"update_D");
    CHECK_BOOL(value,"update_D");
+   lock_model(self);
    self->model.update_D = (value == Py_True) ? 1 : 0;
+   unlock_model(self);
    return 0;
 }
 
-static int PyLWPR_S_w_prune(PyLWPR *self, PyObject *value, void *closure) {
-   CHECK_DELETE(value,"w_prune");
-   CHECK_GET_SCALAR(value,"w_prune",self->model.w_prune);
-   return 0;
-}
-
-static int PyLWPR_S_w_gen(PyLWPR *self, PyObject *value, void *closure) {
-   CHECK_DELETE(value,"w_gen");
-   CHECK_GET_SCALAR(value,"w_gen",self->model.w_gen);
-   return 0;
-}
-
-static int PyLWPR_S_meta_rate(PyLWPR *self, PyObject *value, void *closure) {
-   CHECK_DELETE(value,"meta_rate");
-   CHECK_GET_SCALAR(value,"meta_rate",self->model.meta_rate);
-   return 0;
-}
-
-static int PyLWPR_S_penalty(PyLWPR *self, PyObject *value, void *closure) {
-   CHECK_DELETE(value,"penalty");
-   CHECK_GET_SCALAR(value,"penalty",self->model.penalty);
-   return 0;
-}
-
-static int PyLWPR_S_init_S2(PyLWPR *self, PyObject *value, void *closure) {
-   CHECK_DELETE(value,"init_S2");
-   CHECK_GET_SCALAR(value,"init_S2",self->model.init_S2);
-   return 0;
+#define LOCKED_SCALAR_SETTER(name) \
+static int PyLWPR_S_##name(PyLWPR *self, PyObject *value, void *closure) {\
+   double val;\
+   CHECK_DELETE(value,#name);\
+   CHECK_GET_SCALAR(value,#name,val);\
+   lock_model(self);\
+   self->model.name = val;\
+   unlock_model(self);\
+   return 0;\
 }
 
-static int PyLWPR_S_init_lambda(PyLWPR *self, PyObject *value, void *closure) {
-   CHECK_DELETE(value,"init_lambda");
-   CHECK_GET_SCALAR(value,"init_lambda",self->model.init_lambda);
-   return 0;
-}
-
-static int PyLWPR_S_tau_lambda(PyLWPR *self, PyObject *value, void *closure) {
-   CHECK_DELETE(value,"tau_lambda");
-   CHECK_GET_SCALAR(value,"tau_lambda",self->model.tau_lambda);
-   return 0;
-}
-
-static int PyLWPR_S_final_lambda(PyLWPR *self, PyObject *value, void *closure) {
-   CHECK_DELETE(value,"final_lambda");
-   CHECK_GET_SCALAR(value,"final_lambda",self->model.final_lambda);
-   return 0;
-}
-
-static int PyLWPR_S_add_threshold(PyLWPR *self, PyObject *value, void *closure) {
-   CHECK_DELETE(value,"add_threshold");
-   CHECK_GET_SCALAR(value,"add_threshold",self->model.add_threshold);
-   return 0;
-}
-
-static int PyLWPR_S_init_D(PyLWPR *self,PyObject *value, void *closure) { 
-   int err;
-   LWPR_Model *m = &(self->model);
-   if (!PyArray_Check(value)) {
-      PyErr_SetString(PyExc_TypeError, "Attribute 'init_D' must be a numpy array.");
-      return -1;
-   }
+LOCKED_SCALAR_SETTER(w_prune)
+LOCKED_SCALAR_SETTER(w_gen)
+LOCKED_SCALAR_SETTER(meta_rate)
+LOCKED_SCALAR_SETTER(penalty)
+LOCKED_SCALAR_SETTER(init_S2)
+LOCKED_SCALAR_SETTER(init_lambda)
+LOCKED_SCALAR_SETTER(tau_lambda)
+LOCKED_SCALAR_SETTER(final_lambda)
+LOCKED_SCALAR_SETTER(add_threshold)
+
+static int set_init_D(LWPR_Model *m, PyArrayObject *value) {
    /* First, set init_M to the matrix, and do a Cholesky decomposition in place
    ** If this fails, keep and decompose the original init_D */
-   err = set_matrix_from_array(m->nIn, m->nInStore, m->nIn, m->init_M, (PyArrayObject *)value);
-   if (err) {
+   if (set_matrix_from_array(m->nIn, m->nInStore, m->nIn, m->init_M, value)) {
       lwpr_math_cholesky(m->nIn, m->nInStore, m->init_M, m->init_D);
       return -1;
    }                            
@@ -351,23 +446,16 @@ static int PyLWPR_S_init_D(PyLWPR *self,PyObject *value, void *closure) {
    }
    /* Ok, everything was fine, init_M is already the factor, 
       copy the contents again to init_D */
-   set_matrix_from_array(m->nIn, m->nInStore, m->nIn, m->init_D, (PyArrayObject *)value);
+   set_matrix_from_array(m->nIn, m->nInStore, m->nIn, m->init_D, value);
    return 0;
 }
 
-static int PyLWPR_S_init_M(PyLWPR *self,PyObject *value, void *closure) { 
-   int err;
+static int set_init_M(LWPR_Model *m, PyArrayObject *value) {
    int i,j;
-   LWPR_Model *m = &(self->model);   
    int nIn = m->nIn;
    int nInS = m->nInStore;
    
-   if (!PyArray_Check(value)) {
-      PyErr_SetString(PyExc_TypeError, "Attribute 'init_M' must be a numpy array.");
-      return -1;
-   }
-   err = set_matrix_from_array(nIn, nInS, nIn, m->init_M, (PyArrayObject *)value);
-   if (err) {
+   if (set_matrix_from_array(nIn, nInS, nIn, m->init_M, value)) {
       /* There was a problem with the matrix, revert to original cholesky factor of init_D */
       lwpr_math_cholesky(nIn, nInS, m->init_M, m->init_D);
       return -1;
@@ -393,31 +481,37 @@ static int PyLWPR_S_init_M(PyLWPR *self,PyObject *value, void *closure) {
    return 0;
 }
 
-static int PyLWPR_S_init_alpha(PyLWPR *self,PyObject *value, void *closure) { 
-   if (!PyArray_Check(value)) {
-      PyErr_SetString(PyExc_TypeError, "Attribute 'init_alpha' must be a numpy array.");
-      return -1;
-   }
-   return set_matrix_from_array(self->model.nIn, self->model.nInStore, self->model.nIn, 
-                                 self->model.init_alpha, (PyArrayObject *)value);
+static int set_init_alpha(LWPR_Model *m, PyArrayObject *value) {
+   return set_matrix_from_array(m->nIn, m->nInStore, m->nIn, m->init_alpha, value);
 }
 
-static int PyLWPR_S_norm_in(PyLWPR *self,PyObject *value, void *closure) { 
-   if (!PyArray_Check(value)) {
-      PyErr_SetString(PyExc_TypeError, "Attribute 'norm_in' must be a numpy array.");
-      return -1;
-   }
-   return set_vector_from_array(self->model.nIn, self->model.norm_in, (PyArrayObject *)value);
+static int set_norm_in(LWPR_Model *m, PyArrayObject *value) {
+   return set_vector_from_array(m->nIn, m->norm_in, value);
 }
 
-static int PyLWPR_S_norm_out(PyLWPR *self,PyObject *value, void *closure) { 
-   if (!PyArray_Check(value)) {
-      PyErr_SetString(PyExc_TypeError, "Attribute 'norm_out' must be a numpy array.");
-      return -1;
-   }
-   return set_vector_from_array(self->model.nOut, self->model.norm_out, (PyArrayObject *)value);
+static int set_norm_out(LWPR_Model *m, PyArrayObject *value) {
+   return set_vector_from_array(m->nOut, m->norm_out, value);
 }
 
+#define LOCKED_ARRAY_SETTER(name) \
+static int PyLWPR_S_##name(PyLWPR *self,PyObject *value, void *closure) {\
+   int err;\
+   if (value == NULL || !PyArray_Check(value)) {\
+      PyErr_SetString(PyExc_TypeError, "Attribute '" #name "' must be a numpy array.");\
+      return -1;\
+   }\
+   lock_model(self);\
+   err = set_##name(&(self->model), (PyArrayObject *) value);\
+   unlock_model(self);\
+   return err;\
+}
+
+LOCKED_ARRAY_SETTER(init_D)
+LOCKED_ARRAY_SETTER(init_M)
+LOCKED_ARRAY_SETTER(init_alpha)
+LOCKED_ARRAY_SETTER(norm_in)
+LOCKED_ARRAY_SETTER(norm_out)
+
 static PyGetSetDef PyLWPR_getseters[] = {
    {"nIn", (getter) PyLWPR_G_nIn, NULL, 
       "Input dimension", NULL},
@@ -538,19 +632,22 @@ static PyObject *PyLWPR_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
       lwpr_init_model(&self->model, nIn, nOut, NULL);
    }
     
-   self->extra_in = malloc(sizeof(double) * (nIn*(nOut +1) + 3*nOut));
-   self->extra_out = self->extra_in + nIn;
-   self->extra_out2 = self->extra_out + nOut;
-   self->extra_out3 = self->extra_out2 + nOut;
-   self->extra_J = self->extra_out3 + nOut;
+   self->lock = PyThread_allocate_lock();
+   if (alloc_extra(self, nIn, nOut) || self->lock == NULL) {
+      Py_DECREF(self);
+      return PyErr_NoMemory();
+   }
 
    return (PyObject *)self;
 }
 
 static PyObject *PyLWPR_repr(PyLWPR *obj) {
    LWPR_Model *m = &(obj->model);
+   const LWPR_KernelInfo *kern;
    char str[1001];
    
+   lock_model(obj);
+   kern = lwpr_kernel_info(m->kernel);
    snprintf(str,1000,
       "LWPR model\n"
       "          nIn : %d\n"
@@ -574,17 +671,23 @@ static PyObject *PyLWPR_repr(PyLWPR *obj) {
          m->penalty, m->init_S2, m->w_prune, m->w_gen, 
          TrueFalse[m->diag_only], TrueFalse[m->update_D], TrueFalse[m->meta],
          m->meta_rate, m->init_lambda, m->final_lambda, m->tau_lambda, 
-         m->add_threshold, GaussBiSq[m->kernel==LWPR_BISQUARE_KERNEL?1:0]);
+         m->add_threshold, kern != NULL ? kern->name : "Unknown");
+   unlock_model(obj);
          
    return PyString_FromString(str);
 }
 
-static PyObject *PyLWPR_update(PyLWPR *self, PyObject *args) {
+static PyObject *update_unlocked(PyLWPR *self, PyObject *args) {
    LWPR_Model *model = &(self->model);
    PyArrayObject *x, *y;
    if (!PyArg_ParseTuple(args, "O!O!", &PyArray_Type, &x, &PyArray_Type, &y))  return NULL;
    if (set_vector_from_array(model->nIn, self->extra_in, x)) return NULL;
    if (set_vector_from_array(model->nOut, self->extra_out, y)) return NULL;   
+   if (model->inference_only) {
+      PyErr_SetString(PyExc_RuntimeError, "Model was stripped for inference and cannot be updated.");
+      return NULL;
+   }
+   if (check_no_views(self)) return NULL;
    
    lwpr_update(model,self->extra_in, self->extra_out, self->extra_out2, NULL);
    
@@ -592,7 +695,7 @@ static PyObject *PyLWPR_update(PyLWPR *self, PyObject *args) {
 }
 
 
-static PyObject *PyLWPR_update_maxw(PyLWPR *self, PyObject *args) {
+static PyObject *update_maxw_unlocked(PyLWPR *self, PyObject *args) {
    LWPR_Model *model = &(self->model);
    PyArrayObject *x, *y;
    PyObject *o1,*o2,*result;
@@ -600,6 +703,11 @@ static PyObject *PyLWPR_update_maxw(PyLWPR *self, PyObject *args) {
    if (!PyArg_ParseTuple(args, "O!O!", &PyArray_Type, &x, &PyArray_Type, &y))  return NULL;
    if (set_vector_from_array(model->nIn, self->extra_in, x)) return NULL;
    if (set_vector_from_array(model->nOut, self->extra_out, y)) return NULL;   
+   if (model->inference_only) {
+      PyErr_SetString(PyExc_RuntimeError, "Model was stripped for inference and cannot be updated.");
+      return NULL;
+   }
+   if (check_no_views(self)) return NULL;
    
    lwpr_update(model,self->extra_in, self->extra_out, self->extra_out2, self->extra_out3);
    
@@ -615,7 +723,7 @@ static PyObject *PyLWPR_update_maxw(PyLWPR *self, PyObject *args) {
 }
 
 
-static PyObject *PyLWPR_predict(PyLWPR *self, PyObject *args) {
+static PyObject *predict_unlocked(PyLWPR *self, PyObject *args) {
    double cutoff = 0.0;
    LWPR_Model *model = &(self->model);
    PyArrayObject *x;
@@ -628,7 +736,7 @@ static PyObject *PyLWPR_predict(PyLWPR *self, PyObject *args) {
    return get_array_from_vector(model->nOut, self->extra_out);
 }
 
-static PyObject *PyLWPR_predict_conf(PyLWPR *self, PyObject *args) {
+static PyObject *predict_conf_unlocked(PyLWPR *self, PyObject *args) {
    double cutoff = 0.0;
    LWPR_Model *model = &(self->model);
    PyArrayObject *x;
@@ -650,7 +758,7 @@ static PyObject *PyLWPR_predict_conf(PyLWPR *self, PyObject *args) {
    return result;
 }
 
-static PyObject *PyLWPR_predict_conf_maxw(PyLWPR *self, PyObject *args) {
+static PyObject *predict_conf_maxw_unlocked(PyLWPR *self, PyObject *args) {
    double cutoff = 0.0;
    LWPR_Model *model = &(self->model);
    PyArrayObject *x;
@@ -674,7 +782,7 @@ static PyObject *PyLWPR_predict_conf_maxw(PyLWPR *self, PyObject *args) {
    return result;
 }
 
-static PyObject *PyLWPR_predict_J(PyLWPR *self, PyObject *args) {
+static PyObject *predict_J_unlocked(PyLWPR *self, PyObject *args) {
    double cutoff = 0.0;
    LWPR_Model *model = &(self->model);
    PyArrayObject *x;
@@ -696,7 +804,157 @@ static PyObject *PyLWPR_predict_J(PyLWPR *self, PyObject *args) {
    return result;
 }
 
-static PyObject *PyLWPR_rf_center(PyLWPR *self, PyObject *args) {
+static PyObject *update_batch_unlocked(PyLWPR *self, PyObject *args) {
+   LWPR_Model *model = &(self->model);
+   PyObject *xobj, *yobj;
+   PyArrayObject *X, *Y, *Yp;
+   int i, N, ok = 1;
+   
+   if (!PyArg_ParseTuple(args, "OO", &xobj, &yobj))  return NULL;
+   if (model->inference_only) {
+      PyErr_SetString(PyExc_RuntimeError, "Model was stripped for inference and cannot be updated.");
+      return NULL;
+   }
+   if (check_no_views(self)) return NULL;
+   X = get_batch_from_object(xobj, model->nIn);
+   if (X == NULL) return NULL;
+   Y = get_batch_from_object(yobj, model->nOut);
+   if (Y == NULL) {
+      Py_DECREF(X);
+      return NULL;
+   }
+   if (PyArray_DIM(X,0) != PyArray_DIM(Y,0)) {
+      PyErr_SetString(PyExc_TypeError, "Input and output batches must have the same number of rows.");
+      Py_DECREF(X);
+      Py_DECREF(Y);
+      return NULL;
+   }
+   N = (int) PyArray_DIM(X,0);
+   Yp = new_batch_array(N, model->nOut);
+   if (Yp == NULL) {
+      Py_DECREF(X);
+      Py_DECREF(Y);
+      return NULL;
+   }
+   
+   Py_BEGIN_ALLOW_THREADS
+   for (i=0;i<N && ok;i++) {
+      ok = lwpr_update(model, (double *) PyArray_DATA(X) + i*model->nIn,
+            (double *) PyArray_DATA(Y) + i*model->nOut, 
+            (double *) PyArray_DATA(Yp) + i*model->nOut, NULL);
+   }
+   Py_END_ALLOW_THREADS
+   
+   Py_DECREF(X);
+   Py_DECREF(Y);
+   if (!ok) {
+      PyErr_Format(PyExc_MemoryError, "Receptive field could not be added (sample %d), model was updated with the preceding samples only.", i-1);
+      Py_DECREF(Yp);
+      return NULL;
+   }
+   return PyArray_Return(Yp);
+}
+
+static PyObject *predict_batch_generic(PyLWPR *self, PyObject *args, int numOut) {
+   double cutoff = 0.0;
+   LWPR_Model *model = &(self->model);
+   PyObject *xobj, *result;
+   PyArrayObject *X, *Yp[3] = {NULL, NULL, NULL};
+   int i, N;
+
+   if (!PyArg_ParseTuple(args, "O|d", &xobj, &cutoff))  return NULL;
+   X = get_batch_from_object(xobj, model->nIn);
+   if (X == NULL) return NULL;
+   N = (int) PyArray_DIM(X,0);
+   
+   for (i=0;i<numOut;i++) {
+      Yp[i] = new_batch_array(N, model->nOut);
+      if (Yp[i] == NULL) {
+         Py_DECREF(X);
+         for (--i;i>=0;i--) Py_DECREF(Yp[i]);
+         return NULL;
+      }
+   }
+   
+   Py_BEGIN_ALLOW_THREADS
+   lwpr_predict_batch(model, N, (double *) PyArray_DATA(X), model->nIn, cutoff,
+         (double *) PyArray_DATA(Yp[0]), model->nOut, 
+         Yp[1] ? (double *) PyArray_DATA(Yp[1]) : NULL,
+         Yp[2] ? (double *) PyArray_DATA(Yp[2]) : NULL);
+   Py_END_ALLOW_THREADS
+   
+   Py_DECREF(X);
+   
+   if (numOut == 1) return PyArray_Return(Yp[0]);
+   if (numOut == 2) {
+      result = Py_BuildValue("(O,O)",Yp[0],Yp[1]);
+   } else {
+      result = Py_BuildValue("(O,O,O)",Yp[0],Yp[1],Yp[2]);
+   }
+   for (i=0;i<numOut;i++) Py_DECREF(Yp[i]);
+   return result;
+}
+
+static PyObject *predict_batch_unlocked(PyLWPR *self, PyObject *args) {
+   return predict_batch_generic(self, args, 1);
+}
+
+static PyObject *predict_conf_batch_unlocked(PyLWPR *self, PyObject *args) {
+   return predict_batch_generic(self, args, 2);
+}
+
+static PyObject *predict_conf_maxw_batch_unlocked(PyLWPR *self, PyObject *args) {
+   return predict_batch_generic(self, args, 3);
+}
+
+static PyObject *predict_J_batch_unlocked(PyLWPR *self, PyObject *args) {
+   double cutoff = 0.0;
+   LWPR_Model *model = &(self->model);
+   PyObject *xobj, *Jt, *result;
+   PyArrayObject *X, *Yp, *J;
+   npy_intp dims[3];
+   int N;
+
+   if (!PyArg_ParseTuple(args, "O|d", &xobj, &cutoff))  return NULL;
+   X = get_batch_from_object(xobj, model->nIn);
+   if (X == NULL) return NULL;
+   N = (int) PyArray_DIM(X,0);
+   
+   /* The C library stores each Jacobian column-major, which is a C-contiguous
+      (nIn x nOut) block. We allocate (N x nIn x nOut) and return a transposed view. */
+   dims[0] = N;
+   dims[1] = model->nIn;
+   dims[2] = model->nOut;
+   Yp = new_batch_array(N, model->nOut);
+   J = (PyArrayObject *) PyArray_SimpleNew(3, dims, NPY_DOUBLE);
+   if (Yp == NULL || J == NULL) {
+      Py_DECREF(X);
+      Py_XDECREF(Yp);
+      Py_XDECREF(J);
+      return NULL;
+   }
+   
+   Py_BEGIN_ALLOW_THREADS
+   lwpr_predict_J_batch(model, N, (double *) PyArray_DATA(X), model->nIn, cutoff,
+         (double *) PyArray_DATA(Yp), model->nOut, (double *) PyArray_DATA(J));
+   Py_END_ALLOW_THREADS
+   
+   Py_DECREF(X);
+   
+   Jt = PyArray_SwapAxes(J, 1, 2);
+   Py_DECREF(J);
+   if (Jt == NULL) {
+      Py_DECREF(Yp);
+      return NULL;
+   }
+   
+   result = Py_BuildValue("(O,O)",Yp,Jt);
+   Py_DECREF(Yp);
+   Py_DECREF(Jt);
+   return result;
+}
+
+static PyObject *rf_center_unlocked(PyLWPR *self, PyObject *args) {
    int dim, n;
    LWPR_Model *model = &(self->model);
 
@@ -715,9 +973,10 @@ static PyObject *PyLWPR_rf_center(PyLWPR *self, PyObject *args) {
    return get_array_from_vector(model->nIn, model->sub[dim].rf[n]->c);
 }
 
-static PyObject *PyLWPR_rf_D(PyLWPR *self, PyObject *args) {
+static PyObject *rf_D_unlocked(PyLWPR *self, PyObject *args) {
    int dim, n;
    LWPR_Model *model = &(self->model);
+   LWPR_ReceptiveField *RF;
 
    if (!PyArg_ParseTuple(args, "ii", &dim, &n))  return NULL;
    
@@ -731,15 +990,205 @@ static PyObject *PyLWPR_rf_D(PyLWPR *self, PyObject *args) {
       return NULL;
    }
    
-   return get_array_from_matrix(model->nIn, model->nInStore, model->nIn, model->sub[dim].rf[n]->D);
+   RF = model->sub[dim].rf[n];
+   if (RF->D == NULL) {
+      /* Stripped models only keep the Cholesky factor of full distance metrics */
+      PyObject *D;
+      double *Dp = (double *) malloc(LWPR_TRI_SIZE(model->nIn)*sizeof(double));
+      if (Dp == NULL) return PyErr_NoMemory();
+      lwpr_math_trip_gram(model->nIn, Dp, RF->M);
+      D = get_array_from_tri(model->nIn, Dp, 1);
+      free(Dp);
+      return D;
+   }
+   return get_array_from_tri(model->nIn, RF->D, 1);
+}
+
+static int check_dim_argument(const LWPR_Model *model, int dim) {
+   if (dim<0 || dim>=model->nOut) {
+      PyErr_SetString(PyExc_TypeError, "First parameter must indicate output dimension (0 <= dim < model.nOut).");
+      return -1;
+   }
+   return 0;
+}
+
+static PyObject *rf_centers_unlocked(PyLWPR *self, PyObject *args) {
+   int dim, n;
+   LWPR_Model *model = &(self->model);
+   PyArrayObject *out;
+   double *dest;
+   
+   if (!PyArg_ParseTuple(args, "i", &dim))  return NULL;
+   if (check_dim_argument(model, dim)) return NULL;
+   
+   out = new_batch_array(model->sub[dim].numRFS, model->nIn);
+   if (out == NULL) return NULL;
+   dest = (double *) PyArray_DATA(out);
+   for (n=0;n<model->sub[dim].numRFS;n++) {
+      memcpy(dest + n*model->nIn, model->sub[dim].rf[n]->c, model->nIn*sizeof(double));
+   }
+   return PyArray_Return(out);
+}
+
+static PyObject *rf_beta0s_unlocked(PyLWPR *self, PyObject *args) {
+   int dim, n;
+   npy_intp len;
+   LWPR_Model *model = &(self->model);
+   PyArrayObject *out;
+   double *dest;
+   
+   if (!PyArg_ParseTuple(args, "i", &dim))  return NULL;
+   if (check_dim_argument(model, dim)) return NULL;
+   
+   len = model->sub[dim].numRFS;
+   out = (PyArrayObject *) PyArray_SimpleNew(1, &len, NPY_DOUBLE);
+   if (out == NULL) return NULL;
+   dest = (double *) PyArray_DATA(out);
+   for (n=0;n<model->sub[dim].numRFS;n++) dest[n] = model->sub[dim].rf[n]->beta0;
+   return PyArray_Return(out);
+}
+
+/** Stacks the packed metrics (D if getM==0, M otherwise) of all RFs into a (numRFS x nIn x nIn) array. 
+    Each slice is unpacked column-major, so the result is returned as a view with the last two axes swapped. */
+static PyObject *get_rf_metric_stack(PyLWPR *self, PyObject *args, int getM) {
+   int dim, n, nIn;
+   npy_intp dims[3];
+   LWPR_Model *model = &(self->model);
+   PyArrayObject *out;
+   PyObject *result;
+   double *dest, *tmp = NULL;
+   
+   if (!PyArg_ParseTuple(args, "i", &dim))  return NULL;
+   if (check_dim_argument(model, dim)) return NULL;
+   
+   nIn = model->nIn;
+   dims[0] = model->sub[dim].numRFS;
+   dims[1] = dims[2] = nIn;
+   out = (PyArrayObject *) PyArray_SimpleNew(3, dims, NPY_DOUBLE);
+   if (out == NULL) return NULL;
+   dest = (double *) PyArray_DATA(out);
+   
+   for (n=0;n<model->sub[dim].numRFS;n++) {
+      const LWPR_ReceptiveField *RF = model->sub[dim].rf[n];
+      const double *src = getM ? RF->M : RF->D;
+      
+      if (src == NULL && !getM) {
+         /* Stripped models only keep the Cholesky factor of full distance metrics */
+         if (tmp == NULL) {
+            tmp = (double *) malloc(LWPR_TRI_SIZE(nIn)*sizeof(double));
+            if (tmp == NULL) {
+               Py_DECREF(out);
+               return PyErr_NoMemory();
+            }
+         }
+         lwpr_math_trip_gram(nIn, tmp, RF->M);
+         src = tmp;
+      }
+      if (src == NULL) {
+         free(tmp);
+         Py_DECREF(out);
+         PyErr_SetString(PyExc_RuntimeError, "Cholesky factors were dropped by strip_for_inference() for this diagonal-only model.");
+         return NULL;
+      }
+      lwpr_math_tri_unpack(nIn, nIn, dest + n*nIn*nIn, src, !getM);
+   }
+   free(tmp);
+   
+   result = PyArray_SwapAxes(out, 1, 2);
+   Py_DECREF(out);
+   return result;
+}
+
+static PyObject *rf_Ds_unlocked(PyLWPR *self, PyObject *args) {
+   return get_rf_metric_stack(self, args, 0);
+}
+
+static PyObject *rf_Ms_unlocked(PyLWPR *self, PyObject *args) {
+   return get_rf_metric_stack(self, args, 1);
+}
+
+/** Returns a read-only numpy array that aliases RF storage. D and M are exposed in
+    their packed form (upper triangle, column by column, see LWPR_TRI). The array 
+    keeps the LWPR object alive through a PyLWPR_ViewBase, and as long as it exists,
+    update(), update_batch(), strip_for_inference() and unpickling raise an exception,
+    since they could free or move the receptive field. */
+static PyObject *rf_view_unlocked(PyLWPR *self, PyObject *args) {
+   int dim, n, nd = 1;
+   const char *field;
+   npy_intp dims[2], strides[2];
+   double *data;
+   LWPR_Model *model = &(self->model);
+   LWPR_ReceptiveField *RF;
+   PyArrayObject *view;
+   PyLWPR_ViewBase *base;
+   
+   if (!PyArg_ParseTuple(args, "iis", &dim, &n, &field))  return NULL;
+   if (check_dim_argument(model, dim)) return NULL;
+   if (n<0 || n>=model->sub[dim].numRFS) {
+      PyErr_SetString(PyExc_TypeError, "Second parameter must indicate receptive field (0 <= n < model.num_rf[dim]).");
+      return NULL;
+   }
+   RF = model->sub[dim].rf[n];
+   
+   dims[0] = model->nIn;
+   strides[0] = sizeof(double);
+   
+   if (!strcmp(field, "c")) {
+      data = RF->c;
+   } else if (!strcmp(field, "mean_x")) {
+      data = RF->mean_x;
+   } else if (!strcmp(field, "var_x")) {
+      data = RF->var_x;
+   } else if (!strcmp(field, "slope")) {
+      data = RF->slopeReady ? RF->slope : NULL;
+   } else if (!strcmp(field, "beta")) {
+      data = RF->beta;
+      dims[0] = RF->nReg;
+   } else if (!strcmp(field, "U") || !strcmp(field, "P")) {
+      /* nIn x nReg, column-major with leading dimension nInStore */
+      data = field[0] == 'U' ? RF->U : RF->P;
+      nd = 2;
+      dims[1] = RF->nReg;
+      strides[1] = model->nInStore * sizeof(double);
+   } else if (!strcmp(field, "D") || !strcmp(field, "M")) {
+      /* upper triangle, packed column by column (see LWPR_TRI) */
+      data = field[0] == 'D' ? RF->D : RF->M;
+      dims[0] = LWPR_TRI_SIZE(model->nIn);
+   } else {
+      PyErr_SetString(PyExc_ValueError, "Third parameter must be one of 'c', 'mean_x', 'var_x', 'slope', 'beta', 'U', 'P', 'D', 'M'.");
+      return NULL;
+   }
+   if (data == NULL) {
+      PyErr_SetString(PyExc_RuntimeError, "Requested field is not available in this receptive field (stripped model or slope not computed).");
+      return NULL;
+   }
+   
+   base = PyObject_New(PyLWPR_ViewBase, &PyLWPR_ViewBase_Type);
+   if (base == NULL) return NULL;
+   Py_INCREF(self);
+   base->owner = self;
+   self->num_views++;
+   
+   view = (PyArrayObject *) PyArray_New(&PyArray_Type, nd, dims, NPY_DOUBLE, strides, data, 
+            sizeof(double), NPY_ALIGNED, NULL);
+   if (view == NULL) {
+      Py_DECREF(base);
+      return NULL;
+   }
+   view->base = (PyObject *) base;
+   return (PyObject *) view;
 }
 
-static PyObject *PyLWPR_write_XML(PyLWPR *self, PyObject *args) {
+static PyObject *write_XML_unlocked(PyLWPR *self, PyObject *args) {
    char *filename;
    FILE *fp;
    LWPR_Model *model = &(self->model);
 
    if (!PyArg_ParseTuple(args, "s", &filename))  return NULL;
+   if (model->inference_only) {
+      PyErr_SetString(PyExc_IOError, "Models stripped for inference cannot be written to XML.");
+      return NULL;
+   }
    fp = fopen(filename, "w");
    if (fp==NULL) {
       PyErr_SetString(PyExc_IOError, "File cannot be opened for writing.");
@@ -752,7 +1201,70 @@ static PyObject *PyLWPR_write_XML(PyLWPR *self, PyObject *args) {
    return Py_None;
 }
 
-static PyObject *PyLWPR_write_binary(PyLWPR *self, PyObject *args) {
+/** Pickle support: the state is the binary representation of the model, which
+    is written into a single string buffer of exactly the right size. */
+static PyObject *getstate_unlocked(PyLWPR *self, PyObject *args) {
+   LWPR_Model *model = &(self->model);
+   PyObject *state;
+   size_t size;
+   int ok;
+   
+   size = lwpr_binary_size(model);
+   state = (size > 0) ? PyString_FromStringAndSize(NULL, (Py_ssize_t) size) : NULL;
+   if (state == NULL) {
+      if (!PyErr_Occurred()) PyErr_SetString(PyExc_RuntimeError, "Model cannot be serialised.");
+      return NULL;
+   }
+   ok = lwpr_write_binary_mem(model, PyString_AS_STRING(state), size);
+   
+   if (!ok) {
+      PyErr_SetString(PyExc_RuntimeError, "Model cannot be serialised.");
+      Py_DECREF(state);
+      return NULL;
+   }
+   return state;
+}
+
+static PyObject *setstate_unlocked(PyLWPR *self, PyObject *args) {
+   const char *buf;
+   int len;
+   LWPR_Model tmp;
+   
+   if (!PyArg_ParseTuple(args, "s#", &buf, &len))  return NULL;
+   if (check_no_views(self)) return NULL;
+   
+   if (!lwpr_read_binary_mem(&tmp, buf, (size_t) len)) {
+      PyErr_SetString(PyExc_ValueError, "State is not a valid binary LWPR model.");
+      return NULL;
+   }
+   if ((tmp.nIn != self->model.nIn || tmp.nOut != self->model.nOut) && alloc_extra(self, tmp.nIn, tmp.nOut)) {
+      lwpr_free_model(&tmp);
+      return PyErr_NoMemory();
+   }
+   
+   lwpr_free_model(&self->model);
+   lwpr_move_model(&self->model, &tmp);
+   
+   Py_INCREF(Py_None);
+   return Py_None;
+}
+
+static PyObject *PyLWPR_reduce(PyLWPR *self, PyObject *args) {
+   PyObject *state, *result;
+   int nIn, nOut;
+   
+   lock_model(self);
+   state = getstate_unlocked(self, NULL);
+   nIn = self->model.nIn;
+   nOut = self->model.nOut;
+   unlock_model(self);
+   if (state == NULL) return NULL;
+   result = Py_BuildValue("(O(ii)O)", (PyObject *) self->ob_type, nIn, nOut, state);
+   Py_DECREF(state);
+   return result;
+}
+
+static PyObject *write_binary_unlocked(PyLWPR *self, PyObject *args) {
    char *filename;
    FILE *fp;
    LWPR_Model *model = &(self->model);
@@ -777,6 +1289,54 @@ static PyObject *PyLWPR_write_binary(PyLWPR *self, PyObject *args) {
 }
 
 
+static PyObject *strip_for_inference_unlocked(PyLWPR *self, PyObject *args) {
+   if (!PyArg_ParseTuple(args, ""))  return NULL;
+   if (check_no_views(self)) return NULL;
+   if (!lwpr_strip_for_inference(&(self->model))) {
+      PyErr_SetString(PyExc_MemoryError, "Not enough memory for stripping the model.");
+      return NULL;
+   }
+   Py_INCREF(Py_None);
+   return Py_None;
+}
+
+
+/** All methods that access the model run entirely under the model lock (see lock_model).
+    The batch methods release the GIL while holding it. */
+#define LOCKED_METHOD(name) \
+static PyObject *PyLWPR_##name(PyLWPR *self, PyObject *args) {\
+   PyObject *result;\
+   lock_model(self);\
+   result = name##_unlocked(self, args);\
+   unlock_model(self);\
+   return result;\
+}
+
+LOCKED_METHOD(update)
+LOCKED_METHOD(update_maxw)
+LOCKED_METHOD(predict)
+LOCKED_METHOD(predict_conf)
+LOCKED_METHOD(predict_conf_maxw)
+LOCKED_METHOD(predict_J)
+LOCKED_METHOD(update_batch)
+LOCKED_METHOD(predict_batch)
+LOCKED_METHOD(predict_conf_batch)
+LOCKED_METHOD(predict_conf_maxw_batch)
+LOCKED_METHOD(predict_J_batch)
+LOCKED_METHOD(getstate)
+LOCKED_METHOD(setstate)
+LOCKED_METHOD(rf_center)
+LOCKED_METHOD(rf_D)
+LOCKED_METHOD(rf_centers)
+LOCKED_METHOD(rf_beta0s)
+LOCKED_METHOD(rf_Ds)
+LOCKED_METHOD(rf_Ms)
+LOCKED_METHOD(rf_view)
+LOCKED_METHOD(write_XML)
+LOCKED_METHOD(write_binary)
+LOCKED_METHOD(strip_for_inference)
+
+
 static PyMethodDef PyLWPR_methods[] = {
     {"update", (PyCFunction)PyLWPR_update, METH_VARARGS,
      "Update an LWPR model given an (input, output) training sample. Returns current prediction."},
@@ -790,14 +1350,46 @@ static PyMethodDef PyLWPR_methods[] = {
      "Compute prediction, confidence bounds, and maximal activation of LWPR model for a given input sample"},
     {"predict_J", (PyCFunction)PyLWPR_predict_J, METH_VARARGS,
      "Compute prediction and Jacobi matrix of LWPR model for a given input sample"},
+    {"update_batch", (PyCFunction)PyLWPR_update_batch, METH_VARARGS,
+     "update_batch(X,Y) updates an LWPR model with the rows of X (N x nIn) and Y (N x nOut) in order. Returns the (N x nOut) predictions made during training."},
+    {"predict_batch", (PyCFunction)PyLWPR_predict_batch, METH_VARARGS,
+     "predict_batch(X[,cutoff]) computes predictions (N x nOut) for all rows of X (N x nIn)"},
+    {"predict_conf_batch", (PyCFunction)PyLWPR_predict_conf_batch, METH_VARARGS,
+     "predict_conf_batch(X[,cutoff]) computes predictions and confidence bounds (both N x nOut) for all rows of X (N x nIn)"},
+    {"predict_conf_maxw_batch", (PyCFunction)PyLWPR_predict_conf_maxw_batch, METH_VARARGS,
+     "predict_conf_maxw_batch(X[,cutoff]) computes predictions, confidence bounds, and maximal activations (all N x nOut) for all rows of X (N x nIn)"},
+    {"predict_J_batch", (PyCFunction)PyLWPR_predict_J_batch, METH_VARARGS,
+     "predict_J_batch(X[,cutoff]) computes predictions (N x nOut) and Jacobi matrices (N x nOut x nIn) for all rows of X (N x nIn)"},
     {"rf_center", (PyCFunction)PyLWPR_rf_center, METH_VARARGS,
      "rf_center(dim,n) retrieves the center of the n-th receptive field in output dimension dim."},
     {"rf_D", (PyCFunction)PyLWPR_rf_D, METH_VARARGS,
      "rf_D(dim,n) retrieves the distance metric of the n-th receptive field in output dimension dim."},
+    {"rf_centers", (PyCFunction)PyLWPR_rf_centers, METH_VARARGS,
+     "rf_centers(dim) returns the centres of all receptive fields in output dimension dim as a (num_rf[dim] x nIn) array."},
+    {"rf_beta0s", (PyCFunction)PyLWPR_rf_beta0s, METH_VARARGS,
+     "rf_beta0s(dim) returns the constant offsets of all receptive fields in output dimension dim."},
+    {"rf_Ds", (PyCFunction)PyLWPR_rf_Ds, METH_VARARGS,
+     "rf_Ds(dim) returns the distance metrics of all receptive fields in output dimension dim as a (num_rf[dim] x nIn x nIn) array."},
+    {"rf_Ms", (PyCFunction)PyLWPR_rf_Ms, METH_VARARGS,
+     "rf_Ms(dim) returns the Cholesky factors of all distance metrics in output dimension dim as a (num_rf[dim] x nIn x nIn) array."},
+    {"rf_view", (PyCFunction)PyLWPR_rf_view, METH_VARARGS,
+     "rf_view(dim,n,field) returns a read-only array that aliases the storage of 'c', 'mean_x', 'var_x', 'slope', 'beta', 'U', 'P', "
+     "'D' or 'M' of the n-th receptive field in output dimension dim. 'D' and 'M' are exposed packed, "
+     "that is, as their upper triangles stored column by column (nIn*(nIn+1)/2 elements); use rf_Ds() "
+     "or rf_Ms() for full matrices. While any view exists, update(), update_batch(), strip_for_inference() "
+     "and unpickling raise a RuntimeError, so delete the views before changing the model."},
     {"write_XML", (PyCFunction)PyLWPR_write_XML, METH_VARARGS,
      "write_XML(filename) writes the LWPR model to an XML file."},
     {"write_binary", (PyCFunction)PyLWPR_write_binary, METH_VARARGS,
      "write_binary(filename) writes the LWPR model to a binary, platform-dependent file."},
+    {"strip_for_inference", (PyCFunction)PyLWPR_strip_for_inference, METH_VARARGS,
+     "strip_for_inference() drops all training statistics. The model can still predict, but not be updated anymore."},
+    {"__getstate__", (PyCFunction)PyLWPR_getstate, METH_NOARGS,
+     "__getstate__() returns the model in binary format as a string."},
+    {"__setstate__", (PyCFunction)PyLWPR_setstate, METH_VARARGS,
+     "__setstate__(state) replaces the model by one in binary format, as returned by __getstate__()."},
+    {"__reduce__", (PyCFunction)PyLWPR_reduce, METH_NOARGS,
+     "__reduce__() provides pickle support."},
     {NULL}  /* Sentinel */
 };
 
@@ -858,6 +1450,7 @@ PyMODINIT_FUNC initlwpr(void) {
    PyObject* m;
 
    if (PyType_Ready(&PyLWPR_Type) < 0) return;
+   if (PyType_Ready(&PyLWPR_ViewBase_Type) < 0) return;
 
    m = Py_InitModule3("lwpr", lwpr_methods, "Python wrapper for the C implementation of LWPR.");
 
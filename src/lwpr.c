@@ -80,6 +80,13 @@ int lwpr_init_model(LWPR_Model *model, int nIn, int nOut, const char *name) {
    model->add_threshold = 0.5;
    model->kernel = LWPR_GAUSSIAN_KERNEL;
    model->update_D = 1;
+   model->max_rfs = 0;
+   model->max_bytes = 0;
+   model->evict = LWPR_EVICT_REFUSE;
+   model->eager_slopes = 0;
+   model->early_exit = 0;
+   model->shared_geometry = 0;
+   model->reorder_every = 0;
    return 1;
 }
 
@@ -145,6 +152,35 @@ int lwpr_set_init_D(LWPR_Model *model, const double *D, int stride) {
 }
 
 
+int lwpr_set_shared_geometry(LWPR_Model *model, int flag) {
+   int nTri = LWPR_TRI_SIZE(model->nIn);
+   int k,n;
+   
+   if (!flag) {
+      lwpr_aux_unlink_geometry(model);
+      model->shared_geometry = 0;
+      return 1;
+   }
+   
+   for (k=1;k<model->nOut;k++) {
+      const LWPR_SubModel *sub = &model->sub[k];
+      
+      if (sub->numRFS != model->sub[0].numRFS) return 0;
+      for (n=0;n<sub->numRFS;n++) {
+         const LWPR_ReceptiveField *RF0 = model->sub[0].rf[n];
+         const LWPR_ReceptiveField *RF = sub->rf[n];
+         
+         /* Stripped models only keep one of D and M */
+         if (memcmp(RF->c, RF0->c, model->nIn*sizeof(double)) != 0) return 0;
+         if (RF0->D != NULL && memcmp(RF->D, RF0->D, nTri*sizeof(double)) != 0) return 0;
+         if (RF0->M != NULL && memcmp(RF->M, RF0->M, nTri*sizeof(double)) != 0) return 0;
+      }
+   }
+   lwpr_aux_link_geometry(model);
+   model->shared_geometry = 1;
+   return 1;
+}
+
 int lwpr_duplicate_model(LWPR_Model *dest, const LWPR_Model *src) {
    int dim, n;
    int nIn = src->nIn;
@@ -165,6 +201,14 @@ int lwpr_duplicate_model(LWPR_Model *dest, const LWPR_Model *src) {
    dest->add_threshold = src->add_threshold;
    dest->kernel        = src->kernel;
    dest->update_D      = src->update_D;
+   dest->max_rfs       = src->max_rfs;
+   dest->max_bytes     = src->max_bytes;
+   dest->evict         = src->evict;
+   dest->eager_slopes  = src->eager_slopes;
+   dest->early_exit    = src->early_exit;
+   dest->shared_geometry = src->shared_geometry;
+   dest->reorder_every = src->reorder_every;
+   dest->inference_only= src->inference_only;
    dest->n_data        = src->n_data;
    
    memcpy(dest->mean_x,     src->mean_x,     nIn * sizeof(double));
@@ -188,39 +232,314 @@ int lwpr_duplicate_model(LWPR_Model *dest, const LWPR_Model *src) {
          }
          
          RFd->trustworthy = RFs->trustworthy;
+         RFd->last_active = RFs->last_active;
          RFd->w           = RFs->w;
          RFd->sum_e2      = RFs->sum_e2;
          RFd->beta0       = RFs->beta0;
          RFd->SSp         = RFs->SSp;
          
-         memcpy(RFd->D,      RFs->D,      nInS * nIn * sizeof(double));
-         memcpy(RFd->M,      RFs->M,      nInS * nIn * sizeof(double));
-         memcpy(RFd->alpha,  RFs->alpha,  nInS * nIn * sizeof(double));
          memcpy(RFd->beta,   RFs->beta,   nReg * sizeof(double));
          memcpy(RFd->c,      RFs->c,      nIn * sizeof(double));
-         memcpy(RFd->SXresYres, RFs->SXresYres, nInS * nReg * sizeof(double));
          memcpy(RFd->SSs2,   RFs->SSs2,   nReg * sizeof(double));
-         memcpy(RFd->SSYres, RFs->SSYres, nReg * sizeof(double));
-         memcpy(RFd->SSXres, RFs->SSXres, nInS * nReg * sizeof(double));
          memcpy(RFd->U,      RFs->U,      nInS * nReg * sizeof(double));
          memcpy(RFd->P,      RFs->P,      nInS * nReg * sizeof(double));
-         memcpy(RFd->H,      RFs->H,      nReg * sizeof(double));
-         memcpy(RFd->r,      RFs->r,      nReg * sizeof(double));
-         memcpy(RFd->h,      RFs->h,      nInS * nIn * sizeof(double));
-         memcpy(RFd->b,      RFs->b,      nInS * nIn * sizeof(double));
          memcpy(RFd->sum_w,  RFs->sum_w,  nReg * sizeof(double));
          memcpy(RFd->sum_e_cv2, RFs->sum_e_cv2, nReg * sizeof(double));
          memcpy(RFd->n_data, RFs->n_data, nReg * sizeof(double));
+         memcpy(RFd->mean_x, RFs->mean_x, nIn * sizeof(double));                       
+         
+         if (src->inference_only) {
+            /* slim RFs: there are no training statistics, but slopes are always ready.
+            ** Only one of D and M is present, depending on diag_only */
+            if (RFs->D != NULL) {
+               memcpy(RFd->D,   RFs->D,      LWPR_TRI_SIZE(nIn) * sizeof(double));
+            } else {
+               memcpy(RFd->M,   RFs->M,      LWPR_TRI_SIZE(nIn) * sizeof(double));
+            }
+            memcpy(RFd->slope, RFs->slope, nIn * sizeof(double));
+            RFd->slopeReady = RFs->slopeReady;
+            continue;
+         }
+         
+         memcpy(RFd->D,      RFs->D,      LWPR_TRI_SIZE(nIn) * sizeof(double));
+         memcpy(RFd->M,      RFs->M,      LWPR_TRI_SIZE(nIn) * sizeof(double));
+         memcpy(RFd->alpha,  RFs->alpha,  LWPR_TRI_SIZE(nIn) * sizeof(double));
+         memcpy(RFd->SXresYres, RFs->SXresYres, nInS * nReg * sizeof(double));
+         memcpy(RFd->SSYres, RFs->SSYres, nReg * sizeof(double));
+         memcpy(RFd->SSXres, RFs->SSXres, nInS * nReg * sizeof(double));
+         memcpy(RFd->H,      RFs->H,      nReg * sizeof(double));
+         memcpy(RFd->r,      RFs->r,      nReg * sizeof(double));
+         memcpy(RFd->h,      RFs->h,      LWPR_TRI_SIZE(nIn) * sizeof(double));
+         memcpy(RFd->b,      RFs->b,      LWPR_TRI_SIZE(nIn) * sizeof(double));
          memcpy(RFd->lambda, RFs->lambda, nReg * sizeof(double));         
          memcpy(RFd->s,      RFs->s,      nReg * sizeof(double));    
-         memcpy(RFd->mean_x, RFs->mean_x, nIn * sizeof(double));                       
          memcpy(RFd->var_x,  RFs->var_x,  nIn * sizeof(double));                                
       }
       dest->sub[dim].n_pruned = src->sub[dim].n_pruned;
+      dest->sub[dim].n_evicted = src->sub[dim].n_evicted;
+   }
+   /* The receptive fields have been copied separately, so they need to share them again */
+   if (lwpr_aux_shared_geometry(dest)) lwpr_aux_link_geometry(dest);
+   return 1;
+}
+
+
+void lwpr_move_model(LWPR_Model *dest, LWPR_Model *src) {
+   int dim,n;
+   
+   *dest = *src;
+   for (dim=0;dim<dest->nOut;dim++) {
+      dest->sub[dim].model = dest;
+      for (n=0;n<dest->sub[dim].numRFS;n++) dest->sub[dim].rf[n]->model = dest;
+   }
+   
+   /* lwpr_free_model() does nothing if nIn*nOut == 0 */
+   memset(src, 0, sizeof(LWPR_Model));
+}
+
+
+int lwpr_strip_for_inference(LWPR_Model *model) {
+   int dim, n, k, numRFS = 0;
+   int nIn = model->nIn;
+   int nInS = model->nInStore;
+   LWPR_ReceptiveField *slim;
+   
+   if (model->inference_only) return 1;
+   
+   for (dim=0;dim<model->nOut;dim++) numRFS += model->sub[dim].numRFS;
+   
+   /* Allocate all slim receptive fields first, so the model stays intact
+   ** if we run out of memory halfway through */
+   slim = (LWPR_ReceptiveField *) LWPR_CALLOC((size_t) (numRFS > 0 ? numRFS : 1), sizeof(LWPR_ReceptiveField));
+   if (slim == NULL) return 0;
+   
+   for (dim=0, k=0;dim<model->nOut;dim++) {
+      for (n=0;n<model->sub[dim].numRFS;n++, k++) {
+         if (!lwpr_mem_alloc_rf_slim(&slim[k], model, model->sub[dim].rf[n]->nReg)) {
+            while (--k >= 0) lwpr_mem_free_rf(&slim[k]);
+            LWPR_FREE(slim);
+            return 0;
+         }
+      }
+   }
+   
+   /* The first submodel's RFs are freed before the others are copied */
+   lwpr_aux_unlink_geometry(model);
+   
+   for (dim=0, k=0;dim<model->nOut;dim++) {
+      for (n=0;n<model->sub[dim].numRFS;n++, k++) {
+         LWPR_ReceptiveField *RF = model->sub[dim].rf[n];
+         LWPR_ReceptiveField *RFs = &slim[k];
+         int nReg = RF->nReg;
+         
+         lwpr_aux_compute_slope(RF);
+         
+         RFs->trustworthy = RF->trustworthy;
+         RFs->slopeReady  = RF->slopeReady;
+         RFs->last_active = RF->last_active;
+         RFs->w           = RF->w;
+         RFs->sum_e2      = RF->sum_e2;
+         RFs->beta0       = RF->beta0;
+         RFs->SSp         = RF->SSp;
+         
+         if (model->diag_only) {
+            memcpy(RFs->D,   RF->D,      LWPR_TRI_SIZE(nIn) * sizeof(double));
+         } else {
+            /* predictions only need the Cholesky factor of full distance metrics */
+            memcpy(RFs->M,   RF->M,      LWPR_TRI_SIZE(nIn) * sizeof(double));
+         }
+         memcpy(RFs->c,      RF->c,      nIn * sizeof(double));
+         memcpy(RFs->mean_x, RF->mean_x, nIn * sizeof(double));
+         memcpy(RFs->slope,  RF->slope,  nIn * sizeof(double));
+         memcpy(RFs->U,      RF->U,      nInS * nReg * sizeof(double));
+         memcpy(RFs->P,      RF->P,      nInS * nReg * sizeof(double));
+         memcpy(RFs->beta,   RF->beta,   nReg * sizeof(double));
+         memcpy(RFs->SSs2,   RF->SSs2,   nReg * sizeof(double));
+         memcpy(RFs->sum_w,  RF->sum_w,  nReg * sizeof(double));
+         memcpy(RFs->sum_e_cv2, RF->sum_e_cv2, nReg * sizeof(double));
+         memcpy(RFs->n_data, RF->n_data, nReg * sizeof(double));
+         
+         /* Keep the RF structure in place, since pointers to it might be around */
+         lwpr_mem_free_rf(RF);
+         *RF = *RFs;
+      }
    }
+   LWPR_FREE(slim);
+   
+   /* Pooled storage (see lwpr_reorder_rfs) has been replaced by the slim storage */
+   for (dim=0;dim<model->nOut;dim++) {
+      if (model->sub[dim].pool != NULL) {
+         LWPR_FREE(model->sub[dim].pool);
+         model->sub[dim].pool = NULL;
+         model->sub[dim].poolSize = model->sub[dim].numPooled = 0;
+      }
+   }
+   
+   model->inference_only = 1;
    return 1;
 }
 
+int lwpr_reorder_rfs(LWPR_Model *model) {
+   int shared = lwpr_aux_shared_geometry(model);
+   int dim, n, maxRFS = 1, ok = 1;
+   int *order;
+   LWPR_ReceptiveField **rf;
+   
+   for (dim=0;dim<model->nOut;dim++) {
+      if (model->sub[dim].numRFS > maxRFS) maxRFS = model->sub[dim].numRFS;
+   }
+   order = (int *) LWPR_MALLOC(maxRFS*sizeof(int));
+   rf = (LWPR_ReceptiveField **) LWPR_MALLOC(maxRFS*sizeof(LWPR_ReceptiveField *));
+   if (order == NULL || rf == NULL) {
+      if (order != NULL) LWPR_FREE(order);
+      if (rf != NULL) LWPR_FREE(rf);
+      return 0;
+   }
+   
+   /* Each RF is pooled together with its own copy of the geometry */
+   if (shared) lwpr_aux_unlink_geometry(model);
+   
+   for (dim=0;dim<model->nOut;dim++) {
+      LWPR_SubModel *sub = &model->sub[dim];
+      
+      /* With shared geometry, the order of the first submodel is used for all */
+      if ((dim == 0 || !shared) && !lwpr_aux_morton_order(sub, order)) {
+         ok = 0;
+         if (shared) break;
+         continue;
+      }
+      for (n=0;n<sub->numRFS;n++) rf[n] = sub->rf[order[n]];
+      memcpy(sub->rf, rf, sub->numRFS*sizeof(LWPR_ReceptiveField *));
+      
+      if (!lwpr_mem_pool_rfs(sub)) ok = 0;
+   }
+   /* Pooling moves the shared geometry, see above */
+   if (shared) lwpr_aux_link_geometry(model);
+   LWPR_FREE(order);
+   LWPR_FREE(rf);
+   return ok;
+}
+
+typedef struct {
+   LWPR_Model *model;
+   int start;
+} LWPR_SlopeData;
+
+/* Computes the missing slopes of every NUM_THREADS-th receptive field,
+** counting through all submodels, beginning with SD->start */
+static void *lwpr_finalize_slopes_T(void *ptr) {
+   LWPR_SlopeData *SD = (LWPR_SlopeData *) ptr;
+   LWPR_Model *model = SD->model;
+   int dim, n, k = 0;
+   
+   for (dim=0;dim<model->nOut;dim++) {
+      LWPR_SubModel *sub = &model->sub[dim];
+      for (n=0;n<sub->numRFS;n++,k++) {
+         if (k % NUM_THREADS != SD->start) continue;
+         if (!sub->rf[n]->slopeReady) lwpr_aux_compute_slope(sub->rf[n]);
+      }
+   }
+   return NULL;
+}
+
+void lwpr_finalize_slopes(LWPR_Model *model) {
+   int i;
+   LWPR_SlopeData SD[NUM_THREADS];
+#if NUM_THREADS > 1
+#ifdef WIN32
+   HANDLE thread[NUM_THREADS];
+   DWORD ID[NUM_THREADS];
+#else
+   pthread_t thread[NUM_THREADS];
+   int rc[NUM_THREADS];      
+#endif
+#endif
+
+   for (i=0;i<NUM_THREADS;i++) {
+      SD[i].model = model;
+      SD[i].start = i;
+   }
+   
+#if NUM_THREADS > 1
+   for (i=1;i<NUM_THREADS;i++) {
+#ifdef WIN32
+      thread[i] = CreateThread(NULL,0, lwpr_finalize_slopes_T ,&SD[i],0, &ID[i]);
+#else
+      rc[i] = pthread_create(&thread[i], NULL, lwpr_finalize_slopes_T , &SD[i]);
+#endif         
+   }
+#endif
+
+   (void) lwpr_finalize_slopes_T(&SD[0]);
+
+#if NUM_THREADS > 1
+   for (i=1;i<NUM_THREADS;i++) {
+#ifdef WIN32
+      if (thread[i]!=NULL) {
+         WaitForSingleObject(thread[i],INFINITE);
+         CloseHandle(thread[i]);            
+#else
+      if (rc[i]==0) {
+         pthread_join(thread[i],NULL);
+#endif            
+      } else { 
+         /* Thread could not be started, do its calculations now */         
+         (void) lwpr_finalize_slopes_T(&SD[i]);       
+      }
+   }
+#endif
+}
+
+static double lwpr_kernel_gaussian(double q, double *dwdq, double *ddwdqdq) {
+   double w = exp(-0.5*q);
+   *dwdq = -0.5*w;
+   *ddwdqdq = 0.25*w;
+   return w;
+}
+
+static double lwpr_kernel_bisquare(double q, double *dwdq, double *ddwdqdq) {
+   double d = 1-0.25*q;
+   if (d<0) {
+      *dwdq = *ddwdqdq = 0.0;
+      return 0.0;
+   }
+   *dwdq = -0.5*d;
+   *ddwdqdq = 0.125;
+   return d*d;
+}
+
+/* Kernel registry, indexed by LWPR_Kernel. The built-in kernels come first,
+** in the order of the enumeration */
+static LWPR_KernelInfo lwpr_kernels[LWPR_MAX_KERNELS] = {
+   {"Gaussian", lwpr_kernel_gaussian, 0.0},
+   {"BiSquare", lwpr_kernel_bisquare, 4.0}
+};
+static int lwpr_num_kernels = 2;
+
+int lwpr_register_kernel(const char *name, LWPR_KernelFunction func, double support) {
+   if (name == NULL || func == NULL || support < 0.0) return -1;
+   if (lwpr_num_kernels >= LWPR_MAX_KERNELS) return -1;
+   if (lwpr_kernel_by_name(name) >= 0) return -1;
+   
+   lwpr_kernels[lwpr_num_kernels].name = name;
+   lwpr_kernels[lwpr_num_kernels].func = func;
+   lwpr_kernels[lwpr_num_kernels].support = support;
+   return lwpr_num_kernels++;
+}
+
+const LWPR_KernelInfo *lwpr_kernel_info(LWPR_Kernel kernel) {
+   int k = (int) kernel;
+   if (k < 0 || k >= lwpr_num_kernels) return NULL;
+   return &lwpr_kernels[k];
+}
+
+int lwpr_kernel_by_name(const char *name) {
+   int k;
+   for (k=0;k<lwpr_num_kernels;k++) {
+      if (!strcmp(name, lwpr_kernels[k].name)) return k;
+   }
+   return -1;
+}
 
 int lwpr_update(LWPR_Model *model, const double *x, const double *y, double *yp, double *max_w) {
    double maxw;
@@ -228,37 +547,51 @@ int lwpr_update(LWPR_Model *model, const double *x, const double *y, double *yp,
    
    int i,code=0;
    
+   if (model->inference_only) return 0;
+   
    lwpr_aux_update_model_stats(model,x);
    
    for (i=0;i<model->nIn;i++) model->xn[i]=x[i]/model->norm_in[i];
    for (i=0;i<model->nOut;i++) model->yn[i]=y[i]/model->norm_out[i];   
    
-   for (i=0;i<model->nOut;i++) {
-      code |= lwpr_aux_update_one(model, i, model->xn, model->yn[i], &ypi, &maxw);   
-      if (max_w!=NULL) max_w[i]=maxw;
-      if (yp!=NULL) yp[i]=ypi * model->norm_out[i];
+   if (lwpr_aux_shared_geometry(model)) {
+      code = lwpr_aux_update_shared(model, model->xn, model->yn, yp, max_w);
+      if (yp!=NULL) for (i=0;i<model->nOut;i++) yp[i]*=model->norm_out[i];
+   } else {
+      for (i=0;i<model->nOut;i++) {
+         code |= lwpr_aux_update_one(model, i, model->xn, model->yn[i], &ypi, &maxw);   
+         if (max_w!=NULL) max_w[i]=maxw;
+         if (yp!=NULL) yp[i]=ypi * model->norm_out[i];
+      }
+   }
+   
+   /* A failed reordering leaves the model valid, so it is not reported */
+   if (model->reorder_every > 0 && model->n_data % model->reorder_every == 0) {
+      (void) lwpr_reorder_rfs(model);
    }
    return code;
 }
 
 
 
-#if NUM_THREADS == 1
-/* Predictions (and Jacobians) without multi-threading
-** We directly use the thread-based functions anyway */
-
-void lwpr_predict(const LWPR_Model *model, const double *x, double cutoff, double *y, double *conf, double *max_w) {
+/* Single-threaded predictions (and Jacobians) for one input vector, using the given 
+** workspace and buffer for the normalised input instead of the model's own. These
+** are used by lwpr_predict without multi-threading, and by the batch workers below */
+static void lwpr_predict_ws(const LWPR_Model *model, LWPR_Workspace *ws, double *xn,
+      const double *x, double cutoff, double *y, double *conf, double *max_w) {
    int i;
    LWPR_ThreadData TD; 
    
-   for (i=0;i<model->nIn;i++) model->xn[i]=x[i]/model->norm_in[i];
+   for (i=0;i<model->nIn;i++) xn[i]=x[i]/model->norm_in[i];
    
    TD.model = model;
-   TD.xn = model->xn;
-   TD.ws = &model->ws[0];
+   TD.xn = xn;
+   TD.ws = ws;
    TD.cutoff = cutoff;   
    
-   if (conf == NULL) {
+   if (conf == NULL && lwpr_aux_shared_geometry(model)) {
+      lwpr_aux_predict_shared(model, ws, xn, cutoff, y, max_w);
+   } else if (conf == NULL) {
       for (i=0;i<model->nOut;i++) {
          TD.dim = i;
          (void) lwpr_aux_predict_one_T(&TD);
@@ -277,16 +610,17 @@ void lwpr_predict(const LWPR_Model *model, const double *x, double cutoff, doubl
    for (i=0;i<model->nOut;i++) y[i]*=model->norm_out[i];
 }
 
-void lwpr_predict_J(const LWPR_Model *model, const double *x, double cutoff, double *y, double *J) {
+static void lwpr_predict_J_ws(const LWPR_Model *model, LWPR_Workspace *ws, double *xn,
+      const double *x, double cutoff, double *y, double *J) {
    int nIn = model->nIn;
    LWPR_ThreadData TD; 
    const double *dydx;
    int i,j;
    
-   for (i=0;i<nIn;i++) model->xn[i]=x[i]/model->norm_in[i];
+   for (i=0;i<nIn;i++) xn[i]=x[i]/model->norm_in[i];
    TD.model = model;
-   TD.xn = model->xn;
-   TD.ws = &model->ws[0];
+   TD.xn = xn;
+   TD.ws = ws;
    TD.cutoff = cutoff;   
    
    dydx = TD.ws->sum_dwdx;
@@ -301,6 +635,43 @@ void lwpr_predict_J(const LWPR_Model *model, const double *x, double cutoff, dou
    }
 }
 
+/* Copies the gradient and the packed Hessian that lwpr_aux_predict_one_gH_T left in ws 
+** into column dim of J and into the Hessian of output dimension dim, undoing the 
+** normalisation. The Hessian is stored densely (nIn*nIn per output), or packed 
+** (LWPR_TRI_SIZE(nIn) per output) if packed is non-zero. inv_norm holds 1/norm_in */
+static void lwpr_copy_JH(const LWPR_Model *model, int dim, const LWPR_Workspace *ws,
+      const double *inv_norm, double *J, double *H, int packed) {
+   int nIn = model->nIn;
+   const double *dydx = ws->sum_dwdx;
+   const double *Hp = ws->sum_ddwdxdx;
+   int j,k;
+   
+   H += packed ? dim*LWPR_TRI_SIZE(nIn) : dim*nIn*nIn;
+   for (j=0;j<nIn;j++) {
+      double fac = model->norm_out[dim]*inv_norm[j];
+      const double *Hj = Hp + LWPR_TRI(0,j);
+      
+      J[dim+j*model->nOut] = dydx[j]*fac;
+      if (packed) {
+         for (k=0;k<=j;k++) H[LWPR_TRI(k,j)] = Hj[k]*fac*inv_norm[k];
+      } else {
+         for (k=0;k<=j;k++) H[k + j*nIn] = H[j + k*nIn] = Hj[k]*fac*inv_norm[k];
+      }
+   }
+}
+
+#if NUM_THREADS == 1
+/* Predictions (and Jacobians) without multi-threading
+** We directly use the thread-based functions anyway */
+
+void lwpr_predict(const LWPR_Model *model, const double *x, double cutoff, double *y, double *conf, double *max_w) {
+   lwpr_predict_ws(model, &model->ws[0], model->xn, x, cutoff, y, conf, max_w);
+}
+
+void lwpr_predict_J(const LWPR_Model *model, const double *x, double cutoff, double *y, double *J) {
+   lwpr_predict_J_ws(model, &model->ws[0], model->xn, x, cutoff, y, J);
+}
+
 void lwpr_predict_JcJ(const LWPR_Model *model, const double *x, double cutoff, double *y, double *J, double *conf, double *Jconf) {
    int nIn = model->nIn;
    LWPR_ThreadData TD; 
@@ -331,35 +702,27 @@ void lwpr_predict_JcJ(const LWPR_Model *model, const double *x, double cutoff, d
    }
 }
 
-void lwpr_predict_JH(const LWPR_Model *model, const double *x, double cutoff, double *y, double *J, double *H) {
+static void lwpr_predict_JH_aux(const LWPR_Model *model, const double *x, double cutoff, 
+      double *y, double *J, double *H, int packed) {
    int nIn = model->nIn;
-   int nInS = model->nInStore;
    LWPR_ThreadData TD; 
-   const double *dydx;
-   const double *Hi;
-   int i,j,k;
+   double *inv_norm = model->ws[0].inv_norm;
+   int i;
    
-   for (i=0;i<nIn;i++) model->xn[i]=x[i]/model->norm_in[i];
+   for (i=0;i<nIn;i++) {
+      inv_norm[i] = 1.0/model->norm_in[i];
+      model->xn[i]=x[i]*inv_norm[i];
+   }
    TD.model = model;
    TD.xn = model->xn;
    TD.ws = &model->ws[0];
    TD.cutoff = cutoff;   
-   
-   dydx = TD.ws->sum_dwdx;
-   Hi = TD.ws->sum_ddwdxdx;
       
    for (i=0;i<model->nOut;i++) {
       TD.dim = i;
       (void) lwpr_aux_predict_one_gH_T(&TD);
       y[i] = model->norm_out[i] * TD.yn;
-      for (j=0;j<nIn;j++) {
-         double factor = model->norm_out[i]/model->norm_in[j];
-         
-         J[i+j*model->nOut] = dydx[j]*factor;
-         for (k=0;k<nIn;k++) {
-            H[k + j*nIn + i*nIn*nIn] = Hi[k+j*nInS]*factor/model->norm_in[k];
-         }
-      }
+      lwpr_copy_JH(model, i, TD.ws, inv_norm, J, H, packed);
    }
 }
 
@@ -387,6 +750,13 @@ void lwpr_predict(const LWPR_Model *model, const double *x, double cutoff, doubl
  
    for (i=0;i<model->nIn;i++) model->xn[i]=x[i]/model->norm_in[i];
 
+   if (conf == NULL && lwpr_aux_shared_geometry(model)) {
+      /* One pass over the shared receptive fields, split up among the threads */
+      lwpr_aux_predict_shared(model, NULL, model->xn, cutoff, y, max_w);
+      for (i=0;i<model->nOut;i++) y[i]*=model->norm_out[i];
+      return;
+   }
+
    for (i=0;i<NUM_THREADS;i++) {
       TD[i].model = model;
       TD[i].xn = model->xn;
@@ -582,9 +952,11 @@ void lwpr_predict_JcJ(const LWPR_Model *model, const double *x, double cutoff, d
 
 
 
-void lwpr_predict_JH(const LWPR_Model *model, const double *x, double cutoff, double *y, double *J, double *H) {
-   int i,j,dim;
+static void lwpr_predict_JH_aux(const LWPR_Model *model, const double *x, double cutoff, 
+      double *y, double *J, double *H, int packed) {
+   int i,dim;
    LWPR_ThreadData TD[NUM_THREADS];
+   double *inv_norm = model->ws[0].inv_norm;
    
 #ifdef WIN32
    HANDLE thread[NUM_THREADS-1];
@@ -594,7 +966,10 @@ void lwpr_predict_JH(const LWPR_Model *model, const double *x, double cutoff, do
    int rc[NUM_THREADS-1];      
 #endif
 
-   for (i=0;i<model->nIn;i++) model->xn[i]=x[i]/model->norm_in[i];
+   for (i=0;i<model->nIn;i++) {
+      inv_norm[i] = 1.0/model->norm_in[i];
+      model->xn[i]=x[i]*inv_norm[i];
+   }
 
    for (i=0;i<NUM_THREADS;i++) {
       TD[i].model = model;
@@ -637,20 +1012,8 @@ void lwpr_predict_JH(const LWPR_Model *model, const double *x, double cutoff, do
       }
       
       for (i=0;i<todo;i++) {
-         const double *dydx = TD[i].ws->sum_dwdx;
-         const double *Hi = TD[i].ws->sum_ddwdxdx;
-         double no = model->norm_out[dim+i];
-         
-         y[dim+i] = no * TD[i].yn ;
-         for (j=0;j<model->nIn;j++) {
-            double fac = no/model->norm_in[j];
-            int k;
-            
-            J[dim+i+j*model->nOut] = dydx[j]*fac;
-            for (k=0;k<model->nIn;k++) {
-               H[k+j*model->nIn+(dim+i)*model->nIn*model->nIn] = Hi[k+j*model->nInStore]*fac/model->norm_in[k];
-            }
-         }
+         y[dim+i] = model->norm_out[dim+i] * TD[i].yn;
+         lwpr_copy_JH(model, dim+i, TD[i].ws, inv_norm, J, H, packed);
       }
       dim+=todo;
    }
@@ -658,3 +1021,319 @@ void lwpr_predict_JH(const LWPR_Model *model, const double *x, double cutoff, do
 
 
 #endif
+
+void lwpr_predict_JH(const LWPR_Model *model, const double *x, double cutoff, double *y, double *J, double *H) {
+   lwpr_predict_JH_aux(model, x, cutoff, y, J, H, 0);
+}
+
+void lwpr_predict_JHp(const LWPR_Model *model, const double *x, double cutoff, double *y, double *J, double *Hp) {
+   lwpr_predict_JH_aux(model, x, cutoff, y, J, Hp, 1);
+}
+
+void lwpr_predict_topk(const LWPR_Model *model, const double *x, int K, double cutoff, double *y, double *dropped, double *max_w) {
+   int i;
+   LWPR_ThreadData TD; 
+   
+   for (i=0;i<model->nIn;i++) model->xn[i]=x[i]/model->norm_in[i];
+   
+   TD.model = model;
+   TD.xn = model->xn;
+   TD.ws = &model->ws[0];
+   TD.cutoff = cutoff;
+   TD.topk = (K < 0) ? 0 : K;
+   
+   for (i=0;i<model->nOut;i++) {
+      TD.dim = i;
+      (void) lwpr_aux_predict_topk_one_T(&TD);
+      y[i] = model->norm_out[i] * TD.yn;
+      if (dropped!=NULL) dropped[i] = TD.dropped; 
+      if (max_w!=NULL) max_w[i] = TD.w_max;
+   }
+}
+
+/* Directional derivatives: the direction v is transformed to normalised coordinates,
+** and the results are scaled back, which gives the same as J*v or H*v for the 
+** Jacobian and Hessians computed by lwpr_predict_J and lwpr_predict_JH */
+void lwpr_predict_Jv(const LWPR_Model *model, const double *x, const double *v, double cutoff, double *y, double *Jv) {
+   int i;
+   double *vn = model->ws[0].vn;
+   LWPR_ThreadData TD; 
+   
+   for (i=0;i<model->nIn;i++) {
+      model->xn[i]=x[i]/model->norm_in[i];
+      vn[i]=v[i]/model->norm_in[i];
+   }
+   
+   TD.model = model;
+   TD.xn = model->xn;
+   TD.ws = &model->ws[0];
+   TD.cutoff = cutoff;
+   TD.v = vn;
+   
+   for (i=0;i<model->nOut;i++) {
+      TD.dim = i;
+      (void) lwpr_aux_predict_one_Jv_T(&TD);
+      y[i] = model->norm_out[i] * TD.yn;
+      Jv[i] = model->norm_out[i] * TD.dydv;
+   }
+}
+
+void lwpr_predict_vJ(const LWPR_Model *model, const double *x, const double *u, double cutoff, double *y, double *uJ) {
+   int i;
+   LWPR_ThreadData TD; 
+   
+   for (i=0;i<model->nIn;i++) {
+      model->xn[i]=x[i]/model->norm_in[i];
+      uJ[i] = 0.0;
+   }
+   
+   TD.model = model;
+   TD.xn = model->xn;
+   TD.ws = &model->ws[0];
+   TD.cutoff = cutoff;
+   
+   for (i=0;i<model->nOut;i++) {
+      TD.dim = i;
+      (void) lwpr_aux_predict_one_J_T(&TD);
+      y[i] = model->norm_out[i] * TD.yn;
+      lwpr_math_add_scalar_vector(uJ, u[i]*model->norm_out[i], TD.ws->sum_dwdx, model->nIn);
+   }
+   for (i=0;i<model->nIn;i++) uJ[i]/=model->norm_in[i];
+}
+
+void lwpr_predict_Hv(const LWPR_Model *model, const double *x, const double *v, double cutoff, double *y, double *Jv, double *Hv) {
+   int i,j;
+   int nIn = model->nIn;
+   double *vn = model->ws[0].vn;
+   LWPR_ThreadData TD; 
+   
+   for (i=0;i<nIn;i++) {
+      model->xn[i]=x[i]/model->norm_in[i];
+      vn[i]=v[i]/model->norm_in[i];
+   }
+   
+   TD.model = model;
+   TD.xn = model->xn;
+   TD.ws = &model->ws[0];
+   TD.cutoff = cutoff;
+   TD.v = vn;
+   
+   for (i=0;i<model->nOut;i++) {
+      const double *Hvn = TD.ws->sum_ddwdxdx;
+      
+      TD.dim = i;
+      (void) lwpr_aux_predict_one_Hv_T(&TD);
+      y[i] = model->norm_out[i] * TD.yn;
+      if (Jv != NULL) Jv[i] = model->norm_out[i] * TD.dydv;
+      for (j=0;j<nIn;j++) {
+         Hv[j+i*nIn] = Hvn[j]*model->norm_out[i]/model->norm_in[j];
+      }
+   }
+}
+
+/* Batch predictions: the input vectors are split into contiguous chunks, one per thread.
+** Each chunk gets its own workspace and normalised input buffer, so the model itself 
+** is never written to (slopes are computed beforehand for the Jacobian variant).
+*/
+typedef struct {
+   const LWPR_Model *model;
+   LWPR_Workspace ws;
+   double *xn;
+   int N;
+   const double *X;
+   int ldx;
+   double cutoff;
+   double *Y;
+   int ldy;
+   double *conf;
+   double *max_w;
+   double *J;
+} LWPR_BatchData;
+
+static void *lwpr_predict_batch_T(void *ptr) {
+   LWPR_BatchData *BD = (LWPR_BatchData *) ptr;
+   int k;
+   
+   for (k=0;k<BD->N;k++) {
+      lwpr_predict_ws(BD->model, &BD->ws, BD->xn, BD->X + k*BD->ldx, BD->cutoff, BD->Y + k*BD->ldy, 
+            BD->conf  == NULL ? NULL : BD->conf  + k*BD->ldy, 
+            BD->max_w == NULL ? NULL : BD->max_w + k*BD->ldy);
+   }
+   return NULL;
+}
+
+static void *lwpr_predict_J_batch_T(void *ptr) {
+   LWPR_BatchData *BD = (LWPR_BatchData *) ptr;
+   int sizeJ = BD->model->nOut * BD->model->nIn;
+   int k;
+   
+   for (k=0;k<BD->N;k++) {
+      lwpr_predict_J_ws(BD->model, &BD->ws, BD->xn, BD->X + k*BD->ldx, BD->cutoff, 
+            BD->Y + k*BD->ldy, BD->J + k*sizeJ);
+   }
+   return NULL;
+}
+
+/* Runs func on NUM_THREADS chunks of the batch described by BD[0], returns 0 if
+** no workspace could be allocated at all. Chunks whose workspace or thread could
+** not be allocated are handled by the calling thread. */
+static int lwpr_run_batch(LWPR_BatchData *BD, void *(*func)(void *)) {
+   int i, numChunks, last = -1;
+   int N = BD[0].N;
+   int nIn = BD[0].model->nIn;
+#if NUM_THREADS > 1
+#ifdef WIN32
+   HANDLE thread[NUM_THREADS];
+   DWORD ID[NUM_THREADS];
+#else
+   pthread_t thread[NUM_THREADS];
+   int rc[NUM_THREADS];      
+#endif
+#endif
+   
+   numChunks = (N < NUM_THREADS) ? N : NUM_THREADS;
+   
+   for (i=numChunks-1;i>=0;i--) {
+      int start = (int) (((long) N * i) / numChunks);
+      int end = (int) (((long) N * (i+1)) / numChunks);
+      
+      BD[i] = BD[0];
+      BD[i].N = end - start;
+      BD[i].X += start * BD[0].ldx;
+      BD[i].Y += start * BD[0].ldy;
+      if (BD[i].conf != NULL)  BD[i].conf  += start * BD[0].ldy;
+      if (BD[i].max_w != NULL) BD[i].max_w += start * BD[0].ldy;
+      if (BD[i].J != NULL)     BD[i].J     += start * BD[0].model->nOut * nIn;
+      
+      BD[i].xn = (double *) LWPR_MALLOC(nIn * sizeof(double));
+      if (BD[i].xn != NULL && !lwpr_mem_alloc_ws(&BD[i].ws, nIn, BD[0].model->nOut)) {
+         LWPR_FREE(BD[i].xn);
+         BD[i].xn = NULL;
+      }
+   }
+   
+   /* Chunks without resources are merged into their successor, or (at the end)
+   ** into the last chunk that has resources */
+   for (i=0;i<numChunks-1;i++) {
+      if (BD[i].xn != NULL) {
+         last = i;
+         continue;
+      }
+      BD[i+1].N += BD[i].N;
+      BD[i+1].X = BD[i].X;
+      BD[i+1].Y = BD[i].Y;
+      BD[i+1].conf = BD[i].conf;
+      BD[i+1].max_w = BD[i].max_w;
+      BD[i+1].J = BD[i].J;
+      BD[i].N = 0;
+   }
+   if (BD[numChunks-1].xn == NULL) {
+      /* no chunk has resources, so nothing was allocated */
+      if (last < 0) return 0;
+      BD[last].N += BD[numChunks-1].N;
+      BD[numChunks-1].N = 0;
+   }
+   
+#if NUM_THREADS > 1
+   for (i=1;i<numChunks;i++) {
+      if (BD[i].N == 0 || BD[i].xn == NULL) continue;
+#ifdef WIN32
+      thread[i] = CreateThread(NULL,0, func ,&BD[i],0, &ID[i]);
+#else
+      rc[i] = pthread_create(&thread[i], NULL, func , &BD[i]);
+#endif         
+   }
+#endif
+   
+   if (BD[0].N > 0 && BD[0].xn != NULL) (void) func(&BD[0]);
+   
+#if NUM_THREADS > 1
+   for (i=1;i<numChunks;i++) {
+      if (BD[i].N == 0 || BD[i].xn == NULL) continue;
+#ifdef WIN32
+      if (thread[i]!=NULL) {
+         WaitForSingleObject(thread[i],INFINITE);
+         CloseHandle(thread[i]);            
+#else
+      if (rc[i]==0) {
+         pthread_join(thread[i],NULL);
+#endif            
+      } else { 
+         /* Thread could not be started, do its calculations now */         
+         (void) func(&BD[i]);       
+      }
+   }
+#endif
+   
+   for (i=0;i<numChunks;i++) {
+      if (BD[i].xn != NULL) {
+         lwpr_mem_free_ws(&BD[i].ws);
+         LWPR_FREE(BD[i].xn);
+      }
+   }
+   return 1;
+}
+
+void lwpr_predict_batch(const LWPR_Model *model, int N, const double *X, int ldx,
+      double cutoff, double *Y, int ldy, double *conf, double *max_w) {
+   int k;
+   LWPR_BatchData BD[NUM_THREADS];
+   
+   if (N <= 0) return;
+   
+   BD[0].model = model;
+   BD[0].N = N;
+   BD[0].X = X;
+   BD[0].ldx = ldx;
+   BD[0].cutoff = cutoff;
+   BD[0].Y = Y;
+   BD[0].ldy = ldy;
+   BD[0].conf = conf;
+   BD[0].max_w = max_w;
+   BD[0].J = NULL;
+   
+   if (lwpr_run_batch(BD, lwpr_predict_batch_T)) return;
+   
+   /* Out of memory: fall back to the model's own workspace */
+   for (k=0;k<N;k++) {
+      lwpr_predict(model, X + k*ldx, cutoff, Y + k*ldy, 
+            conf  == NULL ? NULL : conf  + k*ldy, 
+            max_w == NULL ? NULL : max_w + k*ldy);
+   }
+}
+
+void lwpr_predict_J_batch(const LWPR_Model *model, int N, const double *X, int ldx,
+      double cutoff, double *Y, int ldy, double *J) {
+   int k;
+   int sizeJ = model->nOut * model->nIn;
+   LWPR_BatchData BD[NUM_THREADS];
+   
+   if (N <= 0) return;
+   
+   /* lwpr_aux_predict_one_J_T caches slopes within the RFs, which must 
+   ** not happen concurrently, so we compute all missing ones upfront */
+   for (k=0;k<model->nOut;k++) {
+      int i;
+      const LWPR_SubModel *sub = &model->sub[k];
+      for (i=0;i<sub->numRFS;i++) {
+         if (!sub->rf[i]->slopeReady) lwpr_aux_compute_slope(sub->rf[i]);
+      }
+   }
+   
+   BD[0].model = model;
+   BD[0].N = N;
+   BD[0].X = X;
+   BD[0].ldx = ldx;
+   BD[0].cutoff = cutoff;
+   BD[0].Y = Y;
+   BD[0].ldy = ldy;
+   BD[0].conf = NULL;
+   BD[0].max_w = NULL;
+   BD[0].J = J;
+   
+   if (lwpr_run_batch(BD, lwpr_predict_J_batch_T)) return;
+   
+   for (k=0;k<N;k++) {
+      lwpr_predict_J(model, X + k*ldx, cutoff, Y + k*ldy, J + k*sizeJ);
+   }
+}
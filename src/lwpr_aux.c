@@ -34,7 +34,173 @@ Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
    #endif
 #endif
 
-void lwpr_aux_dist_derivatives(int nIn,int nInS,double *dwdM, double *dJ2dM, double *ddwdMdM, double *ddJ2dMdM,
+/* Index of element (i,j) of a packed symmetric matrix, for any i,j */
+#define LWPR_SYM(i,j)   (((i)<=(j)) ? LWPR_TRI(i,j) : LWPR_TRI(j,i))
+
+/* The per-RF loops of updates and predictions are written once as "kernel bodies"
+** taking the kernel as a parameter. They are force-inlined into the thread functions
+** once for each built-in kernel (see LWPR_AUX_KERNEL_DISPATCH), so that the compiler
+** can resolve lwpr_aux_kernel() at compile time and no switch remains in the loops */
+#if defined(__GNUC__)
+   #define LWPR_AUX_INLINE    __inline__ __attribute__((always_inline))
+#elif defined(_MSC_VER)
+   #define LWPR_AUX_INLINE    __forceinline
+#else
+   #define LWPR_AUX_INLINE
+#endif
+
+/* Kernel identifier passed to the kernel bodies for registered kernels */
+#define LWPR_AUX_CUSTOM_KERNEL   -1
+
+#define LWPR_AUX_KERNEL_DISPATCH(body, TD) \
+   switch((TD)->model->kernel) { \
+      case LWPR_GAUSSIAN_KERNEL: \
+         body(TD, LWPR_GAUSSIAN_KERNEL, NULL); \
+         break; \
+      case LWPR_BISQUARE_KERNEL: \
+         body(TD, LWPR_BISQUARE_KERNEL, NULL); \
+         break; \
+      default: \
+         body(TD, LWPR_AUX_CUSTOM_KERNEL, lwpr_kernel_info((TD)->model->kernel)); \
+   }
+
+/* Computes the activation for a squared distance, and its derivatives unless
+** dwdq or ddwdqdq are NULL. Unknown kernels yield w = 0 */
+static LWPR_AUX_INLINE double lwpr_aux_kernel(int kernel, const LWPR_KernelInfo *custom, 
+      double dist, double *dwdq, double *ddwdqdq) {
+   double w, d1, d2;
+   
+   switch(kernel) {
+      case LWPR_GAUSSIAN_KERNEL:
+         w = exp(-0.5*dist);
+         if (dwdq != NULL) *dwdq = -0.5 * w;
+         if (ddwdqdq != NULL) *ddwdqdq = 0.25 * w;
+         return w;
+      case LWPR_BISQUARE_KERNEL:
+         d1 = 1-0.25*dist;
+         if (d1<0) {
+            w = d1 = d2 = 0.0;
+         } else {
+            w = d1*d1;
+            d1 = -0.5*d1;
+            d2 = 0.125;
+         }
+         break;
+      default:
+         if (custom == NULL || (custom->support > 0.0 && dist >= custom->support)) {
+            w = d1 = d2 = 0.0;
+         } else {
+            w = custom->func(dist, &d1, &d2);
+         }
+   }
+   if (dwdq != NULL) *dwdq = d1;
+   if (ddwdqdq != NULL) *ddwdqdq = d2;
+   return w;
+}
+
+/* Computes the kernel derivatives for a squared distance, given the activation w */
+static LWPR_AUX_INLINE void lwpr_aux_kernel_derivs(int kernel, const LWPR_KernelInfo *custom,
+      double dist, double w, double *dwdq, double *ddwdqdq) {
+   if (kernel == LWPR_GAUSSIAN_KERNEL) {
+      *dwdq = -0.5 * w;
+      if (ddwdqdq != NULL) *ddwdqdq = 0.25 * w;
+   } else {
+      (void) lwpr_aux_kernel(kernel, custom, dist, dwdq, ddwdqdq);
+   }
+}
+
+/* The loops over receptive fields first compute the squared distances of a chunk of
+** LWPR_AUX_CHUNK receptive fields, and then the activations of the whole chunk, 
+** so that the exponentials of the Gaussian kernel can be evaluated by 
+** lwpr_math_exp_array() rather than one by one. */
+#define LWPR_AUX_CHUNK     32
+
+/* Returns the squared distance beyond which activations fall below wmin.
+** Receptive fields further away are skipped without evaluating their activation.
+** A small margin makes sure rounding errors do not matter, and the bound stays
+** within the range of lwpr_math_exp_array(). Registered kernels are only skipped
+** outside their support. */
+double lwpr_aux_qmax(int kernel, const LWPR_KernelInfo *custom, double wmin) {
+   double qmax;
+   
+   if (wmin <= 0.0) return HUGE_VAL;
+   switch(kernel) {
+      case LWPR_GAUSSIAN_KERNEL:
+         qmax = -2.0*log(wmin)*(1.0 + 1e-12);
+         return (qmax < 1416.0) ? qmax : 1416.0;
+      case LWPR_BISQUARE_KERNEL:
+         /* w = (1-q/4)^2 */
+         return (wmin < 1.0) ? 4.0*(1.0 - sqrt(wmin))*(1.0 + 1e-12) : 0.0;
+      default:
+         return (custom != NULL && custom->support > 0.0) ? custom->support : HUGE_VAL;
+   }
+}
+
+/* Returns qmax if distance computations may stop as soon as they exceed it 
+** (see LWPR_Model.early_exit), and HUGE_VAL otherwise. Partial sums are only lower
+** bounds of the distance if the metric is a diagonal matrix or given by its 
+** Cholesky factor. With diag_only, the off-diagonal elements of D are the
+** ones of init_D, which therefore must be diagonal. */
+static double lwpr_aux_qbound(const LWPR_Model *model, double qmax) {
+   int i,j;
+   
+   if (!model->early_exit) return HUGE_VAL;
+   if (model->diag_only) {
+      for (j=0;j<model->nIn;j++) {
+         for (i=0;i<j;i++) {
+            if (model->init_D[i+j*model->nInStore] != 0.0) return HUGE_VAL;
+         }
+      }
+   }
+   return qmax;
+}
+
+/* Computes squared distances q and activations w of the receptive fields n, n+incr, ...
+** (at most LWPR_AUX_CHUNK of them, all below end). Activations for q > qmax are 
+** not evaluated, but set to 0. Distances beyond qbound are not computed exactly,
+** any lower bound above qbound is returned instead */
+static LWPR_AUX_INLINE void lwpr_aux_activations(const LWPR_ThreadData *TD, const LWPR_SubModel *sub, 
+      int kernel, const LWPR_KernelInfo *custom, int n, int incr, int end, double qmax, double qbound,
+      double *q, double *w) {
+   int nIn = TD->model->nIn;
+   double *xc = TD->ws->xc;
+   double arg[LWPR_AUX_CHUNK];
+   int idx[LWPR_AUX_CHUNK];
+   int i,j,m,k = 0;
+   
+   for (m=0; m<LWPR_AUX_CHUNK && n<end; m++, n+=incr) {
+      const LWPR_ReceptiveField *RF = sub->rf[n];
+      
+      for (i=0;i<nIn;i++) {
+         xc[i] = TD->xn[i] - RF->c[i];
+      }
+      if (qbound == HUGE_VAL) {
+         q[m] = lwpr_aux_rf_dist(RF, xc);
+      } else if (TD->model->diag_only) {
+         q[m] = lwpr_math_diagp_quad_bounded(nIn, RF->D, xc, qbound);
+      } else {
+         q[m] = lwpr_math_trip_norm2_bounded(nIn, RF->M, xc, qbound);
+      }
+   }
+   
+   if (kernel == LWPR_GAUSSIAN_KERNEL) {
+      for (j=0;j<m;j++) {
+         w[j] = 0.0;
+         if (q[j] <= qmax) {
+            idx[k] = j;
+            arg[k++] = -0.5*q[j];
+         }
+      }
+      lwpr_math_exp_array(k, arg, arg);
+      for (j=0;j<k;j++) w[idx[j]] = arg[j];
+   } else {
+      for (j=0;j<m;j++) {
+         w[j] = (q[j] <= qmax) ? lwpr_aux_kernel(kernel, custom, q[j], NULL, NULL) : 0.0;
+      }
+   }
+}
+
+void lwpr_aux_dist_derivatives(int nIn,double *dwdM, double *dJ2dM, double *ddwdMdM, double *ddJ2dMdM,
          double w, double dwdq, double ddwdqdq, 
          const double *RF_D, const double *RF_M, const double *dx,
          int diag_only, double penalty, int meta) {
@@ -49,7 +215,7 @@ void lwpr_aux_dist_derivatives(int nIn,int nInS,double *dwdM, double *dJ2dM, dou
       if (meta) {
          /* diagonal case WITH meta learning */         
          for (n=0;n<nIn;n++) {
-            int n_n = n + n*nInS;
+            int n_n = LWPR_TRI(n,n);
             /* take the derivative of q=dx'*D*dx with respect to nn_th element of M */
 
             double aux = 2.0 * RF_M[n_n];
@@ -64,7 +230,7 @@ void lwpr_aux_dist_derivatives(int nIn,int nInS,double *dwdM, double *dJ2dM, dou
       } else {
          /* diagonal case WITHOUT meta learning */               
          for (n=0;n<nIn;n++) {
-            int n_n = n + n*nInS;
+            int n_n = LWPR_TRI(n,n);
             /* take the derivative of q=dx'*D*dx with respect to nn_th element of M */            
 
             double aux = 2.0 * RF_M[n_n];
@@ -91,9 +257,9 @@ void lwpr_aux_dist_derivatives(int nIn,int nInS,double *dwdM, double *dJ2dM, dou
                /* aux corresponds to the in_th (= ni_th) element of dDdM_nm  
                   this is directly processed for dwdM and dJ2dM   */
                
-               double M_ni = RF_M[n+i*nInS];
+               double M_ni = RF_M[LWPR_TRI(n,i)];
                dqdM_nm += dx[i] * M_ni;      /* additional factor 2.0*dx[m] comes after the loop */
-               sum_aux += RF_D[i + m*nInS] * M_ni;                         
+               sum_aux += RF_D[LWPR_SYM(i,m)] * M_ni;                         
                
                if (i == m) {                                                  
                   sum_aux1 += 2.0*M_ni*M_ni;
@@ -103,11 +269,11 @@ void lwpr_aux_dist_derivatives(int nIn,int nInS,double *dwdM, double *dJ2dM, dou
             }
             dqdM_nm *= 2.0*dx[m];
             
-            dwdM[n+m*nInS] = dqdM_nm * dwdq;
-            ddwdMdM[n+m*nInS] = ddwdqdq * dqdM_nm * dqdM_nm + 2*dwdq*dx[m]*dx[m];
+            dwdM[LWPR_TRI(n,m)] = dqdM_nm * dwdq;
+            ddwdMdM[LWPR_TRI(n,m)] = ddwdqdq * dqdM_nm * dqdM_nm + 2*dwdq*dx[m]*dx[m];
                         
-            dJ2dM[n+m*nInS] = 2.0*penalty*sum_aux;
-            ddJ2dMdM[n+m*nInS] = 2.0*penalty*(RF_D[m+m*nInS] + sum_aux1);
+            dJ2dM[LWPR_TRI(n,m)] = 2.0*penalty*sum_aux;
+            ddJ2dMdM[LWPR_TRI(n,m)] = 2.0*penalty*(RF_D[LWPR_TRI(m,m)] + sum_aux1);
         }
       }
    } else {
@@ -122,12 +288,12 @@ void lwpr_aux_dist_derivatives(int nIn,int nInS,double *dwdM, double *dJ2dM, dou
             for (i=n;i<nIn;i++) {
                /* aux corresponds to the i,n_th (= n,i_th) element of dDdm_nm  
                   this is directly processed for dwdM and dJ2dM   */
-               double M_ni = RF_M[n+i*nInS];
+               double M_ni = RF_M[LWPR_TRI(n,i)];
                dqdM_nm += dx[i] * M_ni;       /* additional factor 2.0*dx[m] comes after the loop */        
-               sum_aux += RF_D[i + m*nInS] * M_ni;                         
+               sum_aux += RF_D[LWPR_SYM(i,m)] * M_ni;                         
             }
-            dwdM[n+m*nInS] = 2.0 * dx[m] * dqdM_nm * dwdq;
-            dJ2dM[n+m*nInS] = 2.0 * penalty * sum_aux;
+            dwdM[LWPR_TRI(n,m)] = 2.0 * dx[m] * dqdM_nm * dwdq;
+            dJ2dM[LWPR_TRI(n,m)] = 2.0 * penalty * sum_aux;
          }
       }
    }
@@ -240,51 +406,42 @@ void lwpr_aux_update_b_h_alpha(double *b,double *h, double *alpha,
 */
 
 
-double lwpr_aux_update_distance_metric(LWPR_ReceptiveField *RF, 
-      double w, double dwdq, double ddwdqdq, double e_cv, double e, const double *xn, LWPR_Workspace *WS) {
-      
+/* First part of lwpr_aux_update_distance_metric: computes the derivatives of the cost J1
+** of a receptive field with respect to its activation w, and updates H and r. deriv receives
+** the transient multiplier, w/W, dJ1/dw and (if LWPR_Model.meta is set) ddJ1/dwdw.
+** Returns 0 if the derivatives cannot be trusted yet, and then nothing is updated */
+static int lwpr_aux_metric_derivs(LWPR_ReceptiveField *RF,
+      double w, double e_cv, double e, LWPR_Workspace *WS, double *deriv) {
+
    double transMul;
-   double penalty;
-   
-   int nInS = RF->model->nInStore;
+
    int nIn = RF->model->nIn;
    int nR = RF->nReg;
-   
+
    int *derivOk = WS->derivOk;
 
    double *Ps = WS->Ps;
    double *Pse = WS->Pse;
-   
-   double *dwdM = WS->dwdM;
-   double *dJ2dM = WS->dJ2dM;
-   double *ddwdMdM = WS->ddwdMdM;
-   double *ddJ2dMdM = WS->ddJ2dMdM;
-   double *dx = WS->dx;
-   
+
    double h=0.0;
    double e2;
    double e_cv2;
-   
+
    double W,E;
    double dJ1dw;
-   double maxM;
-   double wW;
-   
-   int reduced = 0;
-      
-   int i,j;
-   
-   penalty = RF->model->penalty / RF->model->nIn;
-   
+   double ddJ1dwdw = 0.0;
+
+   int i;
+
    for (i=0;i<nR;i++) {
       derivOk[i] = (RF->n_data[i]*(1.0 - RF->lambda[0]) > 0.1) ? 1:0;
    }
-   
-   if (!derivOk[0]) return 0.0;
-    
+
+   if (!derivOk[0]) return 0;
+
    e2 = e*e;
    e_cv2 = e_cv*e_cv;
-   
+
    for (i=0;i<nR;i++) {
       if (derivOk[i]) h+=RF->s[i]*RF->s[i]/RF->SSs2[i];
    }
@@ -300,10 +457,10 @@ double lwpr_aux_update_distance_metric(LWPR_ReceptiveField *RF,
       }
    }
    transMul = RF->sum_e2/(E+1E-10); /* to the 4th power ... */
-   transMul*=transMul;   transMul*=transMul; 
-   
+   transMul*=transMul;   transMul*=transMul;
+
    if (transMul>1.0) transMul = 1.0;
-   
+
    dJ1dw = -E/W + e_cv2; /* another division by W comes later */
    for (i=0;i<nR;i++) {
       if (derivOk[i]) {
@@ -315,53 +472,94 @@ double lwpr_aux_update_distance_metric(LWPR_ReceptiveField *RF,
       }
    }
    dJ1dw/=W;
-   
-   wW = w/W;
-   
+
+   if (RF->model->meta) {
+      double sPse = 0.0;
+
+      for (i=0;i<nR;i++) sPse+=RF->s[i]*Pse[i];
+
+      ddJ1dwdw = 2.0*(e2*h/w - e_cv2/W) + E/(W*W); /* another division by W comes later */
+      for (i=0;i<nR;i++) {
+         ddJ1dwdw += 4.0 * (Pse[i]/W + Ps[i]*sPse) * RF->H[i];
+      }
+      ddJ1dwdw/=W;
+   }
+
+   for (i=0;i<nR;i++) {
+      if (derivOk[i]) {
+         RF->H[i] = RF->lambda[i] * RF->H[i] + (w/(1-h))*RF->s[i]*e_cv*transMul;
+         RF->r[i] = RF->lambda[i] * RF->r[i] + (w*w*e_cv2/(1-h))*RF->s[i]*RF->s[i]*transMul;
+      }
+   }
+
+   deriv[0] = transMul;
+   deriv[1] = w/W;
+   deriv[2] = dJ1dw;
+   deriv[3] = ddJ1dwdw;
+   return 1;
+}
+
+/* Second part of lwpr_aux_update_distance_metric: updates the distance metric of a receptive
+** field, and with LWPR_Model.meta also its learning rates, from the derivatives computed by
+** lwpr_aux_metric_derivs */
+static void lwpr_aux_metric_step(LWPR_ReceptiveField *RF,
+      double w, double dwdq, double ddwdqdq, const double *deriv, const double *xn, LWPR_Workspace *WS) {
+
+   double transMul = deriv[0];
+   double wW = deriv[1];
+   double dJ1dw = deriv[2];
+   double ddJ1dwdw = deriv[3];
+   double penalty;
+
+   int nIn = RF->model->nIn;
+   int nTri = LWPR_TRI_SIZE(nIn);
+
+   double *dwdM = WS->dwdM;
+   double *dJ2dM = WS->dJ2dM;
+   double *ddwdMdM = WS->ddwdMdM;
+   double *ddJ2dMdM = WS->ddJ2dMdM;
+   double *dx = WS->dx;
+
+   double maxM;
+
+   int reduced = 0;
+
+   int i,j,off;
+
+   penalty = RF->model->penalty / RF->model->nIn;
+
    for (i=0;i<nIn;i++) dx[i]=xn[i]-RF->c[i];
-     
-   lwpr_aux_dist_derivatives(nIn, nInS, dwdM, dJ2dM, ddwdMdM, ddJ2dMdM, w, dwdq, ddwdqdq, RF->D, RF->M, dx, RF->model->diag_only, penalty, RF->model->meta);  
-   
+
+   lwpr_aux_dist_derivatives(nIn, dwdM, dJ2dM, ddwdMdM, ddJ2dMdM, w, dwdq, ddwdqdq, RF->D, RF->M, dx, RF->model->diag_only, penalty, RF->model->meta);
+
    if (RF->model->diag_only) {
-   
+
       maxM = 0.0;
-      for (j=0;j<nIn;j++) {   
-         double m = fabs(RF->M[j+j*nInS]);
+      for (j=0;j<nIn;j++) {
+         double m = fabs(RF->M[LWPR_TRI(j,j)]);
          if (m>maxM) maxM=m;
       }
-      
+
       for (j=0;j<nIn;j++) {
-         int off = j + j*nInS;         
+         int off = LWPR_TRI(j,j);
          dJ2dM[off] = wW * dJ2dM[off] + dwdM[off]*dJ1dw;
       }
-      
+
       if (RF->model->meta) {
          /* Reuse dJ2dM as dJdM */
-
-         double ddJ1dwdw;
-         double sPse = 0.0;
-         
-         for (i=0;i<nR;i++) sPse+=RF->s[i]*Pse[i];
-
-         ddJ1dwdw = 2.0*(e2*h/w - e_cv2/W) + E/(W*W); /* another division by W comes later */
-         for (i=0;i<nR;i++) {
-            ddJ1dwdw += 4.0 * (Pse[i]/W + Ps[i]*sPse) * RF->H[i];
-         }
-         ddJ1dwdw/=W;
-         
          for (j=0;j<nIn;j++) {
-            int off = j + j*nInS;         
+            int off = LWPR_TRI(j,j);
             double ddJdMdM_jj = wW * ddJ2dMdM[off] + ddwdMdM[off]*dJ1dw + dwdM[off]*dwdM[off] * ddJ1dwdw;
             double aux_jj;
             double b_jj;
             double alpha_jj;
-            
+
             /* This implements the incremental Delta-Bar-Delta algorithm (Sutton, 1992)
                with some additional safety heuristics */
             aux_jj = RF->model->meta_rate * transMul * dJ2dM[off] * RF->h[off];
 
             if (aux_jj > 0.1) {
-               aux_jj = 0.1; 
+               aux_jj = 0.1;
             } else if (aux_jj < -0.1) {
                aux_jj = -0.1;
             }
@@ -382,8 +580,8 @@ double lwpr_aux_update_distance_metric(LWPR_ReceptiveField *RF,
          }
       }
 
-      for (j=0;j<nIn;j++) {   
-         int off = j + j*nInS;                     
+      for (j=0;j<nIn;j++) {
+         int off = LWPR_TRI(j,j);
          double delta_M_jj = RF->alpha[off] * transMul * dJ2dM[off];
          if (delta_M_jj > 0.1*maxM) {
             RF->alpha[off]*=0.5;
@@ -393,120 +591,129 @@ double lwpr_aux_update_distance_metric(LWPR_ReceptiveField *RF,
          }
       }
 
-      for (j=0;j<nIn;j++) {   
-         RF->D[j+j*nInS] = RF->M[j+j*nInS] * RF->M[j+j*nInS];
+      for (j=0;j<nIn;j++) {
+         int off = LWPR_TRI(j,j);
+         RF->D[off] = RF->M[off] * RF->M[off];
       }
-   
+
    } else {
       /* Full distance matrix (non-diagonal) case */
       maxM = 0.0;
-      for (j=0;j<nIn;j++) {   
-         for (i=0;i<=j;i++) {
-            double m = fabs(RF->M[i+j*nInS]);
-            if (m>maxM) maxM=m;
-         }
-      }
-   
-      /* Reuse dJ2dM as dJdM */
-      for (j=0;j<nIn;j++) {   
-         /* for (i=0;i<=j;i++) dJ2dM[i+j*nInS] = wW * dJ2dM[i+j*nInS] + dwdM[i+j*nInS]*dJ1dw; */  
-         lwpr_math_scale_add_scalar_vector(wW, dJ2dM + j*nInS, dJ1dw, dwdM + j*nInS, j+1);
+      for (i=0;i<nTri;i++) {
+         double m = fabs(RF->M[i]);
+         if (m>maxM) maxM=m;
       }
 
-      if (RF->model->meta) {
-         double ddJ1dwdw;
-         double sPse = 0.0;
-         for (i=0;i<nR;i++) sPse+=RF->s[i]*Pse[i];
-
-         ddJ1dwdw = 2.0*(e2*h/w - e_cv2/W) + E/(W*W); /* another division by W comes later */
-         for (i=0;i<nR;i++) {
-            ddJ1dwdw += 4.0 * (Pse[i]/W + Ps[i]*sPse) * RF->H[i];
-         }
-         ddJ1dwdw/=W;
+      /* Reuse dJ2dM as dJdM. All matrices are packed, so this is just one long vector */
+      /* for (i=0;i<nTri;i++) dJ2dM[i] = wW * dJ2dM[i] + dwdM[i]*dJ1dw; */
+      lwpr_math_scale_add_scalar_vector(wW, dJ2dM, dJ1dw, dwdM, nTri);
 
+      if (RF->model->meta) {
          /* Reuse ddJ2dMdM as ddJdMdM */
 
          /* SSE2 routine
-         lwpr_aux_update_b_h_alpha(RF->b, RF->h, RF->alpha, dwdM, dJ2dM, ddwdMdM, ddJ2dMdM, 
+         lwpr_aux_update_b_h_alpha(RF->b, RF->h, RF->alpha, dwdM, dJ2dM, ddwdMdM, ddJ2dMdM,
                   &wW, &dJ1dw, &ddJ1dwdw, &(RF->model->meta_rate), &transMul, nIn, nInS);
          */
 
-         for (j=0;j<nIn;j++) {   
-            for (i=0;i<=j;i++) {
-               int off = i+j*nInS;
-               double aux_ij;
-               double b_ij;
-               double alpha_ij;
-               double dwdM_ij = dwdM[off];
-               double ddJdMdM_ij = wW * ddJ2dMdM[off] + ddwdMdM[off]*dJ1dw + dwdM_ij*dwdM_ij * ddJ1dwdw;
-
-               /* This implements the incremental Delta-Bar-Delta algorithm (Sutton, 1992),
-                  with some additional safety heuristics */
-               
-               aux_ij = RF->model->meta_rate * transMul * dJ2dM[off] * RF->h[off];
-               if (aux_ij > 0.1) {
-                  aux_ij = 0.1; 
-               } else if (aux_ij < -0.1) {
-                  aux_ij = -0.1;
-               }
+         for (off=0;off<nTri;off++) {
+            double aux_ij;
+            double b_ij;
+            double alpha_ij;
+            double dwdM_ij = dwdM[off];
+            double ddJdMdM_ij = wW * ddJ2dMdM[off] + ddwdMdM[off]*dJ1dw + dwdM_ij*dwdM_ij * ddJ1dwdw;
 
-               b_ij = RF->b[off] - aux_ij;
-               if (b_ij > 10.0) {
-                  b_ij = 10.0;
-               } else if (b_ij < -10.0) {
-                  b_ij = -10.0;
-               }
+            /* This implements the incremental Delta-Bar-Delta algorithm (Sutton, 1992),
+               with some additional safety heuristics */
 
-               RF->b[off] = b_ij;
-               alpha_ij = exp(b_ij);
-               RF->alpha[off] = alpha_ij;
+            aux_ij = RF->model->meta_rate * transMul * dJ2dM[off] * RF->h[off];
+            if (aux_ij > 0.1) {
+               aux_ij = 0.1;
+            } else if (aux_ij < -0.1) {
+               aux_ij = -0.1;
+            }
 
-               aux_ij = 1.0 - alpha_ij*ddJdMdM_ij*transMul;
-               if (aux_ij < 0) aux_ij = 0;
-               RF->h[off] = RF->h[off] * aux_ij - alpha_ij* transMul * dJ2dM[off];
+            b_ij = RF->b[off] - aux_ij;
+            if (b_ij > 10.0) {
+               b_ij = 10.0;
+            } else if (b_ij < -10.0) {
+               b_ij = -10.0;
             }
-         }
-      }
 
+            RF->b[off] = b_ij;
+            alpha_ij = exp(b_ij);
+            RF->alpha[off] = alpha_ij;
 
-      for (j=0;j<nIn;j++) {   
-         for (i=0;i<=j;i++) {
-            double delta_M_ij = RF->alpha[i+j*nInS] * transMul * dJ2dM[i+j*nInS];
-            if (delta_M_ij > 0.1*maxM) {
-               reduced = 1;
-               RF->alpha[i+j*nInS]*=0.5;
-            } else {
-               RF->M[i+j*nInS] -= delta_M_ij;
-            }
+            aux_ij = 1.0 - alpha_ij*ddJdMdM_ij*transMul;
+            if (aux_ij < 0) aux_ij = 0;
+            RF->h[off] = RF->h[off] * aux_ij - alpha_ij* transMul * dJ2dM[off];
          }
       }
 
-      for (j=0;j<nIn;j++) {   
-         /* Calculate in lower triangle, fill upper */
-         for (i=0;i<j;i++) {   
-            RF->D[i+j*nInS] = RF->D[j+i*nInS];
-         }
-         for (i=j;i<nIn;i++) {
-            RF->D[i+j*nInS] = lwpr_math_dot_product(RF->M + i*nInS, RF->M + j*nInS,j+1);
+
+      for (off=0;off<nTri;off++) {
+         double delta_M_ij = RF->alpha[off] * transMul * dJ2dM[off];
+         if (delta_M_ij > 0.1*maxM) {
+            reduced = 1;
+            RF->alpha[off]*=0.5;
+         } else {
+            RF->M[off] -= delta_M_ij;
          }
       }
+
+      /* D = M'M, only the upper triangle */
+      lwpr_math_trip_gram(nIn, RF->D, RF->M);
    }
-   
-   for (i=0;i<nR;i++) {
-      if (derivOk[i]) {
-         RF->H[i] = RF->lambda[i] * RF->H[i] + (w/(1-h))*RF->s[i]*e_cv*transMul;
-         RF->r[i] = RF->lambda[i] * RF->r[i] + (w*w*e_cv2/(1-h))*RF->s[i]*RF->s[i]*transMul;
-      }
-   }
+
    #ifdef MATLAB
-      if (reduced) printf("Reduced learning rate.\n"); 
+      if (reduced) printf("Reduced learning rate.\n");
    #endif
-   return transMul; 
 }
 
+double lwpr_aux_update_distance_metric(LWPR_ReceptiveField *RF,
+      double w, double dwdq, double ddwdqdq, double e_cv, double e, const double *xn, LWPR_Workspace *WS) {
+   double deriv[4];
+
+   if (!lwpr_aux_metric_derivs(RF, w, e_cv, e, WS, deriv)) return 0.0;
+   lwpr_aux_metric_step(RF, w, dwdq, ddwdqdq, deriv, xn, WS);
+   return deriv[0];
+}
+
+#if NUM_THREADS > 1
+/* Enlarges the working memory of two-phase updates (see lwpr_aux_update_one) to 
+** numPointers receptive fields. Returns 0 if memory could not be allocated */
+static int lwpr_aux_grow_update_buffers(LWPR_SubModel *sub, int numPointers) {
+   double *dw;
+   int *order;
+   
+   dw = (double *) LWPR_REALLOC(sub->dw, 2*numPointers*sizeof(double));
+   if (dw == NULL) return 0;
+   sub->dw = dw;
+   #ifdef MATLAB
+      if (sub->model->isPersistent) mexMakeMemoryPersistent(sub->dw);
+   #endif   
+   
+   order = (int *) LWPR_REALLOC(sub->order, (3*numPointers + sub->model->nIn + 1)*sizeof(int));
+   if (order == NULL) return 0;
+   sub->order = order;
+   #ifdef MATLAB
+      if (sub->model->isPersistent) mexMakeMemoryPersistent(sub->order);
+   #endif   
+   return 1;
+}
+#endif
+
 LWPR_ReceptiveField *lwpr_aux_add_rf(LWPR_SubModel *sub, int nReg) {
    LWPR_ReceptiveField *RF;
    
+#if NUM_THREADS > 1
+   /* The buffers are grown first, so they always hold at least numPointers RFs */
+   if (sub->numRFS == sub->numPointers || sub->order == NULL) {
+      int numPointers = sub->numPointers + ((sub->numRFS == sub->numPointers) ? 16 : 0);
+      if (!lwpr_aux_grow_update_buffers(sub, numPointers)) return NULL;
+   }
+#endif
+   
    if (sub->numRFS == sub->numPointers) {
       LWPR_ReceptiveField **newStore = (LWPR_ReceptiveField **) LWPR_REALLOC(sub->rf, (sub->numPointers+16)*sizeof(LWPR_ReceptiveField *));
       if (newStore == NULL) return NULL;      
@@ -539,6 +746,26 @@ LWPR_ReceptiveField *lwpr_aux_add_rf(LWPR_SubModel *sub, int nReg) {
 
 
 /* returns ymz. xmz is also output value */
+double lwpr_aux_rf_dist(const LWPR_ReceptiveField *RF, const double *xc) {
+   int nIn = RF->model->nIn;
+   
+   if (RF->model->diag_only) return lwpr_math_symp_quad(nIn, RF->D, xc);
+   /* D = M'M, so xc'*D*xc = ||M*xc||^2 */
+   return lwpr_math_trip_norm2(nIn, RF->M, xc);
+}
+
+double lwpr_aux_rf_dist_Dx(const LWPR_ReceptiveField *RF, const double *xc, double *Dx, double *Mx) {
+   int nIn = RF->model->nIn;
+   
+   if (RF->model->diag_only) {
+      lwpr_math_symp_mv(nIn, Dx, RF->D, xc);
+      return lwpr_math_dot_product(xc, Dx, nIn);
+   }
+   lwpr_math_trip_mv(nIn, Mx, RF->M, xc);
+   lwpr_math_trip_tmv(nIn, Dx, RF->M, Mx);
+   return lwpr_math_dot_product(Mx, Mx, nIn);
+}
+
 double lwpr_aux_update_means(LWPR_ReceptiveField *RF, const double *x, double y, double w, double *xmz) {
    int i;
    int nIn = RF->model->nIn;
@@ -626,6 +853,25 @@ void lwpr_aux_compute_projection_d(int nIn, int nInS, int nReg,
    }         
 }
 
+void lwpr_aux_compute_slope(LWPR_ReceptiveField *RF) {
+   int j;
+   int nIn = RF->model->nIn;
+   int nInS = RF->model->nInStore;
+   int nR = RF->nReg;
+   double *t = RF->slope;
+   
+   if (RF->n_data[nR-1] <= 2*nIn) nR--;
+   
+   /* slope = sum_j beta_j * ds_j/dx, where s_j = U_j' * prod_{k<j} (I - P_k U_k') * x 
+   ** Going backwards: t <- beta_j * U_j + (I - U_j P_j') * t */
+   memset(t, 0, nIn*sizeof(double));
+   for (j=nR-1;j>=0;j--) {
+      double dp = lwpr_math_dot_product(RF->P + j*nInS, t, nIn);
+      lwpr_math_add_scalar_vector(t, RF->beta[j] - dp, RF->U + j*nInS, nIn);
+   }
+   RF->slopeReady = 1;
+}
+
 void lwpr_aux_update_regression(LWPR_ReceptiveField *RF, double *yp, double *e_cv_R, double *e,
    const double *x, double y, double w, LWPR_Workspace *WS) {
    
@@ -764,18 +1010,19 @@ int lwpr_aux_check_add_projection(LWPR_ReceptiveField *RF) {
 }
 
 int lwpr_aux_init_rf(LWPR_ReceptiveField *RF, const LWPR_Model *model, const LWPR_ReceptiveField *RFT, const double *xc, double y) {
-   int i,j,nReg, nRegStore;
+   int i,nReg, nRegStore;
    int nIn = model->nIn;
    int nInS = model->nInStore;
+   int nTri = LWPR_TRI_SIZE(nIn);
    
    if (RFT==NULL) {
       nReg = (nIn>1)? 2:1;
       nRegStore = (nReg > LWPR_REGSTORE) ? nReg : LWPR_REGSTORE;
       if (!lwpr_mem_alloc_rf(RF, model, nReg, nRegStore)) return 0;
       
-      memcpy(RF->D, model->init_D, nInS*nIn*sizeof(double));
-      memcpy(RF->M, model->init_M, nInS*nIn*sizeof(double));
-      memcpy(RF->alpha, model->init_alpha, nInS*nIn*sizeof(double));      
+      lwpr_math_tri_pack(nIn, nInS, RF->D, model->init_D);
+      lwpr_math_tri_pack(nIn, nInS, RF->M, model->init_M);
+      lwpr_math_tri_pack(nIn, nInS, RF->alpha, model->init_alpha);
       RF->beta0 = y;
    } else {
       nReg = RFT->nReg;
@@ -783,9 +1030,9 @@ int lwpr_aux_init_rf(LWPR_ReceptiveField *RF, const LWPR_Model *model, const LWP
 
       if (!lwpr_mem_alloc_rf(RF, model, nReg, nRegStore)) return 0;
       
-      memcpy(RF->D, RFT->D, nInS*nIn*sizeof(double));
-      memcpy(RF->M, RFT->M, nInS*nIn*sizeof(double));
-      memcpy(RF->alpha, RFT->alpha, nInS*nIn*sizeof(double));      
+      memcpy(RF->D, RFT->D, nTri*sizeof(double));
+      memcpy(RF->M, RFT->M, nTri*sizeof(double));
+      memcpy(RF->alpha, RFT->alpha, nTri*sizeof(double));
       RF->beta0 = RFT->beta0;
    }
    /* lwpr_mem_alloc_rf has initialised all elements to zero */
@@ -796,6 +1043,7 @@ int lwpr_aux_init_rf(LWPR_ReceptiveField *RF, const LWPR_Model *model, const LWP
    RF->sum_e2 = 0.0;
    RF->SSp = 0.0;
    RF->model = model;
+   RF->last_active = model->n_data;
    
    for (i=0;i<nReg;i++) {
       RF->SSs2[i] = model->init_S2;
@@ -805,10 +1053,8 @@ int lwpr_aux_init_rf(LWPR_ReceptiveField *RF, const LWPR_Model *model, const LWP
       RF->n_data[i] = 1e-10;
       RF->lambda[i] = model->init_lambda;
    }
-   for (j=0;j<nIn;j++) {
-      for (i=0;i<=j;i++) {
-         RF->b[i+j*nInS] = log(RF->alpha[i+j*nInS] + 1e-10);
-      }
+   for (i=0;i<nTri;i++) {
+      RF->b[i] = log(RF->alpha[i] + 1e-10);
    }
    return 1;   
 }
@@ -831,63 +1077,91 @@ void lwpr_aux_update_model_stats(LWPR_Model *model, const double *x) {
 
 
 
-void *lwpr_aux_update_one_T(void *ptr) {
-   LWPR_ThreadData *TD = (LWPR_ThreadData *) ptr;
-   LWPR_SubModel *sub = &(TD->model->sub[TD->dim]);
-   LWPR_Workspace *WS = TD->ws;
+/* Updates the statistics, the local model and the distance metric of an active receptive
+** field, and adds its prediction to yp and sum_w if it is trustworthy */
+static LWPR_AUX_INLINE void lwpr_aux_update_rf(LWPR_ThreadData *TD, LWPR_ReceptiveField *RF,
+      double w, double dwdq, double ddwdqdq, double *yp, double *sum_w) {
    const LWPR_Model *model = TD->model;
+   LWPR_Workspace *WS = TD->ws;
+   double e,e_cv,ymz,yp_n;
+   int i,nRegStore;
+   
+   RF->last_active = model->n_data;
+
+   ymz = lwpr_aux_update_means(RF,TD->xn,TD->yn,w,WS->xmz);
+   lwpr_aux_update_regression(RF, &yp_n, &e_cv, &e, WS->xmz, ymz,w, WS);
+   
+   if (RF->trustworthy) {
+      *yp += w*yp_n;
+      *sum_w += w;
+   }
+   
+   if (model->update_D) {
+      (void) lwpr_aux_update_distance_metric(RF, w, dwdq, ddwdqdq, e_cv, e, TD->xn, WS);
+   }
+   
+   nRegStore = RF->nRegStore;
+   lwpr_aux_check_add_projection(RF);
+   if (RF->nRegStore != nRegStore) TD->grown = 1;
+   
+   for (i=0;i<RF->nReg;i++) {
+      RF->n_data[i] = RF->n_data[i] * RF->lambda[i] + 1;
+      RF->lambda[i] = model->tau_lambda * RF->lambda[i] + model->final_lambda*(1.0-model->tau_lambda);
+   }
+   
+   if (model->eager_slopes) lwpr_aux_compute_slope(RF);
+}
+
+static LWPR_AUX_INLINE void lwpr_aux_update_one_K(LWPR_ThreadData *TD, int kernel, const LWPR_KernelInfo *custom) {
+   LWPR_SubModel *sub = &(TD->model->sub[TD->dim]);
       
-   int i,j,n,nIn,nInS;
-   double *xc; 
-   double e,e_cv; 
-  
-   double ymz;
+   int n;
    
    double w, w_sec = 0.0, w_max = 0.0;
    int ind = -1, ind_sec = -1, ind_max = -1;
-   double yp = 0.0, yp_n;
+   double yp = 0.0;
    
    double sum_w = 0.0;
 
    double dwdq,ddwdqdq;
    
-   nIn = TD->model->nIn;
-   nInS = TD->model->nInStore;   
-      
-   xc = WS->xc;
+   double q[LWPR_AUX_CHUNK], wq[LWPR_AUX_CHUNK];
+   double qmax = lwpr_aux_qmax(kernel, custom, 0.001);
+   double qbound = lwpr_aux_qbound(TD->model, qmax);
+   double q_far[2];
+   int ind_far[2] = {-1, -1};
+   int j = LWPR_AUX_CHUNK;
       
    for (n=TD->start;n<TD->end;n+=TD->incr) {
    
-      double dist = 0.0;
+      double dist;
       LWPR_ReceptiveField *RF = sub->rf[n];
       
-      
-      for (i=0;i<nIn;i++) {
-         xc[i] = TD->xn[i] - RF->c[i];
+      if (j == LWPR_AUX_CHUNK) {
+         lwpr_aux_activations(TD, sub, kernel, custom, n, TD->incr, TD->end, qmax, qbound, q, wq);
+         j = 0;
       }
+      dist = q[j];
+      w = wq[j++];
       
-      for (j=0;j<nIn;j++) {
-         dist += xc[j] * lwpr_math_dot_product(RF->D + j*nInS, xc, nIn);
-      }
-      switch(TD->model->kernel) {
-         case LWPR_GAUSSIAN_KERNEL:
-            w = exp(-0.5*dist);
-            dwdq = -0.5 * w;
-            ddwdqdq = 0.25 * w;
-            break;
-         case LWPR_BISQUARE_KERNEL:
-            dwdq = 1-0.25*dist;
-            if (dwdq<0) {
-               w = dwdq = ddwdqdq = 0.0;
+      if (dist > qmax) {
+         /* w is below 0.001, so the RF is not updated. Only the two closest of
+         ** these RFs may still be needed for w_max and w_sec (see below) */
+         RF->w = 0.0;
+         if (ind_far[1] < 0 || dist < q_far[1]) {
+            if (ind_far[0] < 0 || dist < q_far[0]) {
+               q_far[1] = q_far[0];
+               ind_far[1] = ind_far[0];
+               q_far[0] = dist;
+               ind_far[0] = n;
             } else {
-               w = dwdq*dwdq;
-               ddwdqdq = 0.125;
-               dwdq = -0.5*dwdq;
+               q_far[1] = dist;
+               ind_far[1] = n;
             }
-            break;
-         default:
-            w = dwdq = ddwdqdq = 0;
+         }
+         continue;
       }
+      lwpr_aux_kernel_derivs(kernel, custom, dist, w, &dwdq, &ddwdqdq);
       
      
       if (w>w_sec) {
@@ -906,56 +1180,137 @@ void *lwpr_aux_update_one_T(void *ptr) {
       }
       
       if (w>0.001) {
-         double transmul;
-         
          RF->w = w;
-
-         ymz = lwpr_aux_update_means(RF,TD->xn,TD->yn,w,WS->xmz);
-         lwpr_aux_update_regression(RF, &yp_n, &e_cv, &e, WS->xmz, ymz,w, WS);
-         
-         if (RF->trustworthy) {
-            yp += w*yp_n;
-            sum_w += w;
-         }
-         
-         if (model->update_D) {
-            transmul = lwpr_aux_update_distance_metric(RF, w, dwdq, ddwdqdq, e_cv, e, TD->xn, WS);
-         }
-         
-         lwpr_aux_check_add_projection(RF);
-         
-         for (i=0;i<RF->nReg;i++) {
-            RF->n_data[i] = RF->n_data[i] * RF->lambda[i] + 1;
-            RF->lambda[i] = model->tau_lambda * RF->lambda[i] + model->final_lambda*(1.0-model->tau_lambda);
+         if (TD->dw != NULL) {
+            /* First phase of a two-phase update, see lwpr_aux_update_one */
+            TD->dw[2*n] = dwdq;
+            TD->dw[2*n+1] = ddwdqdq;
+         } else {
+            lwpr_aux_update_rf(TD, RF, w, dwdq, ddwdqdq, &yp, &sum_w);
          }
       } else {
          RF->w = 0.0;
       }
    }
 
+   /* Skipped RFs have smaller activations than all others */
+   for (j=0;j<2 && ind_far[j]>=0;j++) {
+      w = lwpr_aux_kernel(kernel, custom, q_far[j], NULL, NULL);
+      if (w>w_sec) {
+         if (w>w_max) {
+            ind_sec = ind_max;
+            w_sec = w_max;            
+            ind_max = ind_far[j];
+            w_max = w;
+         } else {
+            ind_sec = ind_far[j];
+            w_sec = w;
+         }
+      }
+   }
+
    TD->w_max = w_max;
    TD->ind_max = ind_max;
    TD->w_sec = w_sec;
    TD->ind_sec = ind_sec;
    TD->yp = yp;
    TD->sum_w = sum_w;
-   return NULL;
+}
+
+void *lwpr_aux_update_one_T(void *ptr) {
+   LWPR_ThreadData *TD = (LWPR_ThreadData *) ptr;
+   LWPR_AUX_KERNEL_DISPATCH(lwpr_aux_update_one_K, TD);
+   return NULL;
+}
+
+void lwpr_aux_remove_rf(LWPR_SubModel *sub, int ind) {
+   /* Release the pool (see lwpr_mem_pool_rfs) with the last RF stored in it */
+   if (sub->rf[ind]->pooled && --sub->numPooled == 0) {
+      LWPR_FREE(sub->pool);
+      sub->pool = NULL;
+      sub->poolSize = 0;
+   }
+   lwpr_mem_free_rf(sub->rf[ind]);
+   LWPR_FREE(sub->rf[ind]);
+   
+   if (ind < sub->numRFS-1) {
+      /* Fill the gap with last RF (we just move around the pointer) */      
+      sub->rf[ind] = sub->rf[sub->numRFS-1];
+   }
+   sub->numRFS--;
+}
+
+/* Returns the index of the receptive field that the eviction policy removes first,
+** never choosing keep, or -1 if there is none */
+static int lwpr_aux_select_victim(const LWPR_Model *model, const LWPR_SubModel *sub, const LWPR_ReceptiveField *keep) {
+   int i, victim = -1;
+   
+   switch(model->evict) {
+      case LWPR_EVICT_LEAST_RECENT:
+         for (i=0;i<sub->numRFS;i++) {
+            if (sub->rf[i] == keep) continue;
+            if (victim < 0 || sub->rf[i]->last_active < sub->rf[victim]->last_active) victim = i;
+         }
+         break;
+      case LWPR_EVICT_LEAST_DATA:
+         for (i=0;i<sub->numRFS;i++) {
+            if (sub->rf[i] == keep) continue;
+            if (victim < 0 || sub->rf[i]->n_data[0] < sub->rf[victim]->n_data[0]) victim = i;
+         }
+         break;
+      default:
+         break;
+   }
+   return victim;
+}
+
+int lwpr_aux_make_room(LWPR_Model *model, LWPR_SubModel *sub, const LWPR_ReceptiveField *keep, int nRegStore) {
+   int adding = (nRegStore > 0) ? 1 : 0;
+   size_t bytes = 0, needed = 0;
+   
+   if (model->max_bytes > 0) {
+      bytes = lwpr_mem_sub_bytes(sub);
+      if (adding) needed = lwpr_mem_rf_bytes(model, nRegStore);
+   }
+   
+   while ((model->max_rfs > 0 && sub->numRFS + adding > model->max_rfs) 
+         || (model->max_bytes > 0 && bytes + needed > model->max_bytes)) {
+      int victim = lwpr_aux_select_victim(model, sub, keep);
+      
+      if (victim < 0) return 0;
+      
+      lwpr_aux_remove_rf(sub, victim);
+      sub->n_evicted++;
+      /* Pooled RFs (see lwpr_mem_pool_rfs) free only part of their memory */
+      if (model->max_bytes > 0) bytes = lwpr_mem_sub_bytes(sub);
+   }
+   return 1;
 }
 
 int lwpr_aux_update_one_add_prune(LWPR_Model *model, LWPR_ThreadData *TD, int dim, const double *xn, double yn) {
    LWPR_SubModel *sub = &model->sub[dim];   
    
    if (TD->w_max <= model->w_gen) {
-      LWPR_ReceptiveField *RF = lwpr_aux_add_rf(sub,0);
+      LWPR_ReceptiveField *RF;
+      const LWPR_ReceptiveField *RFT = NULL;
+      int nRegStore = LWPR_REGSTORE;
+      
+      if ((TD->w_max > 0.1*model->w_gen) && (sub->rf[TD->ind_max]->trustworthy)) {
+         RFT = sub->rf[TD->ind_max];
+         nRegStore = RFT->nRegStore;
+      }
+      
+      /* Submodel has reached its budget, and no RF could be evicted. 
+         The LWPR model is still valid, so this is not an error */
+      if (!lwpr_aux_make_room(model, sub, RFT, nRegStore)) return 1;
+      
+      RF = lwpr_aux_add_rf(sub,0);
 
       /* Receptive field could not be allocated. The LWPR model is still
          valid, but return "0" to indicate this */      
       if (RF == NULL) return 0;
 
-      if ((TD->w_max > 0.1*model->w_gen) && (sub->rf[TD->ind_max]->trustworthy)) {
-         return lwpr_aux_init_rf(RF,model,sub->rf[TD->ind_max], xn, yn);
-      }
-      return lwpr_aux_init_rf(RF,model,NULL, xn, yn);
+      return lwpr_aux_init_rf(RF,model,RFT, xn, yn);
    }
    
    /* Prune ReceptiveFields */
@@ -964,24 +1319,17 @@ int lwpr_aux_update_one_add_prune(LWPR_Model *model, LWPR_ThreadData *TD, int di
       int i,prune;
       for (i=0;i<model->nIn;i++) {
          /*
-         tr_max += lwpr_math_norm2(sub->rf[TD->ind_max]->M + i*model->nInStore, model->nIn);
-         tr_sec += lwpr_math_norm2(sub->rf[TD->ind_sec]->M + i*model->nInStore, model->nIn);
+         tr_max += lwpr_math_norm2(sub->rf[TD->ind_max]->M + LWPR_TRI(0,i), i+1);
+         tr_sec += lwpr_math_norm2(sub->rf[TD->ind_sec]->M + LWPR_TRI(0,i), i+1);
          */
          /* code for just comparing the traces of D */
-         tr_max += sub->rf[TD->ind_max]->D[i+i*model->nInStore];
-         tr_sec += sub->rf[TD->ind_sec]->D[i+i*model->nInStore];
+         tr_max += sub->rf[TD->ind_max]->D[LWPR_TRI(i,i)];
+         tr_sec += sub->rf[TD->ind_sec]->D[LWPR_TRI(i,i)];
       }
       /* TODO: ORIGINAL LOGIC WAS REVERSED -- CHECK */
       prune = (tr_max < tr_sec) ? TD->ind_max : TD->ind_sec;
       
-      lwpr_mem_free_rf(sub->rf[prune]);
-      LWPR_FREE(sub->rf[prune]);
-      
-      if (prune < sub->numRFS-1) {
-         /* Fill the gap with last RF (we just move around the pointer) */      
-         sub->rf[prune] = sub->rf[sub->numRFS-1];
-      }
-      sub->numRFS--;
+      lwpr_aux_remove_rf(sub, prune);
       sub->n_pruned++;
       
       /* printf("Output %d, pruned RF %d\n",dim+1,prune+1); */
@@ -990,11 +1338,11 @@ int lwpr_aux_update_one_add_prune(LWPR_Model *model, LWPR_ThreadData *TD, int di
    return 1;   
 }
 
-int lwpr_aux_update_one(LWPR_Model *model, int dim, const double *xn, double yn, double *y_pred, double *max_w) {
-   LWPR_ThreadData TD[NUM_THREADS];
-   int i;
-
+/* Runs func on the thread data TD[0..NUM_THREADS-1], which split up the receptive fields
+** of a submodel, and accumulates their statistics in TD[0] */
+static void lwpr_aux_update_threads(LWPR_ThreadData *TD, void *(*func)(void *)) {
 #if NUM_THREADS > 1
+   int i;
    #ifdef WIN32
       HANDLE thread[NUM_THREADS-1];
       DWORD ID[NUM_THREADS-1];
@@ -1002,32 +1350,19 @@ int lwpr_aux_update_one(LWPR_Model *model, int dim, const double *xn, double yn,
       pthread_t thread[NUM_THREADS-1];
       int rc[NUM_THREADS-1];      
    #endif
-#endif
 
-   for (i=0;i<NUM_THREADS;i++) {
-      TD[i].model = model;
-      TD[i].dim = dim;
-      TD[i].xn = xn;
-      TD[i].yn = yn;
-      TD[i].incr = NUM_THREADS;
-      TD[i].start = i;
-      TD[i].end = model->sub[dim].numRFS;
-      TD[i].ws = &model->ws[i];
-   }
-
-#if NUM_THREADS > 1
    #ifdef WIN32
       for (i=0;i<NUM_THREADS-1;i++) {
-         thread[i] = CreateThread(NULL,0,lwpr_aux_update_one_T,&TD[i],0, &ID[i]);
+         thread[i] = CreateThread(NULL,0,func,&TD[i],0, &ID[i]);
       }
    #else
       for (i=0;i<NUM_THREADS-1;i++) {   
-         rc[i] = pthread_create(&thread[i], NULL, lwpr_aux_update_one_T, &TD[i]);
+         rc[i] = pthread_create(&thread[i], NULL, func, &TD[i]);
       }      
    #endif
 #endif
 
-   (void) lwpr_aux_update_one_T(&TD[NUM_THREADS-1]);      
+   (void) func(&TD[NUM_THREADS-1]);      
    
 #if NUM_THREADS > 1
    /* Wait for other threads to finish, or do their calculations if they
@@ -1038,7 +1373,7 @@ int lwpr_aux_update_one(LWPR_Model *model, int dim, const double *xn, double yn,
             WaitForSingleObject(thread[i],INFINITE);
             CloseHandle(thread[i]);
          } else {
-            (void) lwpr_aux_update_one_T(&TD[i]);       
+            (void) func(&TD[i]);       
          }
       }
    #else
@@ -1046,7 +1381,7 @@ int lwpr_aux_update_one(LWPR_Model *model, int dim, const double *xn, double yn,
          if (rc[i]==0) {
             pthread_join(thread[i],NULL);
          } else {
-            (void) lwpr_aux_update_one_T(&TD[i]);       
+            (void) func(&TD[i]);       
          }
       }
    #endif
@@ -1056,6 +1391,7 @@ int lwpr_aux_update_one(LWPR_Model *model, int dim, const double *xn, double yn,
    for (i=1;i<NUM_THREADS;i++) {
       TD[0].sum_w += TD[i].sum_w;
       TD[0].yp += TD[i].yp;
+      TD[0].grown |= TD[i].grown;
       if (TD[i].w_max > TD[0].w_max) {
          if (TD[i].w_sec > TD[0].w_max) {
             /* if TD[i].w_sec > "old" w_max, then we have  
@@ -1082,6 +1418,165 @@ int lwpr_aux_update_one(LWPR_Model *model, int dim, const double *xn, double yn,
       }
    }
 #endif
+}
+
+#if NUM_THREADS > 1
+/* Estimated cost (see lwpr_aux_update_cost) below which the active RFs are updated
+** by the calling thread alone, roughly that of creating and joining the threads */
+#define LWPR_AUX_PARALLEL_COST   1e5
+
+/* Estimated cost of updating an RF with nReg projections, in multiply-adds. The updates
+** of means and regression are linear in nIn, those of full distance metrics cubic */
+static double lwpr_aux_update_cost(const LWPR_Model *model, int nReg) {
+   double nIn = model->nIn;
+   double cost = nIn*(2*nReg + 2);
+   
+   if (model->update_D) {
+      if (model->diag_only) {
+         cost += nIn*(nReg + 4);
+      } else {
+         cost += nIn*nReg + nIn*(nIn+1)*(nIn+2)/(model->meta ? 3.0 : 6.0);
+      }
+   }
+   return cost;
+}
+
+/* Second phase of a two-phase update: updates the active RFs given by TD->active */
+static void *lwpr_aux_update_active_T(void *ptr) {
+   LWPR_ThreadData *TD = (LWPR_ThreadData *) ptr;
+   LWPR_SubModel *sub = &(TD->model->sub[TD->dim]);
+   int k;
+   
+   TD->yp = TD->sum_w = 0.0;
+   for (k=0;k<TD->numActive;k++) {
+      int n = TD->active[k];
+      LWPR_ReceptiveField *RF = sub->rf[n];
+      
+      lwpr_aux_update_rf(TD, RF, RF->w, TD->dw[2*n], TD->dw[2*n+1], &TD->yp, &TD->sum_w);
+   }
+   return NULL;
+}
+
+/* Distributes the RFs that were found active in the first phase (RF->w > 0) among the 
+** threads, and updates them. The RFs are sorted by their number of projections, and
+** assigned to the least loaded thread in order of decreasing cost. The predictions of
+** the RFs are added to TD[0]. buf must hold 3*numRFS + nIn + 1 integers (LWPR_SubModel.order) */
+static void lwpr_aux_update_active(LWPR_Model *model, int dim, LWPR_ThreadData *TD, double *dw, int *buf) {
+   const LWPR_SubModel *sub = &model->sub[dim];
+   LWPR_ThreadData TA[NUM_THREADS];
+   int numRFS = sub->numRFS;
+   int *sorted = buf, *owner = buf + numRFS, *grouped = buf + 2*numRFS;
+   int *count = buf + 3*numRFS;
+   double load[NUM_THREADS], total = 0.0;
+   int numActive = 0, used = 0;
+   int i,k,n,r;
+   
+   /* Counting sort by decreasing nReg (which is at most nIn for trained models) */
+   for (r=0;r<=model->nIn;r++) count[r] = 0;
+   for (n=0;n<numRFS;n++) {
+      if (sub->rf[n]->w > 0.0) {
+         r = sub->rf[n]->nReg;
+         count[(r > model->nIn) ? model->nIn : r]++;
+         numActive++;
+      }
+   }
+   if (numActive == 0) return;
+   for (r=model->nIn, k=0;r>=0;r--) {
+      int c = count[r];
+      count[r] = k;
+      k += c;
+   }
+   for (n=0;n<numRFS;n++) {
+      if (sub->rf[n]->w > 0.0) {
+         r = sub->rf[n]->nReg;
+         sorted[count[(r > model->nIn) ? model->nIn : r]++] = n;
+      }
+   }
+   
+   /* Longest processing time first */
+   for (i=0;i<NUM_THREADS;i++) {
+      load[i] = 0.0;
+      TA[i].numActive = 0;
+   }
+   for (k=0;k<numActive;k++) {
+      double cost = lwpr_aux_update_cost(model, sub->rf[sorted[k]]->nReg);
+      int t = 0;
+      for (i=1;i<NUM_THREADS;i++) {
+         if (load[i] < load[t]) t = i;
+      }
+      load[t] += cost;
+      total += cost;
+      owner[k] = t;
+      if (TA[t].numActive++ == 0) used++;
+   }
+   for (i=0, n=0;i<NUM_THREADS;i++) {
+      TA[i].model = model;
+      TA[i].dim = dim;
+      TA[i].xn = TD[0].xn;
+      TA[i].yn = TD[0].yn;
+      TA[i].ws = &model->ws[i];
+      TA[i].dw = dw;
+      TA[i].grown = 0;
+      TA[i].active = grouped + n;
+      n += TA[i].numActive;
+      TA[i].numActive = 0;
+   }
+   for (k=0;k<numActive;k++) {
+      LWPR_ThreadData *T = &TA[owner[k]];
+      grouped[(T->active - grouped) + T->numActive++] = sorted[k];
+   }
+   
+   /* Small updates are not worth spawning threads for */
+   if (used == 1 || total < LWPR_AUX_PARALLEL_COST) {
+      TA[0].active = sorted;
+      TA[0].numActive = numActive;
+      (void) lwpr_aux_update_active_T(&TA[0]);
+      TD[0].yp += TA[0].yp;
+      TD[0].sum_w += TA[0].sum_w;
+      TD[0].grown |= TA[0].grown;
+      return;
+   }
+   
+   for (i=0;i<NUM_THREADS;i++) {
+      TA[i].w_max = TA[i].w_sec = 0.0;
+      TA[i].ind_max = TA[i].ind_sec = -1;
+   }
+   lwpr_aux_update_threads(TA, lwpr_aux_update_active_T);
+   TD[0].yp += TA[0].yp;
+   TD[0].sum_w += TA[0].sum_w;
+   TD[0].grown |= TA[0].grown;
+}
+#endif
+
+int lwpr_aux_update_one(LWPR_Model *model, int dim, const double *xn, double yn, double *y_pred, double *max_w) {
+   LWPR_ThreadData TD[NUM_THREADS];
+   double *dw = NULL;
+   int i,code;
+#if NUM_THREADS > 1
+   /* With several threads, all activations are computed first, and then the updates of 
+   ** the active RFs are balanced among the threads (lwpr_aux_update_active). The buffers
+   ** are only missing if no RF was ever added, and then there is nothing to update. */
+   dw = model->sub[dim].dw;
+#endif
+
+   for (i=0;i<NUM_THREADS;i++) {
+      TD[i].model = model;
+      TD[i].dim = dim;
+      TD[i].xn = xn;
+      TD[i].yn = yn;
+      TD[i].incr = NUM_THREADS;
+      TD[i].start = i;
+      TD[i].end = model->sub[dim].numRFS;
+      TD[i].ws = &model->ws[i];
+      TD[i].dw = dw;
+      TD[i].grown = 0;
+   }
+
+   lwpr_aux_update_threads(TD, lwpr_aux_update_one_T);
+   
+#if NUM_THREADS > 1
+   if (dw != NULL) lwpr_aux_update_active(model, dim, TD, dw, model->sub[dim].order);
+#endif
 
    if (TD[0].sum_w > 0.0) {
       *y_pred = TD[0].yp/TD[0].sum_w;
@@ -1091,10 +1586,465 @@ int lwpr_aux_update_one(LWPR_Model *model, int dim, const double *xn, double yn,
    
    if (max_w != NULL) *max_w = TD[0].w_max;
    
-   return lwpr_aux_update_one_add_prune(model, &TD[0], dim, xn, yn);
+   code = lwpr_aux_update_one_add_prune(model, &TD[0], dim, xn, yn);
+   
+   /* Receptive fields that have grown may have exceeded the budget */
+   if (TD[0].grown && model->max_bytes > 0) (void) lwpr_aux_make_room(model, &model->sub[dim], NULL, 0);
+   return code;
+}
+
+/* Updates the distance metric that the receptive fields with the same index in all submodels
+** share, from the derivatives (see lwpr_aux_metric_derivs) of the numDeriv outputs that could
+** provide them. These are averaged with weights proportional to their transient multipliers,
+** and the average transient multiplier dampens the step. With a single output, this is
+** the same as lwpr_aux_update_distance_metric */
+static void lwpr_aux_update_shared_metric(LWPR_ReceptiveField *RF, double w, double dwdq, double ddwdqdq,
+      const double *deriv, int numDeriv, const double *xn, LWPR_Workspace *WS) {
+   double avg[4] = {0.0, 0.0, 0.0, 0.0};
+   double sumT = 0.0;
+   int i,k;
+   
+   for (k=0;k<numDeriv;k++) sumT += deriv[4*k];
+   for (k=0;k<numDeriv;k++) {
+      double weight = (sumT > 0.0) ? deriv[4*k]/sumT : 1.0/numDeriv;
+      for (i=1;i<4;i++) avg[i] += weight*deriv[4*k+i];
+   }
+   avg[0] = sumT/numDeriv;
+   
+   lwpr_aux_metric_step(RF, w, dwdq, ddwdqdq, avg, xn, WS);
+}
+
+static LWPR_AUX_INLINE void lwpr_aux_update_shared_K(LWPR_ThreadData *TD, int kernel, const LWPR_KernelInfo *custom) {
+   const LWPR_Model *model = TD->model;
+   LWPR_SubModel *sub0 = &model->sub[0];
+   LWPR_Workspace *WS = TD->ws;
+   
+   int i,k,n,nRegStore;
+   int nOut = model->nOut;
+   double *yp = WS->sum_out;
+   double *sum_w = WS->sum_out + nOut;
+   double *deriv = WS->metric_derivs;
+   double e,e_cv; 
+  
+   double ymz;
+   
+   double w, w_sec = 0.0, w_max = 0.0;
+   int ind_sec = -1, ind_max = -1;
+   double yp_n;
+   
+   double dwdq,ddwdqdq;
+   
+   double q[LWPR_AUX_CHUNK], wq[LWPR_AUX_CHUNK];
+   double qmax = lwpr_aux_qmax(kernel, custom, 0.001);
+   double qbound = lwpr_aux_qbound(TD->model, qmax);
+   double q_far[2];
+   int ind_far[2] = {-1, -1};
+   int j = LWPR_AUX_CHUNK;
+   
+   memset(WS->sum_out, 0, 2*nOut*sizeof(double));
+      
+   for (n=TD->start;n<TD->end;n+=TD->incr) {
+      double dist;
+      LWPR_ReceptiveField *RF;
+      int numDeriv = 0;
+      
+      if (j == LWPR_AUX_CHUNK) {
+         lwpr_aux_activations(TD, sub0, kernel, custom, n, TD->incr, TD->end, qmax, qbound, q, wq);
+         j = 0;
+      }
+      dist = q[j];
+      w = wq[j++];
+      
+      if (dist > qmax) {
+         /* As in lwpr_aux_update_one_K, only the two closest skipped RFs are kept */
+         for (k=0;k<nOut;k++) model->sub[k].rf[n]->w = 0.0;
+         if (ind_far[1] < 0 || dist < q_far[1]) {
+            if (ind_far[0] < 0 || dist < q_far[0]) {
+               q_far[1] = q_far[0];
+               ind_far[1] = ind_far[0];
+               q_far[0] = dist;
+               ind_far[0] = n;
+            } else {
+               q_far[1] = dist;
+               ind_far[1] = n;
+            }
+         }
+         continue;
+      }
+      lwpr_aux_kernel_derivs(kernel, custom, dist, w, &dwdq, &ddwdqdq);
+      
+      if (w>w_sec) {
+         if (w>w_max) {
+            ind_sec = ind_max;
+            w_sec = w_max;            
+            ind_max = n;
+            w_max = w;
+         } else {
+            ind_sec = n;
+            w_sec = w;
+         }
+      }
+      
+      if (w>0.001) {
+         for (k=0;k<nOut;k++) {
+            RF = model->sub[k].rf[n];
+            RF->w = w;
+            RF->last_active = model->n_data;
+
+            ymz = lwpr_aux_update_means(RF,TD->xn,TD->yv[k],w,WS->xmz);
+            lwpr_aux_update_regression(RF, &yp_n, &e_cv, &e, WS->xmz, ymz,w, WS);
+            
+            if (RF->trustworthy) {
+               yp[k] += w*yp_n;
+               sum_w[k] += w;
+            }
+            
+            /* The shared distance metric is updated once for all outputs, see below */
+            if (model->update_D && lwpr_aux_metric_derivs(RF, w, e_cv, e, WS, deriv + 4*numDeriv)) {
+               numDeriv++;
+            }
+            
+            nRegStore = RF->nRegStore;
+            lwpr_aux_check_add_projection(RF);
+            if (RF->nRegStore != nRegStore) TD->grown = 1;
+            
+            for (i=0;i<RF->nReg;i++) {
+               RF->n_data[i] = RF->n_data[i] * RF->lambda[i] + 1;
+               RF->lambda[i] = model->tau_lambda * RF->lambda[i] + model->final_lambda*(1.0-model->tau_lambda);
+            }
+            
+            if (model->eager_slopes) lwpr_aux_compute_slope(RF);
+         }
+         if (numDeriv > 0) {
+            lwpr_aux_update_shared_metric(sub0->rf[n], w, dwdq, ddwdqdq, deriv, numDeriv, TD->xn, WS);
+         }
+      } else {
+         for (k=0;k<nOut;k++) model->sub[k].rf[n]->w = 0.0;
+      }
+   }
+
+   /* Skipped RFs have smaller activations than all others */
+   for (j=0;j<2 && ind_far[j]>=0;j++) {
+      w = lwpr_aux_kernel(kernel, custom, q_far[j], NULL, NULL);
+      if (w>w_sec) {
+         if (w>w_max) {
+            ind_sec = ind_max;
+            w_sec = w_max;            
+            ind_max = ind_far[j];
+            w_max = w;
+         } else {
+            ind_sec = ind_far[j];
+            w_sec = w;
+         }
+      }
+   }
+
+   TD->w_max = w_max;
+   TD->ind_max = ind_max;
+   TD->w_sec = w_sec;
+   TD->ind_sec = ind_sec;
+   TD->yp = 0.0;
+   TD->sum_w = 0.0;
+}
+
+void *lwpr_aux_update_shared_T(void *ptr) {
+   LWPR_ThreadData *TD = (LWPR_ThreadData *) ptr;
+   LWPR_AUX_KERNEL_DISPATCH(lwpr_aux_update_shared_K, TD);
+   return NULL;
+}
+
+/* Quantised centre of a receptive field, for sorting in Morton order */
+typedef struct {
+   int index;
+   int nIn;
+   const unsigned int *code;
+} LWPR_MortonEntry;
+
+/* Returns whether the most significant bit of x is lower than that of y */
+static int lwpr_aux_less_msb(unsigned int x, unsigned int y) {
+   return x < y && x < (x ^ y);
+}
+
+static int lwpr_aux_morton_compare(const void *a, const void *b) {
+   const LWPR_MortonEntry *ea = (const LWPR_MortonEntry *) a;
+   const LWPR_MortonEntry *eb = (const LWPR_MortonEntry *) b;
+   int i, msd = 0;
+   
+   /* The dimension with the highest differing bit decides */
+   for (i=1;i<ea->nIn;i++) {
+      if (lwpr_aux_less_msb(ea->code[msd] ^ eb->code[msd], ea->code[i] ^ eb->code[i])) msd = i;
+   }
+   if (ea->code[msd] != eb->code[msd]) return (ea->code[msd] < eb->code[msd]) ? -1 : 1;
+   return ea->index - eb->index;
+}
+
+int lwpr_aux_morton_order(const LWPR_SubModel *sub, int *order) {
+   int nIn = sub->model->nIn;
+   int N = sub->numRFS;
+   int i,n;
+   unsigned int *code;
+   LWPR_MortonEntry *entry;
+   
+   if (N == 0) return 1;
+   
+   code = (unsigned int *) LWPR_MALLOC(N*nIn*sizeof(unsigned int));
+   entry = (LWPR_MortonEntry *) LWPR_MALLOC(N*sizeof(LWPR_MortonEntry));
+   if (code == NULL || entry == NULL) {
+      if (code != NULL) LWPR_FREE(code);
+      if (entry != NULL) LWPR_FREE(entry);
+      return 0;
+   }
+   
+   for (i=0;i<nIn;i++) {
+      double lo = sub->rf[0]->c[i], hi = lo, scale;
+      
+      for (n=1;n<N;n++) {
+         double c = sub->rf[n]->c[i];
+         if (c < lo) lo = c;
+         if (c > hi) hi = c;
+      }
+      scale = (hi > lo) ? 65535.0/(hi - lo) : 0.0;
+      for (n=0;n<N;n++) {
+         code[i + n*nIn] = (unsigned int) ((sub->rf[n]->c[i] - lo)*scale);
+      }
+   }
+   for (n=0;n<N;n++) {
+      entry[n].index = n;
+      entry[n].nIn = nIn;
+      entry[n].code = code + n*nIn;
+   }
+   qsort(entry, N, sizeof(LWPR_MortonEntry), lwpr_aux_morton_compare);
+   for (n=0;n<N;n++) order[n] = entry[n].index;
+   
+   LWPR_FREE(code);
+   LWPR_FREE(entry);
+   return 1;
+}
+
+int lwpr_aux_shared_geometry(const LWPR_Model *model) {
+   int k;
+   
+   if (!model->shared_geometry) return 0;
+   for (k=1;k<model->nOut;k++) {
+      if (model->sub[k].numRFS != model->sub[0].numRFS) return 0;
+   }
+   return 1;
+}
+
+/* The centre and distance metric (with its learning rates and meta-learning state) are
+** stored before mean_x in a receptive field's own storage (see lwpr_mem_alloc_rf) */
+static double *lwpr_aux_own_geometry(const LWPR_ReceptiveField *RF) {
+   int nTriS = LWPR_TRI_SIZE(RF->model->nIn);
+   
+   if (nTriS&1) nTriS++;
+   return RF->mean_x - RF->model->nInStore - 5*nTriS;
+}
+
+/* Makes RF use the centre and distance metric of owner */
+static void lwpr_aux_link_rf(LWPR_ReceptiveField *RF, const LWPR_ReceptiveField *owner) {
+   RF->alpha = owner->alpha;
+   RF->D     = owner->D;
+   RF->M     = owner->M;
+   RF->h     = owner->h;
+   RF->b     = owner->b;
+   RF->c     = owner->c;
+}
+
+void lwpr_aux_link_geometry(LWPR_Model *model) {
+   int k,n;
+   
+   if (model->inference_only) return;
+   for (k=1;k<model->nOut;k++) {
+      for (n=0;n<model->sub[k].numRFS;n++) {
+         lwpr_aux_link_rf(model->sub[k].rf[n], model->sub[0].rf[n]);
+      }
+   }
+}
+
+void lwpr_aux_unlink_geometry(LWPR_Model *model) {
+   int k,n;
+   int nInS = model->nInStore;
+   int nTriS = LWPR_TRI_SIZE(model->nIn);
+   
+   if (nTriS&1) nTriS++;
+   if (model->inference_only) return;
+   
+   for (k=1;k<model->nOut;k++) {
+      for (n=0;n<model->sub[k].numRFS;n++) {
+         LWPR_ReceptiveField *RF = model->sub[k].rf[n];
+         double *own = lwpr_aux_own_geometry(RF);
+         
+         if (RF->alpha == own) continue;
+         
+         /* The shared arrays have the same layout in the owner's storage */
+         memcpy(own, RF->alpha, (5*nTriS + nInS)*sizeof(double));
+         RF->alpha = own;
+         RF->D     = own + nTriS;
+         RF->M     = own + 2*nTriS;
+         RF->h     = own + 3*nTriS;
+         RF->b     = own + 4*nTriS;
+         RF->c     = own + 5*nTriS;
+      }
+   }
+}
+
+/* Removes the receptive field with index ind from all submodels, keeping the
+** index of another receptive field (if keep != NULL) up to date */
+static void lwpr_aux_remove_rf_shared(LWPR_Model *model, int ind, int *keep) {
+   int k;
+   
+   for (k=0;k<model->nOut;k++) lwpr_aux_remove_rf(&model->sub[k], ind);
+   /* lwpr_aux_remove_rf moves the last RF into the gap */
+   if (keep != NULL && *keep == model->sub[0].numRFS) *keep = ind;
+}
+
+/* Like lwpr_aux_make_room, but for all submodels at once. The victims are chosen
+** in the first submodel, and keep is the index of a receptive field not to remove, or -1.
+** If adding is 0, the submodels are only brought back within their budget */
+static int lwpr_aux_make_room_shared(LWPR_Model *model, int *keep, int adding) {
+   int k;
+   
+   for (;;) {
+      int full = 0, victim;
+      
+      for (k=0;k<model->nOut && !full;k++) {
+         const LWPR_SubModel *sub = &model->sub[k];
+         
+         if (model->max_rfs > 0 && sub->numRFS + adding > model->max_rfs) full = 1;
+         if (model->max_bytes > 0) {
+            int nRegStore = (*keep >= 0) ? sub->rf[*keep]->nRegStore : LWPR_REGSTORE;
+            size_t needed = adding ? lwpr_mem_rf_bytes(model, nRegStore) : 0;
+            if (lwpr_mem_sub_bytes(sub) + needed > model->max_bytes) full = 1;
+         }
+      }
+      if (!full) return 1;
+      
+      victim = lwpr_aux_select_victim(model, &model->sub[0], (*keep >= 0) ? model->sub[0].rf[*keep] : NULL);
+      if (victim < 0) return 0;
+      
+      lwpr_aux_remove_rf_shared(model, victim, keep);
+      for (k=0;k<model->nOut;k++) model->sub[k].n_evicted++;
+   }
+}
+
+/* Like lwpr_aux_update_one_add_prune, but for all submodels at once */
+static int lwpr_aux_update_shared_add_prune(LWPR_Model *model, LWPR_ThreadData *TD, const double *xn, const double *yv) {
+   LWPR_SubModel *sub0 = &model->sub[0];
+   int k;
+   
+   if (TD->w_max <= model->w_gen) {
+      int tmpl = -1;
+      
+      /* The first output decides whether the closest RF serves as a template,
+      ** so all new RFs start from the same distance metric */
+      if ((TD->w_max > 0.1*model->w_gen) && (sub0->rf[TD->ind_max]->trustworthy)) {
+         tmpl = TD->ind_max;
+      }
+      
+      if (!lwpr_aux_make_room_shared(model, &tmpl, 1)) return 1;
+      
+      for (k=0;k<model->nOut;k++) {
+         LWPR_SubModel *sub = &model->sub[k];
+         LWPR_ReceptiveField *RF = lwpr_aux_add_rf(sub,0);
+         
+         if (RF == NULL || !lwpr_aux_init_rf(RF, model, (tmpl >= 0) ? sub->rf[tmpl] : NULL, xn, yv[k])) {
+            /* Keep the submodels aligned by removing the new RFs again */
+            if (RF != NULL) k++;
+            while (--k >= 0) lwpr_aux_remove_rf(&model->sub[k], model->sub[k].numRFS-1);
+            return 0;
+         }
+      }
+      for (k=1;k<model->nOut;k++) {
+         LWPR_SubModel *sub = &model->sub[k];
+         lwpr_aux_link_rf(sub->rf[sub->numRFS-1], sub0->rf[sub0->numRFS-1]);
+      }
+      return 1;
+   }
+   
+   /* Prune ReceptiveFields, with the same criterion as lwpr_aux_update_one_add_prune */
+   if (TD->w_sec > model->w_prune) {
+      double tr_max = 0.0, tr_sec = 0.0;
+      int i;
+      
+      for (i=0;i<model->nIn;i++) {
+         tr_max += sub0->rf[TD->ind_max]->D[LWPR_TRI(i,i)];
+         tr_sec += sub0->rf[TD->ind_sec]->D[LWPR_TRI(i,i)];
+      }
+      lwpr_aux_remove_rf_shared(model, (tr_max < tr_sec) ? TD->ind_max : TD->ind_sec, NULL);
+      for (k=0;k<model->nOut;k++) model->sub[k].n_pruned++;
+   }
+   
+   return 1;   
+}
+
+int lwpr_aux_update_shared(LWPR_Model *model, const double *xn, const double *yn, double *y_pred, double *max_w) {
+   LWPR_ThreadData TD[NUM_THREADS];
+   int i,k,code;
+   int nOut = model->nOut;
+
+   for (i=0;i<NUM_THREADS;i++) {
+      TD[i].model = model;
+      TD[i].dim = 0;
+      TD[i].xn = xn;
+      TD[i].yv = yn;
+      TD[i].incr = NUM_THREADS;
+      TD[i].start = i;
+      TD[i].end = model->sub[0].numRFS;
+      TD[i].ws = &model->ws[i];
+      TD[i].grown = 0;
+   }
+
+   lwpr_aux_update_threads(TD, lwpr_aux_update_shared_T);
+
+   for (k=0;k<nOut;k++) {
+      double yp = 0.0, sum_w = 0.0;
+      
+      for (i=0;i<NUM_THREADS;i++) {
+         yp += model->ws[i].sum_out[k];
+         sum_w += model->ws[i].sum_out[nOut+k];
+      }
+      if (y_pred != NULL) y_pred[k] = (sum_w > 0.0) ? yp/sum_w : 0.0;
+      if (max_w != NULL) max_w[k] = TD[0].w_max;
+   }
+   
+   code = lwpr_aux_update_shared_add_prune(model, &TD[0], xn, yn);
+   
+   /* Receptive fields that have grown may have exceeded the budget */
+   if (TD[0].grown && model->max_bytes > 0) {
+      int keep = -1;
+      (void) lwpr_aux_make_room_shared(model, &keep, 0);
+   }
+   return code;
 }
 
 
+double lwpr_aux_predict_rf(const LWPR_ReceptiveField *RF, const double *xn, LWPR_Workspace *WS) {
+   int i;
+   int nIn=RF->model->nIn;
+   int nInS=RF->model->nInStore;
+   double *xc = WS->xc;
+   double *s = WS->s;
+   double yp_n = RF->beta0;
+
+   for (i=0;i<nIn;i++) {
+      xc[i] = xn[i] - RF->mean_x[i];
+   }      
+   
+   if (RF->slopeReady) {   
+      yp_n += lwpr_math_dot_product(xc, RF->slope, nIn);
+   } else {
+      int nR = RF->nReg;
+      
+      if (RF->n_data[nR-1] <= 2*nIn) nR--;
+                  
+      lwpr_aux_compute_projection(nIn, nInS, nR, s, xc, RF->U, RF->P, WS);
+      
+      for (i=0;i<nR;i++) {
+         yp_n+=s[i]*RF->beta[i];
+      }
+   }
+   return yp_n;
+}
 
 /* A note to developers:  lwpr_aux_predict_one_T and lwpr_aux_predict_conf_one_T
 ** are very similar, and one might wonder why we need two functions.
@@ -1111,18 +2061,16 @@ int lwpr_aux_update_one(LWPR_Model *model, int dim, const double *xn, double yn,
 ** On the other hand, updates are rather slow, and we wish to speed up
 ** also models with univariate outputs.
 */
-void *lwpr_aux_predict_one_T(void *ptr) {
-   LWPR_ThreadData *TD = (LWPR_ThreadData *) ptr;
+static LWPR_AUX_INLINE void lwpr_aux_predict_one_K(LWPR_ThreadData *TD, int kernel, const LWPR_KernelInfo *custom) {
    LWPR_SubModel *sub = &(TD->model->sub[TD->dim]);
-   LWPR_Workspace *WS = TD->ws;
-   int i,j,n;
-   int nIn=TD->model->nIn;
-   int nInS=TD->model->nInStore;
-   
-   double *xc = WS->xc;
-   double *s = WS->s;
+   int n;
    
    double w;
+   double q[LWPR_AUX_CHUNK], wq[LWPR_AUX_CHUNK];
+   double qmax = lwpr_aux_qmax(kernel, custom, TD->cutoff);
+   double qbound = lwpr_aux_qbound(TD->model, qmax);
+   double qskip = HUGE_VAL;
+   int j = LWPR_AUX_CHUNK;
    
    double yp = 0.0;
    
@@ -1131,25 +2079,19 @@ void *lwpr_aux_predict_one_T(void *ptr) {
    TD->w_max = 0.0;
 
    for (n=0;n<sub->numRFS;n++) {
-      double dist = 0.0;
+      double dist;
       LWPR_ReceptiveField *RF = sub->rf[n];
 
-      for (i=0;i<nIn;i++) {
-         xc[i] = TD->xn[i] - RF->c[i];
-      }
-
-      for (j=0;j<nIn;j++) {
-         dist += xc[j] * lwpr_math_dot_product(RF->D + j*nInS, xc, nIn);
+      if (j == LWPR_AUX_CHUNK) {
+         lwpr_aux_activations(TD, sub, kernel, custom, n, 1, sub->numRFS, qmax, qbound, q, wq);
+         j = 0;
       }
-
-      switch(TD->model->kernel) {
-         case LWPR_GAUSSIAN_KERNEL:
-            w = exp(-0.5*dist);
-            break;
-         case LWPR_BISQUARE_KERNEL:
-            w = 1-0.25*dist;
-            w = (w<0) ? 0 : w*w;
-            break;
+      dist = q[j];
+      w = wq[j++];
+      if (dist > qmax) {
+         /* w is below the cutoff, and only the largest of these matters for w_max */
+         if (dist < qskip) qskip = dist;
+         continue;
       }
 
       if (w > TD->w_max) {
@@ -1157,42 +2099,111 @@ void *lwpr_aux_predict_one_T(void *ptr) {
       }
 
       if (w > TD->cutoff && RF->trustworthy) {
-         double yp_n = RF->beta0;
+         yp += w*lwpr_aux_predict_rf(RF, TD->xn, TD->ws);
+         sum_w += w;
+      }
+   }
+   if (qskip < HUGE_VAL) {
+      w = lwpr_aux_kernel(kernel, custom, qskip, NULL, NULL);
+      if (w > TD->w_max) TD->w_max = w;
+   }
+   if (sum_w > 0.0) yp/=sum_w;
+   TD->yn = yp;
+}
 
-         for (i=0;i<nIn;i++) {
-            xc[i] = TD->xn[i] - RF->mean_x[i];
-         }      
-         
-         if (RF->slopeReady) {   
-            yp_n += lwpr_math_dot_product(xc, RF->slope, nIn);
-         } else {
-            int nR = RF->nReg;
-            
-            if (RF->n_data[nR-1] <= 2*nIn) nR--;
-                        
-            lwpr_aux_compute_projection(nIn, nInS, nR, s, xc, RF->U, RF->P, WS);
-            
-            for (i=0;i<nR;i++) {
-               yp_n+=s[i]*RF->beta[i];
+void *lwpr_aux_predict_one_T(void *ptr) {
+   LWPR_ThreadData *TD = (LWPR_ThreadData *) ptr;
+   LWPR_AUX_KERNEL_DISPATCH(lwpr_aux_predict_one_K, TD);
+   return NULL;
+}
+
+
+static LWPR_AUX_INLINE void lwpr_aux_predict_topk_one_K(LWPR_ThreadData *TD, int kernel, const LWPR_KernelInfo *custom) {
+   LWPR_SubModel *sub = &(TD->model->sub[TD->dim]);
+   int i,n;
+   int K = TD->topk;
+   
+   double w;
+   double q[LWPR_AUX_CHUNK], wq[LWPR_AUX_CHUNK];
+   double qmax = lwpr_aux_qmax(kernel, custom, TD->cutoff);
+   double qbound = lwpr_aux_qbound(TD->model, qmax);
+   double qskip = HUGE_VAL;
+   int j = LWPR_AUX_CHUNK;
+   
+   /* Activations and indices of the K strongest RFs so far, in descending order */
+   double top_w[LWPR_MAX_TOPK];
+   int top_n[LWPR_MAX_TOPK];
+   int numTop = 0;
+   
+   double yp = 0.0;
+   double sum_w = 0.0;
+   double dropped_w = 0.0;
+   
+   if (K > LWPR_MAX_TOPK) K = LWPR_MAX_TOPK;
+   TD->w_max = 0.0;
+
+   for (n=0;n<sub->numRFS;n++) {
+      double dist;
+
+      if (j == LWPR_AUX_CHUNK) {
+         lwpr_aux_activations(TD, sub, kernel, custom, n, 1, sub->numRFS, qmax, qbound, q, wq);
+         j = 0;
+      }
+      dist = q[j];
+      w = wq[j++];
+      if (dist > qmax) {
+         if (dist < qskip) qskip = dist;
+         continue;
+      }
+
+      if (w > TD->w_max) {
+         TD->w_max = w;
+      }
+
+      if (w > TD->cutoff && sub->rf[n]->trustworthy) {
+         if (numTop == K) {
+            /* the weakest of the current top K is dropped, or this one */
+            if (K == 0 || w <= top_w[K-1]) {
+               dropped_w += w;
+               continue;
             }
+            dropped_w += top_w[K-1];
+            numTop--;
          }
-
-         yp += w*yp_n;
-         sum_w += w;
+         for (i=numTop; i>0 && top_w[i-1] < w; i--) {
+            top_w[i] = top_w[i-1];
+            top_n[i] = top_n[i-1];
+         }
+         top_w[i] = w;
+         top_n[i] = n;
+         numTop++;
       }
    }
+   if (qskip < HUGE_VAL) {
+      w = lwpr_aux_kernel(kernel, custom, qskip, NULL, NULL);
+      if (w > TD->w_max) TD->w_max = w;
+   }
+   
+   for (i=0;i<numTop;i++) {
+      yp += top_w[i]*lwpr_aux_predict_rf(sub->rf[top_n[i]], TD->xn, TD->ws);
+      sum_w += top_w[i];
+   }
    if (sum_w > 0.0) yp/=sum_w;
    TD->yn = yp;
-   
+   TD->dropped = (dropped_w > 0.0) ? dropped_w / (sum_w + dropped_w) : 0.0;
+}
+
+void *lwpr_aux_predict_topk_one_T(void *ptr) {
+   LWPR_ThreadData *TD = (LWPR_ThreadData *) ptr;
+   LWPR_AUX_KERNEL_DISPATCH(lwpr_aux_predict_topk_one_K, TD);
    return NULL;
 }
 
 
-void *lwpr_aux_predict_conf_one_T(void *ptr) {
-   LWPR_ThreadData *TD = (LWPR_ThreadData *) ptr;
+static LWPR_AUX_INLINE void lwpr_aux_predict_conf_one_K(LWPR_ThreadData *TD, int kernel, const LWPR_KernelInfo *custom) {
    LWPR_SubModel *sub = &(TD->model->sub[TD->dim]);
    LWPR_Workspace *WS = TD->ws;
-   int i,j,n;
+   int i,n;
    int nIn=TD->model->nIn;
    int nInS=TD->model->nInStore;
    
@@ -1200,6 +2211,11 @@ void *lwpr_aux_predict_conf_one_T(void *ptr) {
    double *s = WS->s;
    
    double w;
+   double q[LWPR_AUX_CHUNK], wq[LWPR_AUX_CHUNK];
+   double qmax = lwpr_aux_qmax(kernel, custom, TD->cutoff);
+   double qbound = lwpr_aux_qbound(TD->model, qmax);
+   double qskip = HUGE_VAL;
+   int j = LWPR_AUX_CHUNK;
   
    
    double sum_w = 0.0;
@@ -1211,25 +2227,19 @@ void *lwpr_aux_predict_conf_one_T(void *ptr) {
 
    /* Prediction and confidence bounds in one go */
    for (n=0;n<sub->numRFS;n++) {
-      double dist = 0.0;
+      double dist;
       LWPR_ReceptiveField *RF = sub->rf[n];
 
-      for (i=0;i<nIn;i++) {
-         xc[i] = TD->xn[i] - RF->c[i];
-      }
-
-      for (j=0;j<nIn;j++) {
-         dist += xc[j] * lwpr_math_dot_product(RF->D + j*nInS, xc, nIn);
+      if (j == LWPR_AUX_CHUNK) {
+         lwpr_aux_activations(TD, sub, kernel, custom, n, 1, sub->numRFS, qmax, qbound, q, wq);
+         j = 0;
       }
-
-      switch(TD->model->kernel) {
-         case LWPR_GAUSSIAN_KERNEL:
-            w = exp(-0.5*dist);
-            break;
-         case LWPR_BISQUARE_KERNEL:
-            w = 1-0.25*dist;
-            w = (w<0) ? 0 : w*w;
-            break;
+      dist = q[j];
+      w = wq[j++];
+      if (dist > qmax) {
+         /* w is below the cutoff, and only the largest of these matters for w_max */
+         if (dist < qskip) qskip = dist;
+         continue;
       }
 
       if (w > TD->w_max) {
@@ -1260,6 +2270,10 @@ void *lwpr_aux_predict_conf_one_T(void *ptr) {
          sum_w += w;
       }
    }
+   if (qskip < HUGE_VAL) {
+      w = lwpr_aux_kernel(kernel, custom, qskip, NULL, NULL);
+      if (w > TD->w_max) TD->w_max = w;
+   }
    if (sum_w > 0.0) {
       double sum_wy = TD->yn;
       TD->yn /= sum_w;
@@ -1267,9 +2281,110 @@ void *lwpr_aux_predict_conf_one_T(void *ptr) {
    } else {
       TD->w_sec = 1e20; /* DBL_INFTY; */
    }
+}
+
+void *lwpr_aux_predict_conf_one_T(void *ptr) {
+   LWPR_ThreadData *TD = (LWPR_ThreadData *) ptr;
+   LWPR_AUX_KERNEL_DISPATCH(lwpr_aux_predict_conf_one_K, TD);
+   return NULL;
+}
+
+static LWPR_AUX_INLINE void lwpr_aux_predict_shared_K(LWPR_ThreadData *TD, int kernel, const LWPR_KernelInfo *custom) {
+   const LWPR_Model *model = TD->model;
+   const LWPR_SubModel *sub0 = &model->sub[0];
+   int k,n;
+   int nOut = model->nOut;
+   double *yp = TD->ws->sum_out;
+   double *sum_w = TD->ws->sum_out + nOut;
+   
+   double w;
+   double q[LWPR_AUX_CHUNK], wq[LWPR_AUX_CHUNK];
+   double qmax = lwpr_aux_qmax(kernel, custom, TD->cutoff);
+   double qbound = lwpr_aux_qbound(TD->model, qmax);
+   double qskip = HUGE_VAL;
+   int j = LWPR_AUX_CHUNK;
+   
+   memset(TD->ws->sum_out, 0, 2*nOut*sizeof(double));
+   TD->w_max = 0.0;
+
+   for (n=TD->start;n<TD->end;n+=TD->incr) {
+      double dist;
+
+      if (j == LWPR_AUX_CHUNK) {
+         lwpr_aux_activations(TD, sub0, kernel, custom, n, TD->incr, TD->end, qmax, qbound, q, wq);
+         j = 0;
+      }
+      dist = q[j];
+      w = wq[j++];
+      if (dist > qmax) {
+         if (dist < qskip) qskip = dist;
+         continue;
+      }
+
+      if (w > TD->w_max) {
+         TD->w_max = w;
+      }
+
+      if (w > TD->cutoff) {
+         for (k=0;k<nOut;k++) {
+            const LWPR_ReceptiveField *RF = model->sub[k].rf[n];
+            
+            if (RF->trustworthy) {
+               yp[k] += w*lwpr_aux_predict_rf(RF, TD->xn, TD->ws);
+               sum_w[k] += w;
+            }
+         }
+      }
+   }
+   if (qskip < HUGE_VAL) {
+      w = lwpr_aux_kernel(kernel, custom, qskip, NULL, NULL);
+      if (w > TD->w_max) TD->w_max = w;
+   }
+   TD->w_sec = 0.0;
+   TD->ind_max = TD->ind_sec = -1;
+   TD->yp = TD->sum_w = 0.0;
+}
+
+void *lwpr_aux_predict_shared_T(void *ptr) {
+   LWPR_ThreadData *TD = (LWPR_ThreadData *) ptr;
+   LWPR_AUX_KERNEL_DISPATCH(lwpr_aux_predict_shared_K, TD);
    return NULL;
 }
 
+void lwpr_aux_predict_shared(const LWPR_Model *model, LWPR_Workspace *ws, const double *xn, double cutoff, double *yn, double *max_w) {
+   LWPR_ThreadData TD[NUM_THREADS];
+   int nT = (ws == NULL) ? NUM_THREADS : 1;
+   int nOut = model->nOut;
+   int i,k;
+   
+   for (i=0;i<nT;i++) {
+      TD[i].model = model;
+      TD[i].xn = xn;
+      TD[i].cutoff = cutoff;
+      TD[i].incr = nT;
+      TD[i].start = i;
+      TD[i].end = model->sub[0].numRFS;
+      TD[i].ws = (ws == NULL) ? &model->ws[i] : ws;
+   }
+   
+   if (nT == 1) {
+      (void) lwpr_aux_predict_shared_T(&TD[0]);
+   } else {
+      lwpr_aux_update_threads(TD, lwpr_aux_predict_shared_T);
+   }
+   
+   for (k=0;k<nOut;k++) {
+      double yp = 0.0, sum_w = 0.0;
+      
+      for (i=0;i<nT;i++) {
+         yp += TD[i].ws->sum_out[k];
+         sum_w += TD[i].ws->sum_out[nOut+k];
+      }
+      yn[k] = (sum_w > 0.0) ? yp/sum_w : 0.0;
+      if (max_w != NULL) max_w[k] = TD[0].w_max;
+   }
+}
+
 double lwpr_aux_predict_one(const LWPR_Model *model, int dim, 
       const double *xn, double cutoff, double *conf, double *max_w) {
       
@@ -1293,23 +2408,23 @@ double lwpr_aux_predict_one(const LWPR_Model *model, int dim,
 
 
 
-void *lwpr_aux_predict_one_J_T(void *ptr) {
-   LWPR_ThreadData *TD = (LWPR_ThreadData *) ptr;
+static LWPR_AUX_INLINE void lwpr_aux_predict_one_J_K(LWPR_ThreadData *TD, int kernel, const LWPR_KernelInfo *custom) {
    LWPR_SubModel *sub = &(TD->model->sub[TD->dim]);
    LWPR_Workspace *WS = TD->ws;
 
-   int i,j,n;
+   int i,n;
    int nIn=TD->model->nIn;
-   int nInS=TD->model->nInStore;
    
    double *xc = WS->xc;
-   double *s = WS->s;
-   double *dsdx = WS->dsdx;
    double *Dx = WS->Dx;
    double *sum_dwdx = WS->sum_dwdx;
    double *sum_ydwdx_wdydx = WS->sum_ydwdx_wdydx;
      
    double w, dwdq;
+   double q[LWPR_AUX_CHUNK], wq[LWPR_AUX_CHUNK];
+   double qmax = lwpr_aux_qmax(kernel, custom, TD->cutoff);
+   double qbound = lwpr_aux_qbound(TD->model, qmax);
+   int j = LWPR_AUX_CHUNK;
    double yp = 0.0;
    
    double sum_w = 0.0;
@@ -1318,69 +2433,38 @@ void *lwpr_aux_predict_one_J_T(void *ptr) {
    memset(sum_ydwdx_wdydx,0,nIn*sizeof(double));
          
    for (n=0;n<sub->numRFS;n++) {
-      double dist = 0.0;
+      double dist;
       LWPR_ReceptiveField *RF = sub->rf[n];
       
-      for (i=0;i<nIn;i++) {
-         xc[i] = TD->xn[i] - RF->c[i];
-      }
-      
-      for (j=0;j<nIn;j++) {
-         Dx[j] = lwpr_math_dot_product(RF->D + j*nInS, xc, nIn);
-         dist += xc[j] * Dx[j];
-      }
-      switch(TD->model->kernel) {
-         case LWPR_GAUSSIAN_KERNEL:
-            w = exp(-0.5*dist);
-            dwdq = -0.5 * w;
-            break;
-         case LWPR_BISQUARE_KERNEL:
-            dwdq = 1-0.25*dist;
-            if (dwdq<0) {
-               w = dwdq = 0.0;
-            } else {
-               w = dwdq*dwdq;
-               dwdq = -0.5*dwdq;
-            }
-            break;
-         default:
-            w = dwdq = 0;
+      if (j == LWPR_AUX_CHUNK) {
+         lwpr_aux_activations(TD, sub, kernel, custom, n, 1, sub->numRFS, qmax, qbound, q, wq);
+         j = 0;
       }
+      dist = q[j];
+      w = wq[j++];
+      if (dist > qmax) continue;
            
       if (w>TD->cutoff && RF->trustworthy) {
          double yp_n = RF->beta0;
          
+         /* D*(x-c) and the kernel derivatives are only needed for active RFs */
+         for (i=0;i<nIn;i++) {
+            xc[i] = TD->xn[i] - RF->c[i];
+         }
+         (void) lwpr_aux_rf_dist_Dx(RF, xc, Dx, WS->dx);
+         lwpr_aux_kernel_derivs(kernel, custom, dist, w, &dwdq, NULL);
+         
          for (i=0;i<nIn;i++) {
             xc[i] = TD->xn[i] - RF->mean_x[i];
          }  
          
          sum_w += w;
          
-         if (RF->slopeReady) {
-            yp_n += lwpr_math_dot_product(xc, RF->slope, nIn);
-            yp += w*yp_n;
-         } else {
-            int nR = RF->nReg;
-            
-            if (RF->n_data[nR-1] <= 2*nIn) nR--;
-
-
-            lwpr_aux_compute_projection_d(nIn, nInS, nR, s, dsdx, xc, RF->U, RF->P,WS);
-            for (i=0;i<nR;i++) {
-               yp_n+=s[i]*RF->beta[i];
-            }
-            yp += w*yp_n;
-            lwpr_math_scalar_vector(RF->slope, RF->beta[0], dsdx, nIn);
-            for (i=1;i<nR;i++) {
-               lwpr_math_add_scalar_vector(RF->slope, RF->beta[i], dsdx + i*nInS, nIn);
-            }
-            /*  part of original code without cached slopes:
-            for (i=0;i<RF->nReg;i++) {
-               lwpr_math_add_scalar_vector(sum_ydwdx_wdydx, w * RF->beta[i], dsdx + i*nInS, nIn);
-            }
-            */
-            RF->slopeReady=1;
-         }
+         /* The slope is computed by back-substitution through the PLS projections,
+         ** which is cheaper than differentiating the projections (see lwpr_aux_compute_slope) */
+         if (!RF->slopeReady) lwpr_aux_compute_slope(RF);
+         yp_n += lwpr_math_dot_product(xc, RF->slope, nIn);
+         yp += w*yp_n;
          
          lwpr_math_add_scalar_vector(sum_dwdx, 2.0*dwdq, Dx, nIn);
          lwpr_math_add_scalar_vector(sum_ydwdx_wdydx, yp_n*2.0*dwdq, Dx, nIn);
@@ -1400,6 +2484,11 @@ void *lwpr_aux_predict_one_J_T(void *ptr) {
       /* memset(sum_dwdx,0,nIn*sizeof(double)); */
       TD->yn = 0.0;
    }
+}
+
+void *lwpr_aux_predict_one_J_T(void *ptr) {
+   LWPR_ThreadData *TD = (LWPR_ThreadData *) ptr;
+   LWPR_AUX_KERNEL_DISPATCH(lwpr_aux_predict_one_J_K, TD);
    return NULL;
 }
 
@@ -1423,12 +2512,11 @@ double lwpr_aux_predict_one_J(const LWPR_Model *model, int dim, const double *xn
 
 
 
-void *lwpr_aux_predict_one_JcJ_T(void *ptr) {
-   LWPR_ThreadData *TD = (LWPR_ThreadData *) ptr;
+static LWPR_AUX_INLINE void lwpr_aux_predict_one_JcJ_K(LWPR_ThreadData *TD, int kernel, const LWPR_KernelInfo *custom) {
    LWPR_SubModel *sub = &(TD->model->sub[TD->dim]);
    LWPR_Workspace *WS = TD->ws;
 
-   int i,j,n;
+   int i,n;
    int nIn=TD->model->nIn;
    int nInS=TD->model->nInStore;
    
@@ -1440,6 +2528,10 @@ void *lwpr_aux_predict_one_JcJ_T(void *ptr) {
    double *sum_ydwdx_wdydx = WS->sum_ydwdx_wdydx;
    
    double w, dwdq;
+   double q[LWPR_AUX_CHUNK], wq[LWPR_AUX_CHUNK];
+   double qmax = lwpr_aux_qmax(kernel, custom, TD->cutoff);
+   double qbound = lwpr_aux_qbound(TD->model, qmax);
+   int j = LWPR_AUX_CHUNK;
    double yp = 0.0;
    
    double sum_w = 0.0;
@@ -1453,34 +2545,16 @@ void *lwpr_aux_predict_one_JcJ_T(void *ptr) {
    memset(sum_dRdx,0,nIn*sizeof(double));
          
    for (n=0;n<sub->numRFS;n++) {
-      double dist = 0.0;
+      double dist;
       LWPR_ReceptiveField *RF = sub->rf[n];
       
-      for (i=0;i<nIn;i++) {
-         xc[i] = TD->xn[i] - RF->c[i];
-      }
-      
-      for (j=0;j<nIn;j++) {
-         Dx[j] = lwpr_math_dot_product(RF->D + j*nInS, xc, nIn);
-         dist += xc[j] * Dx[j];
-      }
-      switch(TD->model->kernel) {
-         case LWPR_GAUSSIAN_KERNEL:
-            w = exp(-0.5*dist);
-            dwdq = -0.5 * w;
-            break;
-         case LWPR_BISQUARE_KERNEL:
-            dwdq = 1-0.25*dist;
-            if (dwdq<0) {
-               w = dwdq = 0.0;
-            } else {
-               w = dwdq*dwdq;
-               dwdq = -0.5*dwdq;
-            }
-            break;
-         default:
-            w = dwdq = 0;
+      if (j == LWPR_AUX_CHUNK) {
+         lwpr_aux_activations(TD, sub, kernel, custom, n, 1, sub->numRFS, qmax, qbound, q, wq);
+         j = 0;
       }
+      dist = q[j];
+      w = wq[j++];
+      if (dist > qmax) continue;
            
       if (w>TD->cutoff && RF->trustworthy) {
          int nR = RF->nReg;
@@ -1488,6 +2562,13 @@ void *lwpr_aux_predict_one_JcJ_T(void *ptr) {
          double Gamma,sigma2;
          double sum_sS2 = 0.0;
          
+         /* D*(x-c) and the kernel derivatives are only needed for active RFs */
+         for (i=0;i<nIn;i++) {
+            xc[i] = TD->xn[i] - RF->c[i];
+         }
+         (void) lwpr_aux_rf_dist_Dx(RF, xc, Dx, WS->dx);
+         lwpr_aux_kernel_derivs(kernel, custom, dist, w, &dwdq, NULL);
+         
          for (i=0;i<nIn;i++) {
             xc[i] = TD->xn[i] - RF->mean_x[i];
          }  
@@ -1570,6 +2651,11 @@ void *lwpr_aux_predict_one_JcJ_T(void *ptr) {
       TD->yn = 0.0;
       TD->w_sec = 1e20;
    }
+}
+
+void *lwpr_aux_predict_one_JcJ_T(void *ptr) {
+   LWPR_ThreadData *TD = (LWPR_ThreadData *) ptr;
+   LWPR_AUX_KERNEL_DISPATCH(lwpr_aux_predict_one_JcJ_K, TD);
    return NULL;
 }
 
@@ -1598,25 +2684,27 @@ double lwpr_aux_predict_one_JcJ(const LWPR_Model *model, int dim, const double *
 
 
 
-void *lwpr_aux_predict_one_gH_T(void *ptr) {
-   LWPR_ThreadData *TD = (LWPR_ThreadData *) ptr;
+static LWPR_AUX_INLINE void lwpr_aux_predict_one_gH_K(LWPR_ThreadData *TD, int kernel, const LWPR_KernelInfo *custom) {
    LWPR_SubModel *sub = &(TD->model->sub[TD->dim]);
    LWPR_Workspace *WS = TD->ws;
 
-   int i,j,n;
+   int i,n;
    int nIn=TD->model->nIn;
-   int nInS=TD->model->nInStore;
    
    double *xc = WS->xc;
-   double *s = WS->s;
-   double *dsdx = WS->dsdx;
    double *Dx = WS->Dx;
    double *sum_dwdx = WS->sum_dwdx;
    double *sum_ydwdx_wdydx = WS->sum_ydwdx_wdydx;
    double *sum_ddwdxdx = WS->sum_ddwdxdx;
    double *sum_ddRdxdx = WS->sum_ddRdxdx;
+   const double *D;
+   int nTri = LWPR_TRI_SIZE(nIn);
      
    double w, dwdq, ddwdqdq;
+   double q[LWPR_AUX_CHUNK], wq[LWPR_AUX_CHUNK];
+   double qmax = lwpr_aux_qmax(kernel, custom, TD->cutoff);
+   double qbound = lwpr_aux_qbound(TD->model, qmax);
+   int j = LWPR_AUX_CHUNK;
    double yp = 0.0;
    
    double sum_w = 0.0;
@@ -1624,94 +2712,66 @@ void *lwpr_aux_predict_one_gH_T(void *ptr) {
    memset(sum_dwdx,0,nIn*sizeof(double));
    memset(sum_ydwdx_wdydx,0,nIn*sizeof(double));
    
-   memset(sum_ddRdxdx,0,nInS*nIn*sizeof(double));
-   memset(sum_ddwdxdx,0,nInS*nIn*sizeof(double));
+   /* The Hessian parts are symmetric, so only their upper triangles are accumulated, in packed form */
+   memset(sum_ddRdxdx,0,nTri*sizeof(double));
+   memset(sum_ddwdxdx,0,nTri*sizeof(double));
          
    for (n=0;n<sub->numRFS;n++) {
-      double dist = 0.0;
+      double dist;
       LWPR_ReceptiveField *RF = sub->rf[n];
       
-      for (i=0;i<nIn;i++) {
-         xc[i] = TD->xn[i] - RF->c[i];
-      }
-      
-      for (j=0;j<nIn;j++) {
-         Dx[j] = lwpr_math_dot_product(RF->D + j*nInS, xc, nIn);
-         dist += xc[j] * Dx[j];
-      }
-      switch(TD->model->kernel) {
-         case LWPR_GAUSSIAN_KERNEL:
-            w = exp(-0.5*dist);
-            dwdq = -0.5 * w;
-            ddwdqdq = 0.25 * w;
-            break;
-         case LWPR_BISQUARE_KERNEL:
-            dwdq = 1-0.25*dist;
-            if (dwdq<0) {
-               w = dwdq = ddwdqdq = 0.0;
-            } else {
-               w = dwdq*dwdq;
-               dwdq = -0.5*dwdq;
-               ddwdqdq = 0.125;
-            }
-            break;
-         default:
-            w = dwdq = ddwdqdq = 0;
+      if (j == LWPR_AUX_CHUNK) {
+         lwpr_aux_activations(TD, sub, kernel, custom, n, 1, sub->numRFS, qmax, qbound, q, wq);
+         j = 0;
       }
+      dist = q[j];
+      w = wq[j++];
+      if (dist > qmax) continue;
            
       if (w>TD->cutoff && RF->trustworthy) {
          double yp_n = RF->beta0;
          
+         /* D*(x-c) and the kernel derivatives are only needed for active RFs */
+         for (i=0;i<nIn;i++) {
+            xc[i] = TD->xn[i] - RF->c[i];
+         }
+         (void) lwpr_aux_rf_dist_Dx(RF, xc, Dx, WS->dx);
+         lwpr_aux_kernel_derivs(kernel, custom, dist, w, &dwdq, &ddwdqdq);
+         
          for (i=0;i<nIn;i++) {
             xc[i] = TD->xn[i] - RF->mean_x[i];
          }  
          
          sum_w += w;
          
-         if (RF->slopeReady) {
-            yp_n += lwpr_math_dot_product(xc, RF->slope, nIn);
-            yp += w*yp_n;
-         } else {
-            int nR = RF->nReg;
-            
-            if (RF->n_data[nR-1] <= 2*nIn) nR--;
-
-
-            lwpr_aux_compute_projection_d(nIn, nInS, nR, s, dsdx, xc, RF->U, RF->P,WS);
-            for (i=0;i<nR;i++) {
-               yp_n+=s[i]*RF->beta[i];
-            }
-            yp += w*yp_n;
-            lwpr_math_scalar_vector(RF->slope, RF->beta[0], dsdx, nIn);
-            for (i=1;i<nR;i++) {
-               lwpr_math_add_scalar_vector(RF->slope, RF->beta[i], dsdx + i*nInS, nIn);
-            }
-            /*  part of original code without cached slopes:
-            for (i=0;i<RF->nReg;i++) {
-               lwpr_math_add_scalar_vector(sum_ydwdx_wdydx, w * RF->beta[i], dsdx + i*nInS, nIn);
-            }
-            */
-            RF->slopeReady=1;
-         }
+         /* The slope is computed by back-substitution through the PLS projections,
+         ** which is cheaper than differentiating the projections (see lwpr_aux_compute_slope) */
+         if (!RF->slopeReady) lwpr_aux_compute_slope(RF);
+         yp_n += lwpr_math_dot_product(xc, RF->slope, nIn);
+         yp += w*yp_n;
          
          lwpr_math_add_scalar_vector(sum_dwdx, 2.0*dwdq, Dx, nIn);
          lwpr_math_add_scalar_vector(sum_ydwdx_wdydx, yp_n*2.0*dwdq, Dx, nIn);
          lwpr_math_add_scalar_vector(sum_ydwdx_wdydx, w, RF->slope, nIn);            
          
-         for (i=0;i<nIn;i++) {
-            /* sum up ddwdxdx */
-            lwpr_math_add_scalar_vector(sum_ddwdxdx + i*nInS, 4.0*ddwdqdq*Dx[i], Dx, nIn);
-            lwpr_math_add_scalar_vector(sum_ddwdxdx + i*nInS, 2.0*dwdq, RF->D + i*nInS, nIn);
-
-            /* sum up ddRdxdx */
-            /* ... the yp_n * ddwdxdx part */
-            lwpr_math_add_scalar_vector(sum_ddRdxdx + i*nInS, yp_n*4.0*ddwdqdq*Dx[i], Dx, nIn);
-            lwpr_math_add_scalar_vector(sum_ddRdxdx + i*nInS, yp_n*2.0*dwdq, RF->D + i*nInS, nIn);
-            /* += dwdx*dydx'  ,that is, 2*dwdq*Dx * RF->slope' */
-            lwpr_math_add_scalar_vector(sum_ddRdxdx + i*nInS, 2.0*dwdq*RF->slope[i], Dx, nIn);
-            /* += dydx*dwdx'  ,that is, 2*dwdq*Dx' * RF->slope */            
-            lwpr_math_add_scalar_vector(sum_ddRdxdx + i*nInS, 2.0*dwdq*Dx[i], RF->slope, nIn);
-         }            
+         /* sum up the D-parts of ddwdxdx and ddRdxdx (yp_n * ddwdxdx).
+         ** Stripped models only keep M for full metrics, so D is recovered here */
+         D = RF->D;
+         if (D == NULL) {
+            lwpr_math_trip_gram(nIn, WS->dwdM, RF->M);
+            D = WS->dwdM;
+         }
+         lwpr_math_add_scalar_vector(sum_ddwdxdx, 2.0*dwdq, D, nTri);
+         lwpr_math_add_scalar_vector(sum_ddRdxdx, yp_n*2.0*dwdq, D, nTri);
+         
+         /* sum up ddwdxdx */
+         lwpr_math_symp_rank1(nIn, sum_ddwdxdx, 4.0*ddwdqdq, Dx);
+
+         /* sum up ddRdxdx, that is, yp_n * 4*ddwdqdq*Dx*Dx' + dwdx*dydx' + dydx*dwdx'
+         ** = Dx*t' + t*Dx'  with  t = yp_n*2*ddwdqdq*Dx + 2*dwdq*RF->slope */
+         lwpr_math_scalar_vector(WS->dx, yp_n*2.0*ddwdqdq, Dx, nIn);
+         lwpr_math_add_scalar_vector(WS->dx, 2.0*dwdq, RF->slope, nIn);
+         lwpr_math_symp_rank2(nIn, sum_ddRdxdx, 1.0, Dx, WS->dx);
       }
    }
      
@@ -1719,7 +2779,7 @@ void *lwpr_aux_predict_one_gH_T(void *ptr) {
       yp/=sum_w;
       
       /* Put Hessian into sum_ddwdxdx */     
-      lwpr_math_scale_add_scalar_vector(-yp/sum_w, sum_ddwdxdx, 1.0/sum_w, sum_ddRdxdx, nIn*nInS);
+      lwpr_math_scale_add_scalar_vector(-yp/sum_w, sum_ddwdxdx, 1.0/sum_w, sum_ddRdxdx, nTri);
       /* put 1/sum_w * sum_dwdx into sum_ddRdxdx, we'll need that later */
       lwpr_math_scalar_vector(sum_ddRdxdx, 1.0/sum_w, sum_dwdx, nIn);
 
@@ -1728,10 +2788,7 @@ void *lwpr_aux_predict_one_gH_T(void *ptr) {
       lwpr_math_scale_add_scalar_vector(-yp/sum_w, sum_dwdx, 1.0/sum_w, sum_ydwdx_wdydx, nIn);
       
       /* Add further terms to Hessian */
-      for (i=0;i<nIn;i++) {
-         lwpr_math_add_scalar_vector(sum_ddwdxdx + i*nInS, -sum_dwdx[i], sum_ddRdxdx, nIn);
-         lwpr_math_add_scalar_vector(sum_ddwdxdx + i*nInS, -sum_ddRdxdx[i], sum_dwdx, nIn);
-      }         
+      lwpr_math_symp_rank2(nIn, sum_ddwdxdx, -1.0, sum_dwdx, sum_ddRdxdx);
             
       TD->yn = yp;
    } else {
@@ -1739,6 +2796,11 @@ void *lwpr_aux_predict_one_gH_T(void *ptr) {
       /* memset(sum_dwdx,0,nIn*sizeof(double)); */
       TD->yn = 0.0;
    }
+}
+
+void *lwpr_aux_predict_one_gH_T(void *ptr) {
+   LWPR_ThreadData *TD = (LWPR_ThreadData *) ptr;
+   LWPR_AUX_KERNEL_DISPATCH(lwpr_aux_predict_one_gH_K, TD);
    return NULL;
 }
 
@@ -1755,5 +2817,196 @@ double lwpr_aux_predict_one_gH(const LWPR_Model *model, int dim, const double *x
    (void) lwpr_aux_predict_one_gH_T(&TD);
    
    memcpy(dydx, TD.ws->sum_dwdx, model->nIn * sizeof(double));
+   lwpr_math_tri_unpack(model->nIn, model->nIn, ddydxdx, TD.ws->sum_ddwdxdx, 1);
    return TD.yn;
 }
+
+
+static LWPR_AUX_INLINE void lwpr_aux_predict_one_Jv_K(LWPR_ThreadData *TD, int kernel, const LWPR_KernelInfo *custom) {
+   LWPR_SubModel *sub = &(TD->model->sub[TD->dim]);
+   LWPR_Workspace *WS = TD->ws;
+
+   int i,n;
+   int nIn=TD->model->nIn;
+   
+   double *xc = WS->xc;
+   double *Dx = WS->Dx;
+   const double *v = TD->v;
+     
+   double w, dwdq;
+   double q[LWPR_AUX_CHUNK], wq[LWPR_AUX_CHUNK];
+   double qmax = lwpr_aux_qmax(kernel, custom, TD->cutoff);
+   double qbound = lwpr_aux_qbound(TD->model, qmax);
+   int j = LWPR_AUX_CHUNK;
+   double yp = 0.0;
+   
+   double sum_w = 0.0;
+   double sum_dwdv = 0.0;     /* sum of dw/dx * v */
+   double sum_ydwdv_wdydv = 0.0;
+         
+   for (n=0;n<sub->numRFS;n++) {
+      double dist;
+      LWPR_ReceptiveField *RF = sub->rf[n];
+      
+      if (j == LWPR_AUX_CHUNK) {
+         lwpr_aux_activations(TD, sub, kernel, custom, n, 1, sub->numRFS, qmax, qbound, q, wq);
+         j = 0;
+      }
+      dist = q[j];
+      w = wq[j++];
+      if (dist > qmax) continue;
+           
+      if (w>TD->cutoff && RF->trustworthy) {
+         double yp_n = RF->beta0;
+         double dwdv;
+         
+         for (i=0;i<nIn;i++) {
+            xc[i] = TD->xn[i] - RF->c[i];
+         }
+         (void) lwpr_aux_rf_dist_Dx(RF, xc, Dx, WS->dx);
+         lwpr_aux_kernel_derivs(kernel, custom, dist, w, &dwdq, NULL);
+         dwdv = 2.0*dwdq*lwpr_math_dot_product(Dx, v, nIn);
+         
+         for (i=0;i<nIn;i++) {
+            xc[i] = TD->xn[i] - RF->mean_x[i];
+         }  
+         if (!RF->slopeReady) lwpr_aux_compute_slope(RF);
+         yp_n += lwpr_math_dot_product(xc, RF->slope, nIn);
+         
+         sum_w += w;
+         yp += w*yp_n;
+         sum_dwdv += dwdv;
+         sum_ydwdv_wdydv += yp_n*dwdv + w*lwpr_math_dot_product(RF->slope, v, nIn);
+      }
+   }
+     
+   if (sum_w > 0.0) {
+      yp/=sum_w;
+      TD->dydv = (sum_ydwdv_wdydv - yp*sum_dwdv)/sum_w;
+      TD->yn = yp;
+   } else {
+      TD->dydv = 0.0;
+      TD->yn = 0.0;
+   }
+}
+
+void *lwpr_aux_predict_one_Jv_T(void *ptr) {
+   LWPR_ThreadData *TD = (LWPR_ThreadData *) ptr;
+   LWPR_AUX_KERNEL_DISPATCH(lwpr_aux_predict_one_Jv_K, TD);
+   return NULL;
+}
+
+
+static LWPR_AUX_INLINE void lwpr_aux_predict_one_Hv_K(LWPR_ThreadData *TD, int kernel, const LWPR_KernelInfo *custom) {
+   LWPR_SubModel *sub = &(TD->model->sub[TD->dim]);
+   LWPR_Workspace *WS = TD->ws;
+
+   int i,n;
+   int nIn=TD->model->nIn;
+   
+   double *xc = WS->xc;
+   double *Dx = WS->Dx;
+   double *Dv = WS->xu;
+   const double *v = TD->v;
+   double *sum_dwdx = WS->sum_dwdx;
+   double *sum_ydwdx_wdydx = WS->sum_ydwdx_wdydx;
+   double *sum_ddwdxdx_v = WS->sum_ddwdxdx;
+   double *sum_ddRdxdx_v = WS->sum_ddRdxdx;
+     
+   double w, dwdq, ddwdqdq;
+   double q[LWPR_AUX_CHUNK], wq[LWPR_AUX_CHUNK];
+   double qmax = lwpr_aux_qmax(kernel, custom, TD->cutoff);
+   double qbound = lwpr_aux_qbound(TD->model, qmax);
+   int j = LWPR_AUX_CHUNK;
+   double yp = 0.0;
+   
+   double sum_w = 0.0;
+
+   memset(sum_dwdx,0,nIn*sizeof(double));
+   memset(sum_ydwdx_wdydx,0,nIn*sizeof(double));
+   memset(sum_ddwdxdx_v,0,nIn*sizeof(double));
+   memset(sum_ddRdxdx_v,0,nIn*sizeof(double));
+         
+   for (n=0;n<sub->numRFS;n++) {
+      double dist;
+      LWPR_ReceptiveField *RF = sub->rf[n];
+      
+      if (j == LWPR_AUX_CHUNK) {
+         lwpr_aux_activations(TD, sub, kernel, custom, n, 1, sub->numRFS, qmax, qbound, q, wq);
+         j = 0;
+      }
+      dist = q[j];
+      w = wq[j++];
+      if (dist > qmax) continue;
+           
+      if (w>TD->cutoff && RF->trustworthy) {
+         double yp_n = RF->beta0;
+         double xDv, dwdv, dydv;
+         
+         for (i=0;i<nIn;i++) {
+            xc[i] = TD->xn[i] - RF->c[i];
+         }
+         (void) lwpr_aux_rf_dist_Dx(RF, xc, Dx, WS->dx);
+         (void) lwpr_aux_rf_dist_Dx(RF, v, Dv, WS->dx);
+         lwpr_aux_kernel_derivs(kernel, custom, dist, w, &dwdq, &ddwdqdq);
+         xDv = lwpr_math_dot_product(Dx, v, nIn);
+         dwdv = 2.0*dwdq*xDv;
+         
+         for (i=0;i<nIn;i++) {
+            xc[i] = TD->xn[i] - RF->mean_x[i];
+         }  
+         if (!RF->slopeReady) lwpr_aux_compute_slope(RF);
+         yp_n += lwpr_math_dot_product(xc, RF->slope, nIn);
+         dydv = lwpr_math_dot_product(RF->slope, v, nIn);
+         
+         sum_w += w;
+         yp += w*yp_n;
+         
+         lwpr_math_add_scalar_vector(sum_dwdx, 2.0*dwdq, Dx, nIn);
+         lwpr_math_add_scalar_vector(sum_ydwdx_wdydx, yp_n*2.0*dwdq, Dx, nIn);
+         lwpr_math_add_scalar_vector(sum_ydwdx_wdydx, w, RF->slope, nIn);
+         
+         /* ddwdxdx*v = 2*dwdq*D*v + 4*ddwdqdq*Dx*(Dx'*v) */
+         lwpr_math_add_scalar_vector(sum_ddwdxdx_v, 2.0*dwdq, Dv, nIn);
+         lwpr_math_add_scalar_vector(sum_ddwdxdx_v, 4.0*ddwdqdq*xDv, Dx, nIn);
+         
+         /* ddRdxdx*v = yp_n*ddwdxdx*v + dwdx*(slope'*v) + slope*(dwdx'*v) */
+         lwpr_math_add_scalar_vector(sum_ddRdxdx_v, yp_n*2.0*dwdq, Dv, nIn);
+         lwpr_math_add_scalar_vector(sum_ddRdxdx_v, yp_n*4.0*ddwdqdq*xDv + 2.0*dwdq*dydv, Dx, nIn);
+         lwpr_math_add_scalar_vector(sum_ddRdxdx_v, dwdv, RF->slope, nIn);
+      }
+   }
+     
+   if (sum_w > 0.0) {
+      double gv, wv;
+      
+      yp/=sum_w;
+      
+      /* Hessian times v, without the outer product terms */
+      lwpr_math_scale_add_scalar_vector(-yp/sum_w, sum_ddwdxdx_v, 1.0/sum_w, sum_ddRdxdx_v, nIn);
+      
+      /* Put gradient into sum_dwdx, and 1/sum_w * sum_dwdx into sum_ddRdxdx_v */
+      lwpr_math_scalar_vector(sum_ddRdxdx_v, 1.0/sum_w, sum_dwdx, nIn);
+      lwpr_math_scale_add_scalar_vector(-yp/sum_w, sum_dwdx, 1.0/sum_w, sum_ydwdx_wdydx, nIn);
+      
+      /* subtract (dydx * sum_dwdx' + sum_dwdx * dydx') * v / sum_w */
+      gv = lwpr_math_dot_product(sum_dwdx, v, nIn);
+      wv = lwpr_math_dot_product(sum_ddRdxdx_v, v, nIn);
+      lwpr_math_add_scalar_vector(sum_ddwdxdx_v, -wv, sum_dwdx, nIn);
+      lwpr_math_add_scalar_vector(sum_ddwdxdx_v, -gv, sum_ddRdxdx_v, nIn);
+      
+      TD->dydv = gv;
+      TD->yn = yp;
+   } else {
+      memset(sum_dwdx,0,nIn*sizeof(double));
+      memset(sum_ddwdxdx_v,0,nIn*sizeof(double));
+      TD->dydv = 0.0;
+      TD->yn = 0.0;
+   }
+}
+
+void *lwpr_aux_predict_one_Hv_T(void *ptr) {
+   LWPR_ThreadData *TD = (LWPR_ThreadData *) ptr;
+   LWPR_AUX_KERNEL_DISPATCH(lwpr_aux_predict_one_Hv_K, TD);
+   return NULL;
+}
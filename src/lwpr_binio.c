@@ -26,90 +26,172 @@ Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
 #include <stdlib.h>
 
 
-#define LWPR_BINIO_VERSION    -1
+#define LWPR_BINIO_VERSION       -1
+#define LWPR_BINIO_VERSION_SLIM  -2
+/* As above, followed by the budget (LWPR_Model.max_rfs etc.) and LWPR_SubModel.n_evicted.
+** Only written if a budget was set, so other files stay readable by older versions */
+#define LWPR_BINIO_VERSION_BUDGET       -3
+#define LWPR_BINIO_VERSION_SLIM_BUDGET  -4
 
+/* Written instead of the kernel identifier for registered kernels, followed by their name,
+** since identifiers depend on the order of lwpr_register_kernel calls */
+#define LWPR_BINIO_NAMED_KERNEL  -1
+#define LWPR_BINIO_MAX_KERNEL_NAME  255
 
-int lwpr_io_write_matrix(FILE *fp,int M, int Ms, int N, const double *data) {
+
+int lwpr_io_write_bytes(LWPR_Stream *s, const void *data, size_t n) {
+   if (s->fp != NULL) return (fwrite(data, 1, n, s->fp) == n) ? 1:0;
+   if (s->buf != NULL) {
+      if (n > s->size - s->pos) return 0;
+      memcpy(s->buf + s->pos, data, n);
+   }
+   s->pos += n;
+   return 1;
+}
+
+int lwpr_io_read_bytes(LWPR_Stream *s, void *data, size_t n) {
+   if (s->fp != NULL) return (fread(data, 1, n, s->fp) == n) ? 1:0;
+   if (s->buf == NULL || n > s->size - s->pos) return 0;
+   memcpy(data, s->buf + s->pos, n);
+   s->pos += n;
+   return 1;
+}
+
+int lwpr_io_write_matrix(LWPR_Stream *s,int M, int Ms, int N, const double *data) {
    int n;
    
    for (n=0;n<N;n++) {
-      if (M!=(int) fwrite(data + n*Ms, sizeof(double), (size_t) M, fp)) return 0;
+      if (!lwpr_io_write_bytes(s, data + n*Ms, M*sizeof(double))) return 0;
    }
    return 1;
 }
 
-int lwpr_io_read_matrix(FILE *fp, int M, int Ms, int N, double *data) {
+int lwpr_io_read_matrix(LWPR_Stream *s, int M, int Ms, int N, double *data) {
    int n;
    
    for (n=0;n<N;n++) {
-      if (M!=(int) fread(data + n*Ms, sizeof(double), (size_t) M, fp)) return 0;
+      if (!lwpr_io_read_bytes(s, data + n*Ms, M*sizeof(double))) return 0;
+   }
+   return 1;
+}
+
+int lwpr_io_write_tri(LWPR_Stream *s, int N, const double *data, int symmetric) {
+   int i,j;
+   
+   for (j=0;j<N;j++) {
+      if (!lwpr_io_write_bytes(s, data + LWPR_TRI(0,j), (j+1)*sizeof(double))) return 0;
+      for (i=j+1;i<N;i++) {
+         if (!lwpr_io_write_scalar(s, symmetric ? data[LWPR_TRI(j,i)] : 0.0)) return 0;
+      }
+   }
+   return 1;
+}
+
+int lwpr_io_read_tri(LWPR_Stream *s, int N, double *data) {
+   int i,j;
+   double dummy;
+   
+   for (j=0;j<N;j++) {
+      if (!lwpr_io_read_bytes(s, data + LWPR_TRI(0,j), (j+1)*sizeof(double))) return 0;
+      for (i=j+1;i<N;i++) {
+         if (!lwpr_io_read_scalar(s, &dummy)) return 0;
+      }
    }
    return 1;
 }
 
-int lwpr_io_write_vector(FILE *fp, int N, const double *data) {
-   return (N==(int) fwrite(data, sizeof(double), (size_t) N, fp)) ? 1:0;
+int lwpr_io_write_vector(LWPR_Stream *s, int N, const double *data) {
+   return lwpr_io_write_bytes(s, data, N*sizeof(double));
 }
 
-int lwpr_io_read_vector(FILE *fp, int N, double *data) {
-   return (N==(int) fread(data, sizeof(double), (size_t) N, fp)) ? 1:0;
+int lwpr_io_read_vector(LWPR_Stream *s, int N, double *data) {
+   return lwpr_io_read_bytes(s, data, N*sizeof(double));
 }
 
-int lwpr_io_write_scalar(FILE *fp, double data) {
-   return (int) fwrite(&data, sizeof(double), 1, fp);
+int lwpr_io_write_scalar(LWPR_Stream *s, double data) {
+   return lwpr_io_write_bytes(s, &data, sizeof(double));
 }
 
-int lwpr_io_read_scalar(FILE *fp, double *data) {
-   return (int) fread(data, sizeof(double), 1, fp);
+int lwpr_io_read_scalar(LWPR_Stream *s, double *data) {
+   return lwpr_io_read_bytes(s, data, sizeof(double));
 }
 
-int lwpr_io_write_int(FILE *fp, int data) {
-   return (int) fwrite(&data, sizeof(int), 1, fp);
+int lwpr_io_write_int(LWPR_Stream *s, int data) {
+   return lwpr_io_write_bytes(s, &data, sizeof(int));
 }
 
-int lwpr_io_read_int(FILE *fp, int *data) {
-   return (int) fread(data, sizeof(int), 1, fp);
+int lwpr_io_read_int(LWPR_Stream *s, int *data) {
+   return lwpr_io_read_bytes(s, data, sizeof(int));
+}
+
+int lwpr_io_write_rf(LWPR_Stream *s, const LWPR_ReceptiveField *RF) {
+   int ok;
+   int nIn = RF->model->nIn;
+   int nInS = RF->model->nInStore;
+   int nReg = RF->nReg;
+   
+   ok = lwpr_io_write_bytes(s, "[RF]", 4);
+   ok &= lwpr_io_write_int(s, nReg);
+   ok &= lwpr_io_write_tri(s,nIn,RF->D,1);
+   ok &= lwpr_io_write_tri(s,nIn,RF->M,0);   
+   ok &= lwpr_io_write_tri(s,nIn,RF->alpha,0);   
+   ok &= lwpr_io_write_scalar(s,RF->beta0);
+   ok &= lwpr_io_write_vector(s,nReg,RF->beta);
+   ok &= lwpr_io_write_vector(s,nIn,RF->c);   
+   ok &= lwpr_io_write_matrix(s,nIn,nInS,nReg,RF->SXresYres);
+   ok &= lwpr_io_write_vector(s,nReg,RF->SSs2);   
+   ok &= lwpr_io_write_vector(s,nReg,RF->SSYres);      
+   ok &= lwpr_io_write_matrix(s,nIn,nInS,nReg,RF->SSXres);   
+   ok &= lwpr_io_write_matrix(s,nIn,nInS,nReg,RF->U);      
+   ok &= lwpr_io_write_matrix(s,nIn,nInS,nReg,RF->P);      
+   ok &= lwpr_io_write_vector(s,nReg,RF->H);            
+   ok &= lwpr_io_write_vector(s,nReg,RF->r);  
+   ok &= lwpr_io_write_tri(s,nIn,RF->h,0);                      
+   ok &= lwpr_io_write_tri(s,nIn,RF->b,0);                   
+   ok &= lwpr_io_write_vector(s,nReg,RF->sum_w);  
+   ok &= lwpr_io_write_vector(s,nReg,RF->sum_e_cv2);  
+   ok &= lwpr_io_write_scalar(s,RF->sum_e2);
+   ok &= lwpr_io_write_scalar(s,RF->SSp);
+   ok &= lwpr_io_write_vector(s,nReg,RF->n_data);     
+   ok &= lwpr_io_write_int(s,RF->trustworthy);   
+   ok &= lwpr_io_write_vector(s,nReg,RF->lambda);     
+   ok &= lwpr_io_write_vector(s,nIn,RF->mean_x);   
+   ok &= lwpr_io_write_vector(s,nIn,RF->var_x);         
+   ok &= lwpr_io_write_scalar(s,RF->w);   
+   ok &= lwpr_io_write_vector(s,nReg,RF->s);     
+   return ok;
 }
 
-int lwpr_io_write_rf(FILE *fp, const LWPR_ReceptiveField *RF) {
+int lwpr_io_write_rf_slim(LWPR_Stream *s, const LWPR_ReceptiveField *RF) {
    int ok;
    int nIn = RF->model->nIn;
    int nInS = RF->model->nInStore;
    int nReg = RF->nReg;
    
-   ok = (fwrite("[RF]", 1, 4, fp)==4) ? 1:0;
-   ok &= lwpr_io_write_int(fp, nReg);
-   ok &= lwpr_io_write_matrix(fp,nIn,nInS,nIn,RF->D);
-   ok &= lwpr_io_write_matrix(fp,nIn,nInS,nIn,RF->M);   
-   ok &= lwpr_io_write_matrix(fp,nIn,nInS,nIn,RF->alpha);   
-   ok &= lwpr_io_write_scalar(fp,RF->beta0);
-   ok &= lwpr_io_write_vector(fp,nReg,RF->beta);
-   ok &= lwpr_io_write_vector(fp,nIn,RF->c);   
-   ok &= lwpr_io_write_matrix(fp,nIn,nInS,nReg,RF->SXresYres);
-   ok &= lwpr_io_write_vector(fp,nReg,RF->SSs2);   
-   ok &= lwpr_io_write_vector(fp,nReg,RF->SSYres);      
-   ok &= lwpr_io_write_matrix(fp,nIn,nInS,nReg,RF->SSXres);   
-   ok &= lwpr_io_write_matrix(fp,nIn,nInS,nReg,RF->U);      
-   ok &= lwpr_io_write_matrix(fp,nIn,nInS,nReg,RF->P);      
-   ok &= lwpr_io_write_vector(fp,nReg,RF->H);            
-   ok &= lwpr_io_write_vector(fp,nReg,RF->r);  
-   ok &= lwpr_io_write_matrix(fp,nIn,nInS,nIn,RF->h);                      
-   ok &= lwpr_io_write_matrix(fp,nIn,nInS,nIn,RF->b);                   
-   ok &= lwpr_io_write_vector(fp,nReg,RF->sum_w);  
-   ok &= lwpr_io_write_vector(fp,nReg,RF->sum_e_cv2);  
-   ok &= lwpr_io_write_scalar(fp,RF->sum_e2);
-   ok &= lwpr_io_write_scalar(fp,RF->SSp);
-   ok &= lwpr_io_write_vector(fp,nReg,RF->n_data);     
-   ok &= lwpr_io_write_int(fp,RF->trustworthy);   
-   ok &= lwpr_io_write_vector(fp,nReg,RF->lambda);     
-   ok &= lwpr_io_write_vector(fp,nIn,RF->mean_x);   
-   ok &= lwpr_io_write_vector(fp,nIn,RF->var_x);         
-   ok &= lwpr_io_write_scalar(fp,RF->w);   
-   ok &= lwpr_io_write_vector(fp,nReg,RF->s);     
+   ok = lwpr_io_write_bytes(s, "[RF]", 4);
+   ok &= lwpr_io_write_int(s, nReg);
+   if (RF->model->diag_only) {
+      ok &= lwpr_io_write_tri(s,nIn,RF->D,1);
+   } else {
+      ok &= lwpr_io_write_tri(s,nIn,RF->M,0);
+   }
+   ok &= lwpr_io_write_scalar(s,RF->beta0);
+   ok &= lwpr_io_write_vector(s,nReg,RF->beta);
+   ok &= lwpr_io_write_vector(s,nIn,RF->c);   
+   ok &= lwpr_io_write_vector(s,nReg,RF->SSs2);   
+   ok &= lwpr_io_write_matrix(s,nIn,nInS,nReg,RF->U);      
+   ok &= lwpr_io_write_matrix(s,nIn,nInS,nReg,RF->P);      
+   ok &= lwpr_io_write_vector(s,nReg,RF->sum_w);  
+   ok &= lwpr_io_write_vector(s,nReg,RF->sum_e_cv2);  
+   ok &= lwpr_io_write_scalar(s,RF->SSp);
+   ok &= lwpr_io_write_vector(s,nReg,RF->n_data);     
+   ok &= lwpr_io_write_int(s,RF->trustworthy);   
+   ok &= lwpr_io_write_vector(s,nIn,RF->mean_x);   
+   ok &= lwpr_io_write_vector(s,nIn,RF->slope);   
    return ok;
 }
 
-int lwpr_io_read_rf(FILE *fp, LWPR_SubModel *sub) {
+int lwpr_io_read_rf(LWPR_Stream *s, LWPR_SubModel *sub) {
    char str[5];
    int ok;
    int nIn = sub->model->nIn;
@@ -117,186 +199,268 @@ int lwpr_io_read_rf(FILE *fp, LWPR_SubModel *sub) {
    int nReg;
    LWPR_ReceptiveField *RF;
    
-   ok = (int) fread(str, 1, 4, fp);
-   if (ok!=4) return 0;
+   if (!lwpr_io_read_bytes(s, str, 4)) return 0;
    str[4]=0;
    if (strcmp(str,"[RF]")!=0) return 0;
 
-   ok = lwpr_io_read_int(fp, &nReg);
+   ok = lwpr_io_read_int(s, &nReg);
    if (ok!=1 || nReg<=0 || nReg>nIn) return 0;
    
    RF = lwpr_aux_add_rf(sub,nReg);
    if (RF==NULL) return 0;
    
-   ok &= lwpr_io_read_matrix(fp,nIn,nInS,nIn,RF->D);
-   ok &= lwpr_io_read_matrix(fp,nIn,nInS,nIn,RF->M);   
-   ok &= lwpr_io_read_matrix(fp,nIn,nInS,nIn,RF->alpha);   
-   ok &= lwpr_io_read_scalar(fp,&RF->beta0);
-   ok &= lwpr_io_read_vector(fp,nReg,RF->beta);
-   ok &= lwpr_io_read_vector(fp,nIn,RF->c);   
-   ok &= lwpr_io_read_matrix(fp,nIn,nInS,nReg,RF->SXresYres);
-   ok &= lwpr_io_read_vector(fp,nReg,RF->SSs2);   
-   ok &= lwpr_io_read_vector(fp,nReg,RF->SSYres);      
-   ok &= lwpr_io_read_matrix(fp,nIn,nInS,nReg,RF->SSXres);   
-   ok &= lwpr_io_read_matrix(fp,nIn,nInS,nReg,RF->U);      
-   ok &= lwpr_io_read_matrix(fp,nIn,nInS,nReg,RF->P);      
-   ok &= lwpr_io_read_vector(fp,nReg,RF->H);            
-   ok &= lwpr_io_read_vector(fp,nReg,RF->r);  
-   ok &= lwpr_io_read_matrix(fp,nIn,nInS,nIn,RF->h);                      
-   ok &= lwpr_io_read_matrix(fp,nIn,nInS,nIn,RF->b);                   
-   ok &= lwpr_io_read_vector(fp,nReg,RF->sum_w);  
-   ok &= lwpr_io_read_vector(fp,nReg,RF->sum_e_cv2);  
-   ok &= lwpr_io_read_scalar(fp,&RF->sum_e2);
-   ok &= lwpr_io_read_scalar(fp,&RF->SSp);
-   ok &= lwpr_io_read_vector(fp,nReg,RF->n_data);     
-   ok &= lwpr_io_read_int(fp,&RF->trustworthy);   
-   ok &= lwpr_io_read_vector(fp,nReg,RF->lambda);     
-   ok &= lwpr_io_read_vector(fp,nIn,RF->mean_x);   
-   ok &= lwpr_io_read_vector(fp,nIn,RF->var_x);         
-   ok &= lwpr_io_read_scalar(fp,&RF->w);   
-   ok &= lwpr_io_read_vector(fp,nReg,RF->s);     
+   if (sub->model->inference_only) {
+      ok &= lwpr_io_read_tri(s,nIn,sub->model->diag_only ? RF->D : RF->M);
+      ok &= lwpr_io_read_scalar(s,&RF->beta0);
+      ok &= lwpr_io_read_vector(s,nReg,RF->beta);
+      ok &= lwpr_io_read_vector(s,nIn,RF->c);   
+      ok &= lwpr_io_read_vector(s,nReg,RF->SSs2);   
+      ok &= lwpr_io_read_matrix(s,nIn,nInS,nReg,RF->U);      
+      ok &= lwpr_io_read_matrix(s,nIn,nInS,nReg,RF->P);      
+      ok &= lwpr_io_read_vector(s,nReg,RF->sum_w);  
+      ok &= lwpr_io_read_vector(s,nReg,RF->sum_e_cv2);  
+      ok &= lwpr_io_read_scalar(s,&RF->SSp);
+      ok &= lwpr_io_read_vector(s,nReg,RF->n_data);     
+      ok &= lwpr_io_read_int(s,&RF->trustworthy);   
+      ok &= lwpr_io_read_vector(s,nIn,RF->mean_x);   
+      ok &= lwpr_io_read_vector(s,nIn,RF->slope);   
+      RF->slopeReady = 1;
+      return ok;
+   }
+   
+   ok &= lwpr_io_read_tri(s,nIn,RF->D);
+   ok &= lwpr_io_read_tri(s,nIn,RF->M);   
+   ok &= lwpr_io_read_tri(s,nIn,RF->alpha);   
+   ok &= lwpr_io_read_scalar(s,&RF->beta0);
+   ok &= lwpr_io_read_vector(s,nReg,RF->beta);
+   ok &= lwpr_io_read_vector(s,nIn,RF->c);   
+   ok &= lwpr_io_read_matrix(s,nIn,nInS,nReg,RF->SXresYres);
+   ok &= lwpr_io_read_vector(s,nReg,RF->SSs2);   
+   ok &= lwpr_io_read_vector(s,nReg,RF->SSYres);      
+   ok &= lwpr_io_read_matrix(s,nIn,nInS,nReg,RF->SSXres);   
+   ok &= lwpr_io_read_matrix(s,nIn,nInS,nReg,RF->U);      
+   ok &= lwpr_io_read_matrix(s,nIn,nInS,nReg,RF->P);      
+   ok &= lwpr_io_read_vector(s,nReg,RF->H);            
+   ok &= lwpr_io_read_vector(s,nReg,RF->r);  
+   ok &= lwpr_io_read_tri(s,nIn,RF->h);                      
+   ok &= lwpr_io_read_tri(s,nIn,RF->b);                   
+   ok &= lwpr_io_read_vector(s,nReg,RF->sum_w);  
+   ok &= lwpr_io_read_vector(s,nReg,RF->sum_e_cv2);  
+   ok &= lwpr_io_read_scalar(s,&RF->sum_e2);
+   ok &= lwpr_io_read_scalar(s,&RF->SSp);
+   ok &= lwpr_io_read_vector(s,nReg,RF->n_data);     
+   ok &= lwpr_io_read_int(s,&RF->trustworthy);   
+   ok &= lwpr_io_read_vector(s,nReg,RF->lambda);     
+   ok &= lwpr_io_read_vector(s,nIn,RF->mean_x);   
+   ok &= lwpr_io_read_vector(s,nIn,RF->var_x);         
+   ok &= lwpr_io_read_scalar(s,&RF->w);   
+   ok &= lwpr_io_read_vector(s,nReg,RF->s);     
    return ok;
 }
 
-int lwpr_write_binary_fp(const LWPR_Model *model, FILE *fp) {
+int lwpr_io_write_model(LWPR_Stream *s, const LWPR_Model *model) {
    int ok;
    int nIn = model->nIn;
    int nInS = model->nInStore;
    int nOut = model->nOut;
    int i,dim;
-   int version = LWPR_BINIO_VERSION;
+   int budget = (model->max_rfs > 0 || model->max_bytes > 0 || model->evict != LWPR_EVICT_REFUSE);
+   int version;
+   
+   if (budget) {
+      version = model->inference_only ? LWPR_BINIO_VERSION_SLIM_BUDGET : LWPR_BINIO_VERSION_BUDGET;
+   } else {
+      version = model->inference_only ? LWPR_BINIO_VERSION_SLIM : LWPR_BINIO_VERSION;
+   }
    
-   ok = (int) fwrite("LWPR", sizeof(char), 4, fp);
-   if (ok!=4) return 0;
+   if (!lwpr_io_write_bytes(s, "LWPR", 4)) return 0;
    
-   ok = lwpr_io_write_int(fp,  version);
-   ok &= lwpr_io_write_int(fp,  nIn);
-   ok &= lwpr_io_write_int(fp, nOut);
-   ok &= lwpr_io_write_int(fp, (int) model->kernel);
+   ok = lwpr_io_write_int(s,  version);
+   ok &= lwpr_io_write_int(s,  nIn);
+   ok &= lwpr_io_write_int(s, nOut);
+   if (model->kernel == LWPR_GAUSSIAN_KERNEL || model->kernel == LWPR_BISQUARE_KERNEL) {
+      ok &= lwpr_io_write_int(s, (int) model->kernel);
+   } else {
+      const LWPR_KernelInfo *kern = lwpr_kernel_info(model->kernel);
+      size_t len;
+      
+      if (kern == NULL) return 0;
+      len = strlen(kern->name);
+      if (len > LWPR_BINIO_MAX_KERNEL_NAME) return 0;
+      ok &= lwpr_io_write_int(s, LWPR_BINIO_NAMED_KERNEL);
+      ok &= lwpr_io_write_int(s, (int) len);
+      ok &= lwpr_io_write_bytes(s, kern->name, len);
+   }
    
    if (model->name == NULL) {
-      ok &= lwpr_io_write_int(fp, 0);
+      ok &= lwpr_io_write_int(s, 0);
    } else {
       size_t len = strlen(model->name);
-      ok &= lwpr_io_write_int(fp, (int ) len);
-      ok &= (fwrite(model->name, sizeof(char), len, fp)==len)? 1:0;
+      ok &= lwpr_io_write_int(s, (int ) len);
+      ok &= lwpr_io_write_bytes(s, model->name, len);
    }
-   ok &= lwpr_io_write_int(fp,model->n_data);
-   ok &= lwpr_io_write_vector(fp, nIn, model->mean_x);
-   ok &= lwpr_io_write_vector(fp, nIn, model->var_x);   
-   ok &= lwpr_io_write_int(fp, model->diag_only);
-   ok &= lwpr_io_write_int(fp, model->update_D);   
-   ok &= lwpr_io_write_int(fp, model->meta);
-   ok &= lwpr_io_write_scalar(fp, model->meta_rate);
-   ok &= lwpr_io_write_scalar(fp, model->penalty);   
-   ok &= lwpr_io_write_matrix(fp, nIn, nInS, nIn, model->init_alpha);
-   ok &= lwpr_io_write_vector(fp, nIn, model->norm_in);
-   ok &= lwpr_io_write_vector(fp, nOut, model->norm_out);   
-   ok &= lwpr_io_write_matrix(fp, nIn, nInS, nIn, model->init_D);   
-   ok &= lwpr_io_write_matrix(fp, nIn, nInS, nIn, model->init_M); 
+   ok &= lwpr_io_write_int(s,model->n_data);
+   ok &= lwpr_io_write_vector(s, nIn, model->mean_x);
+   ok &= lwpr_io_write_vector(s, nIn, model->var_x);   
+   ok &= lwpr_io_write_int(s, model->diag_only);
+   ok &= lwpr_io_write_int(s, model->update_D);   
+   ok &= lwpr_io_write_int(s, model->meta);
+   ok &= lwpr_io_write_scalar(s, model->meta_rate);
+   ok &= lwpr_io_write_scalar(s, model->penalty);   
+   ok &= lwpr_io_write_matrix(s, nIn, nInS, nIn, model->init_alpha);
+   ok &= lwpr_io_write_vector(s, nIn, model->norm_in);
+   ok &= lwpr_io_write_vector(s, nOut, model->norm_out);   
+   ok &= lwpr_io_write_matrix(s, nIn, nInS, nIn, model->init_D);   
+   ok &= lwpr_io_write_matrix(s, nIn, nInS, nIn, model->init_M); 
    
-   ok &= lwpr_io_write_scalar(fp, model->w_gen);  
-   ok &= lwpr_io_write_scalar(fp, model->w_prune);   
-   ok &= lwpr_io_write_scalar(fp, model->init_lambda);   
-   ok &= lwpr_io_write_scalar(fp, model->final_lambda);   
-   ok &= lwpr_io_write_scalar(fp, model->tau_lambda);      
-   ok &= lwpr_io_write_scalar(fp, model->init_S2);      
-   ok &= lwpr_io_write_scalar(fp, model->add_threshold);      
+   ok &= lwpr_io_write_scalar(s, model->w_gen);  
+   ok &= lwpr_io_write_scalar(s, model->w_prune);   
+   ok &= lwpr_io_write_scalar(s, model->init_lambda);   
+   ok &= lwpr_io_write_scalar(s, model->final_lambda);   
+   ok &= lwpr_io_write_scalar(s, model->tau_lambda);      
+   ok &= lwpr_io_write_scalar(s, model->init_S2);      
+   ok &= lwpr_io_write_scalar(s, model->add_threshold);      
+   if (budget) {
+      ok &= lwpr_io_write_int(s, model->max_rfs);
+      ok &= lwpr_io_write_scalar(s, (double) model->max_bytes);
+      ok &= lwpr_io_write_int(s, (int) model->evict);
+   }
 
    for (dim=0;dim<model->nOut;dim++) {
       const LWPR_SubModel *sub = &model->sub[dim];   
-      ok &= (fwrite("SUBM", sizeof(char), 4, fp)==4)?1:0;
-      ok &= lwpr_io_write_int(fp, dim);
-      ok &= lwpr_io_write_int(fp, sub->numRFS);      
-      ok &= lwpr_io_write_int(fp, sub->n_pruned);            
+      ok &= lwpr_io_write_bytes(s, "SUBM", 4);
+      ok &= lwpr_io_write_int(s, dim);
+      ok &= lwpr_io_write_int(s, sub->numRFS);      
+      ok &= lwpr_io_write_int(s, sub->n_pruned);            
+      if (budget) ok &= lwpr_io_write_int(s, sub->n_evicted);
       for (i=0;i<sub->numRFS;i++) {
-         ok &= lwpr_io_write_rf(fp, sub->rf[i]);
+         if (model->inference_only) {
+            ok &= lwpr_io_write_rf_slim(s, sub->rf[i]);
+         } else {
+            ok &= lwpr_io_write_rf(s, sub->rf[i]);
+         }
       }
    }
-   ok &= (fwrite("RPWL", sizeof(char), 4, fp) == 4)?1:0;   
+   ok &= lwpr_io_write_bytes(s, "RPWL", 4);   
    return ok;
 }
 
-int lwpr_read_binary_fp(LWPR_Model *model, FILE *fp) {
+int lwpr_io_read_model(LWPR_Stream *s, LWPR_Model *model) {
    char str[5];
    int ok;
    int nIn,nInS,nOut;
    int i,dim;
-   int version;
+   int version, budget;
    
-   ok = (int) fread(str, sizeof(char), 4, fp);
-   if (ok!=4) return 0;
+   if (!lwpr_io_read_bytes(s, str, 4)) return 0;
    
    str[4]=0;
    if (strcmp(str,"LWPR")!=0) return 0;  
    
-   if (!lwpr_io_read_int(fp, &version)) return 0;
+   if (!lwpr_io_read_int(s, &version)) return 0;
    
-   if (version!=LWPR_BINIO_VERSION) {
+   if (version > LWPR_BINIO_VERSION || version < LWPR_BINIO_VERSION_SLIM_BUDGET) {
       fprintf(stderr,"Sorry, version of binary LWPR file does not match this implementation.\n");
       return 0;
    }
+   budget = (version==LWPR_BINIO_VERSION_BUDGET || version==LWPR_BINIO_VERSION_SLIM_BUDGET);
   
-   if (!lwpr_io_read_int(fp, &nIn) || !lwpr_io_read_int(fp, &nOut)) return 0;
+   if (!lwpr_io_read_int(s, &nIn) || !lwpr_io_read_int(s, &nOut)) return 0;
    if (nIn<=0) return 0;
    if (nOut<=0) return 0;
    if (!lwpr_init_model(model, nIn, nOut, NULL)) return 0;
+   model->inference_only = (version==LWPR_BINIO_VERSION_SLIM || version==LWPR_BINIO_VERSION_SLIM_BUDGET);
    
-   ok = lwpr_io_read_int(fp, &i);
+   /* Errors are only recorded in ok here, since the model must be freed below */
+   ok = lwpr_io_read_int(s, &i);
+   if (!ok) {
+      i = (int) LWPR_GAUSSIAN_KERNEL;
+   } else if (i == LWPR_BINIO_NAMED_KERNEL) {
+      char kname[LWPR_BINIO_MAX_KERNEL_NAME+1];
+      int len = 0;
+      
+      ok &= lwpr_io_read_int(s, &len);
+      if (len <= 0 || len > LWPR_BINIO_MAX_KERNEL_NAME) {
+         ok = 0;
+         len = 0;
+      }
+      ok &= lwpr_io_read_bytes(s, kname, (size_t) len);
+      kname[len] = 0;
+      i = lwpr_kernel_by_name(kname);
+      if (i < 0) {
+         if (ok) fprintf(stderr,"Kernel '%s' is not registered.\n", kname);
+         ok = 0;
+      }
+   } else if (i != (int) LWPR_GAUSSIAN_KERNEL && i != (int) LWPR_BISQUARE_KERNEL) {
+      /* Registered kernels are only stored by name */
+      ok = 0;
+   }
+   if (!ok) i = (int) LWPR_GAUSSIAN_KERNEL;
    model->kernel = (LWPR_Kernel) i;
    
-   ok &= lwpr_io_read_int(fp, &i);
+   ok &= lwpr_io_read_int(s, &i);
    
    if (i>0) {
       size_t len = (size_t) i;
       model->name = (char *) LWPR_MALLOC((len+1)*sizeof(char));
       if (model->name == NULL) return 0;
-      ok &= (fread(model->name, sizeof(char), len, fp) == len)?1:0;
+      ok &= lwpr_io_read_bytes(s, model->name, len);
       model->name[i] = 0;
    }
    nInS = model->nInStore;
    
-   ok &= lwpr_io_read_int(fp, &model->n_data);
-   ok &= lwpr_io_read_vector(fp, nIn, model->mean_x);
-   ok &= lwpr_io_read_vector(fp, nIn, model->var_x);   
-   ok &= lwpr_io_read_int(fp, &model->diag_only);
-   ok &= lwpr_io_read_int(fp, &model->update_D);   
-   ok &= lwpr_io_read_int(fp, &model->meta);
-   ok &= lwpr_io_read_scalar(fp, &model->meta_rate);
-   ok &= lwpr_io_read_scalar(fp, &model->penalty);   
-   ok &= lwpr_io_read_matrix(fp, nIn, nInS, nIn, model->init_alpha);
-   ok &= lwpr_io_read_vector(fp, nIn, model->norm_in);
-   ok &= lwpr_io_read_vector(fp, nOut, model->norm_out);   
-   ok &= lwpr_io_read_matrix(fp, nIn, nInS, nIn, model->init_D);   
-   ok &= lwpr_io_read_matrix(fp, nIn, nInS, nIn, model->init_M); 
+   ok &= lwpr_io_read_int(s, &model->n_data);
+   ok &= lwpr_io_read_vector(s, nIn, model->mean_x);
+   ok &= lwpr_io_read_vector(s, nIn, model->var_x);   
+   ok &= lwpr_io_read_int(s, &model->diag_only);
+   ok &= lwpr_io_read_int(s, &model->update_D);   
+   ok &= lwpr_io_read_int(s, &model->meta);
+   ok &= lwpr_io_read_scalar(s, &model->meta_rate);
+   ok &= lwpr_io_read_scalar(s, &model->penalty);   
+   ok &= lwpr_io_read_matrix(s, nIn, nInS, nIn, model->init_alpha);
+   ok &= lwpr_io_read_vector(s, nIn, model->norm_in);
+   ok &= lwpr_io_read_vector(s, nOut, model->norm_out);   
+   ok &= lwpr_io_read_matrix(s, nIn, nInS, nIn, model->init_D);   
+   ok &= lwpr_io_read_matrix(s, nIn, nInS, nIn, model->init_M); 
    
-   ok &= lwpr_io_read_scalar(fp, &model->w_gen);  
-   ok &= lwpr_io_read_scalar(fp, &model->w_prune);   
-   ok &= lwpr_io_read_scalar(fp, &model->init_lambda);   
-   ok &= lwpr_io_read_scalar(fp, &model->final_lambda);   
-   ok &= lwpr_io_read_scalar(fp, &model->tau_lambda);      
-   ok &= lwpr_io_read_scalar(fp, &model->init_S2);      
-   ok &= lwpr_io_read_scalar(fp, &model->add_threshold); 
+   ok &= lwpr_io_read_scalar(s, &model->w_gen);  
+   ok &= lwpr_io_read_scalar(s, &model->w_prune);   
+   ok &= lwpr_io_read_scalar(s, &model->init_lambda);   
+   ok &= lwpr_io_read_scalar(s, &model->final_lambda);   
+   ok &= lwpr_io_read_scalar(s, &model->tau_lambda);      
+   ok &= lwpr_io_read_scalar(s, &model->init_S2);      
+   ok &= lwpr_io_read_scalar(s, &model->add_threshold); 
+   if (budget) {
+      double max_bytes;
+      
+      ok &= lwpr_io_read_int(s, &model->max_rfs);
+      ok &= lwpr_io_read_scalar(s, &max_bytes);
+      ok &= lwpr_io_read_int(s, &i);
+      model->max_bytes = (max_bytes > 0.0) ? (size_t) max_bytes : 0;
+      if (i < (int) LWPR_EVICT_REFUSE || i > (int) LWPR_EVICT_LEAST_DATA) ok = 0;
+      model->evict = (LWPR_EvictionPolicy) i;
+   }
    
    for (dim=0;dim<model->nOut;dim++) {
       int numRFS;
       LWPR_SubModel *sub = &model->sub[dim];   
-      ok &= (fread(str, sizeof(char), 4, fp)==4)?1:0;
+      ok &= lwpr_io_read_bytes(s, str, 4);
       str[4]=0;
       if (!ok || strcmp(str,"SUBM")!=0) {
          lwpr_free_model(model);
          return 0;
       }
-      ok &= lwpr_io_read_int(fp, &i);
+      ok &= lwpr_io_read_int(s, &i);
       ok &= (i==dim);
-      ok &= lwpr_io_read_int(fp, &numRFS);      
-      ok &= lwpr_io_read_int(fp, &sub->n_pruned);            
+      ok &= lwpr_io_read_int(s, &numRFS);      
+      ok &= lwpr_io_read_int(s, &sub->n_pruned);            
+      if (budget) ok &= lwpr_io_read_int(s, &sub->n_evicted);
       for (i=0;i<numRFS;i++) {
-         ok &= lwpr_io_read_rf(fp, sub);
+         ok &= lwpr_io_read_rf(s, sub);
       }
       ok &= (numRFS == sub->numRFS);
    }
-   ok &= (fread(str, sizeof(char), 4, fp) == 4)?1:0;   
+   ok &= lwpr_io_read_bytes(s, str, 4);   
    str[4] = 0;
    if (!ok || strcmp(str,"RPWL")!=0) {
       lwpr_free_model(model);
@@ -307,6 +471,57 @@ int lwpr_read_binary_fp(LWPR_Model *model, FILE *fp) {
 }
 
 
+int lwpr_write_binary_fp(const LWPR_Model *model, FILE *fp) {
+   LWPR_Stream s;
+   
+   s.fp = fp;
+   s.buf = NULL;
+   s.size = s.pos = 0;
+   return lwpr_io_write_model(&s, model);
+}
+
+int lwpr_read_binary_fp(LWPR_Model *model, FILE *fp) {
+   LWPR_Stream s;
+   
+   s.fp = fp;
+   s.buf = NULL;
+   s.size = s.pos = 0;
+   return lwpr_io_read_model(&s, model);
+}
+
+size_t lwpr_binary_size(const LWPR_Model *model) {
+   LWPR_Stream s;
+   
+   /* Neither file nor buffer: the writing routines only count bytes */
+   s.fp = NULL;
+   s.buf = NULL;
+   s.size = s.pos = 0;
+   if (!lwpr_io_write_model(&s, model)) return 0;
+   return s.pos;
+}
+
+int lwpr_write_binary_mem(const LWPR_Model *model, char *buf, size_t size) {
+   LWPR_Stream s;
+   
+   if (buf == NULL) return 0;
+   s.fp = NULL;
+   s.buf = buf;
+   s.size = size;
+   s.pos = 0;
+   return lwpr_io_write_model(&s, model);
+}
+
+int lwpr_read_binary_mem(LWPR_Model *model, const char *buf, size_t size) {
+   LWPR_Stream s;
+   
+   if (buf == NULL) return 0;
+   s.fp = NULL;
+   s.buf = (char *) buf;   /* only read from */
+   s.size = size;
+   s.pos = 0;
+   return lwpr_io_read_model(&s, model);
+}
+
 int lwpr_write_binary(const LWPR_Model *model, const char *filename) {
    int ok;
    FILE *fp;
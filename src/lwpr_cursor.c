@@ -0,0 +1,266 @@
+/*********************************************************************
+LWPR: A library for incremental online learning
+Copyright (C) 2007  Stefan Klanke, Sethu Vijayakumar
+Contact: sethu.vijayakumar@ed.ac.uk
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Library General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free
+Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*********************************************************************/
+#include <lwpr.h>
+#include <lwpr_aux.h>
+#include <lwpr_cursor.h>
+#include <lwpr_math.h>
+#include <lwpr_mem.h>
+#include <math.h>
+#include <string.h>
+#include <stdlib.h>
+
+/* Partial results of the prediction for one output dimension */
+typedef struct {
+   double yp;
+   double sum_w;
+   double w_max;
+} LWPR_CursorSum;
+
+static double lwpr_cursor_kernel(LWPR_Kernel kernel, const LWPR_KernelInfo *custom, double q) {
+   double dwdq, ddwdqdq, w;
+
+   switch(kernel) {
+      case LWPR_GAUSSIAN_KERNEL:
+         return exp(-0.5*q);
+      case LWPR_BISQUARE_KERNEL:
+         w = 1.0 - 0.25*q;
+         return (w<0.0) ? 0.0 : w*w;
+      default:
+         if (custom == NULL || (custom->support > 0.0 && q >= custom->support)) return 0.0;
+         return custom->func(q, &dwdq, &ddwdqdq);
+   }
+}
+
+/* Returns L such that sqrt(xc'*D*xc) <= L*||xc|| for the distance metric of RF,
+** or HUGE_VAL if the distance is not a norm (diag_only with off-diagonal elements) */
+static double lwpr_cursor_metric_bound(const LWPR_ReceptiveField *RF) {
+   int nIn = RF->model->nIn;
+   int i,j;
+   double L2 = 0.0;
+
+   if (RF->model->diag_only) {
+      for (j=0;j<nIn;j++) {
+         for (i=0;i<j;i++) {
+            if (RF->D[LWPR_TRI(i,j)] != 0.0) return HUGE_VAL;
+         }
+         if (RF->D[LWPR_TRI(j,j)] > L2) L2 = RF->D[LWPR_TRI(j,j)];
+      }
+   } else {
+      /* Frobenius norm of M, which bounds its spectral norm */
+      for (i=0;i<LWPR_TRI_SIZE(nIn);i++) L2 += RF->M[i]*RF->M[i];
+   }
+   return sqrt(L2);
+}
+
+/* Computes the activation of RF for qc->xn, and adds its contribution to S.
+** Returns the squared distance */
+static double lwpr_cursor_eval(LWPR_QueryCursor *qc, const LWPR_ReceptiveField *RF,
+      const LWPR_KernelInfo *custom, LWPR_CursorSum *S) {
+   int nIn = qc->model->nIn;
+   double *xc = qc->ws->xc;
+   double dist, w;
+   int i;
+
+   for (i=0;i<nIn;i++) {
+      xc[i] = qc->xn[i] - RF->c[i];
+   }
+   dist = lwpr_aux_rf_dist(RF, xc);
+   w = lwpr_cursor_kernel(qc->model->kernel, custom, dist);
+
+   if (w > S->w_max) S->w_max = w;
+   if (w > qc->cutoff && RF->trustworthy) {
+      S->yp += w*lwpr_aux_predict_rf(RF, qc->xn, qc->ws);
+      S->sum_w += w;
+   }
+   return dist;
+}
+
+static int lwpr_cursor_compare(const void *a, const void *b) {
+   double ra = ((const LWPR_CursorEntry *) a)->radius;
+   double rb = ((const LWPR_CursorEntry *) b)->radius;
+   return (ra < rb) ? -1 : ((ra > rb) ? 1 : 0);
+}
+
+/* Scans all receptive fields of one output dimension, and stores their radii around
+** the current input, which becomes the anchor point. Returns 0 if the entries could
+** not be allocated, in which case S is still computed */
+static int lwpr_cursor_scan(LWPR_QueryCursor *qc, int dim, LWPR_CursorSum *S) {
+   const LWPR_SubModel *sub = &qc->model->sub[dim];
+   LWPR_CursorSubModel *cs = &qc->sub[dim];
+   const LWPR_KernelInfo *custom = lwpr_kernel_info(qc->model->kernel);
+   double sqrt_qmax = sqrt(lwpr_aux_qmax(qc->model->kernel, custom, qc->cutoff));
+   int store = 1;
+   int n;
+
+   if (sub->numRFS > cs->capacity) {
+      LWPR_CursorEntry *entry = (LWPR_CursorEntry *) LWPR_REALLOC(cs->entry,
+            sub->numRFS*sizeof(LWPR_CursorEntry));
+      if (entry == NULL) {
+         store = 0;
+      } else {
+         cs->entry = entry;
+         cs->capacity = sub->numRFS;
+      }
+   }
+
+   for (n=0;n<sub->numRFS;n++) {
+      const LWPR_ReceptiveField *RF = sub->rf[n];
+      double dist = lwpr_cursor_eval(qc, RF, custom, S);
+
+      if (store) {
+         /* The RF stays inactive while sqrt(dist) - L*|x-x0| > sqrt(qmax). The factors
+         ** make this robust to rounding errors. */
+         double slack = sqrt(dist)*(1.0 - 1e-12) - sqrt_qmax;
+         double L = lwpr_cursor_metric_bound(RF)*(1.0 + 1e-12);
+
+         cs->entry[n].radius = (slack > 0.0) ? slack/L : -1.0;
+         cs->entry[n].index = n;
+      }
+   }
+   if (!store) return 0;
+
+   qsort(cs->entry, sub->numRFS, sizeof(LWPR_CursorEntry), lwpr_cursor_compare);
+   cs->numRFS = sub->numRFS;
+   return 1;
+}
+
+/* Returns the number of entries of cs with radius <= delta */
+static int lwpr_cursor_count(const LWPR_CursorSubModel *cs, double delta) {
+   int lo = 0, hi = cs->numRFS;
+
+   while (lo < hi) {
+      int mid = (lo + hi)/2;
+      if (cs->entry[mid].radius <= delta) lo = mid+1; else hi = mid;
+   }
+   return lo;
+}
+
+int lwpr_cursor_init(LWPR_QueryCursor *qc, const LWPR_Model *model, double cutoff) {
+   int nIn = model->nIn;
+
+   qc->model = model;
+   qc->cutoff = cutoff;
+   qc->max_steps = 100;
+   qc->steps = -1;
+   qc->n_data = model->n_data;
+   qc->full_scans = 0;
+   qc->queries = 0;
+   qc->sub = NULL;
+   qc->ws = NULL;
+
+   qc->x0 = (double *) LWPR_MALLOC(2*nIn*sizeof(double));
+   if (qc->x0 == NULL) return 0;
+   memset(qc->x0, 0, nIn*sizeof(double));
+   qc->xn = qc->x0 + nIn;
+
+   qc->sub = (LWPR_CursorSubModel *) LWPR_CALLOC(model->nOut, sizeof(LWPR_CursorSubModel));
+   qc->ws = (LWPR_Workspace *) LWPR_MALLOC(sizeof(LWPR_Workspace));
+   if (qc->sub == NULL || qc->ws == NULL || !lwpr_mem_alloc_ws(qc->ws, nIn, model->nOut)) {
+      if (qc->ws != NULL) LWPR_FREE(qc->ws);
+      qc->ws = NULL;
+      lwpr_cursor_free(qc);
+      return 0;
+   }
+   return 1;
+}
+
+void lwpr_cursor_free(LWPR_QueryCursor *qc) {
+   int dim;
+
+   if (qc->sub != NULL) {
+      for (dim=0;dim<qc->model->nOut;dim++) {
+         if (qc->sub[dim].entry != NULL) LWPR_FREE(qc->sub[dim].entry);
+      }
+      LWPR_FREE(qc->sub);
+      qc->sub = NULL;
+   }
+   if (qc->ws != NULL) {
+      lwpr_mem_free_ws(qc->ws);
+      LWPR_FREE(qc->ws);
+      qc->ws = NULL;
+   }
+   if (qc->x0 != NULL) {
+      LWPR_FREE(qc->x0);
+      qc->x0 = NULL;
+   }
+}
+
+void lwpr_cursor_reset(LWPR_QueryCursor *qc) {
+   qc->steps = -1;
+}
+
+int lwpr_cursor_predict(LWPR_QueryCursor *qc, const double *x, double *y, double *max_w) {
+   const LWPR_Model *model = qc->model;
+   const LWPR_KernelInfo *custom = lwpr_kernel_info(model->kernel);
+   int nIn = model->nIn;
+   int full = 0, ok = 1;
+   int i,k,dim;
+   double delta = 0.0;
+
+   for (i=0;i<nIn;i++) {
+      double d;
+      qc->xn[i] = x[i]/model->norm_in[i];
+      d = qc->xn[i] - qc->x0[i];
+      delta += d*d;
+   }
+   delta = sqrt(delta);
+
+   if (qc->steps < 0 || qc->steps >= qc->max_steps || qc->n_data != model->n_data) {
+      full = 1;
+   } else {
+      for (dim=0;dim<model->nOut;dim++) {
+         const LWPR_CursorSubModel *cs = &qc->sub[dim];
+         if (cs->numRFS != model->sub[dim].numRFS || 2*lwpr_cursor_count(cs, delta) > cs->numRFS) {
+            full = 1;
+            break;
+         }
+      }
+   }
+
+   for (dim=0;dim<model->nOut;dim++) {
+      LWPR_CursorSum S;
+
+      S.yp = S.sum_w = S.w_max = 0.0;
+      if (full) {
+         ok &= lwpr_cursor_scan(qc, dim, &S);
+      } else {
+         const LWPR_CursorSubModel *cs = &qc->sub[dim];
+         int numCand = lwpr_cursor_count(cs, delta);
+
+         for (k=0;k<numCand;k++) {
+            (void) lwpr_cursor_eval(qc, model->sub[dim].rf[cs->entry[k].index], custom, &S);
+         }
+      }
+      if (S.sum_w > 0.0) S.yp/=S.sum_w;
+      y[dim] = model->norm_out[dim] * S.yp;
+      if (max_w != NULL) max_w[dim] = S.w_max;
+   }
+
+   qc->queries++;
+   if (full) {
+      qc->full_scans++;
+      qc->n_data = model->n_data;
+      memcpy(qc->x0, qc->xn, nIn*sizeof(double));
+      qc->steps = ok ? 0 : -1;
+   } else {
+      qc->steps++;
+   }
+   return ok;
+}
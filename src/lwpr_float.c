@@ -0,0 +1,400 @@
+/*********************************************************************
+LWPR: A library for incremental online learning
+Copyright (C) 2007  Stefan Klanke, Sethu Vijayakumar
+Contact: sethu.vijayakumar@ed.ac.uk
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Library General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free
+Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*********************************************************************/
+#include <lwpr.h>
+#include <lwpr_aux.h>
+#include <lwpr_float.h>
+#include <lwpr_math.h>
+#include <lwpr_mem.h>
+#include <math.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define LANES     LWPR_FLOAT_LANES
+
+/* Alignment of all float arrays in bytes. Since every array holds a multiple of
+** LANES floats, aligning the start of a memory block is sufficient */
+#define LWPR_FLOAT_ALIGN   32
+
+/* Input dimensionality up to which lwpr_float_predict keeps its working memory on
+** the stack. Larger models allocate it for every call */
+#ifndef LWPR_FLOAT_STACK_IN
+#define LWPR_FLOAT_STACK_IN   32
+#endif
+
+static float *lwpr_float_align(void *storage) {
+   size_t addr = (size_t) storage;
+   return (float *) ((addr + LWPR_FLOAT_ALIGN - 1) & ~((size_t) LWPR_FLOAT_ALIGN - 1));
+}
+
+#define LWPR_FLOAT_EXP_MIN    -87.0f       /* exp(LWPR_FLOAT_EXP_MIN) is still a normal float */
+#define LWPR_FLOAT_LOG2E      1.44269504f
+#define LWPR_FLOAT_LN2_HI     0.693359375f /* exact in 9 bits, so k*LN2_HI is exact */
+#define LWPR_FLOAT_LN2_LO     -2.12194440e-4f
+#define LWPR_FLOAT_ROUND      12582912.0f  /* 1.5*2^23, adding it rounds to integers */
+
+/* Gaussian activations w = valid*exp(-0.5*dist) of one block. This is the single
+** precision version of lwpr_math_exp_array(), with a shorter polynomial. Again, there 
+** are no function calls or branches, so the loop can be vectorised. The relative error 
+** is below 2e-7, and dist > 174 yields 0. Like in lwpr_math_exp_array(), unsigned int
+** is assumed to have 32 bits. */
+static void lwpr_float_gaussian(float *w, const float *dist, const float *valid) {
+   int l;
+   union {
+      float f;
+      unsigned int i;
+   } xmin;
+   
+   xmin.f = LWPR_FLOAT_EXP_MIN;
+   
+   for (l=0;l<LANES;l++) {
+      float k, r, p;
+      unsigned int under;
+      union {
+         float f;
+         unsigned int i;
+      } xi, t, scale;
+      
+      /* For negative numbers, a larger bit pattern means a smaller number */
+      xi.f = -0.5f*dist[l];
+      under = 0u - (unsigned int) (xi.i > xmin.i);
+      xi.i = (xi.i & ~under) | (xmin.i & under);
+
+      /* exp(x) = 2^k * exp(r), where k = round(x/ln 2) and |r| <= ln(2)/2 */
+      t.f = xi.f*LWPR_FLOAT_LOG2E + LWPR_FLOAT_ROUND;
+      k = t.f - LWPR_FLOAT_ROUND;
+      r = (xi.f - k*LWPR_FLOAT_LN2_HI) - k*LWPR_FLOAT_LN2_LO;
+      
+      /* Taylor series up to r^7, the remainder is below 6e-9 */
+      p = 1.0f/5040.0f;
+      p = p*r + 1.0f/720.0f;
+      p = p*r + 1.0f/120.0f;
+      p = p*r + 1.0f/24.0f;
+      p = p*r + 1.0f/6.0f;
+      p = p*r + 0.5f;
+      p = p*r + 1.0f;
+      p = p*r + 1.0f;
+      
+      /* 2^k from the exponent bits: -126 <= k <= 0, so the lowest 9 bits of t+127 
+      ** hold the biased exponent k+127 */
+      scale.i = ((t.i + 127u) << 23) & ~under;
+      w[l] = valid[l]*(p*scale.f);
+   }
+}
+
+/* Returns 1 if all distance metrics of a diag_only model are actually diagonal */
+static int lwpr_float_metrics_diagonal(const LWPR_Model *model) {
+   int dim,n,i,j;
+
+   for (dim=0;dim<model->nOut;dim++) {
+      const LWPR_SubModel *sub = &model->sub[dim];
+      for (n=0;n<sub->numRFS;n++) {
+         const double *D = sub->rf[n]->D;
+         for (j=1;j<model->nIn;j++) {
+            for (i=0;i<j;i++) {
+               if (D[LWPR_TRI(i,j)] != 0.0) return 0;
+            }
+         }
+      }
+   }
+   return 1;
+}
+
+static int lwpr_float_init_sub(LWPR_FloatModel *fm, LWPR_FloatSubModel *fs,
+      const LWPR_SubModel *sub, double *R) {
+   int nIn = fm->nIn;
+   int nMetric = fm->nMetric;
+   int numRFS = sub->numRFS;
+   int numBlocks = (numRFS + LANES - 1)/LANES;
+   int n,i;
+   float *storage;
+
+   fs->numRFS = numRFS;
+   fs->numBlocks = numBlocks;
+   fs->storage = LWPR_CALLOC((size_t) numBlocks*LANES*(3*nIn + nMetric + 3)*sizeof(float)
+         + LWPR_FLOAT_ALIGN, 1);
+   if (fs->storage == NULL) return 0;
+
+   storage = lwpr_float_align(fs->storage);
+   fs->c = storage;        storage += numBlocks*LANES*nIn;
+   fs->mean_x = storage;   storage += numBlocks*LANES*nIn;
+   fs->slope = storage;    storage += numBlocks*LANES*nIn;
+   fs->metric = storage;   storage += numBlocks*LANES*nMetric;
+   fs->beta0 = storage;    storage += numBlocks*LANES;
+   fs->trust = storage;    storage += numBlocks*LANES;
+   fs->valid = storage;
+
+   for (n=0;n<numRFS;n++) {
+      const LWPR_ReceptiveField *RF = sub->rf[n];
+      int lane = n % LANES;
+      int vOff = (n / LANES)*LANES*nIn + lane;
+      int mOff = (n / LANES)*LANES*nMetric + lane;
+      const double *Mp = RF->M;
+
+      for (i=0;i<nIn;i++) {
+         fs->c[vOff + i*LANES] = (float) RF->c[i];
+         fs->mean_x[vOff + i*LANES] = (float) RF->mean_x[i];
+         fs->slope[vOff + i*LANES] = (float) RF->slope[i];
+      }
+
+      if (fm->diag_only) {
+         for (i=0;i<nIn;i++) fs->metric[mOff + i*LANES] = (float) RF->D[LWPR_TRI(i,i)];
+      } else {
+         if (RF->model->diag_only) {
+            /* diag_only model with off-diagonal elements. Predictions use D, which
+            ** is not kept equal to M'M during training, so factorise D = R'R */
+            int nInS = RF->model->nInStore;
+
+            lwpr_math_tri_unpack(nIn, nInS, R, RF->D, 1);
+            if (!lwpr_math_cholesky(nIn, nInS, R, NULL)) return 0;
+            lwpr_math_tri_pack(nIn, nInS, R + nInS*nInS, R);
+            Mp = R + nInS*nInS;
+         }
+         for (i=0;i<nMetric;i++) fs->metric[mOff + i*LANES] = (float) Mp[i];
+      }
+
+      fs->beta0[n] = (float) RF->beta0;
+      fs->trust[n] = RF->trustworthy ? 1.0f : 0.0f;
+      fs->valid[n] = 1.0f;
+   }
+   return 1;
+}
+
+int lwpr_float_init(LWPR_FloatModel *fm, LWPR_Model *model) {
+   int nIn = model->nIn;
+   int nOut = model->nOut;
+   int nInS = model->nInStore;
+   int dim;
+   double *R = NULL;
+
+   fm->nIn = nIn;
+   fm->nOut = nOut;
+   fm->kernel = model->kernel;
+   fm->diag_only = model->diag_only && lwpr_float_metrics_diagonal(model);
+   fm->nMetric = fm->diag_only ? nIn : LWPR_TRI_SIZE(nIn);
+
+   fm->storage = LWPR_MALLOC((nIn+nOut)*sizeof(double));
+   if (fm->storage == NULL) return 0;
+
+   fm->sub = (LWPR_FloatSubModel *) LWPR_CALLOC(nOut, sizeof(LWPR_FloatSubModel));
+   if (fm->sub == NULL) {
+      LWPR_FREE(fm->storage);
+      return 0;
+   }
+
+   fm->norm_in = (double *) fm->storage;
+   fm->norm_out = fm->norm_in + nIn;
+   memcpy(fm->norm_in, model->norm_in, nIn*sizeof(double));
+   memcpy(fm->norm_out, model->norm_out, nOut*sizeof(double));
+
+   if (model->diag_only && !fm->diag_only) {
+      R = (double *) LWPR_MALLOC((nInS*nInS + LWPR_TRI_SIZE(nIn))*sizeof(double));
+      if (R == NULL) {
+         lwpr_float_free(fm);
+         return 0;
+      }
+   }
+
+   lwpr_finalize_slopes(model);
+
+   for (dim=0;dim<nOut;dim++) {
+      if (!lwpr_float_init_sub(fm, &fm->sub[dim], &model->sub[dim], R)) {
+         if (R != NULL) LWPR_FREE(R);
+         lwpr_float_free(fm);
+         return 0;
+      }
+   }
+   if (R != NULL) LWPR_FREE(R);
+   return 1;
+}
+
+void lwpr_float_free(LWPR_FloatModel *fm) {
+   int dim;
+
+   if (fm->sub != NULL) {
+      for (dim=0;dim<fm->nOut;dim++) {
+         if (fm->sub[dim].storage != NULL) LWPR_FREE(fm->sub[dim].storage);
+      }
+      LWPR_FREE(fm->sub);
+      fm->sub = NULL;
+   }
+   if (fm->storage != NULL) {
+      LWPR_FREE(fm->storage);
+      fm->storage = NULL;
+   }
+}
+
+/* Prediction of one output dimension for the normalised input xn. All inner loops
+** run over the LANES receptive fields of a block, which are stored adjacently in
+** memory. xc is working memory for one block (nIn*LANES) */
+static float lwpr_float_predict_sub(const LWPR_FloatModel *fm, const LWPR_FloatSubModel *fs,
+      const float *xn, float *xc, float cutoff, float *max_w) {
+   int nIn = fm->nIn;
+   int nMetric = fm->nMetric;
+   const LWPR_KernelInfo *custom = lwpr_kernel_info(fm->kernel);
+   float yp = 0.0f, sum_w = 0.0f, w_max = 0.0f;
+   int b,i,j,l;
+
+   for (b=0;b<fs->numBlocks;b++) {
+      const float *c = fs->c + b*LANES*nIn;
+      const float *mean_x = fs->mean_x + b*LANES*nIn;
+      const float *slope = fs->slope + b*LANES*nIn;
+      const float *metric = fs->metric + b*LANES*nMetric;
+      const float *beta0 = fs->beta0 + b*LANES;
+      const float *trust = fs->trust + b*LANES;
+      const float *valid = fs->valid + b*LANES;
+      float dist[LANES], w[LANES], yp_n[LANES];
+      int active = 0;
+
+      for (l=0;l<LANES;l++) dist[l] = 0.0f;
+
+      if (fm->diag_only) {
+         for (i=0;i<nIn;i++) {
+            for (l=0;l<LANES;l++) {
+               float d = xn[i] - c[i*LANES+l];
+               dist[l] += metric[i*LANES+l]*d*d;
+            }
+         }
+      } else {
+         for (i=0;i<nIn;i++) {
+            for (l=0;l<LANES;l++) xc[i*LANES+l] = xn[i] - c[i*LANES+l];
+         }
+         /* dist = ||M*xc||^2, walking along the rows of the packed M */
+         for (i=0;i<nIn;i++) {
+            float r[LANES];
+            for (l=0;l<LANES;l++) r[l] = 0.0f;
+            for (j=i;j<nIn;j++) {
+               const float *Mij = metric + LWPR_TRI(i,j)*LANES;
+               for (l=0;l<LANES;l++) r[l] += Mij[l]*xc[j*LANES+l];
+            }
+            for (l=0;l<LANES;l++) dist[l] += r[l]*r[l];
+         }
+      }
+
+      switch(fm->kernel) {
+         case LWPR_GAUSSIAN_KERNEL:
+            lwpr_float_gaussian(w,dist,valid);
+            break;
+         case LWPR_BISQUARE_KERNEL:
+            for (l=0;l<LANES;l++) {
+               float v = 1.0f - 0.25f*dist[l];
+               w[l] = (v<0.0f) ? 0.0f : valid[l]*v*v;
+            }
+            break;
+         default:
+            /* Registered kernels are evaluated in double precision */
+            for (l=0;l<LANES;l++) {
+               double dwdq, ddwdqdq;
+               if (custom == NULL || valid[l] == 0.0f || (custom->support > 0.0 && dist[l] >= custom->support)) {
+                  w[l] = 0.0f;
+               } else {
+                  w[l] = (float) custom->func((double) dist[l], &dwdq, &ddwdqdq);
+               }
+            }
+      }
+
+      for (l=0;l<LANES;l++) {
+         if (w[l] > w_max) w_max = w[l];
+         /* Padding lanes and untrustworthy RFs have trust = 0 */
+         w[l] = (w[l] > cutoff) ? trust[l]*w[l] : 0.0f;
+         if (w[l] > 0.0f) active = 1;
+      }
+      if (!active) continue;
+
+      for (l=0;l<LANES;l++) yp_n[l] = beta0[l];
+      for (i=0;i<nIn;i++) {
+         for (l=0;l<LANES;l++) yp_n[l] += slope[i*LANES+l]*(xn[i] - mean_x[i*LANES+l]);
+      }
+      for (l=0;l<LANES;l++) {
+         yp += w[l]*yp_n[l];
+         sum_w += w[l];
+      }
+   }
+   if (sum_w > 0.0f) yp/=sum_w;
+   *max_w = w_max;
+   return yp;
+}
+
+int lwpr_float_predict(const LWPR_FloatModel *fm, const double *x, double cutoff, double *y, double *max_w) {
+   float stack[LWPR_FLOAT_STACK_IN*(LANES+1)];
+   float *xn = stack;
+   float *xc;
+   int i;
+
+   if (fm->nIn > LWPR_FLOAT_STACK_IN) {
+      xn = (float *) LWPR_MALLOC(fm->nIn*(LANES+1)*sizeof(float));
+      if (xn == NULL) return 0;
+   }
+   xc = xn + fm->nIn;
+
+   for (i=0;i<fm->nIn;i++) xn[i] = (float) (x[i]/fm->norm_in[i]);
+
+   for (i=0;i<fm->nOut;i++) {
+      float w_max;
+      float yn = lwpr_float_predict_sub(fm, &fm->sub[i], xn, xc, (float) cutoff, &w_max);
+
+      y[i] = fm->norm_out[i] * (double) yn;
+      if (max_w!=NULL) max_w[i] = (double) w_max;
+   }
+   if (xn != stack) LWPR_FREE(xn);
+   return 1;
+}
+
+int lwpr_float_compare(const LWPR_Model *model, const LWPR_FloatModel *fm, int N,
+      const double *X, int ldx, double cutoff, LWPR_FloatAccuracy *acc) {
+   int nOut = model->nOut;
+   int k,i;
+   double *yd, *yf, *wd, *wf;
+   double sum_sq = 0.0;
+
+   if (model->nIn != fm->nIn || nOut != fm->nOut) return 0;
+
+   yd = (double *) LWPR_MALLOC(4*nOut*sizeof(double));
+   if (yd == NULL) return 0;
+   yf = yd + nOut;
+   wd = yf + nOut;
+   wf = wd + nOut;
+
+   acc->N = N;
+   acc->max_abs_err = acc->rms_err = acc->max_norm_err = acc->max_w_err = 0.0;
+
+   for (k=0;k<N;k++) {
+      const double *x = X + k*ldx;
+
+      lwpr_predict(model, x, cutoff, yd, NULL, wd);
+      if (!lwpr_float_predict(fm, x, cutoff, yf, wf)) {
+         LWPR_FREE(yd);
+         return 0;
+      }
+
+      for (i=0;i<nOut;i++) {
+         double err = fabs(yd[i] - yf[i]);
+         double werr = fabs(wd[i] - wf[i]);
+
+         if (err > acc->max_abs_err) acc->max_abs_err = err;
+         if (err/model->norm_out[i] > acc->max_norm_err) acc->max_norm_err = err/model->norm_out[i];
+         if (werr > acc->max_w_err) acc->max_w_err = werr;
+         sum_sq += err*err;
+      }
+   }
+   if (N > 0) acc->rms_err = sqrt(sum_sq / (N*nOut));
+
+   LWPR_FREE(yd);
+   return 1;
+}
@@ -141,6 +141,75 @@ void lwpr_math_scale_add_scalar_vector(double b, double *y, double a,const doubl
    }      
 }
 
+/* 64 bit integer type for constructing powers of two in lwpr_math_exp_array */
+#if defined(_MSC_VER) && _MSC_VER < 1600
+typedef unsigned __int64 lwpr_uint64;
+#else
+typedef unsigned long long lwpr_uint64;
+#endif
+
+#define LWPR_EXP_MIN    -708.375        /* exp(LWPR_EXP_MIN) is still a normal number, and the
+                                        ** lower 32 bits of its representation are zero */
+#define LWPR_EXP_LOG2E  1.4426950408889634074
+#define LWPR_EXP_LN2_HI 6.93145751953125e-1
+#define LWPR_EXP_LN2_LO 1.42860682030941723212e-6
+#define LWPR_EXP_ROUND  6755399441055744.0 /* 1.5*2^52, adding it rounds to integers */
+
+void lwpr_math_exp_array(int n, double *y, const double *x) {
+   int i;
+   union {
+      double d;
+      lwpr_uint64 i;
+   } xmin;
+   
+   xmin.d = LWPR_EXP_MIN;
+   
+   for (i=0;i<n;i++) {
+      double k, r, p;
+      lwpr_uint64 under;
+      union {
+         double d;
+         lwpr_uint64 i;
+      } xi, t, scale;
+      
+      /* Inputs below LWPR_EXP_MIN are replaced by LWPR_EXP_MIN, and their result 
+      ** is set to zero below. For negative numbers, a larger bit pattern means a 
+      ** smaller number, and comparing the upper 32 bits is sufficient. Integer masks 
+      ** are used instead of branches or floating point comparisons, since the latter 
+      ** may prevent vectorisation (-ftrapping-math) */
+      xi.d = x[i];
+      under = (lwpr_uint64) 0 - (lwpr_uint64) ((unsigned int) (xi.i >> 32) > (unsigned int) (xmin.i >> 32));
+      xi.i = (xi.i & ~under) | (xmin.i & under);
+      
+      /* exp(x) = 2^k * exp(r), where k = round(x/ln 2) and |r| <= ln(2)/2.
+      ** After adding LWPR_EXP_ROUND, k is contained in the lowest bits of t */
+      t.d = xi.d*LWPR_EXP_LOG2E + LWPR_EXP_ROUND;
+      k = t.d - LWPR_EXP_ROUND;
+      r = (xi.d - k*LWPR_EXP_LN2_HI) - k*LWPR_EXP_LN2_LO;
+      
+      /* Taylor series up to r^13, the remainder is below 5e-18 */
+      p = 1.0/6227020800.0;
+      p = p*r + 1.0/479001600.0;
+      p = p*r + 1.0/39916800.0;
+      p = p*r + 1.0/3628800.0;
+      p = p*r + 1.0/362880.0;
+      p = p*r + 1.0/40320.0;
+      p = p*r + 1.0/5040.0;
+      p = p*r + 1.0/720.0;
+      p = p*r + 1.0/120.0;
+      p = p*r + 1.0/24.0;
+      p = p*r + 1.0/6.0;
+      p = p*r + 0.5;
+      p = p*r + 1.0;
+      p = p*r + 1.0;
+      
+      /* 2^k, built directly from the exponent bits. Since -1022 <= k <= 0, the lowest 
+      ** 12 bits of t+1023 hold the biased exponent k+1023, and the shift discards the rest */
+      scale.i = ((t.i + 1023) << 52) & ~under;
+      y[i] = p*scale.d;
+   }
+}
+
 int lwpr_math_cholesky(int N,int Ns,double *R,const double *A) {
    int i,j,k;
    double A_00, R_00;
@@ -196,3 +265,150 @@ int lwpr_math_cholesky(int N,int Ns,double *R,const double *A) {
    return 1;
 }
 
+
+double lwpr_math_symp_quad(int N, const double *Ap, const double *x) {
+   int j;
+   double q = 0.0;
+   
+   /* x'Ax = sum_j x_j * (A_jj x_j + 2 * sum_{i<j} A_ij x_i) */
+   for (j=0;j<N;j++) {
+      const double *Aj = Ap + LWPR_TRI(0,j);
+      q += x[j] * (2.0*lwpr_math_dot_product(Aj, x, j) + Aj[j]*x[j]);
+   }
+   return q;
+}
+
+void lwpr_math_symp_mv(int N, double *y, const double *Ap, const double *x) {
+   int j;
+   
+   for (j=0;j<N;j++) {
+      const double *Aj = Ap + LWPR_TRI(0,j);
+      /* upper part of column j contributes to y_0..y_j-1, its transpose to y_j */
+      y[j] = lwpr_math_dot_product(Aj, x, j+1);
+      lwpr_math_add_scalar_vector(y, x[j], Aj, j);
+   }
+}
+
+void lwpr_math_symp_add_scalar(int N, int Ns, double *A, double a, const double *Bp) {
+   int i,j;
+   
+   for (j=0;j<N;j++) {
+      const double *Bj = Bp + LWPR_TRI(0,j);
+      lwpr_math_add_scalar_vector(A + j*Ns, a, Bj, j+1);
+      for (i=0;i<j;i++) A[j + i*Ns] += a*Bj[i];
+   }
+}
+
+void lwpr_math_symp_rank1(int N, double *Ap, double a, const double *x) {
+   int j;
+   
+   for (j=0;j<N;j++) {
+      lwpr_math_add_scalar_vector(Ap + LWPR_TRI(0,j), a*x[j], x, j+1);
+   }
+}
+
+void lwpr_math_symp_rank2(int N, double *Ap, double a, const double *x, const double *y) {
+   int j;
+   
+   for (j=0;j<N;j++) {
+      double *Aj = Ap + LWPR_TRI(0,j);
+      lwpr_math_add_scalar_vector(Aj, a*y[j], x, j+1);
+      lwpr_math_add_scalar_vector(Aj, a*x[j], y, j+1);
+   }
+}
+
+double lwpr_math_trip_norm2(int N, const double *Mp, const double *x) {
+   int i,j,k;
+   double q = 0.0;
+   
+   /* Walk along the rows of M: element (i,j+1) follows (i,j) at an offset of j+1 */
+   for (i=0;i<N;i++) {
+      double r = 0.0;
+      for (j=i, k=LWPR_TRI(i,i);j<N;j++) {
+         r += Mp[k]*x[j];
+         k += j+1;
+      }
+      q += r*r;
+   }
+   return q;
+}
+
+double lwpr_math_trip_norm2_bounded(int N, const double *Mp, const double *x, double qmax) {
+   int i,j,k,b;
+   double q = 0.0;
+   
+   for (b=0;b<N;b+=LWPR_MATH_DIST_BLOCK) {
+      int iend = (b+LWPR_MATH_DIST_BLOCK < N) ? b+LWPR_MATH_DIST_BLOCK : N;
+      
+      for (i=b;i<iend;i++) {
+         double r = 0.0;
+         for (j=i, k=LWPR_TRI(i,i);j<N;j++) {
+            r += Mp[k]*x[j];
+            k += j+1;
+         }
+         q += r*r;
+      }
+      if (q > qmax) break;
+   }
+   return q;
+}
+
+double lwpr_math_diagp_quad_bounded(int N, const double *Ap, const double *x, double qmax) {
+   int j,b;
+   double q = 0.0;
+   
+   for (b=0;b<N;b+=LWPR_MATH_DIST_BLOCK) {
+      int jend = (b+LWPR_MATH_DIST_BLOCK < N) ? b+LWPR_MATH_DIST_BLOCK : N;
+      
+      for (j=b;j<jend;j++) {
+         q += x[j] * (Ap[LWPR_TRI(j,j)]*x[j]);
+      }
+      if (q > qmax) break;
+   }
+   return q;
+}
+
+void lwpr_math_trip_mv(int N, double *y, const double *Mp, const double *x) {
+   int j;
+   
+   memset(y, 0, N*sizeof(double));
+   for (j=0;j<N;j++) {
+      lwpr_math_add_scalar_vector(y, x[j], Mp + LWPR_TRI(0,j), j+1);
+   }
+}
+
+void lwpr_math_trip_tmv(int N, double *y, const double *Mp, const double *x) {
+   int j;
+   
+   for (j=0;j<N;j++) {
+      y[j] = lwpr_math_dot_product(Mp + LWPR_TRI(0,j), x, j+1);
+   }
+}
+
+void lwpr_math_trip_gram(int N, double *Dp, const double *Mp) {
+   int i,j;
+   
+   for (j=0;j<N;j++) {
+      for (i=0;i<=j;i++) {
+         Dp[LWPR_TRI(i,j)] = lwpr_math_dot_product(Mp + LWPR_TRI(0,i), Mp + LWPR_TRI(0,j), i+1);
+      }
+   }
+}
+
+void lwpr_math_tri_pack(int N, int Ns, double *Ap, const double *A) {
+   int j;
+   
+   for (j=0;j<N;j++) {
+      memcpy(Ap + LWPR_TRI(0,j), A + j*Ns, (j+1)*sizeof(double));
+   }
+}
+
+void lwpr_math_tri_unpack(int N, int Ns, double *A, const double *Ap, int symmetric) {
+   int i,j;
+   
+   for (j=0;j<N;j++) {
+      const double *Aj = Ap + LWPR_TRI(0,j);
+      memcpy(A + j*Ns, Aj, (j+1)*sizeof(double));
+      for (i=0;i<j;i++) A[j + i*Ns] = symmetric ? Aj[i] : 0.0;
+   }
+}
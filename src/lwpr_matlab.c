@@ -137,6 +137,22 @@ void set_field(mxArray *S,int num, int numField, int m, int n, const double *src
 	mxSetFieldByNumber(S,num,numField,ar);
 }
 
+void get_tri_field(const mxArray *S,int num, const char *name,int n, double *dest) {
+   const mxArray *ar; 
+   ar = mxGetField(S,num,name); 
+   if (ar == NULL || n!=mxGetM(ar) || n!=mxGetN(ar)) {
+      printf("Tried to get %ix%i elements of field '%s'.\n",n,n,name);
+      mexErrMsgTxt("Field is missing or has wrong size.");
+   }   
+   lwpr_math_tri_pack(n, n, dest, mxGetPr(ar));
+}
+
+void set_tri_field(mxArray *S,int num, int numField, int n, const double *src, int symmetric) {
+   mxArray *ar = mxCreateDoubleMatrix(n,n,mxREAL);
+   lwpr_math_tri_unpack(n, n, mxGetPr(ar), src, symmetric);
+	mxSetFieldByNumber(S,num,numField,ar);
+}
+
 void create_RF_from_matlab(LWPR_ReceptiveField *RF, const LWPR_Model *model, const mxArray *S, int num) {
    int nIn,nReg;
    const mxArray *ar;
@@ -152,9 +168,9 @@ void create_RF_from_matlab(LWPR_ReceptiveField *RF, const LWPR_Model *model, con
    /* Note that lwpr_mem_alloc_rf   will have set RF->slopeReady = 0
    ** RF->slope is not part of the MATLAB implementation */
    
-   get_field(S,num,"D",nIn,nIn,RF->D);
-   get_field(S,num,"M",nIn,nIn,RF->M);
-   get_field(S,num,"alpha",nIn,nIn,RF->alpha);
+   get_tri_field(S,num,"D",nIn,RF->D);
+   get_tri_field(S,num,"M",nIn,RF->M);
+   get_tri_field(S,num,"alpha",nIn,RF->alpha);
    get_field(S,num,"beta0",1,1,&RF->beta0);
    get_field(S,num,"beta",nReg,1,RF->beta);
    get_field(S,num,"c",nIn,1,RF->c);
@@ -166,8 +182,8 @@ void create_RF_from_matlab(LWPR_ReceptiveField *RF, const LWPR_Model *model, con
    get_field(S,num,"P",nIn,nReg,RF->P);
    get_field(S,num,"H",nReg,1,RF->H);
    get_field(S,num,"r",nReg,1,RF->r);
-   get_field(S,num,"h",nIn,nIn,RF->h);   
-   get_field(S,num,"b",nIn,nIn,RF->b);      
+   get_tri_field(S,num,"h",nIn,RF->h);   
+   get_tri_field(S,num,"b",nIn,RF->b);      
    get_field(S,num,"sum_w",nReg,1,RF->sum_w);   
    get_field(S,num,"sum_e_cv2",nReg,1,RF->sum_e_cv2);      
    get_field(S,num,"sum_e2",1,1,&RF->sum_e2);   
@@ -186,9 +202,9 @@ void fill_matlab_from_RF(LWPR_ReceptiveField *RF, mxArray *S, int num) {
    int nIn = RF->model->nIn;
    int nReg = RF->nReg;
    
-   set_field(S,num, 0,nIn,nIn,RF->D);
-   set_field(S,num, 1,nIn,nIn,RF->M);
-   set_field(S,num, 2,nIn,nIn,RF->alpha);
+   set_tri_field(S,num, 0,nIn,RF->D,1);
+   set_tri_field(S,num, 1,nIn,RF->M,0);
+   set_tri_field(S,num, 2,nIn,RF->alpha,0);
    set_field(S,num, 3,1,1,&RF->beta0);
    set_field(S,num, 4,nReg,1,RF->beta);
    set_field(S,num, 5,nIn,1,RF->c);
@@ -200,8 +216,8 @@ void fill_matlab_from_RF(LWPR_ReceptiveField *RF, mxArray *S, int num) {
    set_field(S,num,11,nIn,nReg,RF->P);
    set_field(S,num,12,nReg,1,RF->H);
    set_field(S,num,13,nReg,1,RF->r);
-   set_field(S,num,14,nIn,nIn,RF->h);   
-   set_field(S,num,15,nIn,nIn,RF->b);      
+   set_tri_field(S,num,14,nIn,RF->h,0);   
+   set_tri_field(S,num,15,nIn,RF->b,0);      
    set_field(S,num,16,nReg,1,RF->sum_w);   
    set_field(S,num,17,nReg,1,RF->sum_e_cv2);      
    set_field(S,num,18,1,1,&RF->sum_e2);   
@@ -234,6 +250,15 @@ void model_consts_from_matlab(LWPR_Model *model, const mxArray *S) {
 
    val = get_scalar_field(S,0,"meta");
    model->meta = (val!=0.0);
+   
+   /* no budget, since the MATLAB implementation does not know about it */
+   model->max_rfs = 0;
+   model->max_bytes = 0;
+   model->evict = LWPR_EVICT_REFUSE;
+   model->eager_slopes = 0;
+   model->early_exit = 0;
+   model->shared_geometry = 0;
+   model->reorder_every = 0;
 
    model->meta_rate = get_scalar_field(S,0,"meta_rate");
    model->penalty = get_scalar_field(S,0,"penalty");
@@ -272,6 +297,8 @@ mxArray *create_matlab_from_model(LWPR_Model *model) {
    mxArray *S;
    mxArray *sub;
    
+   if (model->inference_only) mexErrMsgTxt("Stripped (inference-only) models cannot be converted to MATLAB structures.");
+   
    S = mxCreateStructMatrix(1,1, MODEL_FIELDS, MODEL_FIELD_NAMES);
    if (S==NULL) mexErrMsgTxt("Couldn't create MATLAB model structure.");
    
@@ -32,30 +32,37 @@ int lwpr_mem_alloc_rf(LWPR_ReceptiveField *RF, const LWPR_Model *model, int nReg
    double *storage;
    int nIn = model->nIn;
    int nInS = model->nInStore;
+   int nTriS = LWPR_TRI_SIZE(nIn);
+   
+   if (nTriS&1) nTriS++;
    
    if (nRegStore < nReg) nRegStore = nReg;
    
    RF->nReg = nReg;
    RF->nRegStore = nRegStore;   
+   RF->pooled = 0;
    
    RF->model = model;
    
+   if (model->inference_only) return lwpr_mem_alloc_rf_slim(RF, model, nReg);
+   
    /* First allocate stuff independent of nReg:
-   **    D,M,alpha,h,b are nIn x nIn
+   **    D,M,alpha,h,b are nIn x nIn, but only the upper triangle
+   **                  is stored (nTriS = nIn*(nIn+1)/2, rounded up to even)
    **    mean_x, var_x are nIn x 1
    **           slope  is  nIn x 1
-   **      ==>  nIn * (5*nIn + 4)
+   **      ==>  5*nTriS + 4*nIn
    */
    
-   storage = RF->fixStorage = (double *) LWPR_CALLOC((size_t) (1 + nInS*(5*nIn + 4)), sizeof(double));
+   storage = RF->fixStorage = (double *) LWPR_CALLOC((size_t) (1 + 5*nTriS + 4*nInS), sizeof(double));
    if (storage==NULL) return 0;
    
    if (((intptr_t)((void *) storage)) & 8) storage++;
-   RF->alpha  = storage; storage+=nInS*nIn;
-   RF->D      = storage; storage+=nInS*nIn;
-   RF->M      = storage; storage+=nInS*nIn;
-   RF->h      = storage; storage+=nInS*nIn;
-   RF->b      = storage; storage+=nInS*nIn;
+   RF->alpha  = storage; storage+=nTriS;
+   RF->D      = storage; storage+=nTriS;
+   RF->M      = storage; storage+=nTriS;
+   RF->h      = storage; storage+=nTriS;
+   RF->b      = storage; storage+=nTriS;
    RF->c      = storage; storage+=nInS;   
    RF->mean_x = storage; storage+=nInS;
    RF->slope  = storage; storage+=nInS;
@@ -103,7 +110,78 @@ int lwpr_mem_alloc_rf(LWPR_ReceptiveField *RF, const LWPR_Model *model, int nReg
    RF->w = RF->beta0 = RF->sum_e2 = 0.0;
    RF->trustworthy = 0;
    RF->slopeReady = 0;
+   RF->last_active = model->n_data;
+
+   
+   return 1;
+}
 
+int lwpr_mem_alloc_rf_slim(LWPR_ReceptiveField *RF, const LWPR_Model *model, int nReg) {
+   double *storage;
+   int nIn = model->nIn;
+   int nInS = model->nInStore;
+   int nTriS = LWPR_TRI_SIZE(nIn);
+   
+   if (nTriS&1) nTriS++;
+   
+   RF->nReg = nReg;
+   RF->nRegStore = nReg;
+   RF->pooled = 0;
+   RF->model = model;
+   
+   /* Only what the prediction routines need:
+   **    M (or D if diag_only) is nIn x nIn (packed upper triangle)
+   **    c, mean_x, slope are nIn x 1
+   **      ==>  nTriS + 3*nIn
+   */
+   storage = RF->fixStorage = (double *) LWPR_CALLOC((size_t) (1 + nTriS + 3*nInS), sizeof(double));
+   if (storage==NULL) return 0;
+   
+   if (((intptr_t)((void *) storage)) & 8) storage++;
+   if (model->diag_only) {
+      RF->D = storage;
+      RF->M = NULL;
+   } else {
+      RF->M = storage;
+      RF->D = NULL;
+   }
+   storage+=nTriS;
+   RF->c      = storage; storage+=nInS;   
+   RF->mean_x = storage; storage+=nInS;
+   RF->slope  = storage;
+   
+   /* U and P first, so they stay aligned for any nReg */
+   storage = RF->varStorage = (double *) LWPR_CALLOC((size_t) (1 + nReg*(2*nInS + 5)), sizeof(double));
+   if (storage==NULL) {
+      LWPR_FREE(RF->fixStorage);
+      RF->fixStorage=NULL;
+      return 0;
+   }
+   
+   #ifdef MATLAB
+      if (model->isPersistent) {
+         mexMakeMemoryPersistent(RF->varStorage);
+         mexMakeMemoryPersistent(RF->fixStorage);
+      }
+   #endif   
+   
+   if (((intptr_t)((void *) storage)) & 8) storage++;
+   RF->U         = storage; storage+=nInS*nReg;
+   RF->P         = storage; storage+=nInS*nReg;
+   RF->beta      = storage; storage+=nReg;
+   RF->SSs2      = storage; storage+=nReg;
+   RF->sum_w     = storage; storage+=nReg;
+   RF->sum_e_cv2 = storage; storage+=nReg;
+   RF->n_data    = storage;
+   
+   RF->alpha = RF->h = RF->b = RF->var_x = NULL;
+   RF->SXresYres = RF->SSXres = RF->SSYres = NULL;
+   RF->H = RF->r = RF->lambda = RF->s = NULL;
+   
+   RF->w = RF->beta0 = RF->sum_e2 = RF->SSp = 0.0;
+   RF->trustworthy = 0;
+   RF->slopeReady = 0;
+   RF->last_active = model->n_data;
    
    return 1;
 }
@@ -145,6 +223,48 @@ int lwpr_mem_realloc_rf(LWPR_ReceptiveField *RF, int nRegStore) {
    return 1;
 }
 
+size_t lwpr_mem_rf_bytes(const LWPR_Model *model, int nRegStore) {
+   int nIn = model->nIn;
+   int nInS = model->nInStore;
+   int nTriS = LWPR_TRI_SIZE(nIn);
+   
+   if (nTriS&1) nTriS++;
+   
+   /* same storage sizes as in lwpr_mem_alloc_rf and lwpr_mem_alloc_rf_slim */
+   if (model->inference_only) {
+      return sizeof(LWPR_ReceptiveField) + sizeof(LWPR_ReceptiveField *)
+            + sizeof(double) * (size_t) (2 + nTriS + 3*nInS + nRegStore*(2*nInS + 5));
+   }
+   return sizeof(LWPR_ReceptiveField) + sizeof(LWPR_ReceptiveField *)
+         + sizeof(double) * (size_t) (2 + 5*nTriS + 4*nInS + nRegStore*(4*nInS + 10));
+}
+
+/* Size of a receptive field's storage that does not depend on nReg, without alignment */
+static int lwpr_mem_fix_doubles(const LWPR_Model *model) {
+   int nInS = model->nInStore;
+   int nTriS = LWPR_TRI_SIZE(model->nIn);
+   
+   if (nTriS&1) nTriS++;
+   return model->inference_only ? (nTriS + 3*nInS) : (5*nTriS + 4*nInS);
+}
+
+size_t lwpr_mem_sub_bytes(const LWPR_SubModel *sub) {
+   size_t bytes = 0;
+   int i;
+   
+   for (i=0;i<sub->numRFS;i++) {
+      bytes += lwpr_mem_rf_bytes(sub->model, sub->rf[i]->nRegStore);
+      /* counted as part of the pool below */
+      if (sub->rf[i]->pooled) {
+         bytes -= sizeof(double) * (size_t) (1 + lwpr_mem_fix_doubles(sub->model));
+      }
+   }
+   if (sub->pool != NULL) {
+      bytes += sizeof(double) * (size_t) (1 + sub->poolSize*lwpr_mem_fix_doubles(sub->model));
+   }
+   return bytes;
+}
+
 void lwpr_mem_free_rf(LWPR_ReceptiveField *RF) {
    RF->nRegStore = 0;
    
@@ -152,6 +272,56 @@ void lwpr_mem_free_rf(LWPR_ReceptiveField *RF) {
    LWPR_FREE(RF->varStorage);
 }
 
+int lwpr_mem_pool_rfs(LWPR_SubModel *sub) {
+   const LWPR_Model *model = sub->model;
+   int i, slot;
+   double *pool, *storage;
+   
+   /* same layout as in lwpr_mem_alloc_rf and lwpr_mem_alloc_rf_slim, without the 
+   ** alignment padding. The slot size is even, so each slot stays aligned */
+   slot = lwpr_mem_fix_doubles(model);
+   
+   pool = (double *) LWPR_CALLOC((size_t) (1 + sub->numRFS*slot), sizeof(double));
+   if (pool == NULL) return 0;
+   #ifdef MATLAB
+      if (model->isPersistent) mexMakeMemoryPersistent(pool);
+   #endif   
+   
+   storage = pool;
+   if (((intptr_t)((void *) storage)) & 8) storage++;
+   
+   for (i=0;i<sub->numRFS;i++, storage+=slot) {
+      LWPR_ReceptiveField *RF = sub->rf[i];
+      /* the first array of the fixed-size variables */
+      double *base = model->inference_only ? (model->diag_only ? RF->D : RF->M) : RF->alpha;
+      
+      memcpy(storage, base, slot*sizeof(double));
+      
+#define LWPR_MEM_REBASE(p)  if ((p) != NULL) (p) = storage + ((p) - base)
+      LWPR_MEM_REBASE(RF->alpha);
+      LWPR_MEM_REBASE(RF->D);
+      LWPR_MEM_REBASE(RF->M);
+      LWPR_MEM_REBASE(RF->h);
+      LWPR_MEM_REBASE(RF->b);
+      LWPR_MEM_REBASE(RF->c);
+      LWPR_MEM_REBASE(RF->mean_x);
+      LWPR_MEM_REBASE(RF->slope);
+      LWPR_MEM_REBASE(RF->var_x);
+#undef LWPR_MEM_REBASE
+
+      if (!RF->pooled) {
+         LWPR_FREE(RF->fixStorage);
+         RF->fixStorage = NULL;
+         RF->pooled = 1;
+      }
+   }
+   
+   if (sub->pool != NULL) LWPR_FREE(sub->pool);
+   sub->pool = pool;
+   sub->poolSize = sub->numPooled = sub->numRFS;
+   return 1;
+}
+
 int lwpr_mem_alloc_model(LWPR_Model *model, int nIn, int nOut, int storeRFS) {
    int i,nInS;
    double *storage;
@@ -168,7 +338,7 @@ int lwpr_mem_alloc_model(LWPR_Model *model, int nIn, int nOut, int storeRFS) {
    }
    
    for (i=0;i<NUM_THREADS;i++) {
-      if (!lwpr_mem_alloc_ws(&model->ws[i],nIn)) {
+      if (!lwpr_mem_alloc_ws(&model->ws[i],nIn,nOut)) {
          int j;
          for (j=0;j<i;j++) lwpr_mem_free_ws(&model->ws[j]);
          LWPR_FREE(model->ws);
@@ -199,13 +369,19 @@ int lwpr_mem_alloc_model(LWPR_Model *model, int nIn, int nOut, int storeRFS) {
    model->yn = storage;
    
    model->name = NULL;
+   model->inference_only = 0;
    
    model->nOut = nOut;
    for (i=0;i<nOut;i++) {
       model->sub[i].n_pruned = 0;   
+      model->sub[i].n_evicted = 0;
       model->sub[i].numRFS = 0;
       model->sub[i].numPointers = storeRFS;
       model->sub[i].model = model;
+      model->sub[i].pool = NULL;
+      model->sub[i].poolSize = model->sub[i].numPooled = 0;
+      model->sub[i].dw = NULL;
+      model->sub[i].order = NULL;
       if (storeRFS>0) {
          model->sub[i].rf = (LWPR_ReceptiveField **) LWPR_CALLOC((size_t)storeRFS, sizeof(LWPR_ReceptiveField *));
          if (model->sub[i].rf == NULL) {
@@ -231,8 +407,13 @@ int lwpr_mem_alloc_model(LWPR_Model *model, int nIn, int nOut, int storeRFS) {
 
 int lwpr_mem_alloc_sub(LWPR_SubModel *sub, int storeRFS) {
    sub->n_pruned = 0;   
+   sub->n_evicted = 0;
    sub->numRFS = 0;
    sub->numPointers = storeRFS;
+   sub->pool = NULL;
+   sub->poolSize = sub->numPooled = 0;
+   sub->dw = NULL;
+   sub->order = NULL;
    sub->rf = (LWPR_ReceptiveField **) LWPR_CALLOC((size_t)storeRFS, sizeof(LWPR_ReceptiveField *));
       
    if (sub->rf == NULL) {
@@ -253,6 +434,9 @@ void lwpr_free_model(LWPR_Model *model) {
          LWPR_FREE(model->sub[i].rf[j]);
       }
       LWPR_FREE(model->sub[i].rf);
+      if (model->sub[i].pool != NULL) LWPR_FREE(model->sub[i].pool);
+      if (model->sub[i].dw != NULL) LWPR_FREE(model->sub[i].dw);
+      if (model->sub[i].order != NULL) LWPR_FREE(model->sub[i].order);
    }
    LWPR_FREE(model->sub);
 
@@ -265,7 +449,7 @@ void lwpr_free_model(LWPR_Model *model) {
 }
 
 
-int lwpr_mem_alloc_ws(LWPR_Workspace *ws, int nIn) {
+int lwpr_mem_alloc_ws(LWPR_Workspace *ws, int nIn, int nOut) {
    int nInS;
    double *storage;
    
@@ -275,7 +459,7 @@ int lwpr_mem_alloc_ws(LWPR_Workspace *ws, int nIn) {
    
    if (ws->derivOk == NULL) return 0;
    
-   ws->storage = storage = (double *) LWPR_CALLOC((size_t)(1 + 8*nInS*nIn + 7*nInS + 6*nIn), sizeof(double));
+   ws->storage = storage = (double *) LWPR_CALLOC((size_t)(1 + 8*nInS*nIn + 9*nInS + 6*nIn + 6*nOut), sizeof(double));
    
    if (storage == NULL) {
       LWPR_FREE(ws->derivOk);
@@ -304,6 +488,8 @@ int lwpr_mem_alloc_ws(LWPR_Workspace *ws, int nIn) {
    ws->sum_ydwdx_wdydx = storage; storage+=nInS;   
    ws->sum_ddwdxdx     = storage; storage+=nInS*nIn;      
    ws->sum_ddRdxdx     = storage; storage+=nInS*nIn;            
+   ws->vn              = storage; storage+=nInS;
+   ws->inv_norm        = storage; storage+=nInS;
    
    /* needs only nReg storage (<=nIn), no alignment necessary */
    ws->e_cv     = storage; storage+=nIn;   
@@ -312,6 +498,8 @@ int lwpr_mem_alloc_ws(LWPR_Workspace *ws, int nIn) {
    ws->ytarget  = storage; storage+=nIn;         
    ws->yres     = storage; storage+=nIn;            
    ws->s        = storage; storage+=nIn;            
+   ws->sum_out  = storage; storage+=2*nOut;
+   ws->metric_derivs = storage; storage+=4*nOut;
    
    return 1;
 }
@@ -58,6 +58,31 @@ void lwpr_xml_write_matrix(FILE *fp, int level, const char *name, int M, int Ms,
    fprintf(fp,"</matrix>\n");
 }
 
+void lwpr_xml_write_tri(FILE *fp, int level, const char *name, int N, const double *val, int symmetric) {
+   int m,n,l;
+   double abs0 = fabs(val[0]);
+   const char *fmt;
+
+   for (l=0;l<level;l++) fprintf(fp,"\t");
+   fprintf(fp,"<matrix name='%s' rows='%d' columns='%d'>\n",name,N,N);
+
+   fmt = (abs0 != 0.0 && (abs0 >= 1000 || abs0 < 0.01)) ? " %12.6e" : " %12.6f";
+   
+   for (m=0;m<N;m++) {
+      for (l=0;l<level;l++) fprintf(fp,"\t");
+      for (n=0;n<N;n++) {
+         if (m<=n) {
+            fprintf(fp,fmt,val[LWPR_TRI(m,n)]);
+         } else {
+            fprintf(fp,fmt,symmetric ? val[LWPR_TRI(n,m)] : 0.0);
+         }
+      }
+      fprintf(fp,"\n");
+   }
+   for (l=0;l<level;l++) fprintf(fp,"\t");
+   fprintf(fp,"</matrix>\n");
+}
+
 void lwpr_xml_write_vector(FILE *fp, int level, const char *name, int N, const double *val) {
    int n,l;
    double abs0 = fabs(val[0]);
@@ -108,9 +133,9 @@ void lwpr_xml_write_rf(FILE *fp, const LWPR_ReceptiveField *RF) {
    int nReg = RF->nReg;
 
    fprintf(fp,"\t\t<ReceptiveField nReg='%d'>\n",RF->nReg);
-   lwpr_xml_write_matrix(fp,3,"D",nIn,nInS,nIn,RF->D);
-   lwpr_xml_write_matrix(fp,3,"M",nIn,nInS,nIn,RF->M);
-   lwpr_xml_write_matrix(fp,3,"alpha",nIn,nInS,nIn,RF->alpha);
+   lwpr_xml_write_tri(fp,3,"D",nIn,RF->D,1);
+   lwpr_xml_write_tri(fp,3,"M",nIn,RF->M,0);
+   lwpr_xml_write_tri(fp,3,"alpha",nIn,RF->alpha,0);
    lwpr_xml_write_scalar(fp,3,"beta0",RF->beta0);
    lwpr_xml_write_vector(fp,3,"beta",nReg,RF->beta);
    lwpr_xml_write_vector(fp,3,"c",nIn,RF->c);
@@ -122,8 +147,8 @@ void lwpr_xml_write_rf(FILE *fp, const LWPR_ReceptiveField *RF) {
    lwpr_xml_write_matrix(fp,3,"P",nIn,nInS,nReg,RF->P);
    lwpr_xml_write_vector(fp,3,"H",nReg,RF->H);
    lwpr_xml_write_vector(fp,3,"r",nReg,RF->r);
-   lwpr_xml_write_matrix(fp,3,"h",nIn,nInS,nIn,RF->h);
-   lwpr_xml_write_matrix(fp,3,"b",nIn,nInS,nIn,RF->b);
+   lwpr_xml_write_tri(fp,3,"h",nIn,RF->h,0);
+   lwpr_xml_write_tri(fp,3,"b",nIn,RF->b,0);
    lwpr_xml_write_vector(fp,3,"sum_w",nReg,RF->sum_w);
    lwpr_xml_write_vector(fp,3,"sum_e_cv2",nReg,RF->sum_e_cv2);
    lwpr_xml_write_scalar(fp,3,"sum_e2",RF->sum_e2);
@@ -142,17 +167,13 @@ void lwpr_xml_write_rf(FILE *fp, const LWPR_ReceptiveField *RF) {
 void lwpr_write_xml_fp(const LWPR_Model *model, FILE *fp) {
    int dim;
    const char *kern_name;
+   const LWPR_KernelInfo *kern = lwpr_kernel_info(model->kernel);
+   int budget = (model->max_rfs > 0 || model->max_bytes > 0 || model->evict != LWPR_EVICT_REFUSE);
+   
+   /* The XML format requires the complete training statistics */
+   if (model->inference_only) return;
 
-   switch(model->kernel) {
-      case LWPR_GAUSSIAN_KERNEL:
-         kern_name = "Gaussian";
-         break;
-      case LWPR_BISQUARE_KERNEL:
-         kern_name = "BiSquare";
-         break;
-      default:
-         kern_name = "Unknown";
-   }
+   kern_name = (kern != NULL) ? kern->name : "Unknown";
 
    fprintf(fp,"<?xml version='1.0' encoding='US-ASCII' ?>\n");
 
@@ -183,11 +204,18 @@ void lwpr_write_xml_fp(const LWPR_Model *model, FILE *fp) {
    lwpr_xml_write_scalar(fp,1,"tau_lambda",model->tau_lambda);
    lwpr_xml_write_scalar(fp,1,"init_S2",model->init_S2);
    lwpr_xml_write_scalar(fp,1,"add_threshold",model->add_threshold);
+   /* Only written if set, so files without a budget stay free of warnings in older versions */
+   if (budget) {
+      lwpr_xml_write_int(fp,1,"max_rfs",model->max_rfs);
+      lwpr_xml_write_scalar(fp,1,"max_bytes",(double) model->max_bytes);
+      lwpr_xml_write_int(fp,1,"evict",(int) model->evict);
+   }
    for (dim=0;dim<model->nOut;dim++) {
       int num;
       const LWPR_SubModel *sub = &model->sub[dim];
       fprintf(fp,"\t<SubModel out_dim='%d' numRFS='%d'>\n",dim,sub->numRFS);
       lwpr_xml_write_int(fp,2,"n_pruned",sub->n_pruned);
+      if (budget) lwpr_xml_write_int(fp,2,"n_evicted",sub->n_evicted);
       for (num=0;num<sub->numRFS;num++) {
          lwpr_xml_write_rf(fp,sub->rf[num]);
       }
@@ -198,6 +226,8 @@ void lwpr_write_xml_fp(const LWPR_Model *model, FILE *fp) {
 
 int lwpr_write_xml(const LWPR_Model *model, const char *filename) {
    FILE *fp;
+   
+   if (model->inference_only) return 0;
 
    fp = fopen(filename,"w");
    if (fp==NULL) return 0;
@@ -351,6 +381,7 @@ void lwpr_xml_start_element(void *userData, const char *name, const char **atts)
    LWPR_ReceptiveField *RF=NULL;
 
    ud->readN = ud->readM = ud->N = ud->M = 0;
+   ud->packed = 0;
 
    if (model->sub!=NULL) {
       sub = &(model->sub[ud->curSub]);
@@ -399,16 +430,15 @@ void lwpr_xml_start_element(void *userData, const char *name, const char **atts)
             } else if (!strcmp(at[0],"nOut")) {
                nOut = atoi(at[1]);
             } else if (!strcmp(at[0],"kernel")) {
+               int k = lwpr_kernel_by_name(at[1]);
                kern = LWPR_GAUSSIAN_KERNEL;
-               if (!strcmp(at[1],"BiSquare")) {
-                  kern = LWPR_BISQUARE_KERNEL;
+               if (k >= 0) {
+                  kern = (LWPR_Kernel) k;
                } else if (!strcmp(at[1],"Bisquare")) {
                   kern = LWPR_BISQUARE_KERNEL;
                } else {
-                  if (strcmp(at[1],"Gaussian")) {
-                     ud->numWarnings++;
-                     if (ud->errFile) fprintf(ud->errFile,"Unknown kernel, using Gaussian.\n");
-                  }
+                  ud->numWarnings++;
+                  if (ud->errFile) fprintf(ud->errFile,"Unknown kernel, using Gaussian.\n");
                }
             }
             at+=2;
@@ -466,6 +496,10 @@ void lwpr_xml_start_element(void *userData, const char *name, const char **atts)
                ud->curPtr = (void *) &(model->update_D);
             } else if (!strcmp(fieldName,"meta")) {
                ud->curPtr = (void *) &(model->meta);
+            } else if (!strcmp(fieldName,"max_rfs")) {
+               ud->curPtr = (void *) &(model->max_rfs);
+            } else if (!strcmp(fieldName,"evict")) {
+               ud->curPtr = (void *) &(ud->evict);
             } else {
                lwpr_xml_report_unknown(ud,fieldName);
             }
@@ -490,6 +524,8 @@ void lwpr_xml_start_element(void *userData, const char *name, const char **atts)
                ud->curPtr = (void *) &(model->init_S2);
             } else if (!strcmp(fieldName,"add_threshold")) {
                ud->curPtr = (void *) &(model->add_threshold);
+            } else if (!strcmp(fieldName,"max_bytes")) {
+               ud->curPtr = (void *) &(ud->maxBytes);
             } else {
                lwpr_xml_report_unknown(ud,fieldName);
             }
@@ -571,6 +607,11 @@ void lwpr_xml_start_element(void *userData, const char *name, const char **atts)
          ud->N = 1;
          return;
       }
+      if (ud->curType == 1 && !strcmp(fieldName,"n_evicted")) {
+         ud->curPtr = (void *) &sub->n_evicted;
+         ud->N = 1;
+         return;
+      }
       if (ud->curType == 0) {
          lwpr_xml_report_unknown(ud,name);
       } else {
@@ -661,18 +702,23 @@ void lwpr_xml_start_element(void *userData, const char *name, const char **atts)
             if (!strcmp(fieldName,"D")) {
                ud->curPtr = (void *) RF->D;
                wishM = wishN = model->nIn;
+               ud->packed = 1;
             } else if (!strcmp(fieldName,"M")) {
                ud->curPtr = (void *) RF->M;
                wishM = wishN = model->nIn;
+               ud->packed = 1;
             } else if (!strcmp(fieldName,"alpha")) {
                ud->curPtr = (void *) RF->alpha;
                wishM = wishN = model->nIn;
+               ud->packed = 1;
             } else if (!strcmp(fieldName,"b")) {
                ud->curPtr = (void *) RF->b;
                wishM = wishN = model->nIn;
+               ud->packed = 1;
             } else if (!strcmp(fieldName,"h")) {
                ud->curPtr = (void *) RF->h;
                wishM = wishN = model->nIn;
+               ud->packed = 1;
             } else if (!strcmp(fieldName,"SXresYres")) {
                ud->curPtr = (void *) RF->SXresYres;
                wishM = model->nIn;
@@ -816,7 +862,11 @@ void lwpr_xml_handle_data(void *userData, const char *s, int len) {
                lwpr_xml_error(ud,"Too many elemtents in matrix field.\n");
                break;
             }
-            dest[ud->readM + ud->readN*ud->MS] = dVal;
+            if (!ud->packed) {
+               dest[ud->readM + ud->readN*ud->MS] = dVal;
+            } else if (ud->readM <= ud->readN) {
+               dest[LWPR_TRI(ud->readM, ud->readN)] = dVal;
+            }
             if (++ud->readN == ud->N) {
                if (++ud->readM < ud->M) ud->readN=0;
             }
@@ -886,6 +936,8 @@ int lwpr_read_xml(LWPR_Model *model, const char *filename, int *numWarnings) {
    ud.model = model;
    ud.numErrors = ud.numWarnings = 0;
    ud.errFile = stderr;
+   ud.maxBytes = 0.0;
+   ud.evict = (int) LWPR_EVICT_REFUSE;
 
    parser = XML_ParserCreate("US-ASCII");
    XML_SetUserData(parser,&ud);
@@ -898,6 +950,16 @@ int lwpr_read_xml(LWPR_Model *model, const char *filename, int *numWarnings) {
 
    LWPR_FREE(buffer);
    if (numWarnings!=NULL) *numWarnings = ud.numWarnings;
+   
+   if (model->sub != NULL) {
+      model->max_bytes = (ud.maxBytes > 0.0) ? (size_t) ud.maxBytes : 0;
+      if (ud.evict < (int) LWPR_EVICT_REFUSE || ud.evict > (int) LWPR_EVICT_LEAST_DATA) {
+         ud.numErrors++;
+         if (ud.errFile) fprintf(ud.errFile,"Invalid eviction policy.\n");
+      } else {
+         model->evict = (LWPR_EvictionPolicy) ud.evict;
+      }
+   }
 
    return ud.numErrors;
 }
@@ -23,10 +23,10 @@ Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
 #include <stdio.h>
 #include <math.h>
 #include <stdlib.h>
+#include <time.h>
 
 #ifdef WIN32
 
-#include <time.h>
 #define SEED_RAND()     srand(time(NULL))
 #define URAND()         (((double)rand())/ (double)RAND_MAX)
 
@@ -0,0 +1,29 @@
+# Checks that LWPR models survive pickling (see __reduce__ / __setstate__).
+import pickle
+from numpy import *
+from lwpr import LWPR
+
+random.seed(1)
+Ntr = 500
+Xtr = 2 * random.random((Ntr, 2)) - 1
+Ytr = sin(3 * Xtr[:, :1]) * cos(2 * Xtr[:, 1:])
+
+model = LWPR(2, 1)
+model.init_D = 30 * eye(2)
+model.update_D = True
+model.diag_only = False
+model.update_batch(Xtr, Ytr)
+
+for protocol in range(pickle.HIGHEST_PROTOCOL + 1):
+    copy = pickle.loads(pickle.dumps(model, protocol))
+    assert copy.nIn == model.nIn and copy.nOut == model.nOut
+    assert copy.n_data == model.n_data
+    assert all(copy.num_rfs == model.num_rfs)
+    assert array_equal(copy.predict_batch(Xtr), model.predict_batch(Xtr))
+
+# The restored model must be independent of the original
+copy = pickle.loads(pickle.dumps(model))
+copy.update_batch(Xtr, Ytr)
+assert copy.n_data == 2 * model.n_data
+
+print("OK")
@@ -0,0 +1,102 @@
+/*********************************************************************
+LWPR: A library for incremental online learning
+Copyright (C) 2007  Stefan Klanke, Sethu Vijayakumar
+Contact: sethu.vijayakumar@ed.ac.uk
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Library General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free
+Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*********************************************************************/
+#include <lwpr.h>
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include "test_util.h"
+
+#define NIN       3
+#define NOUT      2
+#define LDX       5
+#define LDY       3
+#define MAXN      500
+#define CUTOFF    0.001
+
+static int differs(double a, double b) {
+   return fabs(a-b) > 1e-12*(1.0+fabs(b));
+}
+
+/* Checks batches of N inputs (with strides LDX and LDY) against per-sample calls */
+void testBatch(const LWPR_Model *model, int N) {
+   static double X[LDX*MAXN],Y[LDY*MAXN],conf[LDY*MAXN],max_w[LDY*MAXN];
+   static double J[NOUT*NIN*MAXN];
+   double y[NOUT],c[NOUT],w[NOUT],Jn[NOUT*NIN];
+   int n,i,k;
+
+   for (i=0;i<LDX*N;i++) X[i] = 2.0*URAND()-1.0;
+   /* padding entries must be left alone */
+   for (i=0;i<LDY*N;i++) Y[i] = conf[i] = max_w[i] = -1.0;
+
+   lwpr_predict_batch(model,N,X,LDX,CUTOFF,Y,LDY,conf,max_w);
+   for (n=0;n<N;n++) {
+      lwpr_predict(model,X+n*LDX,CUTOFF,y,c,w);
+      for (k=0;k<NOUT;k++) {
+         if (differs(Y[n*LDY+k],y[k])) fail("lwpr_predict_batch: wrong prediction");
+         if (differs(conf[n*LDY+k],c[k])) fail("lwpr_predict_batch: wrong confidence bound");
+         if (differs(max_w[n*LDY+k],w[k])) fail("lwpr_predict_batch: wrong activation");
+      }
+      for (k=NOUT;k<LDY;k++) {
+         if (Y[n*LDY+k]!=-1.0 || conf[n*LDY+k]!=-1.0 || max_w[n*LDY+k]!=-1.0) {
+            fail("lwpr_predict_batch: wrote beyond nOut");
+         }
+      }
+   }
+
+   for (i=0;i<LDY*N;i++) Y[i] = -1.0;
+   lwpr_predict_J_batch(model,N,X,LDX,CUTOFF,Y,LDY,J);
+   for (n=0;n<N;n++) {
+      lwpr_predict_J(model,X+n*LDX,CUTOFF,y,Jn);
+      for (k=0;k<NOUT;k++) {
+         if (differs(Y[n*LDY+k],y[k])) fail("lwpr_predict_J_batch: wrong prediction");
+      }
+      for (k=NOUT;k<LDY;k++) {
+         if (Y[n*LDY+k]!=-1.0) fail("lwpr_predict_J_batch: wrote beyond nOut");
+      }
+      for (i=0;i<NOUT*NIN;i++) {
+         if (differs(J[n*NOUT*NIN+i],Jn[i])) fail("lwpr_predict_J_batch: wrong Jacobian");
+      }
+   }
+}
+
+int main() {
+   LWPR_Model model;
+   double x[NIN],y[NOUT];
+   int n;
+
+   srand(1);
+   lwpr_init_model(&model,NIN,NOUT,"batch");
+   lwpr_set_init_D_spherical(&model,10);
+   for (n=0;n<3000;n++) {
+      sample(NIN,NOUT,x,y);
+      lwpr_update(&model,x,y,NULL,NULL);
+   }
+   printf("%d and %d RFs\n", model.sub[0].numRFS, model.sub[1].numRFS);
+
+   /* N smaller than, equal to and much larger than NUM_THREADS */
+   testBatch(&model,1);
+   testBatch(&model,2);
+   testBatch(&model,3);
+   testBatch(&model,7);
+   testBatch(&model,MAXN);
+   lwpr_free_model(&model);
+   printf("OK\n");
+   return 0;
+}
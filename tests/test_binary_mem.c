@@ -0,0 +1,107 @@
+/*********************************************************************
+LWPR: A library for incremental online learning
+Copyright (C) 2007  Stefan Klanke, Sethu Vijayakumar
+Contact: sethu.vijayakumar@ed.ac.uk
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Library General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free
+Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*********************************************************************/
+#include <lwpr.h>
+#include <lwpr_binio.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <stdlib.h>
+#include "test_util.h"
+
+#define NIN    2
+#define NOUT   2
+
+int samePredictions(const LWPR_Model *a, const LWPR_Model *b) {
+   double x[NIN],y[NOUT],ya[NOUT],yb[NOUT],ca[NOUT],cb[NOUT];
+   int n,i;
+   for (n=0;n<200;n++) {
+      sample(NIN,NOUT,x,y);
+      lwpr_predict(a,x,0.001,ya,ca,NULL);
+      lwpr_predict(b,x,0.001,yb,cb,NULL);
+      for (i=0;i<NOUT;i++) {
+         if (ya[i] != yb[i] || ca[i] != cb[i]) return 0;
+      }
+   }
+   return 1;
+}
+
+/* Serialises the model into memory and checks the buffer against the binary file */
+void testModel(const LWPR_Model *model) {
+   LWPR_Model loaded;
+   size_t size = lwpr_binary_size(model);
+   char *buf, *file;
+   FILE *fp;
+
+   if (size == 0) fail("lwpr_binary_size failed");
+   buf = (char *) malloc(size);
+   file = (char *) malloc(size+1);
+   if (buf == NULL || file == NULL) fail("Out of memory");
+
+   if (lwpr_write_binary_mem(model, buf, size-1)) fail("lwpr_write_binary_mem accepted a buffer that is too small");
+   if (!lwpr_write_binary_mem(model, buf, size)) fail("lwpr_write_binary_mem failed");
+
+   /* the buffer must hold exactly what lwpr_write_binary() stores */
+   if (!lwpr_write_binary(model, "lwpr_mem.bin")) fail("Could not write binary file");
+   fp = fopen("lwpr_mem.bin","rb");
+   if (fp == NULL) fail("Could not open binary file");
+   if (fread(file, 1, size+1, fp) != size) fail("lwpr_binary_size does not match the file size");
+   fclose(fp);
+   remove("lwpr_mem.bin");
+   if (memcmp(buf, file, size)) fail("Buffer differs from binary file");
+
+   if (lwpr_read_binary_mem(&loaded, buf, size-1)) fail("lwpr_read_binary_mem accepted a truncated buffer");
+   if (lwpr_read_binary_mem(&loaded, buf, 0)) fail("lwpr_read_binary_mem accepted an empty buffer");
+   if (!lwpr_read_binary_mem(&loaded, buf, size)) fail("lwpr_read_binary_mem failed");
+   if (loaded.sub[0].numRFS != model->sub[0].numRFS || loaded.sub[1].numRFS != model->sub[1].numRFS
+         || loaded.n_data != model->n_data || loaded.inference_only != model->inference_only) {
+      fail("Model read from memory differs");
+   }
+   if (!samePredictions(model, &loaded)) fail("Model read from memory predicts differently");
+
+   printf("%s model: %d+%d RFs, %u bytes\n", model->inference_only ? "Slim" : "Full",
+         model->sub[0].numRFS, model->sub[1].numRFS, (unsigned int) size);
+
+   lwpr_free_model(&loaded);
+   free(file);
+   free(buf);
+}
+
+int main() {
+   LWPR_Model model;
+   double x[NIN],y[NOUT];
+   int n;
+
+   srand(1);
+   lwpr_init_model(&model,NIN,NOUT,"binary_mem");
+   lwpr_set_init_D_spherical(&model,30);
+   model.diag_only = 0;
+   for (n=0;n<2000;n++) {
+      sample(NIN,NOUT,x,y);
+      lwpr_update(&model,x,y,NULL,NULL);
+   }
+   testModel(&model);
+
+   if (!lwpr_strip_for_inference(&model)) fail("Could not strip model");
+   testModel(&model);
+
+   lwpr_free_model(&model);
+   printf("OK\n");
+   return 0;
+}
@@ -0,0 +1,200 @@
+/*********************************************************************
+LWPR: A library for incremental online learning
+Copyright (C) 2007  Stefan Klanke, Sethu Vijayakumar
+Contact: sethu.vijayakumar@ed.ac.uk
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Library General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free
+Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*********************************************************************/
+#include <lwpr.h>
+#include <lwpr_aux.h>
+#include <lwpr_mem.h>
+#include <lwpr_xml.h>
+#include <lwpr_binio.h>
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include "test_util.h"
+
+/* Snapshot of a receptive field, identified by its centre */
+typedef struct {
+   double c0, c1;
+   int last_active;
+   double n_data;
+} RFInfo;
+
+void init(LWPR_Model *model, int max_rfs, size_t max_bytes, LWPR_EvictionPolicy evict) {
+   lwpr_init_model(model,2,1,"budget");
+   lwpr_set_init_D_spherical(model,50);
+   model->max_rfs = max_rfs;
+   model->max_bytes = max_bytes;
+   model->evict = evict;
+}
+
+int snapshot(const LWPR_SubModel *sub, RFInfo *info) {
+   int i;
+   for (i=0;i<sub->numRFS;i++) {
+      info[i].c0 = sub->rf[i]->c[0];
+      info[i].c1 = sub->rf[i]->c[1];
+      info[i].last_active = sub->rf[i]->last_active;
+      info[i].n_data = sub->rf[i]->n_data[0];
+   }
+   return sub->numRFS;
+}
+
+int find(const RFInfo *info, int num, const LWPR_ReceptiveField *RF) {
+   int i;
+   for (i=0;i<num;i++) {
+      if (info[i].c0 == RF->c[0] && info[i].c1 == RF->c[1]) return i;
+   }
+   return -1;
+}
+
+/* Trains with a budget of max_rfs and checks after each eviction that the removed
+** receptive field is the one the policy should have chosen among those that were
+** not touched by the update */
+void testPolicy(LWPR_EvictionPolicy evict, int max_rfs) {
+   LWPR_Model model;
+   RFInfo before[64];
+   int survived[64];
+   double x[2],y[1];
+   int n,i,k,numBefore,numEvictions = 0;
+
+   init(&model, max_rfs, 0, evict);
+   for (n=0;n<3000;n++) {
+      int evicted = model.sub[0].n_evicted;
+
+      numBefore = snapshot(&model.sub[0], before);
+      sample(2,1,x,y);
+      lwpr_update(&model,x,y,NULL,NULL);
+
+      if (model.sub[0].numRFS > max_rfs) fail("Number of receptive fields exceeds max_rfs");
+      if (evict == LWPR_EVICT_REFUSE && model.sub[0].n_evicted != 0) fail("Receptive fields evicted with LWPR_EVICT_REFUSE");
+      if (model.sub[0].n_evicted == evicted) continue;
+      if (model.sub[0].n_evicted != evicted+1) fail("More than one eviction for one new receptive field");
+      numEvictions++;
+
+      for (k=0;k<numBefore;k++) survived[k] = 0;
+      for (i=0;i<model.sub[0].numRFS;i++) {
+         k = find(before, numBefore, model.sub[0].rf[i]);
+         if (k>=0) survived[k] = 1;
+      }
+      for (k=0;k<numBefore;k++) {
+         if (survived[k]) continue;
+         /* k was evicted, compare with all untouched survivors */
+         for (i=0;i<model.sub[0].numRFS;i++) {
+            const LWPR_ReceptiveField *RF = model.sub[0].rf[i];
+            int j = find(before, numBefore, RF);
+
+            if (j<0 || RF->last_active != before[j].last_active) continue;
+            if (evict == LWPR_EVICT_LEAST_RECENT && RF->last_active < before[k].last_active) {
+               fail("LWPR_EVICT_LEAST_RECENT did not evict the least recently active receptive field");
+            }
+            if (evict == LWPR_EVICT_LEAST_DATA && RF->n_data[0] < before[k].n_data) {
+               fail("LWPR_EVICT_LEAST_DATA did not evict the receptive field with the least data");
+            }
+         }
+      }
+   }
+   printf("Policy %d: %d RFs, %d evictions, %d pruned\n", (int) evict, model.sub[0].numRFS,
+         model.sub[0].n_evicted, model.sub[0].n_pruned);
+   if (evict != LWPR_EVICT_REFUSE && numEvictions == 0) fail("No receptive field was evicted");
+   lwpr_free_model(&model);
+}
+
+/* Checks that max_bytes holds during training, also after the receptive fields were
+** moved into one pool by lwpr_reorder_rfs */
+void testBytes(void) {
+   LWPR_Model model;
+   double x[2],y[1];
+   size_t max_bytes;
+   int n;
+
+   init(&model, 0, 0, LWPR_EVICT_LEAST_RECENT);
+   max_bytes = 20*lwpr_mem_rf_bytes(&model, 4);
+   model.max_bytes = max_bytes;
+   model.reorder_every = 250;
+
+   for (n=0;n<5000;n++) {
+      sample(2,1,x,y);
+      lwpr_update(&model,x,y,NULL,NULL);
+      if (lwpr_mem_sub_bytes(&model.sub[0]) > max_bytes) fail("Submodel exceeds max_bytes");
+   }
+   printf("max_bytes = %u: %d RFs, %u bytes, %d evictions\n", (unsigned int) max_bytes,
+         model.sub[0].numRFS, (unsigned int) lwpr_mem_sub_bytes(&model.sub[0]), model.sub[0].n_evicted);
+   if (model.sub[0].n_evicted == 0) fail("No receptive field was evicted");
+   lwpr_free_model(&model);
+}
+
+void checkBudget(const LWPR_Model *a, const LWPR_Model *b, const char *format) {
+   if (a->max_rfs != b->max_rfs || a->max_bytes != b->max_bytes || a->evict != b->evict
+         || a->sub[0].n_evicted != b->sub[0].n_evicted) {
+      fprintf(stderr,"Budget was not restored from %s file\n",format);
+      exit(1);
+   }
+}
+
+void testFiles(void) {
+   LWPR_Model model, loaded;
+   double x[2],y[1];
+   int n;
+
+   init(&model, 20, 1000000, LWPR_EVICT_LEAST_DATA);
+   for (n=0;n<2000;n++) {
+      sample(2,1,x,y);
+      lwpr_update(&model,x,y,NULL,NULL);
+   }
+
+   if (!lwpr_write_binary(&model,"lwpr_budget.dat")) fail("Could not write binary file");
+   n = lwpr_read_binary(&loaded,"lwpr_budget.dat");
+   remove("lwpr_budget.dat");
+   if (!n) fail("Could not read binary file");
+   checkBudget(&model, &loaded, "binary");
+   lwpr_free_model(&loaded);
+
+#if HAVE_LIBEXPAT
+   lwpr_write_xml(&model,"lwpr_budget.xml");
+   n = lwpr_read_xml(&loaded,"lwpr_budget.xml",NULL);
+   remove("lwpr_budget.xml");
+   if (n != 0) fail("Could not read XML file");
+   checkBudget(&model, &loaded, "XML");
+   lwpr_free_model(&loaded);
+#endif
+
+   /* Out-of-range eviction policies are rejected */
+   model.evict = (LWPR_EvictionPolicy) 7;
+   if (!lwpr_write_binary(&model,"lwpr_budget.dat")) fail("Could not write binary file");
+   n = lwpr_read_binary(&loaded,"lwpr_budget.dat");
+   remove("lwpr_budget.dat");
+   if (n) fail("Invalid eviction policy accepted from binary file");
+#if HAVE_LIBEXPAT
+   lwpr_write_xml(&model,"lwpr_budget.xml");
+   n = lwpr_read_xml(&loaded,"lwpr_budget.xml",NULL);
+   remove("lwpr_budget.xml");
+   if (n == 0) fail("Invalid eviction policy accepted from XML file");
+   lwpr_free_model(&loaded);
+#endif
+   lwpr_free_model(&model);
+}
+
+int main() {
+   srand(1);
+   testPolicy(LWPR_EVICT_REFUSE, 20);
+   testPolicy(LWPR_EVICT_LEAST_RECENT, 20);
+   testPolicy(LWPR_EVICT_LEAST_DATA, 20);
+   testBytes();
+   testFiles();
+   printf("OK\n");
+   return 0;
+}
@@ -0,0 +1,94 @@
+/*********************************************************************
+LWPR: A library for incremental online learning
+Copyright (C) 2007  Stefan Klanke, Sethu Vijayakumar
+Contact: sethu.vijayakumar@ed.ac.uk
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Library General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free
+Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*********************************************************************/
+#include <lwpr.h>
+#include <lwpr_cursor.h>
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include "test_util.h"
+
+#define NIN       2
+#define NOUT      2
+#define CUTOFF    0.001
+
+void train(LWPR_Model *model, int N) {
+   double x[NIN],y[NOUT];
+   int n;
+   for (n=0;n<N;n++) {
+      sample(NIN,NOUT,x,y);
+      lwpr_update(model,x,y,NULL,NULL);
+   }
+}
+
+/* Walks along a circle and compares the cursor with a full scan by lwpr_predict */
+void walk(LWPR_QueryCursor *qc, const LWPR_Model *model, int steps, double phase) {
+   double x[NIN],yc[NOUT],yp[NOUT],wc[NOUT],wp[NOUT];
+   int n,i;
+
+   for (n=0;n<steps;n++) {
+      double t = phase + 0.01*n;
+      x[0] = 0.8*cos(t);
+      x[1] = 0.6*sin(2*t);
+
+      if (!lwpr_cursor_predict(qc,x,yc,wc)) fail("Cursor could not allocate memory");
+      lwpr_predict(model,x,CUTOFF,yp,NULL,wp);
+      for (i=0;i<NOUT;i++) {
+         if (fabs(yc[i]-yp[i]) > 1e-12) fail("Cursor prediction differs from full scan");
+         if (wp[i] > CUTOFF && fabs(wc[i]-wp[i]) > 1e-12) fail("Cursor maximum activation differs from full scan");
+      }
+   }
+}
+
+int main() {
+   LWPR_Model model;
+   LWPR_QueryCursor qc;
+   int fullScans;
+
+   srand(1);
+   lwpr_init_model(&model,NIN,NOUT,"cursor");
+   lwpr_set_init_D_spherical(&model,50);
+   train(&model,5000);
+   printf("%d and %d RFs\n", model.sub[0].numRFS, model.sub[1].numRFS);
+
+   if (!lwpr_cursor_init(&qc,&model,CUTOFF)) fail("Could not initialise cursor");
+   walk(&qc,&model,1000,0.0);
+   printf("%d queries, %d full scans\n", qc.queries, qc.full_scans);
+   if (qc.full_scans >= qc.queries/10) fail("Cursor did not avoid full scans");
+
+   /* Updates in between must trigger a new full scan */
+   fullScans = qc.full_scans;
+   train(&model,500);
+   walk(&qc,&model,100,1.0);
+   if (qc.full_scans == fullScans) fail("No full scan after update");
+
+   /* Jumps along the trajectory */
+   lwpr_cursor_reset(&qc);
+   walk(&qc,&model,100,3.0);
+
+   /* RF indices change after reordering */
+   if (!lwpr_reorder_rfs(&model)) fail("Could not reorder RFs");
+   lwpr_cursor_reset(&qc);
+   walk(&qc,&model,300,4.0);
+
+   lwpr_cursor_free(&qc);
+   lwpr_free_model(&model);
+   printf("OK\n");
+   return 0;
+}
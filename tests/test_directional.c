@@ -0,0 +1,122 @@
+/*********************************************************************
+LWPR: A library for incremental online learning
+Copyright (C) 2007  Stefan Klanke, Sethu Vijayakumar
+Contact: sethu.vijayakumar@ed.ac.uk
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Library General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free
+Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*********************************************************************/
+#include <lwpr.h>
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include "test_util.h"
+
+#define NIN       3
+#define NOUT      2
+#define CUTOFF    0.001
+
+/* Inputs on different scales, matching the input normalisation of the model */
+void sampleScaled(double *x, double *y) {
+   sample(NIN,NOUT,x,y);
+   x[0] *= 2.0;
+   x[1] *= 0.5;
+   target(NIN,NOUT,x,y);
+   y[1] *= 10.0;
+}
+
+/* Largest absolute difference of a and b, relative to the largest element of b (at least 1) */
+double relErr(const double *a, const double *b, int N) {
+   double err = 0.0, scale = 1.0;
+   int i;
+   for (i=0;i<N;i++) {
+      if (fabs(a[i]-b[i]) > err) err = fabs(a[i]-b[i]);
+      if (fabs(b[i]) > scale) scale = fabs(b[i]);
+   }
+   return err/scale;
+}
+
+/* Compares the directional derivatives with products of the full J and H, computed
+** at the same points. Input and output normalisation are not 1, so the scaling of
+** v and the results is checked as well */
+void testModel(int diag_only) {
+   LWPR_Model model;
+   double x[NIN],y[NOUT],v[NIN],u[NOUT];
+   double yr[NOUT],J[NOUT*NIN],H[NIN*NIN*NOUT];
+   double yd[NOUT],Jv[NOUT],uJ[NIN],Hv[NIN*NOUT];
+   double Jv_ref[NOUT],uJ_ref[NIN],Hv_ref[NIN*NOUT];
+   double err = 0.0;
+   int n,i,j,k;
+
+   lwpr_init_model(&model,NIN,NOUT,"directional");
+   model.diag_only = diag_only;
+   model.norm_in[0] = 2.0;
+   model.norm_in[1] = 0.5;
+   model.norm_out[1] = 10.0;
+   lwpr_set_init_D_spherical(&model,20);
+   for (n=0;n<5000;n++) {
+      sampleScaled(x,y);
+      lwpr_update(&model,x,y,NULL,NULL);
+   }
+
+   for (n=0;n<200;n++) {
+      sampleScaled(x,y);
+      for (i=0;i<NIN;i++) v[i] = 2.0*URAND()-1.0;
+      for (k=0;k<NOUT;k++) u[k] = 2.0*URAND()-1.0;
+
+      lwpr_predict_JH(&model,x,CUTOFF,yr,J,H);
+      for (k=0;k<NOUT;k++) {
+         Jv_ref[k] = 0.0;
+         for (i=0;i<NIN;i++) Jv_ref[k] += J[k+i*NOUT]*v[i];
+      }
+      for (i=0;i<NIN;i++) {
+         uJ_ref[i] = 0.0;
+         for (k=0;k<NOUT;k++) uJ_ref[i] += u[k]*J[k+i*NOUT];
+      }
+      for (k=0;k<NOUT;k++) {
+         for (i=0;i<NIN;i++) {
+            Hv_ref[k*NIN+i] = 0.0;
+            for (j=0;j<NIN;j++) Hv_ref[k*NIN+i] += H[k*NIN*NIN+i+j*NIN]*v[j];
+         }
+      }
+
+      lwpr_predict_Jv(&model,x,v,CUTOFF,yd,Jv);
+      if (relErr(yd,yr,NOUT) > 1e-12) fail("lwpr_predict_Jv: wrong prediction");
+      if (relErr(Jv,Jv_ref,NOUT) > 1e-10) fail("lwpr_predict_Jv differs from J*v");
+
+      lwpr_predict_vJ(&model,x,u,CUTOFF,yd,uJ);
+      if (relErr(yd,yr,NOUT) > 1e-12) fail("lwpr_predict_vJ: wrong prediction");
+      if (relErr(uJ,uJ_ref,NIN) > 1e-10) fail("lwpr_predict_vJ differs from u'*J");
+
+      lwpr_predict_Hv(&model,x,v,CUTOFF,yd,Jv,Hv);
+      if (relErr(yd,yr,NOUT) > 1e-12) fail("lwpr_predict_Hv: wrong prediction");
+      if (relErr(Jv,Jv_ref,NOUT) > 1e-10) fail("lwpr_predict_Hv differs from J*v");
+      if (relErr(Hv,Hv_ref,NIN*NOUT) > 1e-10) fail("lwpr_predict_Hv differs from H*v");
+      lwpr_predict_Hv(&model,x,v,CUTOFF,yd,NULL,Hv);
+      if (relErr(Hv,Hv_ref,NIN*NOUT) > 1e-10) fail("lwpr_predict_Hv differs from H*v without Jv");
+
+      if (relErr(Hv,Hv_ref,NIN*NOUT) > err) err = relErr(Hv,Hv_ref,NIN*NOUT);
+   }
+   printf("diag_only=%d: %d and %d RFs, largest relative error of H*v: %g\n", diag_only,
+         model.sub[0].numRFS, model.sub[1].numRFS, err);
+   lwpr_free_model(&model);
+}
+
+int main() {
+   srand(1);
+   testModel(1);
+   testModel(0);
+   printf("OK\n");
+   return 0;
+}
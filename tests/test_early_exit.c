@@ -0,0 +1,98 @@
+/*********************************************************************
+LWPR: A library for incremental online learning
+Copyright (C) 2007  Stefan Klanke, Sethu Vijayakumar
+Contact: sethu.vijayakumar@ed.ac.uk
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Library General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free
+Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*********************************************************************/
+#include <lwpr.h>
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include "test_util.h"
+
+#define NIN       4
+#define NOUT      2
+#define CUTOFF    0.001
+
+static int differs(double a, double b) {
+   return fabs(a-b) > 1e-12*(1.0+fabs(b));
+}
+
+/* Trains and queries two models that only differ in LWPR_Model.early_exit. Their
+** predictions must agree, and so must the maximal activations unless these are below
+** the cutoff. metric: 0 = full, 1 = diagonal, 2 = diag_only with off-diagonal init_D */
+void testModel(int metric, const char *name) {
+   LWPR_Model exact, early;
+   double x[NIN],y[NOUT],ya[NOUT],yb[NOUT],wa[NOUT],wb[NOUT],ca[NOUT],cb[NOUT];
+   double Ja[NOUT*NIN],Jb[NOUT*NIN];
+   int n,i,k;
+
+   lwpr_init_model(&exact,NIN,NOUT,name);
+   exact.diag_only = (metric != 0);
+   if (metric == 2) {
+      double D[NIN*NIN] = {30,10,0,0, 10,30,0,0, 0,0,25,0, 0,0,0,25};
+      lwpr_set_init_D(&exact,D,NIN);
+   } else {
+      lwpr_set_init_D_spherical(&exact,20);
+   }
+   if (!lwpr_duplicate_model(&early,&exact)) fail("Could not duplicate model");
+   early.early_exit = 1;
+
+   for (n=0;n<3000;n++) {
+      sample(NIN,NOUT,x,y);
+      lwpr_update(&exact,x,y,ya,wa);
+      lwpr_update(&early,x,y,yb,wb);
+      for (k=0;k<NOUT;k++) {
+         if (differs(yb[k],ya[k])) fail("early_exit changes the prediction of lwpr_update");
+         if (differs(wb[k],wa[k]) && (wa[k] >= CUTOFF || wb[k] < wa[k])) {
+            fail("early_exit changes max_w of lwpr_update");
+         }
+      }
+   }
+   for (k=0;k<NOUT;k++) {
+      if (exact.sub[k].numRFS != early.sub[k].numRFS) fail("early_exit changes the number of RFs");
+   }
+
+   for (n=0;n<500;n++) {
+      sample(NIN,NOUT,x,y);
+      lwpr_predict(&exact,x,CUTOFF,ya,ca,wa);
+      lwpr_predict(&early,x,CUTOFF,yb,cb,wb);
+      for (k=0;k<NOUT;k++) {
+         if (differs(yb[k],ya[k])) fail("early_exit changes the prediction");
+         if (differs(cb[k],ca[k])) fail("early_exit changes the confidence bound");
+         if (differs(wb[k],wa[k]) && (wa[k] >= CUTOFF || wb[k] < wa[k])) {
+            fail("early_exit changes max_w");
+         }
+      }
+      lwpr_predict_J(&exact,x,CUTOFF,ya,Ja);
+      lwpr_predict_J(&early,x,CUTOFF,yb,Jb);
+      for (i=0;i<NOUT*NIN;i++) {
+         if (differs(Jb[i],Ja[i])) fail("early_exit changes the Jacobian");
+      }
+   }
+   printf("%s: %d and %d RFs\n", name, exact.sub[0].numRFS, exact.sub[1].numRFS);
+   lwpr_free_model(&exact);
+   lwpr_free_model(&early);
+}
+
+int main() {
+   srand(1);
+   testModel(0,"full");
+   testModel(1,"diagonal");
+   testModel(2,"symmetric");
+   printf("OK\n");
+   return 0;
+}
@@ -0,0 +1,75 @@
+/*********************************************************************
+LWPR: A library for incremental online learning
+Copyright (C) 2007  Stefan Klanke, Sethu Vijayakumar
+Contact: sethu.vijayakumar@ed.ac.uk
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Library General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free
+Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*********************************************************************/
+#include <lwpr.h>
+#include <lwpr_math.h>
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include "test_util.h"
+
+#define XMIN      -708.375
+#define N         100000
+
+/* Checks lwpr_math_exp_array against exp over its documented range, including
+** both endpoints and the points where the range reduction switches */
+int main() {
+   static double x[N+4], y[N+4];
+   double maxErr = 0.0;
+   int i,k;
+
+   x[0] = XMIN;
+   x[1] = 0.0;
+   x[2] = -0.5*log(2.0);
+   x[3] = -0.5*log(2.0)*(1.0+1e-15);
+   for (i=0;i<N;i++) x[i+4] = XMIN*URAND();
+   
+   lwpr_math_exp_array(N+4, y, x);
+   for (i=0;i<N+4;i++) {
+      double e = exp(x[i]);
+      double err = fabs(y[i]-e)/e;
+      if (err > maxErr) maxErr = err;
+      if (err >= 1e-15) {
+         fprintf(stderr,"exp(%.17g): relative error %g\n", x[i], err);
+         fail("lwpr_math_exp_array is inaccurate");
+      }
+   }
+   if (y[1] != 1.0) fail("lwpr_math_exp_array(0) is not 1");
+   
+   /* Exactly at the round-off points of k, and far below the range */
+   for (k=-1022;k<=0;k++) {
+      double xk = (k+0.5)*log(2.0);
+      double e = exp(xk);
+      if (xk < XMIN) continue;
+      lwpr_math_exp_array(1, y, &xk);
+      if (fabs(y[0]-e)/e >= 1e-15) fail("lwpr_math_exp_array is inaccurate near a power of two");
+   }
+   x[0] = -710.0;
+   x[1] = -1e300;
+   lwpr_math_exp_array(2, y, x);
+   if (y[0] != 0.0 || y[1] != 0.0) fail("Inputs below the range do not yield 0");
+   
+   /* In place */
+   x[0] = -1.0;
+   lwpr_math_exp_array(1, x, x);
+   if (fabs(x[0]-exp(-1.0)) > 1e-15*exp(-1.0)) fail("lwpr_math_exp_array in place failed");
+
+   printf("Maximal relative error: %g\nOK\n", maxErr);
+   return 0;
+}
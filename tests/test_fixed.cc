@@ -0,0 +1,107 @@
+/*********************************************************************
+LWPR: A library for incremental online learning
+Copyright (C) 2007  Stefan Klanke, Sethu Vijayakumar
+Contact: sethu.vijayakumar@ed.ac.uk
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Library General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free
+Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*********************************************************************/
+#include <lwpr_fixed.hh>
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include "test_util.h"
+
+#define NIN       3
+#define NOUT      2
+#define CUTOFF    0.001
+
+typedef LWPR_FixedPredictor<NIN,NOUT> Fixed;
+
+static bool differs(double a, double b) {
+   return fabs(a-b) > 1e-12*(1.0+fabs(b));
+}
+
+/* Compares the fixed predictor (and copies of it) with lwpr_predict, which uses 
+** the slopes computed while constructing the predictor */
+static void check(const LWPR_Model& model, const Fixed& fixed, const char *name) {
+   Fixed copy(fixed);
+   Fixed assigned(fixed);
+   double x[NIN],y[NOUT],yf[NOUT],yc[NOUT],w[NOUT],wf[NOUT];
+
+   assigned = copy;
+   for (int k=0;k<NOUT;k++) {
+      if (fixed.numRFS(k) != model.sub[k].numRFS) fail("Wrong number of receptive fields");
+   }
+   for (int n=0;n<500;n++) {
+      sample(NIN,NOUT,x,y);
+      lwpr_predict(&model,x,CUTOFF,y,NULL,w);
+      fixed.predict(x,yf,CUTOFF,wf);
+      for (int k=0;k<NOUT;k++) {
+         if (differs(yf[k],y[k])) fail("LWPR_FixedPredictor: wrong prediction");
+         if (differs(wf[k],w[k])) fail("LWPR_FixedPredictor: wrong activation");
+      }
+      copy.predict(x,yc,CUTOFF);
+      for (int k=0;k<NOUT;k++) if (yc[k] != yf[k]) fail("Copy predicts differently");
+      assigned.predict(x,yc,CUTOFF);
+      for (int k=0;k<NOUT;k++) if (yc[k] != yf[k]) fail("Assigned copy predicts differently");
+   }
+   printf("%s: %d and %d RFs\n", name, model.sub[0].numRFS, model.sub[1].numRFS);
+}
+
+/* metric: 0 = full, 1 = diagonal, 2 = diag_only with off-diagonal init_D */
+static void testModel(int metric, LWPR_Kernel kernel, const char *name) {
+   LWPR_Model model;
+   double x[NIN],y[NOUT];
+
+   lwpr_init_model(&model,NIN,NOUT,name);
+   model.kernel = kernel;
+   model.diag_only = (metric != 0);
+   if (metric == 2) {
+      double D[NIN*NIN] = {30, 10, 0, 10, 30, 0, 0, 0, 25};
+      lwpr_set_init_D(&model,D,NIN);
+   } else {
+      lwpr_set_init_D_spherical(&model,10);
+   }
+   for (int n=0;n<2000;n++) {
+      sample(NIN,NOUT,x,y);
+      lwpr_update(&model,x,y,NULL,NULL);
+   }
+   try {
+      Fixed fixed(model);
+      check(model,fixed,name);
+   } catch(LWPR_Exception& e) {
+      fail(e.getString());
+   }
+   lwpr_free_model(&model);
+}
+
+int main() {
+   srand(1);
+   testModel(0,LWPR_GAUSSIAN_KERNEL,"full");
+   testModel(1,LWPR_GAUSSIAN_KERNEL,"diagonal");
+   testModel(2,LWPR_GAUSSIAN_KERNEL,"symmetric");
+   testModel(0,LWPR_BISQUARE_KERNEL,"full/bisquare");
+   testModel(1,LWPR_BISQUARE_KERNEL,"diagonal/bisquare");
+
+   try {
+      LWPR_Object obj(NIN+1,NOUT);
+      Fixed fixed(obj);
+      fail("Dimension mismatch was not detected");
+   } catch(LWPR_Exception& e) {
+      if (e.getCode() != LWPR_Exception::BAD_INPUT_DIM) fail("Wrong exception");
+   }
+   printf("OK\n");
+   return 0;
+}
@@ -0,0 +1,85 @@
+/*********************************************************************
+LWPR: A library for incremental online learning
+Copyright (C) 2007  Stefan Klanke, Sethu Vijayakumar
+Contact: sethu.vijayakumar@ed.ac.uk
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Library General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free
+Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*********************************************************************/
+#include <lwpr.h>
+#include <lwpr_float.h>
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include "test_util.h"
+
+#define MAX_IN    40
+#define NTEST     500
+
+/* Trains a model, builds its float representation and checks that predictions and
+** activations agree up to single precision rounding, also when the float model is
+** used through a const pointer. mode is 0 for diag_only, 1 for a full metric, and 2
+** for diag_only with an initial metric that has off-diagonal elements. d is the
+** diagonal of the initial metric */
+void testModel(int nIn, int mode, double d) {
+   LWPR_Model model;
+   LWPR_FloatModel fm;
+   LWPR_FloatAccuracy acc;
+   const LWPR_FloatModel *cfm = &fm;
+   double *X, D[MAX_IN*MAX_IN], x[MAX_IN], y[2];
+   int n,i,j;
+
+   lwpr_init_model(&model,nIn,2,"float");
+   model.diag_only = (mode != 1);
+   model.update_D = (mode == 1);
+   for (j=0;j<nIn;j++) {
+      for (i=0;i<nIn;i++) D[i+j*nIn] = (i==j) ? d : 0.0;
+   }
+   if (mode == 2) D[1] = D[nIn] = 0.25*d;
+   lwpr_set_init_D(&model,D,nIn);
+
+   for (n=0;n<2000;n++) {
+      sample(nIn,2,x,y);
+      lwpr_update(&model,x,y,NULL,NULL);
+   }
+
+   if (!lwpr_float_init(&fm,&model)) fail("Could not build float model");
+   if (fm.diag_only != (mode == 0)) fail("Wrong metric representation in float model");
+
+   X = (double *) malloc(NTEST*nIn*sizeof(double));
+   if (X == NULL) fail("Out of memory");
+   for (n=0;n<NTEST;n++) sample(nIn,2,X+n*nIn,y);
+
+   if (!lwpr_float_compare(&model,cfm,NTEST,X,nIn,0.001,&acc)) fail("Could not compare models");
+   printf("nIn=%d mode=%d: %d RFs, max_norm_err = %g, rms_err = %g, max_w_err = %g\n",
+         nIn, mode, model.sub[0].numRFS, acc.max_norm_err, acc.rms_err, acc.max_w_err);
+   if (acc.N != NTEST) fail("Wrong number of comparisons");
+   if (acc.max_norm_err > 1e-4) fail("Float predictions differ too much");
+   if (acc.max_w_err > 1e-5) fail("Float activations differ too much");
+
+   free(X);
+   lwpr_float_free(&fm);
+   lwpr_free_model(&model);
+}
+
+int main() {
+   srand(1);
+   testModel(3,0,6.0);
+   testModel(3,1,6.0);
+   testModel(3,2,6.0);
+   /* Working memory on the heap */
+   testModel(MAX_IN,0,0.15);
+   printf("OK\n");
+   return 0;
+}
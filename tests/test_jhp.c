@@ -0,0 +1,81 @@
+/*********************************************************************
+LWPR: A library for incremental online learning
+Copyright (C) 2007  Stefan Klanke, Sethu Vijayakumar
+Contact: sethu.vijayakumar@ed.ac.uk
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Library General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free
+Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*********************************************************************/
+#include <lwpr.h>
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include "test_util.h"
+
+#define NIN       4
+#define NOUT      2
+#define NTRI      LWPR_TRI_SIZE(NIN)
+#define CUTOFF    0.001
+
+/* Checks that the packed Hessians of lwpr_predict_JHp are the upper triangles of
+** the dense ones of lwpr_predict_JH, and that y and J are the same */
+void testModel(int diag_only) {
+   LWPR_Model model;
+   double x[NIN],y[NOUT],yd[NOUT],yp[NOUT],Jd[NOUT*NIN],Jp[NOUT*NIN];
+   double H[NIN*NIN*NOUT],Hp[NTRI*NOUT];
+   int n,i,j,k;
+
+   lwpr_init_model(&model,NIN,NOUT,"jhp");
+   model.diag_only = diag_only;
+   model.norm_in[2] = 2.0;
+   lwpr_set_init_D_spherical(&model,10);
+   for (n=0;n<3000;n++) {
+      sample(NIN,NOUT,x,y);
+      lwpr_update(&model,x,y,NULL,NULL);
+   }
+
+   for (n=0;n<200;n++) {
+      sample(NIN,NOUT,x,y);
+      lwpr_predict_JH(&model,x,CUTOFF,yd,Jd,H);
+      lwpr_predict_JHp(&model,x,CUTOFF,yp,Jp,Hp);
+
+      for (k=0;k<NOUT;k++) {
+         if (yp[k] != yd[k]) fail("lwpr_predict_JHp: wrong prediction");
+      }
+      for (i=0;i<NOUT*NIN;i++) {
+         if (Jp[i] != Jd[i]) fail("lwpr_predict_JHp: wrong Jacobian");
+      }
+      for (k=0;k<NOUT;k++) {
+         const double *Hk = H + k*NIN*NIN;
+         const double *Hpk = Hp + k*NTRI;
+         for (j=0;j<NIN;j++) {
+            for (i=0;i<=j;i++) {
+               if (Hpk[LWPR_TRI(i,j)] != Hk[i+j*NIN] || Hk[j+i*NIN] != Hk[i+j*NIN]) {
+                  fail("Packed Hessian differs from the triangle of lwpr_predict_JH");
+               }
+            }
+         }
+      }
+   }
+   printf("diag_only=%d: %d and %d RFs\n", diag_only, model.sub[0].numRFS, model.sub[1].numRFS);
+   lwpr_free_model(&model);
+}
+
+int main() {
+   srand(1);
+   testModel(1);
+   testModel(0);
+   printf("OK\n");
+   return 0;
+}
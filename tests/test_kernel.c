@@ -0,0 +1,140 @@
+/*********************************************************************
+LWPR: A library for incremental online learning
+Copyright (C) 2007  Stefan Klanke, Sethu Vijayakumar
+Contact: sethu.vijayakumar@ed.ac.uk
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Library General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free
+Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*********************************************************************/
+#include <lwpr.h>
+#include <lwpr_binio.h>
+#include <lwpr_xml.h>
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "test_util.h"
+
+#define NIN       3
+#define NOUT      2
+#define CUTOFF    0.001
+
+/* Same function as the built-in BiSquare kernel, so that models using it can be
+** checked against models using LWPR_BISQUARE_KERNEL */
+static double quartic(double q, double *dwdq, double *ddwdqdq) {
+   double d = 1-0.25*q;
+   if (d<0) {
+      *dwdq = *ddwdqdq = 0.0;
+      return 0.0;
+   }
+   *dwdq = -0.5*d;
+   *ddwdqdq = 0.125;
+   return d*d;
+}
+
+/* Only registered to move "Quartic" away from the first free identifier */
+static double cosine(double q, double *dwdq, double *ddwdqdq) {
+   double w = cos(q);
+   *dwdq = -sin(q);
+   *ddwdqdq = -w;
+   return w;
+}
+
+static int differs(double a, double b, double tol) {
+   return fabs(a-b) > tol*(1.0+fabs(b));
+}
+
+static void comparePredictions(const LWPR_Model *a, const LWPR_Model *b, double tol, const char *msg) {
+   double x[NIN],y[NOUT],ya[NOUT],yb[NOUT],wa[NOUT],wb[NOUT];
+   int n,k;
+
+   for (n=0;n<500;n++) {
+      sample(NIN,NOUT,x,y);
+      lwpr_predict(a,x,CUTOFF,ya,NULL,wa);
+      lwpr_predict(b,x,CUTOFF,yb,NULL,wb);
+      for (k=0;k<NOUT;k++) {
+         if (differs(ya[k],yb[k],tol) || differs(wa[k],wb[k],tol)) fail(msg);
+      }
+   }
+}
+
+int main() {
+   LWPR_Model model, ref, loaded;
+   double x[NIN],y[NOUT],yp[NOUT],yr[NOUT];
+   char *buf;
+   size_t size;
+   int kernel,n,k;
+
+   srand(1);
+   if (lwpr_register_kernel("Cosine", cosine, 2.25) < 0) fail("Could not register kernel");
+   kernel = lwpr_register_kernel("Quartic", quartic, 4.0);
+   if (kernel < 0) fail("Could not register kernel");
+   if (lwpr_register_kernel("Quartic", quartic, 4.0) >= 0) fail("Duplicate name was accepted");
+   if (lwpr_kernel_by_name("Quartic") != kernel) fail("lwpr_kernel_by_name failed");
+   if (lwpr_kernel_info((LWPR_Kernel) kernel)->support != 4.0) fail("lwpr_kernel_info failed");
+
+   /* Updates and predictions through the function pointer match the specialised BiSquare code */
+   lwpr_init_model(&model,NIN,NOUT,"quartic");
+   lwpr_set_init_D_spherical(&model,10);
+   model.diag_only = 0;
+   lwpr_duplicate_model(&ref,&model);
+   model.kernel = (LWPR_Kernel) kernel;
+   ref.kernel = LWPR_BISQUARE_KERNEL;
+   for (n=0;n<2000;n++) {
+      sample(NIN,NOUT,x,y);
+      lwpr_update(&model,x,y,yp,NULL);
+      lwpr_update(&ref,x,y,yr,NULL);
+      for (k=0;k<NOUT;k++) {
+         if (differs(yp[k],yr[k],1e-10)) fail("Registered kernel: update differs from reference");
+      }
+   }
+   for (k=0;k<NOUT;k++) {
+      if (model.sub[k].numRFS != ref.sub[k].numRFS) fail("Registered kernel: different number of RFs");
+   }
+   comparePredictions(&model,&ref,1e-10,"Registered kernel: prediction differs from reference");
+   printf("%d and %d RFs\n", model.sub[0].numRFS, model.sub[1].numRFS);
+
+   /* Binary files store the kernel by name */
+   size = lwpr_binary_size(&model);
+   buf = (char *) malloc(size);
+   if (buf == NULL || !lwpr_write_binary_mem(&model,buf,size)) fail("Could not write binary model");
+   if (!lwpr_read_binary_mem(&loaded,buf,size)) fail("Could not read binary model");
+   if (loaded.kernel != model.kernel) fail("Binary model: wrong kernel");
+   comparePredictions(&model,&loaded,0.0,"Binary model: prediction differs");
+   lwpr_free_model(&loaded);
+   
+   /* Names of kernels that are not registered are rejected */
+   for (n=0;n+7<=(int) size;n++) {
+      if (!memcmp(buf+n,"Quartic",7)) break;
+   }
+   if (n+7>(int) size) fail("Kernel name not found in binary model");
+   buf[n+6] = 'x';
+   if (lwpr_read_binary_mem(&loaded,buf,size)) fail("Unknown kernel accepted from binary model");
+   free(buf);
+
+#if HAVE_LIBEXPAT
+   lwpr_write_xml(&model,"lwpr_kernel.xml");
+   n = lwpr_read_xml(&loaded,"lwpr_kernel.xml",NULL);
+   remove("lwpr_kernel.xml");
+   if (n != 0) fail("Could not read XML file");
+   if (loaded.kernel != model.kernel) fail("XML model: wrong kernel");
+   comparePredictions(&model,&loaded,1e-4,"XML model: prediction differs");
+   lwpr_free_model(&loaded);
+#endif
+
+   lwpr_free_model(&model);
+   lwpr_free_model(&ref);
+   printf("OK\n");
+   return 0;
+}
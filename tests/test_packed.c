@@ -0,0 +1,142 @@
+/*********************************************************************
+LWPR: A library for incremental online learning
+Copyright (C) 2007  Stefan Klanke, Sethu Vijayakumar
+Contact: sethu.vijayakumar@ed.ac.uk
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Library General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free
+Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*********************************************************************/
+#include <lwpr.h>
+#include <lwpr_math.h>
+#include <lwpr_xml.h>
+#include <lwpr_binio.h>
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include "test_util.h"
+
+#define NIN    3
+
+/* Maximum deviation of the packed D from M'M, relative to the largest element of D */
+double checkCholesky(const LWPR_ReceptiveField *RF) {
+   double err = 0.0, scale = 0.0;
+   int i,j,k;
+   for (j=0;j<NIN;j++) {
+      for (i=0;i<=j;i++) {
+         double d = 0.0;
+         for (k=0;k<=i;k++) d += RF->M[LWPR_TRI(k,i)] * RF->M[LWPR_TRI(k,j)];
+         if (fabs(d - RF->D[LWPR_TRI(i,j)]) > err) err = fabs(d - RF->D[LWPR_TRI(i,j)]);
+         if (fabs(RF->D[LWPR_TRI(i,j)]) > scale) scale = fabs(RF->D[LWPR_TRI(i,j)]);
+      }
+   }
+   return err/scale;
+}
+
+/* Maximum difference between the metrics of the receptive fields of two models,
+** relative to the magnitude of the elements (at least 1) */
+double compareMetrics(const LWPR_Model *a, const LWPR_Model *b) {
+   double err = 0.0;
+   int n,i;
+   if (a->sub[0].numRFS != b->sub[0].numRFS) fail("Number of receptive fields differs");
+   for (n=0;n<a->sub[0].numRFS;n++) {
+      for (i=0;i<LWPR_TRI_SIZE(NIN);i++) {
+         double dD = fabs(a->sub[0].rf[n]->D[i] - b->sub[0].rf[n]->D[i]);
+         double dM = fabs(a->sub[0].rf[n]->M[i] - b->sub[0].rf[n]->M[i]);
+         if (fabs(a->sub[0].rf[n]->D[i]) > 1.0) dD /= fabs(a->sub[0].rf[n]->D[i]);
+         if (fabs(a->sub[0].rf[n]->M[i]) > 1.0) dM /= fabs(a->sub[0].rf[n]->M[i]);
+         if (dD > err) err = dD;
+         if (dM > err) err = dM;
+      }
+   }
+   return err;
+}
+
+int main() {
+   LWPR_Model model, loaded;
+   double D0[NIN*NIN] = {60, 10, -5,  10, 40, 8,  -5, 8, 50};
+   double A[NIN*NIN], x[NIN], y[1];
+   double Ap[LWPR_TRI_SIZE(NIN)];
+   double err;
+   int n,i,j;
+
+   srand(1);
+
+   /* packing and the packed quadratic form */
+   for (i=0;i<NIN*NIN;i++) A[i] = D0[i];
+   lwpr_math_tri_pack(NIN, NIN, Ap, A);
+   for (j=0;j<NIN;j++) for (i=0;i<=j;i++) {
+      if (Ap[LWPR_TRI(i,j)] != D0[i+j*NIN]) fail("lwpr_math_tri_pack stores the wrong elements");
+   }
+   for (n=0;n<100;n++) {
+      double dense = 0.0;
+      for (i=0;i<NIN;i++) x[i] = 2.0*URAND()-1.0;
+      for (j=0;j<NIN;j++) for (i=0;i<NIN;i++) dense += x[i]*D0[i+j*NIN]*x[j];
+      if (fabs(dense - lwpr_math_symp_quad(NIN, Ap, x)) > 1e-12*fabs(dense)) {
+         fail("lwpr_math_symp_quad differs from the dense quadratic form");
+      }
+   }
+
+   lwpr_init_model(&model,NIN,1,"packed");
+   if (!lwpr_set_init_D(&model, D0, NIN)) fail("Could not set init_D");
+   model.diag_only = 0;
+   model.update_D = 1;
+   model.meta = 1;
+
+   /* the first receptive field starts with the packed init_D and init_M */
+   sample(NIN,1,x,y);
+   lwpr_update(&model,x,y,NULL,NULL);
+   if (model.sub[0].numRFS != 1) fail("First update did not create a receptive field");
+   for (j=0;j<NIN;j++) for (i=0;i<=j;i++) {
+      if (model.sub[0].rf[0]->D[LWPR_TRI(i,j)] != model.init_D[i+j*model.nInStore]
+            || model.sub[0].rf[0]->M[LWPR_TRI(i,j)] != model.init_M[i+j*model.nInStore]) {
+         fail("New receptive field does not hold the packed initial metric");
+      }
+   }
+
+   for (n=0;n<3000;n++) {
+      sample(NIN,1,x,y);
+      lwpr_update(&model,x,y,NULL,NULL);
+   }
+   err = 0.0;
+   for (n=0;n<model.sub[0].numRFS;n++) {
+      double e = checkCholesky(model.sub[0].rf[n]);
+      if (e > err) err = e;
+   }
+   printf("%d RFs, max. relative deviation of D from M'M: %g\n", model.sub[0].numRFS, err);
+   if (err > 1e-12) fail("Packed D does not match M'M");
+
+   /* files store dense matrices, reading them must restore the packed ones.
+   ** XML files only keep 7 significant digits. */
+   if (!lwpr_write_binary(&model,"lwpr_packed.bin")) fail("Could not write binary file");
+   n = lwpr_read_binary(&loaded,"lwpr_packed.bin");
+   remove("lwpr_packed.bin");
+   if (!n) fail("Could not read binary file");
+   if (compareMetrics(&model,&loaded) != 0.0) fail("Binary round trip changed the metrics");
+   lwpr_free_model(&loaded);
+
+#if HAVE_LIBEXPAT
+   lwpr_write_xml(&model,"lwpr_packed.xml");
+   n = lwpr_read_xml(&loaded,"lwpr_packed.xml",NULL);
+   remove("lwpr_packed.xml");
+   if (n != 0) fail("Could not read XML file");
+   err = compareMetrics(&model,&loaded);
+   printf("XML round trip: max. metric difference %g\n", err);
+   if (err > 1e-6) fail("XML round trip changed the metrics");
+   lwpr_free_model(&loaded);
+#endif
+
+   lwpr_free_model(&model);
+   printf("OK\n");
+   return 0;
+}
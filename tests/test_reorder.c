@@ -0,0 +1,121 @@
+/*********************************************************************
+LWPR: A library for incremental online learning
+Copyright (C) 2007  Stefan Klanke, Sethu Vijayakumar
+Contact: sethu.vijayakumar@ed.ac.uk
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Library General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free
+Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*********************************************************************/
+#include <lwpr.h>
+#include <lwpr_aux.h>
+#include <lwpr_binio.h>
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include "test_util.h"
+
+#define NIN       2
+#define NOUT      2
+#define NTEST     200
+#define CUTOFF    0.001
+
+void train(LWPR_Model *model, int N) {
+   double x[NIN],y[NOUT];
+   int n;
+   for (n=0;n<N;n++) {
+      sample(NIN,NOUT,x,y);
+      if (!lwpr_update(model,x,y,NULL,NULL)) fail("Update failed");
+   }
+}
+
+/* Predictions, confidences and Jacobians at the test inputs X */
+void predictAll(const LWPR_Model *model, const double *X, double *Y) {
+   int n;
+   for (n=0;n<NTEST;n++) {
+      double *yn = Y + n*(2+NIN)*NOUT;
+      lwpr_predict(model,X+n*NIN,CUTOFF,yn,yn+NOUT,NULL);
+      lwpr_predict_J(model,X+n*NIN,CUTOFF,yn,yn+2*NOUT);
+   }
+}
+
+void compare(const double *Y1, const double *Y2, const char *msg) {
+   int i;
+   for (i=0;i<NTEST*(2+NIN)*NOUT;i++) {
+      if (fabs(Y1[i]-Y2[i]) > 1e-10*(1.0 + fabs(Y1[i]))) fail(msg);
+   }
+}
+
+/* Reorders a trained model and checks that it still predicts the same, that it keeps
+** learning like an unordered copy, and that it can be written and read back */
+void testModel(int shared) {
+   LWPR_Model model, copy, loaded;
+   double X[NTEST*NIN], y[NOUT];
+   double Y1[NTEST*(2+NIN)*NOUT], Y2[NTEST*(2+NIN)*NOUT];
+   int n;
+
+   lwpr_init_model(&model,NIN,NOUT,"reorder");
+   lwpr_set_init_D_spherical(&model,50);
+   if (!lwpr_set_shared_geometry(&model,shared)) fail("Could not set shared geometry");
+   train(&model,3000);
+   for (n=0;n<NTEST;n++) sample(NIN,NOUT,X+n*NIN,y);
+
+   if (!lwpr_duplicate_model(&copy,&model)) fail("Could not duplicate model");
+   predictAll(&model,X,Y1);
+   if (!lwpr_reorder_rfs(&model)) fail("Could not reorder RFs");
+   if (model.sub[0].pool == NULL) fail("Reordering did not pool the RF storage");
+   predictAll(&model,X,Y2);
+   compare(Y1,Y2,"Reordering changed predictions");
+
+   /* An RF that was never initialised (as left by a failed lwpr_aux_init_rf) is 
+   ** not pooled, so removing it must not release the pool */
+   n = model.sub[0].numPooled;
+   if (lwpr_aux_add_rf(&model.sub[0],0) == NULL) fail("Could not add RF");
+   lwpr_aux_remove_rf(&model.sub[0],model.sub[0].numRFS-1);
+   if (model.sub[0].numPooled != n || model.sub[0].pool == NULL) fail("Removing an unpooled RF changed the pool");
+   predictAll(&model,X,Y2);
+   compare(Y1,Y2,"Removing an unpooled RF changed predictions");
+
+   /* Both models see the same data, only the order of their RFs differs */
+   srand(2);
+   train(&model,1000);
+   srand(2);
+   train(&copy,1000);
+   if (model.sub[0].numRFS != copy.sub[0].numRFS) fail("Reordered model created different RFs");
+   predictAll(&model,X,Y1);
+   predictAll(&copy,X,Y2);
+   compare(Y1,Y2,"Reordered model learned differently");
+
+   if (!lwpr_reorder_rfs(&model)) fail("Could not reorder RFs again");
+   if (!lwpr_write_binary(&model,"lwpr_reorder.dat")) fail("Could not write binary file");
+   n = lwpr_read_binary(&loaded,"lwpr_reorder.dat");
+   remove("lwpr_reorder.dat");
+   if (!n) fail("Could not read binary file");
+   predictAll(&model,X,Y1);
+   predictAll(&loaded,X,Y2);
+   compare(Y1,Y2,"Reordered model changed in binary file");
+
+   printf("shared=%d: %d RFs\n", shared, model.sub[0].numRFS);
+   lwpr_free_model(&loaded);
+   lwpr_free_model(&copy);
+   lwpr_free_model(&model);
+}
+
+int main() {
+   srand(1);
+   testModel(0);
+   srand(1);
+   testModel(1);
+   printf("OK\n");
+   return 0;
+}
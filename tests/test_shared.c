@@ -0,0 +1,177 @@
+/*********************************************************************
+LWPR: A library for incremental online learning
+Copyright (C) 2007  Stefan Klanke, Sethu Vijayakumar
+Contact: sethu.vijayakumar@ed.ac.uk
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Library General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free
+Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*********************************************************************/
+#include <lwpr.h>
+#include <lwpr_binio.h>
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+#include <stdlib.h>
+#include "test_util.h"
+
+#define NIN       2
+#define NOUT      3
+#define NTRI      LWPR_TRI_SIZE(NIN)
+#define CUTOFF    0.001
+
+/* Checks that receptive field n uses the same centre and distance metric in all submodels */
+void checkAligned(const LWPR_Model *model) {
+   int k,n;
+   for (k=1;k<NOUT;k++) {
+      if (model->sub[k].numRFS != model->sub[0].numRFS) fail("Submodels hold different numbers of RFs");
+      for (n=0;n<model->sub[0].numRFS;n++) {
+         const LWPR_ReceptiveField *RF0 = model->sub[0].rf[n];
+         const LWPR_ReceptiveField *RF = model->sub[k].rf[n];
+         if (RF->c != RF0->c || RF->D != RF0->D || RF->M != RF0->M) fail("Geometry is not shared between submodels");
+         if (RF->alpha != RF0->alpha || RF->b != RF0->b || RF->h != RF0->h) fail("Learning rates are not shared between submodels");
+      }
+   }
+}
+
+/* Checks that the receptive fields of two models with one output are identical */
+void checkIdentical(const LWPR_Model *a, const LWPR_Model *b) {
+   int n;
+   if (a->sub[0].numRFS != b->sub[0].numRFS) fail("Different numbers of RFs");
+   if (a->sub[0].n_pruned != b->sub[0].n_pruned || a->sub[0].n_evicted != b->sub[0].n_evicted) fail("Different numbers of pruned or evicted RFs");
+   for (n=0;n<a->sub[0].numRFS;n++) {
+      const LWPR_ReceptiveField *RFa = a->sub[0].rf[n];
+      const LWPR_ReceptiveField *RFb = b->sub[0].rf[n];
+      int nReg = RFa->nReg;
+      
+      if (RFb->nReg != nReg) fail("Different numbers of projections");
+      if (memcmp(RFa->c, RFb->c, NIN*sizeof(double)) != 0) fail("Centres differ");
+      if (memcmp(RFa->D, RFb->D, NTRI*sizeof(double)) != 0) fail("Distance metrics differ");
+      if (memcmp(RFa->M, RFb->M, NTRI*sizeof(double)) != 0) fail("Cholesky factors differ");
+      if (memcmp(RFa->alpha, RFb->alpha, NTRI*sizeof(double)) != 0) fail("Learning rates differ");
+      if (memcmp(RFa->b, RFb->b, NTRI*sizeof(double)) != 0) fail("Meta-learning parameters b differ");
+      if (memcmp(RFa->h, RFb->h, NTRI*sizeof(double)) != 0) fail("Meta-learning parameters h differ");
+      if (memcmp(RFa->H, RFb->H, nReg*sizeof(double)) != 0) fail("H differs");
+      if (memcmp(RFa->r, RFb->r, nReg*sizeof(double)) != 0) fail("r differs");
+      if (memcmp(RFa->beta, RFb->beta, nReg*sizeof(double)) != 0) fail("Regression coefficients differ");
+      if (RFa->beta0 != RFb->beta0 || RFa->sum_e2 != RFb->sum_e2) fail("Statistics differ");
+   }
+}
+
+/* A shared model with one output must train exactly like an independent one */
+void checkSingleOutput(int meta) {
+   LWPR_Model shared, indep;
+   double x[NIN],y,ys,yi;
+   int n;
+   
+   lwpr_init_model(&shared,NIN,1,"single");
+   lwpr_set_init_D_spherical(&shared,50);
+   shared.meta = meta;
+   shared.w_prune = 0.3;
+   shared.max_rfs = 25;
+   shared.evict = LWPR_EVICT_LEAST_RECENT;
+   if (!lwpr_duplicate_model(&indep,&shared)) fail("Could not duplicate model");
+   if (!lwpr_set_shared_geometry(&shared,1)) fail("Could not share geometry of a single output");
+   
+   for (n=0;n<3000;n++) {
+      sample(NIN,1,x,&y);
+      if (!lwpr_update(&shared,x,&y,&ys,NULL)) fail("Update failed");
+      if (!lwpr_update(&indep,x,&y,&yi,NULL)) fail("Update failed");
+      if (fabs(ys-yi) > 1e-12) fail("Shared training predicts differently");
+   }
+   checkIdentical(&shared,&indep);
+   printf("Single output, meta=%d: %d RFs, identical\n", meta, shared.sub[0].numRFS);
+   
+   lwpr_free_model(&shared);
+   lwpr_free_model(&indep);
+}
+
+void init(LWPR_Model *model) {
+   lwpr_init_model(model,NIN,NOUT,"shared");
+   lwpr_set_init_D_spherical(model,50);
+   model->w_prune = 0.3;
+   model->max_rfs = 25;
+   model->evict = LWPR_EVICT_LEAST_RECENT;
+}
+
+int main() {
+   LWPR_Model model, loaded;
+   double x[NIN],y[NOUT],ys[NOUT],yi[NOUT];
+   int n,i;
+
+   srand(1);
+   init(&model);
+   if (!lwpr_set_shared_geometry(&model,1) || !model.shared_geometry) fail("Could not share geometry of an empty model");
+
+   /* RFs are created, pruned and evicted for all outputs together */
+   for (n=0;n<5000;n++) {
+      sample(NIN,NOUT,x,y);
+      if (!lwpr_update(&model,x,y,NULL,NULL)) fail("Update failed");
+      checkAligned(&model);
+   }
+   printf("%d RFs, %d pruned, %d evicted\n", model.sub[0].numRFS, model.sub[0].n_pruned, model.sub[0].n_evicted);
+   if (model.sub[0].n_pruned == 0) fail("No receptive field was pruned");
+   if (model.sub[0].n_evicted == 0) fail("No receptive field was evicted");
+   if (!lwpr_set_shared_geometry(&model,1)) fail("Could not keep sharing the geometry of a trained model");
+   checkAligned(&model);
+   
+   /* Copies share their own geometry, and stripping gives each RF its own copy again */
+   if (!lwpr_duplicate_model(&loaded,&model)) fail("Could not duplicate model");
+   checkAligned(&loaded);
+   if (!lwpr_strip_for_inference(&loaded)) fail("Could not strip model");
+   for (n=0;n<100;n++) {
+      sample(NIN,NOUT,x,y);
+      lwpr_predict(&model,x,CUTOFF,ys,NULL,NULL);
+      lwpr_predict(&loaded,x,CUTOFF,yi,NULL,NULL);
+      for (i=0;i<NOUT;i++) {
+         if (fabs(ys[i]-yi[i]) > 1e-12) fail("Stripped copy predicts differently");
+      }
+   }
+   lwpr_free_model(&loaded);
+
+   /* The flag is not stored in files, but can be set again for the loaded model */
+   if (!lwpr_write_binary(&model,"lwpr_shared.dat")) fail("Could not write binary file");
+   n = lwpr_read_binary(&loaded,"lwpr_shared.dat");
+   remove("lwpr_shared.dat");
+   if (!n) fail("Could not read binary file");
+   if (!lwpr_set_shared_geometry(&loaded,1)) fail("Could not share geometry of a loaded model");
+
+   /* The shared prediction path gives the same results as the per-output one */
+   for (n=0;n<200;n++) {
+      sample(NIN,NOUT,x,y);
+      lwpr_predict(&loaded,x,CUTOFF,ys,NULL,NULL);
+      if (!lwpr_set_shared_geometry(&loaded,0)) fail("Could not switch sharing off");
+      lwpr_predict(&loaded,x,CUTOFF,yi,NULL,NULL);
+      if (!lwpr_set_shared_geometry(&loaded,1)) fail("Could not switch sharing on again");
+      for (i=0;i<NOUT;i++) {
+         if (fabs(ys[i]-yi[i]) > 1e-12) fail("Shared predictions differ from independent ones");
+      }
+   }
+   lwpr_free_model(&loaded);
+   lwpr_free_model(&model);
+
+   /* Independently trained submodels cannot share their geometry afterwards */
+   init(&model);
+   for (n=0;n<1000;n++) {
+      sample(NIN,NOUT,x,y);
+      lwpr_update(&model,x,y,NULL,NULL);
+   }
+   if (lwpr_set_shared_geometry(&model,1) || model.shared_geometry) fail("Shared geometry accepted for unaligned submodels");
+   lwpr_free_model(&model);
+
+   checkSingleOutput(0);
+   checkSingleOutput(1);
+
+   printf("OK\n");
+   return 0;
+}
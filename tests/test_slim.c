@@ -0,0 +1,119 @@
+/*********************************************************************
+LWPR: A library for incremental online learning
+Copyright (C) 2007  Stefan Klanke, Sethu Vijayakumar
+Contact: sethu.vijayakumar@ed.ac.uk
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Library General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free
+Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*********************************************************************/
+#include <lwpr.h>
+#include <lwpr_binio.h>
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include "test_util.h"
+
+#define NIN    3
+#define NOUT   2
+
+/* Maximum absolute difference of predictions, confidence bounds and Jacobians */
+double compare(const LWPR_Model *a, const LWPR_Model *b) {
+   double x[NIN],y[NOUT];
+   double ya[NOUT],yb[NOUT],ca[NOUT],cb[NOUT],Ja[NIN*NOUT],Jb[NIN*NOUT];
+   double err = 0.0;
+   int n,i;
+
+   for (n=0;n<200;n++) {
+      sample(NIN,NOUT,x,y);
+      lwpr_predict(a,x,0.001,ya,ca,NULL);
+      lwpr_predict(b,x,0.001,yb,cb,NULL);
+      for (i=0;i<NOUT;i++) {
+         if (fabs(ya[i]-yb[i]) > err) err = fabs(ya[i]-yb[i]);
+         if (fabs(ca[i]-cb[i]) > err) err = fabs(ca[i]-cb[i]);
+      }
+      lwpr_predict_J(a,x,0.001,ya,Ja);
+      lwpr_predict_J(b,x,0.001,yb,Jb);
+      for (i=0;i<NIN*NOUT;i++) {
+         if (fabs(Ja[i]-Jb[i]) > err) err = fabs(Ja[i]-Jb[i]);
+      }
+   }
+   return err;
+}
+
+long fileSize(const char *filename) {
+   long size;
+   FILE *fp = fopen(filename,"rb");
+   if (fp==NULL) return -1;
+   fseek(fp,0,SEEK_END);
+   size = ftell(fp);
+   fclose(fp);
+   return size;
+}
+
+/* Strips a trained model and checks that predictions survive the slim binary format */
+void testSlim(int diag_only) {
+   LWPR_Model model, slim, loaded;
+   double x[NIN],y[NOUT];
+   long fullSize, slimSize;
+   double err;
+   int n;
+
+   lwpr_init_model(&model,NIN,NOUT,"slim");
+   lwpr_set_init_D_spherical(&model,20);
+   model.diag_only = diag_only;
+   model.update_D = 1;
+   for (n=0;n<3000;n++) {
+      sample(NIN,NOUT,x,y);
+      lwpr_update(&model,x,y,NULL,NULL);
+   }
+
+   if (!lwpr_duplicate_model(&slim,&model)) fail("Could not duplicate model");
+   if (!lwpr_strip_for_inference(&slim)) fail("Could not strip model");
+   if (!slim.inference_only) fail("Stripped model is not marked as inference_only");
+   if (lwpr_update(&slim,x,y,NULL,NULL)) fail("Stripped model accepted an update");
+
+   err = compare(&model,&slim);
+   if (err > 1e-10) fail("Stripped model predicts differently");
+
+   if (!lwpr_write_binary(&model,"lwpr_full.bin")) fail("Could not write full binary file");
+   if (!lwpr_write_binary(&slim,"lwpr_slim.bin")) fail("Could not write slim binary file");
+   fullSize = fileSize("lwpr_full.bin");
+   slimSize = fileSize("lwpr_slim.bin");
+   remove("lwpr_full.bin");
+
+   n = lwpr_read_binary(&loaded,"lwpr_slim.bin");
+   remove("lwpr_slim.bin");
+   if (!n) fail("Could not read slim binary file");
+   if (!loaded.inference_only) fail("Model read from slim file is not marked as inference_only");
+   if (loaded.sub[0].numRFS != slim.sub[0].numRFS || loaded.sub[1].numRFS != slim.sub[1].numRFS) {
+      fail("Number of receptive fields changed in slim binary file");
+   }
+   if (compare(&slim,&loaded) != 0.0) fail("Slim binary round trip changed the predictions");
+
+   printf("diag_only=%d: %d+%d RFs, error after strip %g, file size %ld -> %ld bytes\n", diag_only,
+         model.sub[0].numRFS, model.sub[1].numRFS, err, fullSize, slimSize);
+   if (slimSize <= 0 || slimSize >= fullSize) fail("Slim binary file is not smaller");
+
+   lwpr_free_model(&loaded);
+   lwpr_free_model(&slim);
+   lwpr_free_model(&model);
+}
+
+int main() {
+   srand(1);
+   testSlim(0);
+   testSlim(1);
+   printf("OK\n");
+   return 0;
+}
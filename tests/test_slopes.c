@@ -0,0 +1,97 @@
+/*********************************************************************
+LWPR: A library for incremental online learning
+Copyright (C) 2007  Stefan Klanke, Sethu Vijayakumar
+Contact: sethu.vijayakumar@ed.ac.uk
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Library General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free
+Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*********************************************************************/
+#include <lwpr.h>
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include "test_util.h"
+
+#define NIN       3
+#define NOUT      3
+#define CUTOFF    0.001
+
+static int differs(double a, double b) {
+   return fabs(a-b) > 1e-10*(1.0+fabs(b));
+}
+
+static void checkSlopes(const LWPR_Model *model, int ready) {
+   int dim,n;
+   for (dim=0;dim<model->nOut;dim++) {
+      for (n=0;n<model->sub[dim].numRFS;n++) {
+         if (model->sub[dim].rf[n]->slopeReady != ready) fail("Unexpected slope state");
+      }
+   }
+}
+
+/* Checks that predictions from cached slopes (after lwpr_finalize_slopes, or kept up to
+** date by LWPR_Model.eager_slopes) match those of the PLS projections */
+void testModel(int diag_only) {
+   LWPR_Model pls, fin, eager;
+   double x[NIN],y[NOUT],yp[NOUT],yf[NOUT],ye[NOUT];
+   double cp[NOUT],cf[NOUT],ce[NOUT];
+   int n,k;
+
+   lwpr_init_model(&pls,NIN,NOUT,"pls");
+   pls.diag_only = diag_only;
+   lwpr_set_init_D_spherical(&pls,10);
+   if (!lwpr_duplicate_model(&eager,&pls)) fail("Could not duplicate model");
+   eager.eager_slopes = 1;
+   
+   for (n=0;n<3000;n++) {
+      sample(NIN,NOUT,x,y);
+      lwpr_update(&pls,x,y,NULL,NULL);
+      lwpr_update(&eager,x,y,NULL,NULL);
+   }
+   checkSlopes(&pls,0);
+   checkSlopes(&eager,1);
+   for (k=0;k<NOUT;k++) {
+      if (pls.sub[k].numRFS != eager.sub[k].numRFS) fail("eager_slopes changed the training");
+   }
+
+   if (!lwpr_duplicate_model(&fin,&pls)) fail("Could not duplicate model");
+   lwpr_finalize_slopes(&fin);
+   checkSlopes(&fin,1);
+   
+   for (n=0;n<500;n++) {
+      sample(NIN,NOUT,x,y);
+      lwpr_predict(&pls,x,CUTOFF,yp,cp,NULL);
+      lwpr_predict(&fin,x,CUTOFF,yf,cf,NULL);
+      lwpr_predict(&eager,x,CUTOFF,ye,ce,NULL);
+      for (k=0;k<NOUT;k++) {
+         if (differs(yf[k],yp[k])) fail("Prediction after lwpr_finalize_slopes differs from PLS");
+         if (differs(ye[k],yp[k])) fail("Prediction with eager_slopes differs from PLS");
+         if (differs(cf[k],cp[k]) || differs(ce[k],cp[k])) fail("Confidence bound differs from PLS");
+      }
+   }
+   printf("diag_only=%d: %d, %d and %d RFs\n", diag_only, pls.sub[0].numRFS, 
+         pls.sub[1].numRFS, pls.sub[2].numRFS);
+   
+   lwpr_free_model(&pls);
+   lwpr_free_model(&fin);
+   lwpr_free_model(&eager);
+}
+
+int main() {
+   srand(1);
+   testModel(1);
+   testModel(0);
+   printf("OK\n");
+   return 0;
+}
@@ -0,0 +1,107 @@
+/*********************************************************************
+LWPR: A library for incremental online learning
+Copyright (C) 2007  Stefan Klanke, Sethu Vijayakumar
+Contact: sethu.vijayakumar@ed.ac.uk
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Library General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free
+Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*********************************************************************/
+#include <lwpr.h>
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include "test_util.h"
+
+#define NIN       2
+#define NOUT      2
+#define CUTOFF    0.001
+
+int compareDesc(const void *a, const void *b) {
+   double wa = *((const double *) a), wb = *((const double *) b);
+   return (wa < wb) ? 1 : (wa > wb) ? -1 : 0;
+}
+
+/* Fraction of the activation of the trustworthy RFs above the cutoff that does
+** not belong to the K strongest, computed directly from the receptive fields */
+double droppedFraction(const LWPR_Model *model, int dim, const double *x, int K) {
+   const LWPR_SubModel *sub = &model->sub[dim];
+   double *w, sum = 0.0, kept = 0.0;
+   int n,i,j,num = 0;
+
+   w = (double *) malloc((sub->numRFS+1)*sizeof(double));
+   if (w == NULL) fail("Out of memory");
+
+   for (n=0;n<sub->numRFS;n++) {
+      const LWPR_ReceptiveField *RF = sub->rf[n];
+      double xc[NIN], dist = 0.0;
+
+      if (!RF->trustworthy) continue;
+      for (i=0;i<NIN;i++) xc[i] = x[i]/model->norm_in[i] - RF->c[i];
+      for (i=0;i<NIN;i++) {
+         for (j=0;j<NIN;j++) {
+            dist += xc[i]*RF->D[(i<=j) ? LWPR_TRI(i,j) : LWPR_TRI(j,i)]*xc[j];
+         }
+      }
+      if (exp(-0.5*dist) > CUTOFF) w[num++] = exp(-0.5*dist);
+   }
+   qsort(w, num, sizeof(double), compareDesc);
+   for (i=0;i<num;i++) {
+      sum += w[i];
+      if (i<K) kept += w[i];
+   }
+   free(w);
+   return (sum > kept) ? (sum - kept)/sum : 0.0;
+}
+
+int main() {
+   LWPR_Model model;
+   double x[NIN],y[NOUT],yp[NOUT],yk[NOUT],wp[NOUT],wk[NOUT],dropped[NOUT];
+   int n,i,K,numDropped = 0;
+
+   srand(1);
+   lwpr_init_model(&model,NIN,NOUT,"topk");
+   lwpr_set_init_D_spherical(&model,20);
+   for (n=0;n<5000;n++) {
+      sample(NIN,NOUT,x,y);
+      lwpr_update(&model,x,y,NULL,NULL);
+   }
+   printf("%d and %d RFs\n", model.sub[0].numRFS, model.sub[1].numRFS);
+
+   for (n=0;n<200;n++) {
+      sample(NIN,NOUT,x,y);
+      lwpr_predict(&model,x,CUTOFF,yp,NULL,wp);
+
+      /* All active RFs are evaluated */
+      lwpr_predict_topk(&model,x,LWPR_MAX_TOPK,CUTOFF,yk,dropped,wk);
+      for (i=0;i<NOUT;i++) {
+         if (dropped[i] != 0.0) fail("Large K dropped receptive fields");
+         if (fabs(yk[i]-yp[i]) > 1e-12 || wk[i] != wp[i]) fail("Large K differs from lwpr_predict");
+      }
+
+      for (K=-1;K<=4;K++) {
+         lwpr_predict_topk(&model,x,K,CUTOFF,yk,dropped,wk);
+         for (i=0;i<NOUT;i++) {
+            double ref = droppedFraction(&model,i,x,K);
+            if (fabs(dropped[i]-ref) > 1e-12) fail("Wrong fraction of dropped activation");
+            if (K <= 0 && dropped[i] > 0.0 && yk[i] != 0.0) fail("Prediction without receptive fields is not zero");
+            if (wk[i] != wp[i]) fail("Maximum activation differs from lwpr_predict");
+            if (dropped[i] > 0.0) numDropped++;
+         }
+      }
+   }
+   if (numDropped == 0) fail("No receptive field was dropped");
+   lwpr_free_model(&model);
+   printf("OK\n");
+   return 0;
+}
@@ -0,0 +1,128 @@
+/*********************************************************************
+LWPR: A library for incremental online learning
+Copyright (C) 2007  Stefan Klanke, Sethu Vijayakumar
+Contact: sethu.vijayakumar@ed.ac.uk
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Library General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free
+Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*********************************************************************/
+#include <lwpr.h>
+#include <lwpr_aux.h>
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include "test_util.h"
+
+#define NIN       3
+#define NOUT      2
+
+/* Updates all receptive fields of the model in one pass, in the order of their indices,
+** as lwpr_update does with one thread. RFs are neither added nor pruned */
+void updateOnePass(LWPR_Model *model, const double *x, const double *y) {
+   LWPR_ThreadData TD;
+   int i;
+
+   lwpr_aux_update_model_stats(model,x);
+   for (i=0;i<NIN;i++) model->xn[i] = x[i]/model->norm_in[i];
+
+   TD.model = model;
+   TD.xn = model->xn;
+   TD.ws = &model->ws[0];
+   TD.start = 0;
+   TD.incr = 1;
+   TD.dw = NULL;
+   for (i=0;i<NOUT;i++) {
+      TD.dim = i;
+      TD.yn = y[i]/model->norm_out[i];
+      TD.end = model->sub[i].numRFS;
+      TD.grown = 0;
+      (void) lwpr_aux_update_one_T(&TD);
+   }
+}
+
+double maxDiff(const double *a, const double *b, int N) {
+   double err = 0.0;
+   int i;
+   for (i=0;i<N;i++) if (fabs(a[i]-b[i]) > err) err = fabs(a[i]-b[i]);
+   return err;
+}
+
+/* Trains a model, and then continues training a copy of it with lwpr_update, which
+** uses two-phase updates if the library is built with several threads, and the
+** original with single-pass updates. Both must end up with the same receptive fields */
+void testModel(int diag_only, int meta) {
+   LWPR_Model model, copy;
+   double x[NIN],y[NOUT];
+   double err = 0.0;
+   int n,k,i;
+
+   lwpr_init_model(&model,NIN,NOUT,"two_phase");
+   model.diag_only = diag_only;
+   model.meta = meta;
+   lwpr_set_init_D_spherical(&model,10);
+   for (n=0;n<2000;n++) {
+      sample(NIN,NOUT,x,y);
+      lwpr_update(&model,x,y,NULL,NULL);
+   }
+
+   /* No RFs are added or pruned from now on */
+   model.w_gen = 0.0;
+   model.w_prune = 2.0;
+   if (!lwpr_duplicate_model(&copy,&model)) fail("Could not duplicate model");
+
+   for (n=0;n<500;n++) {
+      sample(NIN,NOUT,x,y);
+      lwpr_update(&copy,x,y,NULL,NULL);
+      updateOnePass(&model,x,y);
+   }
+
+   for (k=0;k<NOUT;k++) {
+#if NUM_THREADS > 1
+      if (copy.sub[k].dw == NULL || copy.sub[k].order == NULL) fail("No buffers for two-phase updates");
+#endif
+      if (copy.sub[k].numRFS != model.sub[k].numRFS) fail("Number of RFs differs");
+      for (n=0;n<model.sub[k].numRFS;n++) {
+         const LWPR_ReceptiveField *RF = model.sub[k].rf[n];
+         const LWPR_ReceptiveField *RFc = copy.sub[k].rf[n];
+         double d;
+
+         if (RF->nReg != RFc->nReg || RF->trustworthy != RFc->trustworthy) fail("Projections differ");
+         d = maxDiff(RF->D, RFc->D, LWPR_TRI_SIZE(NIN));
+         if (d > err) err = d;
+         d = maxDiff(RF->mean_x, RFc->mean_x, NIN);
+         if (d > err) err = d;
+         d = maxDiff(RF->beta, RFc->beta, RF->nReg);
+         if (d > err) err = d;
+         for (i=0;i<RF->nReg;i++) {
+            d = fabs(RF->n_data[i] - RFc->n_data[i]);
+            if (d > err) err = d;
+         }
+         if (fabs(RF->beta0 - RFc->beta0) > err) err = fabs(RF->beta0 - RFc->beta0);
+      }
+   }
+   printf("diag_only=%d meta=%d: %d and %d RFs, largest difference %g\n", diag_only, meta,
+         model.sub[0].numRFS, model.sub[1].numRFS, err);
+   if (err > 1e-12) fail("Two-phase updates differ from single-pass updates");
+
+   lwpr_free_model(&copy);
+   lwpr_free_model(&model);
+}
+
+int main() {
+   srand(1);
+   testModel(1,0);
+   testModel(0,1);
+   printf("OK\n");
+   return 0;
+}
@@ -0,0 +1,43 @@
+/*********************************************************************
+LWPR: A library for incremental online learning
+Copyright (C) 2007  Stefan Klanke, Sethu Vijayakumar
+Contact: sethu.vijayakumar@ed.ac.uk
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Library General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free
+Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*********************************************************************/
+#include "test_util.h"
+#include <stdio.h>
+#include <math.h>
+
+void fail(const char *msg) {
+   fprintf(stderr,"%s\n",msg);
+   exit(1);
+}
+
+void target(int nIn, int nOut, const double *x, double *y) {
+   /* Further inputs contribute through the last one */
+   double xl = (nIn > 2) ? x[nIn-1] : 0.0;
+
+   if (nOut > 3) fail("target: at most 3 outputs");
+   y[0] = sin(3*x[0])*cos(2*x[1]) + 0.5*x[0]*xl;
+   if (nOut > 1) y[1] = x[0]*x[1] - 0.5*xl;
+   if (nOut > 2) y[2] = exp(-5.0*(x[0]*x[0]+x[1]*x[1]));
+}
+
+void sample(int nIn, int nOut, double *x, double *y) {
+   int i;
+   for (i=0;i<nIn;i++) x[i] = 2.0*URAND()-1.0;
+   target(nIn,nOut,x,y);
+}
@@ -0,0 +1,47 @@
+/*********************************************************************
+LWPR: A library for incremental online learning
+Copyright (C) 2007  Stefan Klanke, Sethu Vijayakumar
+Contact: sethu.vijayakumar@ed.ac.uk
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Library General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free
+Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*********************************************************************/
+
+/* Helpers shared by the tests in this directory, see test_util.c */
+
+#ifndef __LWPR_TEST_UTIL_H
+#define __LWPR_TEST_UTIL_H
+
+#include <stdlib.h>
+
+#define URAND()         (((double)rand())/ (double)RAND_MAX)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Prints msg to stderr and exits with status 1 */
+void fail(const char *msg);
+
+/* Evaluates smooth test functions of the inputs x (nIn >= 2) for nOut <= 3 outputs */
+void target(int nIn, int nOut, const double *x, double *y);
+
+/* Draws x uniformly from [-1,1]^nIn, and computes y = target(x) */
+void sample(int nIn, int nOut, double *x, double *y);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif